@@ -121,6 +121,30 @@ int dvbca_link_read(int fd, uint8_t *slot, uint8_t *connection_id,
 	return size - 2;
 }
 
+int dvbca_link_write_prefixed(int fd, uint8_t slot, uint8_t connection_id,
+			      uint8_t *buf, uint16_t data_length)
+{
+	buf[0] = slot;
+	buf[1] = connection_id;
+
+	if (write(fd, buf, data_length + DVBCA_LINK_HEADER_SIZE) < 0)
+		return -1;
+	return 0;
+}
+
+int dvbca_link_read_prefixed(int fd, uint8_t *slot, uint8_t *connection_id,
+			     uint8_t *buf, uint16_t buf_length)
+{
+	int size;
+
+	if ((size = read(fd, buf, buf_length)) < DVBCA_LINK_HEADER_SIZE)
+		return -1;
+
+	*slot = buf[0];
+	*connection_id = buf[1];
+	return size - DVBCA_LINK_HEADER_SIZE;
+}
+
 int dvbca_hlci_write(int fd, uint8_t *data, uint16_t data_length)
 {
 	struct ca_msg msg;
@@ -41,6 +41,11 @@ extern "C"
 #define DVBCA_CAMSTATE_INITIALISING 1
 #define DVBCA_CAMSTATE_READY 2
 
+/**
+ * Bytes of link header in front of each message on a link-layer interface.
+ */
+#define DVBCA_LINK_HEADER_SIZE 2
+
 
 /**
  * Open a CA device. Multiple CAMs can be accessed through a CA device.
@@ -104,6 +109,35 @@ extern int dvbca_link_write(int fd, uint8_t slot, uint8_t connection_id,
 extern int dvbca_link_read(int fd, uint8_t *slot, uint8_t *connection_id,
 			   uint8_t *data, uint16_t data_length);
 
+/**
+ * Write a message to a CAM using a link-layer interface, without copying it.
+ * The caller leaves DVBCA_LINK_HEADER_SIZE bytes in front of the data, which
+ * are filled in with the link header.
+ *
+ * @param fd File handle opened with dvbca_open.
+ * @param slot Slot where the requested CAM is in.
+ * @param connection_id Connection ID of the message.
+ * @param buf Buffer holding DVBCA_LINK_HEADER_SIZE spare bytes followed by the data.
+ * @param data_length Number of bytes of data to write.
+ * @return 0 on success, or -1 on failure.
+ */
+extern int dvbca_link_write_prefixed(int fd, uint8_t slot, uint8_t connection_id,
+				     uint8_t *buf, uint16_t data_length);
+
+/**
+ * Read a message from a CAM using a link-layer interface, without copying it.
+ * The data is left after DVBCA_LINK_HEADER_SIZE bytes of link header.
+ *
+ * @param fd File handle opened with dvbca_open.
+ * @param slot Slot where the responding CAM is in.
+ * @param connection_id Destination for the connection ID the message came from.
+ * @param buf Buffer to read the link header and data into.
+ * @param buf_length Size of buf, including the link header.
+ * @return Number of bytes of data read on success, or -1 on failure.
+ */
+extern int dvbca_link_read_prefixed(int fd, uint8_t *slot, uint8_t *connection_id,
+				    uint8_t *buf, uint16_t buf_length);
+
 // FIXME how do we determine which CAM slot of a CA is meant?
 /**
  * Write a message to a CAM using an HLCI interface.
@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <linux/dvb/dmx.h>
 #include "dvbdemux.h"
+#include "dvbdemux_file.h"
 
 
 int dvbdemux_open_demux(int adapter, int demuxdevice, int nonblocking)
@@ -37,6 +38,9 @@ int dvbdemux_open_demux(int adapter, int demuxdevice, int nonblocking)
 	int flags = O_RDWR;
 	int fd;
 
+	if (dvbdemux_file_active)
+		return dvbdemux_file_open_demux(nonblocking);
+
 	if (nonblocking)
 		flags |= O_NONBLOCK;
 
@@ -56,6 +60,9 @@ int dvbdemux_open_dvr(int adapter, int dvrdevice, int readonly, int nonblocking)
 	int flags = O_RDWR;
 	int fd;
 
+	if (dvbdemux_file_active)
+		return dvbdemux_file_open_dvr(nonblocking);
+
 	if (readonly)
 		flags = O_RDONLY;
 	if (nonblocking)
@@ -77,6 +84,9 @@ int dvbdemux_set_section_filter(int fd, int pid,
 {
 	struct dmx_sct_filter_params sctfilter;
 
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_set_section_filter(fd, pid, filter, mask, start, checkcrc);
+
 	memset(&sctfilter, 0, sizeof(sctfilter));
 	sctfilter.pid = pid;
 	memcpy(sctfilter.filter.filter, filter, 1);
@@ -99,6 +109,9 @@ int dvbdemux_set_pes_filter(int fd, int pid,
 {
 	struct dmx_pes_filter_params filter;
 
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_set_pid_filter(fd, pid, output, start);
+
 	memset(&filter, 0, sizeof(filter));
 	filter.pid = pid;
 
@@ -175,6 +188,9 @@ int dvbdemux_set_pid_filter(int fd, int pid,
 {
 	struct dmx_pes_filter_params filter;
 
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_set_pid_filter(fd, pid, output, start);
+
 	memset(&filter, 0, sizeof(filter));
 	if (pid == -1)
 		filter.pid = 0x2000;
@@ -227,11 +243,17 @@ int dvbdemux_set_pid_filter(int fd, int pid,
 
 int dvbdemux_start(int fd)
 {
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_start(fd);
+
 	return ioctl(fd, DMX_START);
 }
 
 int dvbdemux_stop(int fd)
 {
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_stop(fd);
+
 	return ioctl(fd, DMX_STOP);
 }
 
@@ -240,6 +262,9 @@ int dvbdemux_get_stc(int fd, uint64_t *stc)
 	struct dmx_stc _stc;
 	int result;
 
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_get_stc(fd, stc);
+
 	memset(stc, 0, sizeof(_stc));
 	if ((result = ioctl(fd, DMX_GET_STC, &_stc)) != 0) {
 		return result;
@@ -251,5 +276,8 @@ int dvbdemux_get_stc(int fd, uint64_t *stc)
 
 int dvbdemux_set_buffer(int fd, int bufsize)
 {
+	if (dvbdemux_file_owns(fd))
+		return dvbdemux_file_set_buffer(fd, bufsize);
+
 	return ioctl(fd, DMX_SET_BUFFER_SIZE, bufsize);
 }
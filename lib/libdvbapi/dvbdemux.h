@@ -66,6 +66,39 @@ extern "C"
 #define DVBDEMUX_PESTYPE_SUBTITLE 3
 #define DVBDEMUX_PESTYPE_PCR 4
 
+/**
+ * Flags for dvbdemux_set_file_input().
+ *
+ * REALTIME. Deliver the data at the rate given by the PCRs in the file, as a
+ * live frontend would. Otherwise the file is read as fast as the DVR device is
+ * read (or as fast as possible if no DVR output is in use), pausing briefly
+ * after each section so that its reader can set up more filters in response.
+ *
+ * LOOP. Start again from the beginning at the end of the file.
+ */
+#define DVBDEMUX_FILE_REALTIME 1
+#define DVBDEMUX_FILE_LOOP 2
+
+
+/**
+ * Use a recorded transport stream file instead of the demux hardware. From
+ * then on, dvbdemux_open_demux() and dvbdemux_open_dvr() return descriptors of
+ * a software demux reading the file, whichever adapter is asked for, and all
+ * the other functions here work on them as they would on the real devices:
+ * section filters return one section per read(), and the DVR returns the
+ * packets of the PID filters with DVBDEMUX_OUTPUT_DVR. DVBDEMUX_OUTPUT_DECODER
+ * filters are accepted but output nothing.
+ *
+ * Reading starts when the first filter is started. As with the hardware,
+ * demux descriptors which are not read quickly enough lose data. At the end of
+ * the file, the DVR returns EOF and the demux descriptors receive no more
+ * data.
+ *
+ * @param filename Name of the file, containing 188 byte transport packets.
+ * @param flags Orred DVBDEMUX_FILE_* flags.
+ * @return 0 on success, nonzero on failure.
+ */
+extern int dvbdemux_set_file_input(const char *filename, int flags);
 
 /**
  * Open a demux device. Can be called multiple times. These let you setup a
@@ -0,0 +1,855 @@
+/*
+ * libdvbdemux - a DVB demux library
+ *
+ * Software demux reading a recorded transport stream file.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#include "dvbdemux.h"
+#include "dvbdemux_file.h"
+
+#define TS_PACKET_SIZE		188
+#define TS_SYNC_BYTE		0x47
+#define TS_PACKETS_PER_READ	348
+#define CHUNK_SIZE		(TS_PACKET_SIZE * TS_PACKETS_PER_READ)
+#define MAX_PIDS		8192
+#define PID_ALL			0x2000
+#define MAX_SECTION_SIZE	4096
+
+#define PCR_HZ			27000000ULL
+#define PCR_WRAP		(0x200000000ULL * 300)
+#define PCR_MAX_GAP		(PCR_HZ * 10)
+
+#define SETTLE_POLL_NS		250000
+#define SETTLE_MAX_POLLS	80
+
+#define FILTER_NONE		0
+#define FILTER_SECTION		1
+#define FILTER_PID		2
+
+struct dvbdemux_file_filter {
+	struct dvbdemux_file_filter *next;
+	int fd;			/* the application's end of the socket pair */
+	int peer;		/* our end */
+	ino_t ino;		/* to spot the fd being closed and reused */
+	int type;
+	int pid;
+	int output;
+	int running;
+	int checkcrc;
+	uint8_t filter[18];
+	uint8_t mask[18];
+	uint8_t *tap;		/* data waiting to be sent for tap outputs */
+	int tap_count;
+};
+
+struct dvbdemux_file_pid {
+	int users;		/* running filters of any kind */
+	int sections;		/* running section filters */
+	int dvr;		/* running pid filters with DVR output */
+	uint8_t cc;
+	uint8_t have_cc:1;
+	uint8_t wait_pusi:1;
+	int section_count;
+	int section_len;
+	uint8_t section[MAX_SECTION_SIZE];
+};
+
+volatile int dvbdemux_file_active;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t dvr_lock = PTHREAD_MUTEX_INITIALIZER;
+static int file_fd = -1;
+static int file_flags;
+static int pump_started;
+static int file_eof;
+
+static struct dvbdemux_file_filter *filters;
+static struct dvbdemux_file_pid *pids[MAX_PIDS];
+static int all_users;
+static int all_dvr;
+
+static int dvr_fd = -1;
+static int dvr_peer = -1;
+static ino_t dvr_ino;
+static uint8_t dvr_buf[CHUNK_SIZE];
+static int dvr_count;
+
+static int pcr_pid = -1;
+static uint64_t stc;
+static int stc_valid;
+static uint64_t pace_pcr;
+static double pace_time;
+static int pace_valid;
+static int section_sent;
+
+static uint32_t crc_table[256];
+
+static struct dvbdemux_file_filter *dvbdemux_file_find(int fd);
+static struct dvbdemux_file_pid *dvbdemux_file_get_pid(int pid);
+static void dvbdemux_file_account(struct dvbdemux_file_filter *f, int delta);
+static void dvbdemux_file_kill(struct dvbdemux_file_filter *f);
+static void *dvbdemux_file_pump(void *arg);
+
+
+int dvbdemux_set_file_input(const char *filename, int flags)
+{
+	uint32_t i, j, c;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return -1;
+
+	pthread_mutex_lock(&lock);
+	if (dvbdemux_file_active) {
+		pthread_mutex_unlock(&lock);
+		close(fd);
+		errno = EBUSY;
+		return -1;
+	}
+
+	for (i = 0; i < 256; i++) {
+		c = i << 24;
+		for (j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		crc_table[i] = c;
+	}
+
+	file_fd = fd;
+	file_flags = flags;
+	dvbdemux_file_active = 1;
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+int dvbdemux_file_owns(int fd)
+{
+	int owned;
+
+	if (!dvbdemux_file_active)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+	owned = dvbdemux_file_find(fd) != NULL;
+	pthread_mutex_unlock(&lock);
+	if (owned)
+		return 1;
+
+	pthread_mutex_lock(&dvr_lock);
+	owned = (fd == dvr_fd) && (dvr_peer >= 0);
+	pthread_mutex_unlock(&dvr_lock);
+	return owned;
+}
+
+int dvbdemux_file_open_demux(int nonblocking)
+{
+	struct dvbdemux_file_filter *f, **pf;
+	struct stat st;
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+		return -1;
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+	if (nonblocking)
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fstat(sv[0], &st);
+
+	pthread_mutex_lock(&lock);
+
+	// forget any filter whose fd was closed and has now been reused
+	for (pf = &filters; (f = *pf) != NULL; ) {
+		if (f->fd == sv[0]) {
+			dvbdemux_file_kill(f);
+			*pf = f->next;
+			free(f->tap);
+			free(f);
+		} else {
+			pf = &f->next;
+		}
+	}
+
+	f = (struct dvbdemux_file_filter *) malloc(sizeof(struct dvbdemux_file_filter));
+	if (f == NULL) {
+		pthread_mutex_unlock(&lock);
+		close(sv[0]);
+		close(sv[1]);
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(f, 0, sizeof(struct dvbdemux_file_filter));
+	f->fd = sv[0];
+	f->peer = sv[1];
+	f->ino = st.st_ino;
+	f->next = filters;
+	filters = f;
+
+	pthread_mutex_unlock(&lock);
+	return sv[0];
+}
+
+int dvbdemux_file_open_dvr(int nonblocking)
+{
+	struct stat st;
+	int sv[2];
+
+	pthread_mutex_lock(&dvr_lock);
+
+	// only one reader, unless the previous one has gone away
+	if (dvr_peer >= 0) {
+		if ((fstat(dvr_fd, &st) == 0) && (st.st_ino == dvr_ino)) {
+			pthread_mutex_unlock(&dvr_lock);
+			errno = EBUSY;
+			return -1;
+		}
+		close(dvr_peer);
+		dvr_peer = -1;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		pthread_mutex_unlock(&dvr_lock);
+		return -1;
+	}
+	if (nonblocking)
+		fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fstat(sv[0], &st);
+	dvr_fd = sv[0];
+	dvr_peer = sv[1];
+	dvr_ino = st.st_ino;
+	if (file_eof) {
+		close(dvr_peer);
+		dvr_peer = -1;
+	}
+
+	pthread_mutex_unlock(&dvr_lock);
+	return sv[0];
+}
+
+int dvbdemux_file_set_section_filter(int fd, int pid,
+				     uint8_t filter[18], uint8_t mask[18],
+				     int start, int checkcrc)
+{
+	struct dvbdemux_file_filter *f;
+
+	if ((pid < 0) || (pid >= MAX_PIDS)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (((f = dvbdemux_file_find(fd)) == NULL) || (dvbdemux_file_get_pid(pid) == NULL)) {
+		pthread_mutex_unlock(&lock);
+		errno = EINVAL;
+		return -1;
+	}
+	if (f->running)
+		dvbdemux_file_account(f, -1);
+
+	f->type = FILTER_SECTION;
+	f->pid = pid;
+	f->checkcrc = checkcrc;
+	memcpy(f->filter, filter, 18);
+	memcpy(f->mask, mask, 18);
+	pthread_mutex_unlock(&lock);
+
+	if (start)
+		return dvbdemux_file_start(fd);
+	return 0;
+}
+
+int dvbdemux_file_set_pid_filter(int fd, int pid, int output, int start)
+{
+	struct dvbdemux_file_filter *f;
+
+	if (pid == -1)
+		pid = PID_ALL;
+	if ((pid < 0) || (pid > PID_ALL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&lock);
+	if (((f = dvbdemux_file_find(fd)) == NULL) ||
+	    ((pid != PID_ALL) && (dvbdemux_file_get_pid(pid) == NULL))) {
+		pthread_mutex_unlock(&lock);
+		errno = EINVAL;
+		return -1;
+	}
+	if (f->running)
+		dvbdemux_file_account(f, -1);
+
+	if ((output == DVBDEMUX_OUTPUT_DEMUX) || (output == DVBDEMUX_OUTPUT_TS_DEMUX)) {
+		if ((f->tap == NULL) && ((f->tap = malloc(CHUNK_SIZE)) == NULL)) {
+			pthread_mutex_unlock(&lock);
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	f->type = FILTER_PID;
+	f->pid = pid;
+	f->output = output;
+	pthread_mutex_unlock(&lock);
+
+	if (start)
+		return dvbdemux_file_start(fd);
+	return 0;
+}
+
+int dvbdemux_file_start(int fd)
+{
+	struct dvbdemux_file_filter *f;
+	pthread_t thread;
+	int ret;
+
+	pthread_mutex_lock(&lock);
+	if (((f = dvbdemux_file_find(fd)) == NULL) || (f->type == FILTER_NONE)) {
+		pthread_mutex_unlock(&lock);
+		errno = EINVAL;
+		return -1;
+	}
+	if (!f->running)
+		dvbdemux_file_account(f, 1);
+
+	// nothing is read from the file until the first filter is started
+	if (!pump_started) {
+		if ((ret = pthread_create(&thread, NULL, dvbdemux_file_pump, NULL)) != 0) {
+			dvbdemux_file_account(f, -1);
+			pthread_mutex_unlock(&lock);
+			errno = ret;
+			return -1;
+		}
+		pthread_detach(thread);
+		pump_started = 1;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+int dvbdemux_file_stop(int fd)
+{
+	struct dvbdemux_file_filter *f;
+
+	pthread_mutex_lock(&lock);
+	if ((f = dvbdemux_file_find(fd)) != NULL) {
+		if (f->running)
+			dvbdemux_file_account(f, -1);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+int dvbdemux_file_get_stc(int fd, uint64_t *stc_out)
+{
+	(void) fd;
+
+	pthread_mutex_lock(&lock);
+	if (!stc_valid) {
+		pthread_mutex_unlock(&lock);
+		errno = EAGAIN;
+		return -1;
+	}
+	*stc_out = stc / 300;
+	pthread_mutex_unlock(&lock);
+
+	return 0;
+}
+
+int dvbdemux_file_set_buffer(int fd, int bufsize)
+{
+	struct dvbdemux_file_filter *f;
+	int peer = -1;
+
+	pthread_mutex_lock(&lock);
+	if ((f = dvbdemux_file_find(fd)) != NULL)
+		peer = f->peer;
+	pthread_mutex_unlock(&lock);
+
+	if (peer < 0) {
+		pthread_mutex_lock(&dvr_lock);
+		if (fd == dvr_fd)
+			peer = dvr_peer;
+		pthread_mutex_unlock(&dvr_lock);
+	}
+	if (peer < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	setsockopt(peer, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	return 0;
+}
+
+static struct dvbdemux_file_filter *dvbdemux_file_find(int fd)
+{
+	struct dvbdemux_file_filter *f;
+	struct stat st;
+
+	for (f = filters; f; f = f->next) {
+		if (f->fd != fd)
+			continue;
+		if ((f->peer < 0) || fstat(fd, &st) || (st.st_ino != f->ino))
+			return NULL;
+		return f;
+	}
+
+	return NULL;
+}
+
+static struct dvbdemux_file_pid *dvbdemux_file_get_pid(int pid)
+{
+	if (pids[pid] == NULL) {
+		pids[pid] = (struct dvbdemux_file_pid *) malloc(sizeof(struct dvbdemux_file_pid));
+		if (pids[pid] == NULL)
+			return NULL;
+		memset(pids[pid], 0, sizeof(struct dvbdemux_file_pid));
+	}
+
+	return pids[pid];
+}
+
+static void dvbdemux_file_account(struct dvbdemux_file_filter *f, int delta)
+{
+	int dvr = (f->type == FILTER_PID) && (f->output == DVBDEMUX_OUTPUT_DVR);
+	struct dvbdemux_file_pid *p;
+
+	f->running = delta > 0;
+	f->tap_count = 0;
+
+	if (f->pid == PID_ALL) {
+		all_users += delta;
+		all_dvr += dvr ? delta : 0;
+		return;
+	}
+
+	p = pids[f->pid];
+	p->users += delta;
+	p->dvr += dvr ? delta : 0;
+	if (f->type == FILTER_SECTION) {
+		// a newly started section filter must not see a stale partial section
+		if (p->sections == 0) {
+			p->have_cc = 0;
+			p->wait_pusi = 1;
+			p->section_count = 0;
+		}
+		p->sections += delta;
+	}
+}
+
+/*
+ * The application has closed its end: stop the filter and release our end.
+ */
+static void dvbdemux_file_kill(struct dvbdemux_file_filter *f)
+{
+	if (f->running)
+		dvbdemux_file_account(f, -1);
+	if (f->peer >= 0)
+		close(f->peer);
+	f->peer = -1;
+	f->type = FILTER_NONE;
+}
+
+static void dvbdemux_file_send(struct dvbdemux_file_filter *f, uint8_t *data, int len)
+{
+	// like the kernel demux, data is dropped if the reader is not keeping up
+	if ((send(f->peer, data, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) &&
+	    ((errno == EPIPE) || (errno == ECONNRESET)))
+		dvbdemux_file_kill(f);
+}
+
+static uint32_t dvbdemux_file_crc32(uint8_t *data, int len)
+{
+	uint32_t crc = 0xffffffff;
+
+	while (len--)
+		crc = (crc << 8) ^ crc_table[((crc >> 24) ^ *data++) & 0xff];
+
+	return crc;
+}
+
+static void dvbdemux_file_deliver(struct dvbdemux_file_pid *p, int pid)
+{
+	struct dvbdemux_file_filter *f;
+	uint8_t *s = p->section;
+	int len = p->section_len;
+	int crc_ok = -1;
+	int i;
+
+	for (f = filters; f; f = f->next) {
+		if (!f->running || (f->type != FILTER_SECTION) || (f->pid != pid))
+			continue;
+
+		// bytes 1 and 2 hold the length and are not filtered
+		for (i = 0; i < 18 && i < len; i++) {
+			if ((i != 1) && (i != 2) && ((s[i] ^ f->filter[i]) & f->mask[i]))
+				break;
+		}
+		if ((i < 18) && (i < len))
+			continue;
+
+		if (f->checkcrc && (s[1] & 0x80)) {
+			if (crc_ok < 0)
+				crc_ok = dvbdemux_file_crc32(s, len) == 0;
+			if (!crc_ok)
+				continue;
+		}
+
+		dvbdemux_file_send(f, s, len);
+		section_sent = 1;
+	}
+}
+
+static void dvbdemux_file_section_data(struct dvbdemux_file_pid *p, int pid,
+				       uint8_t *data, int len)
+{
+	while (len > 0) {
+		int n;
+
+		if (p->section_count < 3) {
+			// stuffing after the last section in the packet
+			if ((p->section_count == 0) && (data[0] == 0xff)) {
+				p->wait_pusi = 1;
+				return;
+			}
+			p->section[p->section_count++] = *data++;
+			len--;
+			if (p->section_count == 3) {
+				p->section_len = 3 + (((p->section[1] & 0x0f) << 8) | p->section[2]);
+				if (p->section_len > MAX_SECTION_SIZE) {
+					p->section_count = 0;
+					p->wait_pusi = 1;
+					return;
+				}
+			}
+			continue;
+		}
+
+		n = p->section_len - p->section_count;
+		if (n > len)
+			n = len;
+		memcpy(p->section + p->section_count, data, n);
+		p->section_count += n;
+		data += n;
+		len -= n;
+
+		if (p->section_count == p->section_len) {
+			dvbdemux_file_deliver(p, pid);
+			p->section_count = 0;
+		}
+	}
+}
+
+static void dvbdemux_file_section_packet(struct dvbdemux_file_pid *p, int pid,
+					 uint8_t *pkt, uint8_t *data, int len)
+{
+	int cc = pkt[3] & 0x0f;
+
+	if (p->have_cc) {
+		if (cc == p->cc)
+			return;
+		if (cc != ((p->cc + 1) & 0x0f)) {
+			p->section_count = 0;
+			p->wait_pusi = 1;
+		}
+	}
+	p->cc = cc;
+	p->have_cc = 1;
+
+	if (pkt[1] & 0x40) {
+		int pointer = data[0];
+
+		data++;
+		len--;
+		if (pointer > len) {
+			p->section_count = 0;
+			p->wait_pusi = 1;
+			return;
+		}
+		if (!p->wait_pusi && p->section_count)
+			dvbdemux_file_section_data(p, pid, data, pointer);
+		p->section_count = 0;
+		p->wait_pusi = 0;
+		dvbdemux_file_section_data(p, pid, data + pointer, len - pointer);
+	} else if (!p->wait_pusi && p->section_count) {
+		dvbdemux_file_section_data(p, pid, data, len);
+	}
+}
+
+static double dvbdemux_file_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*
+ * Process one packet with the lock held. Returns the time to wait until
+ * before carrying on in real time mode, or 0.
+ */
+static double dvbdemux_file_packet(uint8_t *pkt)
+{
+	int pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+	struct dvbdemux_file_pid *p = pids[pid];
+	struct dvbdemux_file_filter *f;
+	int afc = (pkt[3] >> 4) & 3;
+	int offset = 4;
+	double wait = 0;
+
+	// PCRs drive the STC, and the pacing in real time mode
+	if ((afc & 2) && (pkt[4] >= 7) && (pkt[5] & 0x10)) {
+		uint64_t pcr = (((uint64_t) pkt[6] << 25) | (pkt[7] << 17) | (pkt[8] << 9) |
+				(pkt[9] << 1) | (pkt[10] >> 7)) * 300 +
+			       (((pkt[10] & 1) << 8) | pkt[11]);
+
+		if (pcr_pid < 0)
+			pcr_pid = pid;
+		if (pid == pcr_pid) {
+			stc = pcr;
+			stc_valid = 1;
+			if (file_flags & DVBDEMUX_FILE_REALTIME) {
+				uint64_t delta = (pcr + PCR_WRAP - pace_pcr) % PCR_WRAP;
+
+				if (!pace_valid || (delta > PCR_MAX_GAP)) {
+					pace_pcr = pcr;
+					pace_time = dvbdemux_file_now();
+					pace_valid = 1;
+				} else {
+					wait = pace_time + (double) delta / PCR_HZ;
+				}
+			}
+		}
+	}
+
+	if (((p == NULL) || (p->users == 0)) && (all_users == 0))
+		return wait;
+
+	if (all_dvr || (p && p->dvr)) {
+		memcpy(dvr_buf + dvr_count, pkt, TS_PACKET_SIZE);
+		dvr_count += TS_PACKET_SIZE;
+	}
+
+	// payload, if any and if not damaged
+	if (pkt[1] & 0x80)
+		return wait;
+	if (afc & 2)
+		offset += 1 + pkt[4];
+	if (!(afc & 1) || (offset >= TS_PACKET_SIZE))
+		return wait;
+
+	for (f = filters; f; f = f->next) {
+		if (!f->running || (f->type != FILTER_PID) ||
+		    ((f->output != DVBDEMUX_OUTPUT_DEMUX) && (f->output != DVBDEMUX_OUTPUT_TS_DEMUX)))
+			continue;
+		if ((f->pid != pid) && (f->pid != PID_ALL))
+			continue;
+		if (f->output == DVBDEMUX_OUTPUT_TS_DEMUX) {
+			memcpy(f->tap + f->tap_count, pkt, TS_PACKET_SIZE);
+			f->tap_count += TS_PACKET_SIZE;
+		} else {
+			memcpy(f->tap + f->tap_count, pkt + offset, TS_PACKET_SIZE - offset);
+			f->tap_count += TS_PACKET_SIZE - offset;
+		}
+	}
+
+	if (p && p->sections)
+		dvbdemux_file_section_packet(p, pid, pkt, pkt + offset, TS_PACKET_SIZE - offset);
+
+	return wait;
+}
+
+static void dvbdemux_file_flush_taps(void)
+{
+	struct dvbdemux_file_filter *f;
+
+	for (f = filters; f; f = f->next) {
+		if (f->running && f->tap_count)
+			dvbdemux_file_send(f, f->tap, f->tap_count);
+		f->tap_count = 0;
+	}
+}
+
+static void dvbdemux_file_flush_dvr(void)
+{
+	int pos = 0;
+
+	// the DVR is flow controlled: the file is not read faster than it is
+	pthread_mutex_lock(&dvr_lock);
+	while ((dvr_peer >= 0) && (pos < dvr_count)) {
+		ssize_t sz = send(dvr_peer, dvr_buf + pos, dvr_count - pos, MSG_NOSIGNAL);
+
+		if (sz < 0) {
+			if (errno == EINTR)
+				continue;
+			close(dvr_peer);
+			dvr_peer = -1;
+			break;
+		}
+		pos += sz;
+	}
+	pthread_mutex_unlock(&dvr_lock);
+
+	dvr_count = 0;
+}
+
+/*
+ * Without real time pacing, the file would be finished before an application
+ * could react to a PAT or PMT by setting more filters. So wait (briefly) for
+ * section readers to drain their sockets, and then a little longer.
+ */
+static void dvbdemux_file_settle(void)
+{
+	struct timespec ts = { 0, SETTLE_POLL_NS };
+	int polls;
+
+	for (polls = 0; polls < SETTLE_MAX_POLLS; polls++) {
+		struct dvbdemux_file_filter *f;
+		int queued = 0;
+
+		pthread_mutex_lock(&lock);
+		for (f = filters; f && !queued; f = f->next) {
+			int outq;
+
+			if (f->running && (f->type == FILTER_SECTION) &&
+			    !ioctl(f->peer, SIOCOUTQ, &outq) && (outq > 0))
+				queued = 1;
+		}
+		pthread_mutex_unlock(&lock);
+		nanosleep(&ts, NULL);
+		if (!queued)
+			break;
+	}
+}
+
+static void dvbdemux_file_process(uint8_t *buf, int len)
+{
+	int pos = 0;
+
+	while (pos < len) {
+		double wait = 0;
+		int settle;
+
+		pthread_mutex_lock(&lock);
+		section_sent = 0;
+		while ((pos < len) && (wait == 0) && !section_sent) {
+			wait = dvbdemux_file_packet(buf + pos);
+			pos += TS_PACKET_SIZE;
+		}
+		dvbdemux_file_flush_taps();
+		settle = section_sent && !(file_flags & DVBDEMUX_FILE_REALTIME);
+		pthread_mutex_unlock(&lock);
+		dvbdemux_file_flush_dvr();
+
+		if (settle)
+			dvbdemux_file_settle();
+
+		if (wait > 0) {
+			struct timespec ts;
+
+			ts.tv_sec = (time_t) wait;
+			ts.tv_nsec = (long) ((wait - ts.tv_sec) * 1e9);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+		}
+	}
+}
+
+static void dvbdemux_file_rewind(void)
+{
+	int pid;
+
+	pthread_mutex_lock(&lock);
+	for (pid = 0; pid < MAX_PIDS; pid++) {
+		if (pids[pid]) {
+			pids[pid]->have_cc = 0;
+			pids[pid]->wait_pusi = 1;
+			pids[pid]->section_count = 0;
+		}
+	}
+	pace_valid = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+static void *dvbdemux_file_pump(void *arg)
+{
+	uint8_t *buf = (uint8_t *) malloc(CHUNK_SIZE);
+	uint64_t pass_bytes = 0;
+	int have = 0;
+	(void) arg;
+
+	while (buf) {
+		ssize_t r;
+		int pos, end;
+
+		if ((r = read(file_fd, buf + have, CHUNK_SIZE - have)) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (r == 0) {
+			if (!(file_flags & DVBDEMUX_FILE_LOOP) || (pass_bytes == 0) ||
+			    (lseek(file_fd, 0, SEEK_SET) != 0))
+				break;
+			dvbdemux_file_rewind();
+			pass_bytes = 0;
+			have = 0;
+			continue;
+		}
+		pass_bytes += r;
+		have += r;
+
+		// process runs of packets with good sync bytes, skipping anything else
+		pos = 0;
+		while (have - pos >= TS_PACKET_SIZE) {
+			if (buf[pos] != TS_SYNC_BYTE) {
+				uint8_t *next = memchr(buf + pos + 1, TS_SYNC_BYTE, have - pos - 1);
+
+				pos = next ? next - buf : have;
+				continue;
+			}
+			end = pos;
+			while ((have - end >= TS_PACKET_SIZE) && (buf[end] == TS_SYNC_BYTE))
+				end += TS_PACKET_SIZE;
+			dvbdemux_file_process(buf + pos, end - pos);
+			pos = end;
+		}
+		memmove(buf, buf + pos, have - pos);
+		have -= pos;
+	}
+
+	// end of file: readers of the DVR see EOF, the demux fds go quiet
+	pthread_mutex_lock(&dvr_lock);
+	if (dvr_peer >= 0)
+		close(dvr_peer);
+	dvr_peer = -1;
+	file_eof = 1;
+	pthread_mutex_unlock(&dvr_lock);
+
+	free(buf);
+	return NULL;
+}
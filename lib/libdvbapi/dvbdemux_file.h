@@ -0,0 +1,43 @@
+/*
+ * libdvbdemux - a DVB demux library
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef LIBDVBDEMUX_FILE_H
+#define LIBDVBDEMUX_FILE_H 1
+
+/*
+ * Internal interface between dvbdemux.c and the software demux which reads a
+ * transport stream file. Not installed.
+ */
+
+#include <stdint.h>
+
+extern volatile int dvbdemux_file_active;
+
+extern int dvbdemux_file_owns(int fd);
+extern int dvbdemux_file_open_demux(int nonblocking);
+extern int dvbdemux_file_open_dvr(int nonblocking);
+extern int dvbdemux_file_set_section_filter(int fd, int pid,
+					    uint8_t filter[18], uint8_t mask[18],
+					    int start, int checkcrc);
+extern int dvbdemux_file_set_pid_filter(int fd, int pid, int output, int start);
+extern int dvbdemux_file_start(int fd);
+extern int dvbdemux_file_stop(int fd);
+extern int dvbdemux_file_get_stc(int fd, uint64_t *stc);
+extern int dvbdemux_file_set_buffer(int fd, int bufsize);
+
+#endif
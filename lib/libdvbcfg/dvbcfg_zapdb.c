@@ -0,0 +1,323 @@
+/*
+ * dvbcfg - support for linuxtv configuration files
+ * compiled zap channel database
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dvbcfg_zapdb.h"
+
+#define DVBCFG_ZAPDB_MAGIC "DVBZAPDB"
+#define DVBCFG_ZAPDB_VERSION 1
+
+/*
+ * File layout:
+ *   struct dvbcfg_zapdb_header
+ *   struct dvbcfg_zapchannel channels[count]
+ *   uint32_t name_head[buckets]		first channel in each bucket, + 1; 0 if none
+ *   uint32_t name_next[count]		next channel in the same bucket, + 1
+ *   uint32_t service_head[buckets]
+ *   uint32_t service_next[count]
+ *
+ * Each chain is in channel file order.
+ */
+struct dvbcfg_zapdb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;		/* sizeof(struct dvbcfg_zapchannel) */
+	uint32_t count;
+	uint32_t buckets;		/* a power of 2 */
+	uint64_t size;			/* of the whole file */
+};
+
+struct dvbcfg_zapdb {
+	void *map;
+	size_t size;
+	uint32_t count;
+	uint32_t mask;
+	const struct dvbcfg_zapchannel *channels;
+	const uint32_t *name_head;
+	const uint32_t *name_next;
+	const uint32_t *service_head;
+	const uint32_t *service_next;
+};
+
+struct dvbcfg_zapdb_load {
+	struct dvbcfg_zapchannel *channels;
+	uint32_t count;
+	uint32_t alloc;
+	int error;
+};
+
+static uint32_t dvbcfg_zapdb_hash_name(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t) *name++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static uint32_t dvbcfg_zapdb_hash_service(int service_id)
+{
+	uint32_t hash = service_id;
+
+	hash ^= hash >> 16;
+	hash *= 0x45d9f3bU;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+static uint64_t dvbcfg_zapdb_size(uint32_t count, uint32_t buckets)
+{
+	return sizeof(struct dvbcfg_zapdb_header) +
+		((uint64_t) count * sizeof(struct dvbcfg_zapchannel)) +
+		(2 * ((uint64_t) buckets + count) * sizeof(uint32_t));
+}
+
+static void dvbcfg_zapdb_layout(struct dvbcfg_zapdb *db, uint8_t *base, uint32_t count, uint32_t buckets)
+{
+	uint8_t *pos = base + sizeof(struct dvbcfg_zapdb_header);
+
+	db->count = count;
+	db->mask = buckets - 1;
+	db->channels = (const struct dvbcfg_zapchannel *) pos;
+	pos += count * sizeof(struct dvbcfg_zapchannel);
+	db->name_head = (const uint32_t *) pos;
+	pos += buckets * sizeof(uint32_t);
+	db->name_next = (const uint32_t *) pos;
+	pos += count * sizeof(uint32_t);
+	db->service_head = (const uint32_t *) pos;
+	pos += buckets * sizeof(uint32_t);
+	db->service_next = (const uint32_t *) pos;
+}
+
+static int dvbcfg_zapdb_load_callback(struct dvbcfg_zapchannel *channel, void *private_data)
+{
+	struct dvbcfg_zapdb_load *load = private_data;
+	struct dvbcfg_zapchannel *tmp;
+
+	if (load->count == load->alloc) {
+		load->alloc = load->alloc ? (2 * load->alloc) : 256;
+		tmp = realloc(load->channels, load->alloc * sizeof(struct dvbcfg_zapchannel));
+		if (tmp == NULL) {
+			load->error = -ENOMEM;
+			return 1;
+		}
+		load->channels = tmp;
+	}
+	memcpy(&load->channels[load->count++], channel, sizeof(struct dvbcfg_zapchannel));
+
+	return 0;
+}
+
+int dvbcfg_zapdb_compile(FILE *file, const char *dbfile)
+{
+	struct dvbcfg_zapdb_load load;
+	struct dvbcfg_zapdb_header *header;
+	struct dvbcfg_zapdb db;
+	uint32_t *name_head, *name_next, *service_head, *service_next;
+	uint32_t buckets = 16;
+	uint64_t size;
+	uint8_t *buf;
+	char tmpname[PATH_MAX];
+	int fd;
+	int ret;
+	int i;
+
+	memset(&load, 0, sizeof(load));
+	dvbcfg_zapchannel_parse(file, dvbcfg_zapdb_load_callback, &load);
+	if (load.error) {
+		free(load.channels);
+		return load.error;
+	}
+
+	while (buckets < 2 * load.count)
+		buckets *= 2;
+	size = dvbcfg_zapdb_size(load.count, buckets);
+	if ((buf = calloc(1, size)) == NULL) {
+		free(load.channels);
+		return -ENOMEM;
+	}
+
+	header = (struct dvbcfg_zapdb_header *) buf;
+	memcpy(header->magic, DVBCFG_ZAPDB_MAGIC, sizeof(header->magic));
+	header->version = DVBCFG_ZAPDB_VERSION;
+	header->record_size = sizeof(struct dvbcfg_zapchannel);
+	header->count = load.count;
+	header->buckets = buckets;
+	header->size = size;
+
+	dvbcfg_zapdb_layout(&db, buf, load.count, buckets);
+	memcpy((void *) db.channels, load.channels, load.count * sizeof(struct dvbcfg_zapchannel));
+	name_head = (uint32_t *) db.name_head;
+	name_next = (uint32_t *) db.name_next;
+	service_head = (uint32_t *) db.service_head;
+	service_next = (uint32_t *) db.service_next;
+
+	/* insert in reverse, so each chain is in file order */
+	for (i = load.count - 1; i >= 0; i--) {
+		uint32_t hash;
+
+		hash = dvbcfg_zapdb_hash_name(load.channels[i].name) & db.mask;
+		name_next[i] = name_head[hash];
+		name_head[hash] = i + 1;
+
+		hash = dvbcfg_zapdb_hash_service(load.channels[i].service_id) & db.mask;
+		service_next[i] = service_head[hash];
+		service_head[hash] = i + 1;
+	}
+	free(load.channels);
+
+	snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", dbfile);
+	if ((fd = mkstemp(tmpname)) < 0) {
+		ret = -errno;
+		free(buf);
+		return ret;
+	}
+	fchmod(fd, 0644);
+	errno = 0;
+	if ((write(fd, buf, size) != (ssize_t) size) || close(fd) || rename(tmpname, dbfile)) {
+		ret = errno ? -errno : -EIO;
+		unlink(tmpname);
+		free(buf);
+		return ret;
+	}
+	free(buf);
+
+	return load.count;
+}
+
+struct dvbcfg_zapdb *dvbcfg_zapdb_open(const char *dbfile)
+{
+	struct dvbcfg_zapdb *db;
+	struct dvbcfg_zapdb_header *header;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open(dbfile, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return NULL;
+	}
+	if ((size_t) st.st_size < sizeof(struct dvbcfg_zapdb_header)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	header = map;
+	if (memcmp(header->magic, DVBCFG_ZAPDB_MAGIC, sizeof(header->magic)) ||
+	    (header->version != DVBCFG_ZAPDB_VERSION) ||
+	    (header->record_size != sizeof(struct dvbcfg_zapchannel)) ||
+	    (header->buckets == 0) ||
+	    (header->buckets & (header->buckets - 1)) ||
+	    (header->size != (uint64_t) st.st_size) ||
+	    (header->size != dvbcfg_zapdb_size(header->count, header->buckets))) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((db = malloc(sizeof(struct dvbcfg_zapdb))) == NULL) {
+		munmap(map, st.st_size);
+		errno = ENOMEM;
+		return NULL;
+	}
+	db->map = map;
+	db->size = st.st_size;
+	dvbcfg_zapdb_layout(db, map, header->count, header->buckets);
+
+	return db;
+}
+
+void dvbcfg_zapdb_close(struct dvbcfg_zapdb *db)
+{
+	munmap(db->map, db->size);
+	free(db);
+}
+
+int dvbcfg_zapdb_count(struct dvbcfg_zapdb *db)
+{
+	return db->count;
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_zapdb_get(struct dvbcfg_zapdb *db, int index)
+{
+	if ((index < 0) || ((uint32_t) index >= db->count))
+		return NULL;
+
+	return &db->channels[index];
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_zapdb_find_name(struct dvbcfg_zapdb *db,
+						       const char *name)
+{
+	uint32_t pos = db->name_head[dvbcfg_zapdb_hash_name(name) & db->mask];
+
+	/* an index past the end can only come from a corrupt file */
+	while (pos && (pos <= db->count)) {
+		const struct dvbcfg_zapchannel *channel = &db->channels[pos - 1];
+
+		if (strncmp(channel->name, name, sizeof(channel->name)) == 0)
+			return channel;
+		pos = db->name_next[pos - 1];
+	}
+
+	return NULL;
+}
+
+const struct dvbcfg_zapchannel *dvbcfg_zapdb_find_service(struct dvbcfg_zapdb *db,
+							  int service_id,
+							  uint32_t frequency,
+							  const struct dvbcfg_zapchannel *prev)
+{
+	uint32_t pos;
+
+	if (prev)
+		pos = db->service_next[prev - db->channels];
+	else
+		pos = db->service_head[dvbcfg_zapdb_hash_service(service_id) & db->mask];
+
+	while (pos && (pos <= db->count)) {
+		const struct dvbcfg_zapchannel *channel = &db->channels[pos - 1];
+
+		if ((channel->service_id == service_id) &&
+		    ((frequency == 0) || (channel->fe_params.frequency == frequency)))
+			return channel;
+		pos = db->service_next[pos - 1];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,116 @@
+/*
+ * dvbcfg - support for linuxtv configuration files
+ * compiled zap channel database
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef DVBCFG_ZAPDB_H
+#define DVBCFG_ZAPDB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libdvbcfg/dvbcfg_zapchannel.h>
+
+/*
+ * A zap channel database is a channel file compiled into a form which is
+ * mapped into memory and searched in place: the channels are stored as an
+ * array of struct dvbcfg_zapchannel, followed by hash indexes by name and by
+ * service id. Opening one costs the same whatever its size, and a lookup
+ * touches only the entries which share a hash bucket.
+ *
+ * The channels are stored in the machine's native layout, so a database
+ * should be compiled on the machine which reads it; one with a different
+ * layout or version is refused.
+ */
+struct dvbcfg_zapdb;
+
+/**
+ * Compile a linuxtv channel file into a database. The database is written to
+ * a temporary file which is then renamed, so readers never see a partial one.
+ *
+ * @param file Linuxtv channel file.
+ * @param dbfile Name of the database to write.
+ * @return Number of channels on success, or a negative errno value on failure.
+ */
+extern int dvbcfg_zapdb_compile(FILE *file, const char *dbfile);
+
+/**
+ * Open a database.
+ *
+ * @param dbfile Name of the database.
+ * @return The database, or NULL on failure with errno set. errno is EINVAL if
+ * the file is not a database compiled for this machine.
+ */
+extern struct dvbcfg_zapdb *dvbcfg_zapdb_open(const char *dbfile);
+
+/**
+ * Close a database. Channels returned by it must not be used afterwards.
+ *
+ * @param db The database.
+ */
+extern void dvbcfg_zapdb_close(struct dvbcfg_zapdb *db);
+
+/**
+ * @param db The database.
+ * @return Number of channels in the database.
+ */
+extern int dvbcfg_zapdb_count(struct dvbcfg_zapdb *db);
+
+/**
+ * Get a channel by its position in the original channel file.
+ *
+ * @param db The database.
+ * @param index Position, from 0.
+ * @return The channel, or NULL if index is out of range.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_zapdb_get(struct dvbcfg_zapdb *db, int index);
+
+/**
+ * Find a channel by name. If several channels have the same name, the first
+ * in the original channel file is returned, as dvbcfg_zapchannel_parse()
+ * would find it.
+ *
+ * @param db The database.
+ * @param name Channel name.
+ * @return The channel, or NULL if there is none.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_zapdb_find_name(struct dvbcfg_zapdb *db,
+							      const char *name);
+
+/**
+ * Find a channel by service id. A channel file does not record the network
+ * or transport stream, so the frequency may be given to tell apart services
+ * with the same id on different multiplexes.
+ *
+ * @param db The database.
+ * @param service_id Service id.
+ * @param frequency Frequency as stored in the channel, or 0 to match any.
+ * @param prev NULL to find the first match, or a channel returned by a previous
+ * call, to find the next one after it.
+ * @return The channel, or NULL if there are no more.
+ */
+extern const struct dvbcfg_zapchannel *dvbcfg_zapdb_find_service(struct dvbcfg_zapdb *db,
+								 int service_id,
+								 uint32_t frequency,
+								 const struct dvbcfg_zapchannel *prev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DVBCFG_ZAPDB_H */
@@ -46,32 +46,41 @@ struct en50221_app_ca {
 	pthread_mutex_t lock;
 };
 
-struct ca_pmt_descriptor {
-	uint8_t *descriptor;
-	uint16_t length;
+// largest CA PMT kept in a cache entry; anything bigger is formatted each time
+#define CA_PMT_CACHE_ENTRY_SIZE 2048
 
-	struct ca_pmt_descriptor *next;
+struct ca_pmt_cache_entry {
+	uint32_t last_used;	// 0 if the entry is unused
+
+	// what the CA PMT was formatted from
+	uint16_t program_number;
+	uint8_t version;	// version_number << 1 | current_next_indicator
+	uint32_t crc;
+	uint16_t ca_ids[EN50221_CA_PMT_CACHE_MAX_CA_IDS];
+	uint32_t ca_id_count;
+
+	uint32_t length;
+	uint8_t data[CA_PMT_CACHE_ENTRY_SIZE];
 };
 
-struct ca_pmt_stream {
-	uint8_t stream_type;
-	uint16_t pid;
-	struct ca_pmt_descriptor *descriptors;
-	uint32_t descriptors_length;
-	uint32_t descriptors_count;
+struct en50221_ca_pmt_cache {
+	int move_ca_descriptors;
+	uint32_t entry_count;
+	struct ca_pmt_cache_entry *entries;
+	uint32_t clock;
+
+	uint32_t hits;
+	uint32_t misses;
 
-	struct ca_pmt_stream *next;
+	pthread_mutex_t lock;
 };
 
-static int en50221_ca_extract_pmt_descriptors(struct mpeg_pmt_section *pmt,
-					      struct ca_pmt_descriptor **outdescriptors);
-static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
-				      struct ca_pmt_stream **outstreams);
-static void en50221_ca_try_move_pmt_descriptors(struct ca_pmt_descriptor **pmt_descriptors,
-						struct ca_pmt_stream **pmt_streams);
-static uint32_t en50221_ca_calculate_length(struct ca_pmt_descriptor *pmt_descriptors,
-					    uint32_t *pmt_descriptors_length,
-					    struct ca_pmt_stream *pmt_streams);
+static int en50221_ca_format(struct mpeg_pmt_section *pmt, uint8_t * data,
+			     uint32_t data_length, int move_ca_descriptors,
+			     uint8_t ca_pmt_list_management, uint8_t ca_pmt_cmd_id,
+			     uint16_t *ca_ids, uint32_t ca_id_count);
+static void en50221_ca_patch(uint8_t *data, uint32_t data_length,
+			     uint8_t ca_pmt_list_management, uint8_t ca_pmt_cmd_id);
 static int en50221_app_ca_parse_info(struct en50221_app_ca *ca,
 				     uint8_t slot_id,
 				     uint16_t session_number,
@@ -203,344 +212,357 @@ int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt, uint8_t * data,
 			  uint8_t ca_pmt_list_management,
 			  uint8_t ca_pmt_cmd_id)
 {
-	struct ca_pmt_descriptor *pmt_descriptors = NULL;
-	uint32_t pmt_descriptors_length = 0;
-	struct ca_pmt_stream *pmt_streams = NULL;
-	uint32_t total_required_length = 0;
-	struct ca_pmt_descriptor *cur_d;
-	struct ca_pmt_stream *cur_s;
-	int result = -1;
-
-	// extract the descriptors and streams
-	if (en50221_ca_extract_pmt_descriptors(pmt, &pmt_descriptors))
-		goto cleanup;
-	if (en50221_ca_extract_streams(pmt, &pmt_streams))
-		goto cleanup;
+	return en50221_ca_format(pmt, data, data_length, move_ca_descriptors,
+				 ca_pmt_list_management, ca_pmt_cmd_id, NULL, 0);
+}
 
-	// try and merge them if we have no PMT descriptors
-	if ((pmt_descriptors == NULL) && move_ca_descriptors) {
-		en50221_ca_try_move_pmt_descriptors(&pmt_descriptors,
-						    &pmt_streams);
+struct en50221_ca_pmt_cache *en50221_ca_pmt_cache_create(uint32_t max_entries,
+							 int move_ca_descriptors)
+{
+	struct en50221_ca_pmt_cache *cache = NULL;
+
+	// create structure and set it up
+	cache = malloc(sizeof(struct en50221_ca_pmt_cache));
+	if (cache == NULL) {
+		return NULL;
 	}
-	// calculate the length of all descriptors/streams and the total length required
-	total_required_length =
-	    en50221_ca_calculate_length(pmt_descriptors,
-					&pmt_descriptors_length,
-					pmt_streams);
-
-	// ensure we were supplied with enough data
-	if (total_required_length > data_length) {
-		goto cleanup;
+	cache->entries = calloc(max_entries, sizeof(struct ca_pmt_cache_entry));
+	if (cache->entries == NULL) {
+		free(cache);
+		return NULL;
 	}
-	// format the start of the PMT
-	uint32_t data_pos = 0;
-	data[data_pos++] = ca_pmt_list_management;
-	data[data_pos++] = mpeg_pmt_section_program_number(pmt) >> 8;
-	data[data_pos++] = mpeg_pmt_section_program_number(pmt);
-	data[data_pos++] =
-	    (pmt->head.version_number << 1) | pmt->head.
-	    current_next_indicator;
-	data[data_pos++] = (pmt_descriptors_length >> 8) & 0x0f;
-	data[data_pos++] = pmt_descriptors_length;
-
-	// append the PMT descriptors
-	if (pmt_descriptors_length) {
-		data[data_pos++] = ca_pmt_cmd_id;
-		cur_d = pmt_descriptors;
-		while (cur_d) {
-			memcpy(data + data_pos, cur_d->descriptor,
-			       cur_d->length);
-			data_pos += cur_d->length;
-			cur_d = cur_d->next;
-		}
+	cache->move_ca_descriptors = move_ca_descriptors;
+	cache->entry_count = max_entries;
+	cache->clock = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+
+	pthread_mutex_init(&cache->lock, NULL);
+
+	// done
+	return cache;
+}
+
+void en50221_ca_pmt_cache_destroy(struct en50221_ca_pmt_cache *cache)
+{
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->entries);
+	free(cache);
+}
+
+int en50221_ca_pmt_cache_format(struct en50221_ca_pmt_cache *cache,
+				struct mpeg_pmt_section *pmt,
+				uint16_t *ca_ids, uint32_t ca_id_count,
+				uint8_t * data, uint32_t data_length,
+				uint8_t ca_pmt_list_management,
+				uint8_t ca_pmt_cmd_id)
+{
+	struct ca_pmt_cache_entry *entry = NULL;
+	struct ca_pmt_cache_entry *victim = NULL;
+	uint16_t program_number = mpeg_pmt_section_program_number(pmt);
+	uint8_t version = (pmt->head.version_number << 1) | pmt->head.current_next_indicator;
+	uint32_t i;
+	int result;
+
+	// the CRC tells apart PMTs of the same version from different multiplexes
+	uint8_t *crc_ptr = (uint8_t *) pmt + section_ext_length(&pmt->head);
+	uint32_t crc = (crc_ptr[0] << 24) | (crc_ptr[1] << 16) | (crc_ptr[2] << 8) | crc_ptr[3];
+
+	if (ca_id_count > EN50221_CA_PMT_CACHE_MAX_CA_IDS) {
+		return en50221_ca_format(pmt, data, data_length, cache->move_ca_descriptors,
+					 ca_pmt_list_management, ca_pmt_cmd_id,
+					 ca_ids, ca_id_count);
 	}
-	// now, append the streams
-	cur_s = pmt_streams;
-	while (cur_s) {
-		data[data_pos++] = cur_s->stream_type;
-		data[data_pos++] = (cur_s->pid >> 8) & 0x1f;
-		data[data_pos++] = cur_s->pid;
-		data[data_pos++] = (cur_s->descriptors_length >> 8) & 0x0f;
-		data[data_pos++] = cur_s->descriptors_length;
 
-		// append the stream descriptors
-		if (cur_s->descriptors_length) {
-			data[data_pos++] = ca_pmt_cmd_id;
-			cur_d = cur_s->descriptors;
-			while (cur_d) {
-				memcpy(data + data_pos, cur_d->descriptor,
-				       cur_d->length);
-				data_pos += cur_d->length;
-				cur_d = cur_d->next;
-			}
+	pthread_mutex_lock(&cache->lock);
+	cache->clock++;
+
+	// look it up, remembering the least recently used entry
+	for (i = 0; i < cache->entry_count; i++) {
+		struct ca_pmt_cache_entry *cur = &cache->entries[i];
+
+		if ((cur->last_used) &&
+		    (cur->program_number == program_number) &&
+		    (cur->version == version) &&
+		    (cur->crc == crc) &&
+		    (cur->ca_id_count == ca_id_count) &&
+		    (!memcmp(cur->ca_ids, ca_ids, ca_id_count * sizeof(uint16_t)))) {
+			entry = cur;
+			break;
 		}
-		cur_s = cur_s->next;
+		if ((victim == NULL) || (cur->last_used < victim->last_used))
+			victim = cur;
 	}
-	result = data_pos;
-
 
-      cleanup:
-	// free the PMT descriptors
-	cur_d = pmt_descriptors;
-	while (cur_d) {
-		struct ca_pmt_descriptor *next = cur_d->next;
-		free(cur_d);
-		cur_d = next;
-	}
+	if (entry) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+		if (victim == NULL) {
+			pthread_mutex_unlock(&cache->lock);
+			return en50221_ca_format(pmt, data, data_length, cache->move_ca_descriptors,
+						 ca_pmt_list_management, ca_pmt_cmd_id,
+						 ca_ids, ca_id_count);
+		}
 
-	// free the streams
-	cur_s = pmt_streams;
-	while (cur_s) {
-		struct ca_pmt_stream *next_s = cur_s->next;
-
-		// free the stream descriptors
-		cur_d = cur_s->descriptors;
-		while (cur_d) {
-			struct ca_pmt_descriptor *next_d = cur_d->next;
-			free(cur_d);
-			cur_d = next_d;
+		// format it into the entry
+		entry = victim;
+		entry->last_used = 0;
+		if ((result = en50221_ca_format(pmt, entry->data, sizeof(entry->data),
+						cache->move_ca_descriptors,
+						ca_pmt_list_management, ca_pmt_cmd_id,
+						ca_ids, ca_id_count)) < 0) {
+			pthread_mutex_unlock(&cache->lock);
+			return en50221_ca_format(pmt, data, data_length, cache->move_ca_descriptors,
+						 ca_pmt_list_management, ca_pmt_cmd_id,
+						 ca_ids, ca_id_count);
 		}
+		entry->program_number = program_number;
+		entry->version = version;
+		entry->crc = crc;
+		memcpy(entry->ca_ids, ca_ids, ca_id_count * sizeof(uint16_t));
+		entry->ca_id_count = ca_id_count;
+		entry->length = result;
+	}
+	entry->last_used = cache->clock;
 
-		free(cur_s);
-		cur_s = next_s;
+	// only the list management and command bytes differ between repeats
+	if (entry->length > data_length) {
+		pthread_mutex_unlock(&cache->lock);
+		return -1;
 	}
+	en50221_ca_patch(entry->data, entry->length, ca_pmt_list_management, ca_pmt_cmd_id);
+	memcpy(data, entry->data, entry->length);
+	result = entry->length;
+
+	pthread_mutex_unlock(&cache->lock);
 	return result;
 }
 
+void en50221_ca_pmt_cache_get_stats(struct en50221_ca_pmt_cache *cache,
+				    uint32_t *hits, uint32_t *misses)
+{
+	pthread_mutex_lock(&cache->lock);
+	*hits = cache->hits;
+	*misses = cache->misses;
+	pthread_mutex_unlock(&cache->lock);
+}
 
 
 
 
+/*
+ * Whether a descriptor is a CA descriptor for one of the given CA system ids
+ * (for any, if there are none).
+ */
+static int en50221_ca_wanted(struct descriptor *d, uint16_t *ca_ids, uint32_t ca_id_count)
+{
+	uint8_t *buf = (uint8_t *) d;
+	uint32_t i;
 
+	if (d->tag != dtag_mpeg_ca)
+		return 0;
+	if (ca_id_count == 0)
+		return 1;
+	if (d->len < 2)
+		return 0;
 
-static int en50221_ca_extract_pmt_descriptors(struct mpeg_pmt_section *pmt,
-					      struct ca_pmt_descriptor **outdescriptors)
-{
-	struct ca_pmt_descriptor *descriptors = NULL;
-	struct ca_pmt_descriptor *descriptors_tail = NULL;
-	struct ca_pmt_descriptor *cur_d;
-
-	struct descriptor *cur_descriptor;
-	mpeg_pmt_section_descriptors_for_each(pmt, cur_descriptor) {
-		if (cur_descriptor->tag == dtag_mpeg_ca) {
-			// create a new structure for this one
-			struct ca_pmt_descriptor *new_d =
-			    malloc(sizeof(struct ca_pmt_descriptor));
-			if (new_d == NULL) {
-				goto error_exit;
-			}
-			new_d->descriptor = (uint8_t *) cur_descriptor;
-			new_d->length = cur_descriptor->len + 2;
-			new_d->next = NULL;
-
-			// append it to the list
-			if (descriptors == NULL) {
-				descriptors = new_d;
-			} else {
-				descriptors_tail->next = new_d;
-			}
-			descriptors_tail = new_d;
-		}
+	// the descriptor is not decoded in place, so is still big endian
+	uint16_t ca_system_id = (buf[2] << 8) | buf[3];
+	for (i = 0; i < ca_id_count; i++) {
+		if (ca_ids[i] == ca_system_id)
+			return 1;
 	}
-	*outdescriptors = descriptors;
 	return 0;
+}
 
-error_exit:
-	cur_d = descriptors;
-	while (cur_d) {
-		struct ca_pmt_descriptor *next = cur_d->next;
-		free(cur_d);
-		cur_d = next;
-	}
-	return -1;
+/*
+ * The wanted CA descriptor after pos in a PMT's programme info, or the first
+ * one if pos is NULL.
+ */
+static struct descriptor *en50221_ca_next_pmt_descriptor(struct mpeg_pmt_section *pmt,
+							 struct descriptor *pos,
+							 uint16_t *ca_ids, uint32_t ca_id_count)
+{
+	if (pos == NULL)
+		pos = mpeg_pmt_section_descriptors_first(pmt);
+	else
+		pos = mpeg_pmt_section_descriptors_next(pmt, pos);
+
+	while (pos && !en50221_ca_wanted(pos, ca_ids, ca_id_count))
+		pos = mpeg_pmt_section_descriptors_next(pmt, pos);
+	return pos;
 }
 
-static int en50221_ca_extract_streams(struct mpeg_pmt_section *pmt,
-				      struct ca_pmt_stream **outstreams)
+/*
+ * The wanted CA descriptor after pos in a stream, or the first one if pos is
+ * NULL.
+ */
+static struct descriptor *en50221_ca_next_stream_descriptor(struct mpeg_pmt_stream *stream,
+							    struct descriptor *pos,
+							    uint16_t *ca_ids, uint32_t ca_id_count)
 {
-	struct ca_pmt_stream *streams = NULL;
-	struct ca_pmt_stream *streams_tail = NULL;
+	if (pos == NULL)
+		pos = mpeg_pmt_stream_descriptors_first(stream);
+	else
+		pos = mpeg_pmt_stream_descriptors_next(stream, pos);
+
+	while (pos && !en50221_ca_wanted(pos, ca_ids, ca_id_count))
+		pos = mpeg_pmt_stream_descriptors_next(stream, pos);
+	return pos;
+}
+
+/*
+ * Whether every stream has exactly the same CA descriptors as the first, in
+ * which case they can be given once at programme level instead.
+ */
+static int en50221_ca_streams_match(struct mpeg_pmt_section *pmt,
+				    uint16_t *ca_ids, uint32_t ca_id_count)
+{
+	struct mpeg_pmt_stream *first_stream;
 	struct mpeg_pmt_stream *cur_stream;
-	struct descriptor *cur_descriptor;
-	struct ca_pmt_stream *cur_s;
 
-	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
-		struct ca_pmt_descriptor *descriptors_tail = NULL;
+	// get the first stream
+	if ((first_stream = mpeg_pmt_section_streams_first(pmt)) == NULL)
+		return 0;
 
-		// create a new structure
-		struct ca_pmt_stream *new_s =
-		    malloc(sizeof(struct ca_pmt_stream));
-		if (new_s == NULL) {
-			goto exit_cleanup;
-		}
-		new_s->stream_type = cur_stream->stream_type;
-		new_s->pid = cur_stream->pid;
-		new_s->descriptors = NULL;
-		new_s->next = NULL;
-		new_s->descriptors_count = 0;
-
-		// append it to the list
-		if (streams == NULL) {
-			streams = new_s;
-		} else {
-			streams_tail->next = new_s;
-		}
-		streams_tail = new_s;
-
-		// now process the descriptors
-		mpeg_pmt_stream_descriptors_for_each(cur_stream,
-						     cur_descriptor) {
-			if (cur_descriptor->tag == dtag_mpeg_ca) {
-				// create a new structure
-				struct ca_pmt_descriptor *new_d =
-				    malloc(sizeof(struct ca_pmt_descriptor));
-				if (new_d == NULL) {
-					goto exit_cleanup;
-				}
-				new_d->descriptor =
-				    (uint8_t *) cur_descriptor;
-				new_d->length = cur_descriptor->len + 2;
-				new_d->next = NULL;
-
-				// append it to the list
-				if (new_s->descriptors == NULL) {
-					new_s->descriptors = new_d;
-				} else {
-					descriptors_tail->next = new_d;
-				}
-				descriptors_tail = new_d;
-				new_s->descriptors_count++;
-			}
+	cur_stream = mpeg_pmt_section_streams_next(pmt, first_stream);
+	while (cur_stream) {
+		struct descriptor *first_d =
+			en50221_ca_next_stream_descriptor(first_stream, NULL, ca_ids, ca_id_count);
+		struct descriptor *cur_d =
+			en50221_ca_next_stream_descriptor(cur_stream, NULL, ca_ids, ca_id_count);
+
+		while (first_d && cur_d) {
+			// check the descriptors are the same length, and their contents match
+			if (first_d->len != cur_d->len)
+				return 0;
+			if (memcmp(first_d, cur_d, first_d->len + 2))
+				return 0;
+
+			first_d = en50221_ca_next_stream_descriptor(first_stream, first_d, ca_ids, ca_id_count);
+			cur_d = en50221_ca_next_stream_descriptor(cur_stream, cur_d, ca_ids, ca_id_count);
 		}
-	}
-	*outstreams = streams;
-	return 0;
 
-exit_cleanup:
-	// free the streams
-	cur_s = streams;
-	while (cur_s) {
-		struct ca_pmt_stream *next_s = cur_s->next;
-
-		// free the stream descriptors
-		struct ca_pmt_descriptor *cur_d = cur_s->descriptors;
-		while (cur_d) {
-			struct ca_pmt_descriptor *next_d = cur_d->next;
-			free(cur_d);
-			cur_d = next_d;
-		}
+		// if there are differing numbers of descriptors, they do not match
+		if (first_d || cur_d)
+			return 0;
 
-		free(cur_s);
-		cur_s = next_s;
+		cur_stream = mpeg_pmt_section_streams_next(pmt, cur_stream);
 	}
-	return -1;
+
+	return 1;
 }
 
-static void en50221_ca_try_move_pmt_descriptors(struct ca_pmt_descriptor **pmt_descriptors,
-						struct ca_pmt_stream **pmt_streams)
+/*
+ * Format a CA PMT straight from the PMT, without building any lists.
+ */
+static int en50221_ca_format(struct mpeg_pmt_section *pmt, uint8_t * data,
+			     uint32_t data_length, int move_ca_descriptors,
+			     uint8_t ca_pmt_list_management, uint8_t ca_pmt_cmd_id,
+			     uint16_t *ca_ids, uint32_t ca_id_count)
 {
-	// get the first stream
-	struct ca_pmt_stream *first_stream = *pmt_streams;
-	if (first_stream == NULL)
-		return;
-
-	// Check that all the other streams with CA descriptors have exactly the same CA descriptors
-	struct ca_pmt_stream *cur_stream = first_stream->next;
-	while (cur_stream) {
-		// if there are differing numbers of descriptors, exit right now
-		if (cur_stream->descriptors_count != first_stream->descriptors_count)
-			return;
-
-		// now verify the descriptors match
-		struct ca_pmt_descriptor *cur_descriptor = cur_stream->descriptors;
-		struct ca_pmt_descriptor *first_cur_descriptor = first_stream->descriptors;
-		while (cur_descriptor) {
-			// check the descriptors are the same length
-			if (cur_descriptor->length != first_cur_descriptor->length)
-				return;
-
-			// check their contents match
-			if (memcmp(cur_descriptor->descriptor,
-			    	   first_cur_descriptor->descriptor,
-				   cur_descriptor->length)) {
-				return;
-			}
-			// move to next
-			cur_descriptor = cur_descriptor->next;
-			first_cur_descriptor = first_cur_descriptor->next;
-		}
+	struct mpeg_pmt_stream *first_stream = mpeg_pmt_section_streams_first(pmt);
+	struct mpeg_pmt_stream *cur_s;
+	struct descriptor *cur_d;
+	uint32_t data_pos = 0;
+	uint32_t descriptors_pos;
+	uint32_t descriptors_length;
+	int moved = 0;
 
-		// move to next
-		cur_stream = cur_stream->next;
+	// try and merge them if we have no PMT descriptors
+	if (move_ca_descriptors &&
+	    (en50221_ca_next_pmt_descriptor(pmt, NULL, ca_ids, ca_id_count) == NULL)) {
+		moved = en50221_ca_streams_match(pmt, ca_ids, ca_id_count);
 	}
 
-	// if we end up here, all descriptors in all streams matched
+	// format the start of the PMT
+	if (data_length < 6)
+		return -1;
+	data[data_pos++] = ca_pmt_list_management;
+	data[data_pos++] = mpeg_pmt_section_program_number(pmt) >> 8;
+	data[data_pos++] = mpeg_pmt_section_program_number(pmt);
+	data[data_pos++] =
+	    (pmt->head.version_number << 1) | pmt->head.
+	    current_next_indicator;
+	data_pos += 2;
+
+	// append the PMT descriptors, after a ca_pmt_cmd_id if there are any
+	descriptors_pos = data_pos++;
+	if (moved)
+		cur_d = en50221_ca_next_stream_descriptor(first_stream, NULL, ca_ids, ca_id_count);
+	else
+		cur_d = en50221_ca_next_pmt_descriptor(pmt, NULL, ca_ids, ca_id_count);
+	while (cur_d) {
+		if ((data_pos + cur_d->len + 2) > data_length)
+			return -1;
+		memcpy(data + data_pos, cur_d, cur_d->len + 2);
+		data_pos += cur_d->len + 2;
+
+		if (moved)
+			cur_d = en50221_ca_next_stream_descriptor(first_stream, cur_d, ca_ids, ca_id_count);
+		else
+			cur_d = en50221_ca_next_pmt_descriptor(pmt, cur_d, ca_ids, ca_id_count);
+	}
+	if (data_pos == (descriptors_pos + 1))
+		data_pos = descriptors_pos;
+	else
+		data[descriptors_pos] = ca_pmt_cmd_id;
+	descriptors_length = data_pos - descriptors_pos;
+	data[4] = (descriptors_length >> 8) & 0x0f;
+	data[5] = descriptors_length;
 
-	// hook the first stream's descriptors into the PMT's
-	*pmt_descriptors = first_stream->descriptors;
-	first_stream->descriptors = NULL;
-	first_stream->descriptors_count = 0;
+	// now, append the streams
+	mpeg_pmt_section_streams_for_each(pmt, cur_s) {
+		if ((data_pos + 5) > data_length)
+			return -1;
+		data[data_pos++] = cur_s->stream_type;
+		data[data_pos++] = (cur_s->pid >> 8) & 0x1f;
+		data[data_pos++] = cur_s->pid;
+		data_pos += 2;
 
-	// now free up all the descriptors in the other streams
-	cur_stream = first_stream->next;
-	while (cur_stream) {
-		struct ca_pmt_descriptor *cur_descriptor = cur_stream->descriptors;
-		while (cur_descriptor) {
-			struct ca_pmt_descriptor *next = cur_descriptor->next;
-			free(cur_descriptor);
-			cur_descriptor = next;
+		// append the stream descriptors
+		descriptors_pos = data_pos++;
+		if (!moved) {
+			mpeg_pmt_stream_descriptors_for_each(cur_s, cur_d) {
+				if (!en50221_ca_wanted(cur_d, ca_ids, ca_id_count))
+					continue;
+				if ((data_pos + cur_d->len + 2) > data_length)
+					return -1;
+				memcpy(data + data_pos, cur_d, cur_d->len + 2);
+				data_pos += cur_d->len + 2;
+			}
 		}
-		cur_stream->descriptors = NULL;
-		cur_stream->descriptors_count = 0;
-		cur_stream = cur_stream->next;
+		if (data_pos == (descriptors_pos + 1))
+			data_pos = descriptors_pos;
+		else
+			data[descriptors_pos] = ca_pmt_cmd_id;
+		descriptors_length = data_pos - descriptors_pos;
+		data[descriptors_pos - 2] = (descriptors_length >> 8) & 0x0f;
+		data[descriptors_pos - 1] = descriptors_length;
 	}
+
+	return data_pos;
 }
 
-static uint32_t en50221_ca_calculate_length(struct ca_pmt_descriptor *pmt_descriptors,
-					    uint32_t *pmt_descriptors_length,
-					    struct ca_pmt_stream *pmt_streams)
+/*
+ * Rewrite the list management and command bytes of a formatted CA PMT.
+ */
+static void en50221_ca_patch(uint8_t *data, uint32_t data_length,
+			     uint8_t ca_pmt_list_management, uint8_t ca_pmt_cmd_id)
 {
-	uint32_t total_required_length = 6;	// header
-	struct ca_pmt_stream *cur_s;
-
-	// calcuate the PMT descriptors length
-	(*pmt_descriptors_length) = 0;
-	struct ca_pmt_descriptor *cur_d = pmt_descriptors;
-	while (cur_d) {
-		(*pmt_descriptors_length) += cur_d->length;
-		cur_d = cur_d->next;
-	}
-
-	// add on 1 byte for the ca_pmt_cmd_id if we have some descriptors.
-	if (*pmt_descriptors_length)
-		(*pmt_descriptors_length)++;
-
-	// update the total required length
-	total_required_length += *pmt_descriptors_length;
-
-	// calculate the length of descriptors in the streams
-	cur_s = pmt_streams;
-	while (cur_s) {
-		// calculate the size of descriptors in this stream
-		cur_s->descriptors_length = 0;
-		cur_d = cur_s->descriptors;
-		while (cur_d) {
-			cur_s->descriptors_length += cur_d->length;
-			cur_d = cur_d->next;
-		}
-
-		// add on 1 byte for the ca_pmt_cmd_id if we have some descriptors.
-		if (cur_s->descriptors_length)
-			cur_s->descriptors_length++;
+	uint32_t data_pos = 4;
+	uint32_t descriptors_length;
 
-		// update the total required length;
-		total_required_length += 5 + cur_s->descriptors_length;
+	data[0] = ca_pmt_list_management;
+	while ((data_pos + 2) <= data_length) {
+		descriptors_length = ((data[data_pos] & 0x0f) << 8) | data[data_pos + 1];
+		if (descriptors_length)
+			data[data_pos + 2] = ca_pmt_cmd_id;
 
-		cur_s = cur_s->next;
+		// skip to the ES_info_length of the next stream
+		data_pos += 2 + descriptors_length + 3;
 	}
-
-	// done
-	return total_required_length;
 }
 
 static int en50221_app_ca_parse_info(struct en50221_app_ca *ca,
@@ -208,6 +208,68 @@ extern int en50221_ca_format_pmt(struct mpeg_pmt_section *pmt,
 				 uint8_t ca_pmt_list_management,
 				 uint8_t ca_pmt_cmd_id);
 
+/**
+ * Largest number of CA system ids an en50221_ca_pmt_cache entry is keyed on.
+ */
+#define EN50221_CA_PMT_CACHE_MAX_CA_IDS 16
+
+/**
+ * Opaque type representing a cache of formatted CA PMTs.
+ */
+struct en50221_ca_pmt_cache;
+
+/**
+ * Create a cache of formatted CA PMTs, for sending the same PMTs to CAMs
+ * repeatedly. All its memory is allocated here.
+ *
+ * @param max_entries Number of CA PMTs to keep; the least recently used is replaced.
+ * @param move_ca_descriptors If non-zero, will attempt to move CA descriptors
+ * in order to reduce the size of the formatted CAPMTs.
+ * @return Instance, or NULL on failure.
+ */
+extern struct en50221_ca_pmt_cache *en50221_ca_pmt_cache_create(uint32_t max_entries,
+								int move_ca_descriptors);
+
+/**
+ * Destroy a cache of formatted CA PMTs.
+ *
+ * @param cache Instance to destroy.
+ */
+extern void en50221_ca_pmt_cache_destroy(struct en50221_ca_pmt_cache *cache);
+
+/**
+ * As en50221_ca_format_pmt(), but only CA descriptors for the given CA system
+ * ids are included, and the result is cached by program number, version, CRC
+ * and CA system ids. A PMT already in the cache is not formatted again: only
+ * its list management and command bytes are changed.
+ *
+ * @param cache Cache instance.
+ * @param pmt The source PMT structure.
+ * @param ca_ids CA system ids of the CAM concerned.
+ * @param ca_id_count Number of ca_ids; 0 to include every CA descriptor.
+ * @param data Pointer to data buffer to write it to.
+ * @param data_length Number of bytes available in data buffer.
+ * @param ca_pmt_list_management One of the CA_LIST_MANAGEMENT_*.
+ * @param ca_pmt_cmd_id One of the CA_PMT_CMD_ID_*.
+ * @return Number of bytes used, or -1 on error.
+ */
+extern int en50221_ca_pmt_cache_format(struct en50221_ca_pmt_cache *cache,
+				       struct mpeg_pmt_section *pmt,
+				       uint16_t *ca_ids, uint32_t ca_id_count,
+				       uint8_t * data, uint32_t data_length,
+				       uint8_t ca_pmt_list_management,
+				       uint8_t ca_pmt_cmd_id);
+
+/**
+ * Get the number of hits and misses of a cache of formatted CA PMTs.
+ *
+ * @param cache Cache instance.
+ * @param hits Set to the number of CA PMTs reused.
+ * @param misses Set to the number of CA PMTs formatted.
+ */
+extern void en50221_ca_pmt_cache_get_stats(struct en50221_ca_pmt_cache *cache,
+					   uint32_t *hits, uint32_t *misses);
+
 /**
  * Pass data received for this resource into it for parsing.
  *
@@ -0,0 +1,808 @@
+/*
+	en50221 encoder An implementation for libdvb
+	a software CAM for driving the en50221 stack without CI hardware
+
+	This library is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as
+	published by the Free Software Foundation; either version 2.1 of
+	the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <libdvbapi/dvbca.h>
+#include "asn_1.h"
+#include "en50221_app_ai.h"
+#include "en50221_app_ca.h"
+#include "en50221_app_datetime.h"
+#include "en50221_app_mmi.h"
+#include "en50221_app_rm.h"
+#include "en50221_app_tags.h"
+#include "en50221_camsim.h"
+
+// TPDU tags, from the module's side of en50221_transport.c
+#define T_SB                0x80
+#define T_RCV               0x81
+#define T_CREATE_T_C        0x82
+#define T_C_T_C_REPLY       0x83
+#define T_DELETE_T_C        0x84
+#define T_D_T_C_REPLY       0x85
+#define T_DATA_LAST         0xA0
+#define T_DATA_MORE         0xA1
+
+// SPDU tags, from the module's side of en50221_session.c
+#define ST_SESSION_NUMBER       0x90
+#define ST_OPEN_SESSION_REQ     0x91
+#define ST_OPEN_SESSION_RES     0x92
+#define ST_CREATE_SESSION       0x93
+#define ST_CREATE_SESSION_RES   0x94
+#define ST_CLOSE_SESSION_REQ    0x95
+#define ST_CLOSE_SESSION_RES    0x96
+
+#define S_STATUS_OPEN           0x00
+#define S_STATUS_CLOSE_NO_RES   0xF0
+
+// the host reads link layer messages of up to 4096 bytes
+#define CAMSIM_MAX_TPDU_DATA    4000
+#define CAMSIM_MAX_MENU_ITEMS   254
+#define CAMSIM_DEFAULT_MENU_ITEMS 4
+#define CAMSIM_DEFAULT_CA_SYSTEM_ID 0x0b00
+#define CAMSIM_DEFAULT_MENU_STRING "en50221 camsim"
+
+// an APDU tag no resource knows, for EN50221_CAMSIM_ERROR_BADAPDU
+#define CAMSIM_BAD_APDU_TAG     0x9f80ff
+
+// the host resources the module opens sessions to
+enum camsim_resource {
+	CAMSIM_RM,
+	CAMSIM_AI,
+	CAMSIM_CA,
+	CAMSIM_DATETIME,
+	CAMSIM_MMI,
+	CAMSIM_RESOURCE_COUNT,
+};
+
+static uint32_t camsim_resource_ids[CAMSIM_RESOURCE_COUNT] = {
+	EN50221_APP_RM_RESOURCEID,
+	EN50221_APP_AI_RESOURCEID,
+	EN50221_APP_CA_RESOURCEID,
+	EN50221_APP_DATETIME_RESOURCEID,
+	EN50221_APP_MMI_RESOURCEID,
+};
+
+#define CAMSIM_SESSION_CLOSED   0
+#define CAMSIM_SESSION_OPENING  1
+#define CAMSIM_SESSION_OPEN     2
+
+struct camsim_spdu {
+	struct camsim_spdu *next;
+	uint32_t length;
+	uint32_t sent;
+	uint8_t data[0];
+};
+
+struct en50221_camsim {
+	struct en50221_camsim_params params;
+	uint16_t default_ca_system_id;
+
+	int host_fd;
+	int fd;
+	pthread_t thread;
+
+	// everything below the lock is only touched by the module's thread
+	pthread_mutex_t lock;
+	struct en50221_camsim_stats stats;
+
+	int connection_id;
+	uint8_t *chain_buffer;
+	uint32_t chain_length;
+
+	struct camsim_spdu *send_queue;
+	struct camsim_spdu *send_queue_tail;
+
+	int session_state[CAMSIM_RESOURCE_COUNT];
+	uint16_t session_number[CAMSIM_RESOURCE_COUNT];
+	int menu_pending;
+
+	uint32_t tpdu_error_count;
+	uint32_t apdu_error_count;
+	int next_error;
+};
+
+static void *camsim_thread_func(void *arg);
+
+
+struct en50221_camsim *en50221_camsim_create(struct en50221_camsim_params *params)
+{
+	struct en50221_camsim *sim;
+	int sv[2];
+
+	sim = malloc(sizeof(struct en50221_camsim));
+	if (sim == NULL)
+		return NULL;
+	memset(sim, 0, sizeof(struct en50221_camsim));
+	if (params)
+		sim->params = *params;
+	sim->connection_id = -1;
+	pthread_mutex_init(&sim->lock, NULL);
+
+	// fill in the defaults, and take copies of what the caller owns
+	if (sim->params.ca_system_id_count == 0) {
+		sim->default_ca_system_id = CAMSIM_DEFAULT_CA_SYSTEM_ID;
+		sim->params.ca_system_ids = &sim->default_ca_system_id;
+		sim->params.ca_system_id_count = 1;
+	} else {
+		uint16_t *ids = malloc(sim->params.ca_system_id_count * sizeof(uint16_t));
+		if (ids == NULL)
+			goto error_exit;
+		memcpy(ids, sim->params.ca_system_ids,
+		       sim->params.ca_system_id_count * sizeof(uint16_t));
+		sim->params.ca_system_ids = ids;
+	}
+	if (sim->params.menu_string == NULL)
+		sim->params.menu_string = CAMSIM_DEFAULT_MENU_STRING;
+	if ((sim->params.menu_string = strdup(sim->params.menu_string)) == NULL)
+		goto error_exit;
+	if (strlen(sim->params.menu_string) > 255)
+		sim->params.menu_string[255] = 0;
+	if (sim->params.menu_items == 0)
+		sim->params.menu_items = CAMSIM_DEFAULT_MENU_ITEMS;
+	if (sim->params.menu_items > CAMSIM_MAX_MENU_ITEMS)
+		sim->params.menu_items = CAMSIM_MAX_MENU_ITEMS;
+	if ((sim->params.fragment_size == 0) ||
+	    (sim->params.fragment_size > CAMSIM_MAX_TPDU_DATA))
+		sim->params.fragment_size = CAMSIM_MAX_TPDU_DATA;
+
+	// one link layer message per datagram, as from a CA device
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+		goto error_exit;
+	sim->host_fd = sv[0];
+	sim->fd = sv[1];
+
+	if ((errno = pthread_create(&sim->thread, NULL, camsim_thread_func, sim)) != 0) {
+		close(sim->host_fd);
+		close(sim->fd);
+		goto error_exit;
+	}
+
+	return sim;
+
+error_exit:
+	if (sim->params.ca_system_ids != &sim->default_ca_system_id)
+		free(sim->params.ca_system_ids);
+	free(sim->params.menu_string);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim);
+	return NULL;
+}
+
+void en50221_camsim_destroy(struct en50221_camsim *sim)
+{
+	// the module's thread finishes when its end of the socket is shut down
+	shutdown(sim->fd, SHUT_RDWR);
+	pthread_join(sim->thread, NULL);
+	close(sim->fd);
+	close(sim->host_fd);
+
+	while (sim->send_queue) {
+		struct camsim_spdu *next = sim->send_queue->next;
+		free(sim->send_queue);
+		sim->send_queue = next;
+	}
+	free(sim->chain_buffer);
+	if (sim->params.ca_system_ids != &sim->default_ca_system_id)
+		free(sim->params.ca_system_ids);
+	free(sim->params.menu_string);
+	pthread_mutex_destroy(&sim->lock);
+	free(sim);
+}
+
+int en50221_camsim_get_fd(struct en50221_camsim *sim)
+{
+	return sim->host_fd;
+}
+
+void en50221_camsim_get_stats(struct en50221_camsim *sim,
+			      struct en50221_camsim_stats *stats)
+{
+	pthread_mutex_lock(&sim->lock);
+	*stats = sim->stats;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+
+
+
+static void camsim_count(struct en50221_camsim *sim, uint32_t *counter)
+{
+	pthread_mutex_lock(&sim->lock);
+	(*counter)++;
+	pthread_mutex_unlock(&sim->lock);
+}
+
+/*
+ * Decide whether the next reply or APDU carries an error: every
+ * error_interval'th one does, cycling through the enabled types in turn.
+ * Returns the EN50221_CAMSIM_ERROR_* to inject, or 0.
+ */
+static int camsim_inject_error(struct en50221_camsim *sim, uint32_t *count, int types)
+{
+	int i;
+
+	types &= sim->params.error_types;
+	if ((sim->params.error_interval == 0) || (types == 0))
+		return 0;
+	if (++(*count) % sim->params.error_interval)
+		return 0;
+
+	for (i = 0; i < 3; i++) {
+		int error = 1 << ((sim->next_error + i) % 3);
+		if (types & error) {
+			sim->next_error = (sim->next_error + i + 1) % 3;
+			camsim_count(sim, &sim->stats.errors_injected);
+			return error;
+		}
+	}
+	return 0;
+}
+
+static struct camsim_spdu *camsim_alloc_spdu(uint32_t length)
+{
+	struct camsim_spdu *spdu = malloc(sizeof(struct camsim_spdu) + length);
+	if (spdu == NULL)
+		return NULL;
+
+	spdu->next = NULL;
+	spdu->length = length;
+	spdu->sent = 0;
+	return spdu;
+}
+
+static void camsim_queue_spdu(struct en50221_camsim *sim, struct camsim_spdu *spdu)
+{
+	if (sim->send_queue_tail)
+		sim->send_queue_tail->next = spdu;
+	else
+		sim->send_queue = spdu;
+	sim->send_queue_tail = spdu;
+}
+
+static int camsim_apdu_header(uint8_t *buf, uint32_t tag, uint16_t length)
+{
+	buf[0] = tag >> 16;
+	buf[1] = tag >> 8;
+	buf[2] = tag;
+	return 3 + asn_1_encode(length, buf + 3, 3);
+}
+
+static void camsim_send_apdu(struct en50221_camsim *sim, int resource,
+			     uint32_t tag, uint8_t *data, uint16_t data_length)
+{
+	uint8_t hdr[6];
+	uint8_t bad_apdu[4];
+	int hdr_length;
+	int bad_apdu_length = 0;
+
+	if (sim->session_state[resource] != CAMSIM_SESSION_OPEN)
+		return;
+
+	hdr_length = camsim_apdu_header(hdr, tag, data_length);
+	if (camsim_inject_error(sim, &sim->apdu_error_count, EN50221_CAMSIM_ERROR_BADAPDU))
+		bad_apdu_length = camsim_apdu_header(bad_apdu, CAMSIM_BAD_APDU_TAG, 0);
+
+	struct camsim_spdu *spdu =
+		camsim_alloc_spdu(4 + bad_apdu_length + hdr_length + data_length);
+	if (spdu == NULL)
+		return;
+
+	uint32_t pos = 0;
+	spdu->data[pos++] = ST_SESSION_NUMBER;
+	spdu->data[pos++] = 2;
+	spdu->data[pos++] = sim->session_number[resource] >> 8;
+	spdu->data[pos++] = sim->session_number[resource];
+	memcpy(spdu->data + pos, bad_apdu, bad_apdu_length);
+	pos += bad_apdu_length;
+	memcpy(spdu->data + pos, hdr, hdr_length);
+	pos += hdr_length;
+	memcpy(spdu->data + pos, data, data_length);
+
+	camsim_queue_spdu(sim, spdu);
+}
+
+static void camsim_open_session(struct en50221_camsim *sim, int resource)
+{
+	struct camsim_spdu *spdu;
+
+	if (sim->session_state[resource] != CAMSIM_SESSION_CLOSED)
+		return;
+	if ((spdu = camsim_alloc_spdu(6)) == NULL)
+		return;
+
+	spdu->data[0] = ST_OPEN_SESSION_REQ;
+	spdu->data[1] = 4;
+	spdu->data[2] = camsim_resource_ids[resource] >> 24;
+	spdu->data[3] = camsim_resource_ids[resource] >> 16;
+	spdu->data[4] = camsim_resource_ids[resource] >> 8;
+	spdu->data[5] = camsim_resource_ids[resource];
+	camsim_queue_spdu(sim, spdu);
+
+	sim->session_state[resource] = CAMSIM_SESSION_OPENING;
+}
+
+
+
+
+static void camsim_send_menu(struct en50221_camsim *sim)
+{
+	uint8_t menu[CAMSIM_MAX_TPDU_DATA];
+	char item[16];
+	uint32_t pos = 0;
+	uint32_t i;
+
+	sim->menu_pending = 0;
+
+	menu[pos++] = sim->params.menu_items;
+	for (i = 0; i < 3 + sim->params.menu_items; i++) {
+		char *text;
+
+		switch (i) {
+		case 0:
+			text = sim->params.menu_string;
+			break;
+		case 1:
+			text = "Main menu";
+			break;
+		case 2:
+			text = "Press OK";
+			break;
+		default:
+			sprintf(item, "Item %u", i - 2);
+			text = item;
+			break;
+		}
+		pos += camsim_apdu_header(menu + pos, TAG_TEXT_LAST, strlen(text));
+		memcpy(menu + pos, text, strlen(text));
+		pos += strlen(text);
+	}
+
+	camsim_send_apdu(sim, CAMSIM_MMI, TAG_MENU_LAST, menu, pos);
+	camsim_count(sim, &sim->stats.mmi_menus);
+}
+
+static void camsim_handle_ca_pmt(struct en50221_camsim *sim, uint8_t *data, uint32_t data_length)
+{
+	uint8_t reply[CAMSIM_MAX_TPDU_DATA];
+	uint32_t reply_length = 0;
+	int ca_pmt_cmd_id = -1;
+
+	camsim_count(sim, &sim->stats.ca_pmts);
+	if (data_length < 6)
+		goto bad_data;
+
+	// the program, which is descrambled if the PMT asks for it
+	uint16_t program_info_length = ((data[4] & 0x0f) << 8) | data[5];
+	reply[reply_length++] = data[1];
+	reply[reply_length++] = data[2];
+	reply[reply_length++] = data[3];
+	reply[reply_length++] = 0x80 | CA_ENABLE_DESCRAMBLING_POSSIBLE;
+	if (program_info_length)
+		ca_pmt_cmd_id = data[6];
+
+	// and each of its streams likewise
+	uint32_t pos = 6 + program_info_length;
+	while (pos + 5 <= data_length) {
+		uint16_t es_info_length = ((data[pos + 3] & 0x0f) << 8) | data[pos + 4];
+
+		if (es_info_length && (ca_pmt_cmd_id == -1))
+			ca_pmt_cmd_id = data[pos + 5];
+		if (reply_length + 3 <= sizeof(reply)) {
+			reply[reply_length++] = 0xe0 | (data[pos + 1] & 0x1f);
+			reply[reply_length++] = data[pos + 2];
+			reply[reply_length++] = 0x80 | CA_ENABLE_DESCRAMBLING_POSSIBLE;
+		}
+		pos += 5 + es_info_length;
+	}
+	if (pos != data_length)
+		goto bad_data;
+
+	// only a query is answered
+	if (ca_pmt_cmd_id == CA_PMT_CMD_ID_QUERY) {
+		camsim_send_apdu(sim, CAMSIM_CA, TAG_CA_PMT_REPLY, reply, reply_length);
+		camsim_count(sim, &sim->stats.ca_pmt_replies);
+	}
+	return;
+
+bad_data:
+	camsim_count(sim, &sim->stats.bad_data);
+}
+
+static void camsim_handle_apdu(struct en50221_camsim *sim, int resource,
+			       uint32_t tag, uint8_t *data, uint32_t data_length)
+{
+	uint8_t buf[256 + 6];
+	uint32_t i;
+
+	switch (tag) {
+	case TAG_PROFILE_ENQUIRY:
+		// the module provides no resources of its own
+		camsim_send_apdu(sim, CAMSIM_RM, TAG_PROFILE, NULL, 0);
+		return;
+
+	case TAG_PROFILE_CHANGE:
+		camsim_send_apdu(sim, CAMSIM_RM, TAG_PROFILE_ENQUIRY, NULL, 0);
+		return;
+
+	case TAG_PROFILE:
+		// now the host's resources are known, connect to the rest
+		camsim_open_session(sim, CAMSIM_AI);
+		camsim_open_session(sim, CAMSIM_CA);
+		camsim_open_session(sim, CAMSIM_DATETIME);
+		return;
+
+	case TAG_APP_INFO_ENQUIRY:
+	{
+		uint8_t menu_string_length = strlen(sim->params.menu_string);
+		buf[0] = 0x01;	// conditional access
+		buf[1] = 0xca;
+		buf[2] = 0x5e;
+		buf[3] = 0x00;
+		buf[4] = 0x01;
+		buf[5] = menu_string_length;
+		memcpy(buf + 6, sim->params.menu_string, menu_string_length);
+		camsim_send_apdu(sim, CAMSIM_AI, TAG_APP_INFO, buf, 6 + menu_string_length);
+		return;
+	}
+
+	case TAG_ENTER_MENU:
+		sim->menu_pending = 1;
+		if (sim->session_state[CAMSIM_MMI] == CAMSIM_SESSION_OPEN)
+			camsim_send_menu(sim);
+		else
+			camsim_open_session(sim, CAMSIM_MMI);
+		return;
+
+	case TAG_CA_INFO_ENQUIRY:
+	{
+		uint8_t ids[CAMSIM_MAX_TPDU_DATA];
+		uint32_t count = sim->params.ca_system_id_count;
+
+		if (count > sizeof(ids) / 2)
+			count = sizeof(ids) / 2;
+		for (i = 0; i < count; i++) {
+			ids[i * 2] = sim->params.ca_system_ids[i] >> 8;
+			ids[(i * 2) + 1] = sim->params.ca_system_ids[i];
+		}
+		camsim_send_apdu(sim, CAMSIM_CA, TAG_CA_INFO, ids, count * 2);
+		return;
+	}
+
+	case TAG_CA_PMT:
+		camsim_handle_ca_pmt(sim, data, data_length);
+		return;
+
+	case TAG_DATE_TIME:
+		camsim_count(sim, &sim->stats.date_times);
+		return;
+
+	case TAG_MENU_ANSWER:
+		camsim_count(sim, &sim->stats.mmi_answers);
+		buf[0] = 0x00;	// close immediately
+		camsim_send_apdu(sim, CAMSIM_MMI, TAG_CLOSE_MMI, buf, 1);
+		return;
+
+	case TAG_CLOSE_MMI:
+		return;
+	}
+
+	(void) resource;
+	camsim_count(sim, &sim->stats.bad_data);
+}
+
+static void camsim_session_opened(struct en50221_camsim *sim, int resource)
+{
+	uint8_t response_interval = 0;
+
+	switch (resource) {
+	case CAMSIM_RM:
+		camsim_send_apdu(sim, CAMSIM_RM, TAG_PROFILE_ENQUIRY, NULL, 0);
+		break;
+
+	case CAMSIM_DATETIME:
+		camsim_send_apdu(sim, CAMSIM_DATETIME, TAG_DATE_TIME_ENQUIRY, &response_interval, 1);
+		break;
+
+	case CAMSIM_MMI:
+		if (sim->menu_pending)
+			camsim_send_menu(sim);
+		break;
+	}
+}
+
+static void camsim_handle_spdu(struct en50221_camsim *sim, uint8_t *data, uint32_t data_length)
+{
+	struct camsim_spdu *spdu;
+	int resource;
+
+	if (data_length < 2)
+		goto bad_data;
+
+	switch (data[0]) {
+	case ST_OPEN_SESSION_RES:
+	{
+		if ((data_length < 9) || (data[1] != 7))
+			goto bad_data;
+		uint32_t resource_id = (data[3] << 24) | (data[4] << 16) | (data[5] << 8) | data[6];
+		for (resource = 0; resource < CAMSIM_RESOURCE_COUNT; resource++) {
+			if ((camsim_resource_ids[resource] == resource_id) &&
+			    (sim->session_state[resource] == CAMSIM_SESSION_OPENING))
+				break;
+		}
+		if (resource == CAMSIM_RESOURCE_COUNT)
+			goto bad_data;
+
+		if (data[2] != S_STATUS_OPEN) {
+			sim->session_state[resource] = CAMSIM_SESSION_CLOSED;
+			return;
+		}
+		sim->session_state[resource] = CAMSIM_SESSION_OPEN;
+		sim->session_number[resource] = (data[7] << 8) | data[8];
+		camsim_count(sim, &sim->stats.sessions_opened);
+		camsim_session_opened(sim, resource);
+		return;
+	}
+
+	case ST_SESSION_NUMBER:
+	{
+		if ((data_length < 4) || (data[1] != 2))
+			goto bad_data;
+		uint16_t session_number = (data[2] << 8) | data[3];
+		for (resource = 0; resource < CAMSIM_RESOURCE_COUNT; resource++) {
+			if ((sim->session_state[resource] == CAMSIM_SESSION_OPEN) &&
+			    (sim->session_number[resource] == session_number))
+				break;
+		}
+		if (resource == CAMSIM_RESOURCE_COUNT)
+			goto bad_data;
+
+		// there may be several APDUs following
+		data += 4;
+		data_length -= 4;
+		while (data_length) {
+			uint16_t asn_data_length;
+			int length_field_len;
+
+			if ((data_length < 4) ||
+			    ((length_field_len = asn_1_decode(&asn_data_length, data + 3, data_length - 3)) < 0) ||
+			    ((uint32_t) (3 + length_field_len + asn_data_length) > data_length))
+				goto bad_data;
+
+			uint32_t tag = (data[0] << 16) | (data[1] << 8) | data[2];
+			camsim_handle_apdu(sim, resource, tag,
+					   data + 3 + length_field_len, asn_data_length);
+
+			data += 3 + length_field_len + asn_data_length;
+			data_length -= 3 + length_field_len + asn_data_length;
+		}
+		return;
+	}
+
+	case ST_CREATE_SESSION:
+		// the module offers no resources to the host
+		if ((data_length < 8) || (data[1] != 6))
+			goto bad_data;
+		if ((spdu = camsim_alloc_spdu(9)) == NULL)
+			return;
+		spdu->data[0] = ST_CREATE_SESSION_RES;
+		spdu->data[1] = 7;
+		spdu->data[2] = S_STATUS_CLOSE_NO_RES;
+		memcpy(spdu->data + 3, data + 2, 6);
+		camsim_queue_spdu(sim, spdu);
+		return;
+
+	case ST_CLOSE_SESSION_REQ:
+	{
+		if ((data_length < 4) || (data[1] != 2))
+			goto bad_data;
+		uint16_t session_number = (data[2] << 8) | data[3];
+		for (resource = 0; resource < CAMSIM_RESOURCE_COUNT; resource++) {
+			if ((sim->session_state[resource] == CAMSIM_SESSION_OPEN) &&
+			    (sim->session_number[resource] == session_number))
+				sim->session_state[resource] = CAMSIM_SESSION_CLOSED;
+		}
+		if ((spdu = camsim_alloc_spdu(5)) == NULL)
+			return;
+		spdu->data[0] = ST_CLOSE_SESSION_RES;
+		spdu->data[1] = 3;
+		spdu->data[2] = S_STATUS_OPEN;
+		spdu->data[3] = session_number >> 8;
+		spdu->data[4] = session_number;
+		camsim_queue_spdu(sim, spdu);
+		return;
+	}
+
+	case ST_CLOSE_SESSION_RES:
+		return;
+	}
+
+bad_data:
+	camsim_count(sim, &sim->stats.bad_data);
+}
+
+
+
+
+/*
+ * Append the next fragment of the head of the send queue as a T_DATA TPDU.
+ */
+static uint32_t camsim_append_data(struct en50221_camsim *sim, uint8_t *buf, uint8_t connection_id)
+{
+	struct camsim_spdu *spdu = sim->send_queue;
+	uint32_t length = spdu->length - spdu->sent;
+	uint32_t pos = 0;
+	int last = 1;
+
+	if (length > sim->params.fragment_size) {
+		length = sim->params.fragment_size;
+		last = 0;
+	}
+
+	buf[pos++] = last ? T_DATA_LAST : T_DATA_MORE;
+	pos += asn_1_encode(length + 1, buf + pos, 3);
+	buf[pos++] = connection_id;
+	memcpy(buf + pos, spdu->data + spdu->sent, length);
+	pos += length;
+
+	spdu->sent += length;
+	if (last) {
+		sim->send_queue = spdu->next;
+		if (sim->send_queue == NULL)
+			sim->send_queue_tail = NULL;
+		free(spdu);
+	}
+	return pos;
+}
+
+static void camsim_handle_tpdu(struct en50221_camsim *sim, uint8_t slot,
+			       uint8_t *data, uint32_t data_length)
+{
+	uint8_t reply[DVBCA_LINK_HEADER_SIZE + CAMSIM_MAX_TPDU_DATA + 16];
+	uint32_t pos = DVBCA_LINK_HEADER_SIZE;
+	uint16_t asn_data_length;
+	int length_field_len;
+	int send_sb = 1;
+
+	camsim_count(sim, &sim->stats.tpdus_received);
+
+	// every TPDU from the host carries at least the connection id
+	if ((data_length < 3) ||
+	    ((length_field_len = asn_1_decode(&asn_data_length, data + 1, data_length - 1)) < 0) ||
+	    (asn_data_length < 1) ||
+	    ((uint32_t) (1 + length_field_len + asn_data_length) > data_length)) {
+		camsim_count(sim, &sim->stats.bad_data);
+		return;
+	}
+	uint8_t tpdu_tag = data[0];
+	uint8_t connection_id = data[1 + length_field_len];
+	data += 1 + length_field_len + 1;
+	data_length = asn_data_length - 1;
+
+	// decide now, so a dropped or garbled reply consumes nothing
+	int error = camsim_inject_error(sim, &sim->tpdu_error_count,
+					EN50221_CAMSIM_ERROR_BADTPDU | EN50221_CAMSIM_ERROR_DROP);
+
+	switch (tpdu_tag) {
+	case T_CREATE_T_C:
+		reply[pos++] = T_C_T_C_REPLY;
+		reply[pos++] = 1;
+		reply[pos++] = connection_id;
+		if (!error && (sim->connection_id == -1)) {
+			sim->connection_id = connection_id;
+			camsim_open_session(sim, CAMSIM_RM);
+		}
+		break;
+
+	case T_DELETE_T_C:
+		reply[pos++] = T_D_T_C_REPLY;
+		reply[pos++] = 1;
+		reply[pos++] = connection_id;
+		send_sb = 0;
+		if (!error && (connection_id == sim->connection_id)) {
+			int i;
+			sim->connection_id = -1;
+			for (i = 0; i < CAMSIM_RESOURCE_COUNT; i++)
+				sim->session_state[i] = CAMSIM_SESSION_CLOSED;
+			while (sim->send_queue) {
+				struct camsim_spdu *next = sim->send_queue->next;
+				free(sim->send_queue);
+				sim->send_queue = next;
+			}
+			sim->send_queue_tail = NULL;
+		}
+		break;
+
+	case T_RCV:
+		if (!error && sim->send_queue && (connection_id == sim->connection_id))
+			pos += camsim_append_data(sim, reply + pos, connection_id);
+		break;
+
+	case T_DATA_MORE:
+	case T_DATA_LAST:
+		if (error || (data_length == 0))
+			break;
+		if ((tpdu_tag == T_DATA_MORE) || sim->chain_buffer) {
+			uint8_t *new_buffer = realloc(sim->chain_buffer, sim->chain_length + data_length);
+			if (new_buffer == NULL)
+				break;
+			memcpy(new_buffer + sim->chain_length, data, data_length);
+			sim->chain_buffer = new_buffer;
+			sim->chain_length += data_length;
+		}
+		if (tpdu_tag == T_DATA_LAST) {
+			if (sim->chain_buffer) {
+				camsim_handle_spdu(sim, sim->chain_buffer, sim->chain_length);
+				free(sim->chain_buffer);
+				sim->chain_buffer = NULL;
+				sim->chain_length = 0;
+			} else {
+				camsim_handle_spdu(sim, data, data_length);
+			}
+		}
+		break;
+
+	default:
+		camsim_count(sim, &sim->stats.bad_data);
+		break;
+	}
+
+	// say whether there is more to come
+	if (send_sb) {
+		reply[pos++] = T_SB;
+		reply[pos++] = 2;
+		reply[pos++] = connection_id;
+		reply[pos++] = (sim->send_queue && (connection_id == sim->connection_id)) ? 0x80 : 0;
+	}
+
+	if (error == EN50221_CAMSIM_ERROR_DROP)
+		return;
+	if (error == EN50221_CAMSIM_ERROR_BADTPDU)
+		reply[DVBCA_LINK_HEADER_SIZE + 1] = 0x85;
+
+	if (sim->params.latency_us)
+		usleep(sim->params.latency_us);
+	reply[0] = slot;
+	reply[1] = connection_id;
+	if (write(sim->fd, reply, pos) == (ssize_t) pos)
+		camsim_count(sim, &sim->stats.tpdus_sent);
+}
+
+static void *camsim_thread_func(void *arg)
+{
+	struct en50221_camsim *sim = (struct en50221_camsim *) arg;
+	uint8_t buf[DVBCA_LINK_HEADER_SIZE + 4096];
+	ssize_t len;
+
+	while ((len = read(sim->fd, buf, sizeof(buf))) > 0) {
+		if (len <= DVBCA_LINK_HEADER_SIZE) {
+			camsim_count(sim, &sim->stats.bad_data);
+			continue;
+		}
+		camsim_handle_tpdu(sim, buf[0], buf + DVBCA_LINK_HEADER_SIZE,
+				   len - DVBCA_LINK_HEADER_SIZE);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,123 @@
+/*
+	en50221 encoder An implementation for libdvb
+	a software CAM for driving the en50221 stack without CI hardware
+
+	This library is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as
+	published by the Free Software Foundation; either version 2.1 of
+	the License, or (at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public
+	License along with this library; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+*/
+
+#ifndef EN50221_CAMSIM_H
+#define EN50221_CAMSIM_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Errors the simulated CAM can inject, for en50221_camsim_params.error_types.
+ */
+#define EN50221_CAMSIM_ERROR_BADTPDU	0x01	/* garble the length of a link layer reply */
+#define EN50221_CAMSIM_ERROR_DROP	0x02	/* do not answer a TPDU at all */
+#define EN50221_CAMSIM_ERROR_BADAPDU	0x04	/* precede an APDU with one of an unknown tag */
+
+/**
+ * Behaviour of a simulated CAM. Any field left as zero takes a default.
+ */
+struct en50221_camsim_params {
+	/* delay before the module answers each TPDU, in microseconds */
+	uint32_t latency_us;
+
+	/* largest T_DATA payload the module sends; longer SPDUs go as T_DATA_MORE chains */
+	uint16_t fragment_size;
+
+	/* inject one of error_types into every error_interval'th reply; 0 for none */
+	uint32_t error_interval;
+	int error_types;
+
+	/* ca_system_ids reported in the ca_info; default 0x0b00 */
+	uint16_t *ca_system_ids;
+	uint32_t ca_system_id_count;
+
+	/* application info menu string, also used as the MMI menu title */
+	char *menu_string;
+
+	/* number of choices in the MMI menu; default 4 */
+	uint32_t menu_items;
+};
+
+/**
+ * Counters kept by a simulated CAM.
+ */
+struct en50221_camsim_stats {
+	uint32_t tpdus_received;
+	uint32_t tpdus_sent;
+	uint32_t sessions_opened;
+	uint32_t ca_pmts;
+	uint32_t ca_pmt_replies;
+	uint32_t mmi_menus;
+	uint32_t mmi_answers;
+	uint32_t date_times;
+	uint32_t errors_injected;
+	uint32_t bad_data;	/* malformed data received from the host */
+};
+
+/**
+ * Opaque type representing a simulated CAM.
+ */
+struct en50221_camsim;
+
+/**
+ * Create a simulated CAM. It behaves as an LLCI module in slot 0 of a CA
+ * device: it answers the link and transport layers, opens sessions to the
+ * host's resource manager, application information, CA support and date-time
+ * resources, and to MMI when the host enters the CAM menu.
+ *
+ * @param params Behaviour of the module, or NULL for the defaults.
+ * @return en50221_camsim instance, or NULL on error with errno set.
+ */
+extern struct en50221_camsim *en50221_camsim_create(struct en50221_camsim_params *params);
+
+/**
+ * Destroy a simulated CAM. The slot using it must already have been destroyed
+ * in the transport layer.
+ *
+ * @param camsim en50221_camsim instance.
+ */
+extern void en50221_camsim_destroy(struct en50221_camsim *camsim);
+
+/**
+ * Get the FD to hand to en50221_tl_register_slot() or
+ * en50221_stdcam_llci_create() in place of a CA device, with slot 0. It
+ * remains owned by the simulated CAM.
+ *
+ * @param camsim en50221_camsim instance.
+ * @return The FD.
+ */
+extern int en50221_camsim_get_fd(struct en50221_camsim *camsim);
+
+/**
+ * Take a snapshot of the counters of a simulated CAM.
+ *
+ * @param camsim en50221_camsim instance.
+ * @param stats Where to put them.
+ */
+extern void en50221_camsim_get_stats(struct en50221_camsim *camsim,
+				     struct en50221_camsim_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -61,9 +61,10 @@ struct en50221_stdcam {
 };
 
 /**
- * Create an instance of the STDCAM for an LLCI interface.
+ * Create an instance of the STDCAM for an LLCI interface. Instances for
+ * several slots may share one transport and session layer.
  *
- * @param cafd FD of the CA device.
+ * @param cafd FD of the CA device, or of an en50221_camsim.
  * @param slotnum Slotnum on that CA device.
  * @param tl Transport layer instance to use.
  * @param sl Session layer instance to use.
@@ -73,6 +74,17 @@ extern struct en50221_stdcam *en50221_stdcam_llci_create(int cafd, int slotnum,
 						  struct en50221_transport_layer *tl,
 						  struct en50221_session_layer *sl);
 
+/**
+ * Poll an LLCI STDCAM instance, as its poll function does, except for the
+ * transport layer. Where several instances share one transport layer, the
+ * application polls it once with en50221_tl_poll_wait(), then calls this
+ * for each instance, instead of polling the transport layer once per slot.
+ *
+ * @param stdcam An instance created by en50221_stdcam_llci_create().
+ * @return The status of the CAM, as from its poll function.
+ */
+extern enum en50221_stdcam_status en50221_stdcam_llci_poll_slot(struct en50221_stdcam *stdcam);
+
 /**
  * Create an instance of the STDCAM for an HLCI interface.
  *
@@ -24,6 +24,7 @@
 #include <limits.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include <libdvbapi/dvbca.h>
 #include <libdvbmisc/dvbmisc.h>
 #include "en50221_app_rm.h"
@@ -34,6 +35,7 @@
 
 #define LLCI_RESPONSE_TIMEOUT_MS 1000
 #define LLCI_POLL_DELAY_MS 100
+#define LLCI_CAMSTATE_POLL_MS 100
 
 /* resource IDs we support */
 static uint32_t resource_ids[] =
@@ -54,6 +56,7 @@ struct llci_resource {
 
 struct en50221_stdcam_llci {
 	struct en50221_stdcam stdcam;
+	struct en50221_stdcam_llci *next;
 
 	int cafd;
 	int slotnum;
@@ -75,14 +78,27 @@ struct en50221_stdcam_llci {
 	time_t datetime_dvbtime;
 };
 
+/*
+ * Every LLCI instance, so that several slots can share a session layer: its
+ * callbacks are dispatched to the instance owning the slot concerned.
+ */
+static struct en50221_stdcam_llci *llci_instances = NULL;
+static pthread_mutex_t llci_instances_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static enum en50221_stdcam_status en50221_stdcam_llci_poll(struct en50221_stdcam *stdcam);
 static void en50221_stdcam_llci_dvbtime(struct en50221_stdcam *stdcam, time_t dvbtime);
 static void en50221_stdcam_llci_destroy(struct en50221_stdcam *stdcam, int closefd);
+static void llci_poll_cam_state(struct en50221_stdcam_llci *llci);
+static void llci_poll_datetime(struct en50221_stdcam_llci *llci);
 static void llci_cam_added(struct en50221_stdcam_llci *llci);
 static void llci_cam_in_reset(struct en50221_stdcam_llci *llci);
 static void llci_cam_removed(struct en50221_stdcam_llci *llci);
 
 
+static int llci_lookup_dispatch(void *arg, uint8_t _slot_id, uint32_t requested_resource_id,
+				en50221_sl_resource_callback *callback_out, void **arg_out,
+				uint32_t *connected_resource_id);
+static int llci_session_dispatch(void *arg, int reason, uint8_t _slot_id, uint16_t session_number, uint32_t resource_id);
 static int llci_lookup_callback(void *arg, uint8_t _slot_id, uint32_t requested_resource_id,
 				en50221_sl_resource_callback *callback_out, void **arg_out,
 				uint32_t *connected_resource_id);
@@ -164,8 +180,8 @@ struct en50221_stdcam *en50221_stdcam_llci_create(int cafd, int slotnum,
 	resource_idx++;
 
 	// register session layer callbacks
-	en50221_sl_register_lookup_callback(sl, llci_lookup_callback, llci);
-	en50221_sl_register_session_callback(sl, llci_session_callback, llci);
+	en50221_sl_register_lookup_callback(sl, llci_lookup_dispatch, sl);
+	en50221_sl_register_session_callback(sl, llci_session_dispatch, sl);
 
 	// done
 	llci->stdcam.destroy = en50221_stdcam_llci_destroy;
@@ -177,6 +193,11 @@ struct en50221_stdcam *en50221_stdcam_llci_create(int cafd, int slotnum,
 	llci->sl = sl;
 	llci->tl_slot_id = -1;
 	llci->state = EN50221_STDCAM_CAM_NONE;
+
+	pthread_mutex_lock(&llci_instances_lock);
+	llci->next = llci_instances;
+	llci_instances = llci;
+	pthread_mutex_unlock(&llci_instances_lock);
 	return &llci->stdcam;
 }
 
@@ -194,6 +215,13 @@ static void en50221_stdcam_llci_destroy(struct en50221_stdcam *stdcam, int close
 	// "remove" the cam
 	llci_cam_removed(llci);
 
+	pthread_mutex_lock(&llci_instances_lock);
+	struct en50221_stdcam_llci **pprev = &llci_instances;
+	while (*pprev != llci)
+		pprev = &(*pprev)->next;
+	*pprev = llci->next;
+	pthread_mutex_unlock(&llci_instances_lock);
+
 	// destroy resources
 	if (llci->rm_resource)
 		en50221_app_rm_destroy(llci->rm_resource);
@@ -215,11 +243,50 @@ static void en50221_stdcam_llci_destroy(struct en50221_stdcam *stdcam, int close
 
 
 
+/*
+ * The state of the CAM. An FD which is not a CA device, such as that of an
+ * en50221_camsim, is a link to a CAM which is always ready.
+ */
+static int llci_cam_state(struct en50221_stdcam_llci *llci)
+{
+	int state = dvbca_get_cam_state(llci->cafd, llci->slotnum);
+
+	if ((state == -1) && (errno == ENOTTY))
+		return DVBCA_CAMSTATE_READY;
+	return state;
+}
+
 static enum en50221_stdcam_status en50221_stdcam_llci_poll(struct en50221_stdcam *stdcam)
 {
 	struct en50221_stdcam_llci *llci = (struct en50221_stdcam_llci *) stdcam;
 
-	switch(dvbca_get_cam_state(llci->cafd, llci->slotnum)) {
+	llci_poll_cam_state(llci);
+
+	// poll the stack; it wakes for anything it has to do, so only the CAM
+	// state needs checking at an interval
+	int error;
+	if ((error = en50221_tl_poll_wait(llci->tl, LLCI_CAMSTATE_POLL_MS)) != 0) {
+		print(LOG_LEVEL, ERROR, 1, "Error reported by stack:%i\n", en50221_tl_get_error(llci->tl));
+	}
+
+	llci_poll_datetime(llci);
+
+	return llci->state;
+}
+
+enum en50221_stdcam_status en50221_stdcam_llci_poll_slot(struct en50221_stdcam *stdcam)
+{
+	struct en50221_stdcam_llci *llci = (struct en50221_stdcam_llci *) stdcam;
+
+	llci_poll_cam_state(llci);
+	llci_poll_datetime(llci);
+
+	return llci->state;
+}
+
+static void llci_poll_cam_state(struct en50221_stdcam_llci *llci)
+{
+	switch(llci_cam_state(llci)) {
 	case DVBCA_CAMSTATE_MISSING:
 		if (llci->state != EN50221_STDCAM_CAM_NONE)
 			llci_cam_removed(llci);
@@ -232,13 +299,10 @@ static enum en50221_stdcam_status en50221_stdcam_llci_poll(struct en50221_stdcam
 			llci_cam_in_reset(llci);
 		break;
 	}
+}
 
-	// poll the stack
-	int error;
-	if ((error = en50221_tl_poll(llci->tl)) != 0) {
-		print(LOG_LEVEL, ERROR, 1, "Error reported by stack:%i\n", en50221_tl_get_error(llci->tl));
-	}
-
+static void llci_poll_datetime(struct en50221_stdcam_llci *llci)
+{
 	// send date/time response
 	if (llci->datetime_session_number != -1) {
 		time_t cur_time = time(NULL);
@@ -249,8 +313,6 @@ static enum en50221_stdcam_status en50221_stdcam_llci_poll(struct en50221_stdcam
 			llci->datetime_next_send = cur_time + llci->datetime_response_interval;
 		}
 	}
-
-	return llci->state;
 }
 
 static void llci_cam_added(struct en50221_stdcam_llci *llci)
@@ -267,7 +329,7 @@ static void llci_cam_added(struct en50221_stdcam_llci *llci)
 
 static void llci_cam_in_reset(struct en50221_stdcam_llci *llci)
 {
-	if (dvbca_get_cam_state(llci->cafd, llci->slotnum) != DVBCA_CAMSTATE_READY) {
+	if (llci_cam_state(llci) != DVBCA_CAMSTATE_READY) {
 		return;
 	}
 
@@ -281,8 +343,8 @@ static void llci_cam_in_reset(struct en50221_stdcam_llci *llci)
 	// create a new connection on the slot
 	if (en50221_tl_new_tc(llci->tl, llci->tl_slot_id) < 0) {
 		llci->state = EN50221_STDCAM_CAM_BAD;
-		llci->tl_slot_id = -1;
 		en50221_tl_destroy_slot(llci->tl, llci->tl_slot_id);
+		llci->tl_slot_id = -1;
 		return;
 	}
 
@@ -304,6 +366,40 @@ static void llci_cam_removed(struct en50221_stdcam_llci *llci)
 
 
 
+static struct en50221_stdcam_llci *llci_find(struct en50221_session_layer *sl, uint8_t _slot_id)
+{
+	struct en50221_stdcam_llci *llci;
+
+	pthread_mutex_lock(&llci_instances_lock);
+	for (llci = llci_instances; llci; llci = llci->next) {
+		if ((llci->sl == sl) && (llci->tl_slot_id == _slot_id))
+			break;
+	}
+	pthread_mutex_unlock(&llci_instances_lock);
+	return llci;
+}
+
+static int llci_lookup_dispatch(void *arg, uint8_t _slot_id, uint32_t requested_resource_id,
+				en50221_sl_resource_callback *callback_out, void **arg_out,
+				uint32_t *connected_resource_id)
+{
+	struct en50221_stdcam_llci *llci = llci_find((struct en50221_session_layer *) arg, _slot_id);
+
+	if (llci == NULL)
+		return -1;
+	return llci_lookup_callback(llci, _slot_id, requested_resource_id,
+				    callback_out, arg_out, connected_resource_id);
+}
+
+static int llci_session_dispatch(void *arg, int reason, uint8_t _slot_id, uint16_t session_number, uint32_t resource_id)
+{
+	struct en50221_stdcam_llci *llci = llci_find((struct en50221_session_layer *) arg, _slot_id);
+
+	if (llci == NULL)
+		return 0;
+	return llci_session_callback(llci, reason, _slot_id, session_number, resource_id);
+}
+
 static int llci_lookup_callback(void *arg, uint8_t _slot_id, uint32_t requested_resource_id,
 				en50221_sl_resource_callback *callback_out, void **arg_out,
 				uint32_t *connected_resource_id)
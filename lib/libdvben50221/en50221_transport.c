@@ -27,7 +27,9 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
 #include <time.h>
 #include <libdvbmisc/dvbmisc.h>
 #include <libdvbapi/dvbca.h>
@@ -51,9 +53,17 @@
 #define T_DATA_MORE         0xA1	// convey data from higher      constructed h<->m
 				 // layers
 
+// epoll data for the wakeup eventfd; slots use their slot_id
+#define WAKEUP_ID           0xffffffff
+
+// messages up to this size, including the struct, come from the slot's pool
+#define MESSAGE_POOL_SIZE   512
+
 struct en50221_message {
-	struct en50221_message *next;
+	struct en50221_message *next;	// in the send queue, or the pool's free list
 	uint32_t length;
+	int pooled;
+	uint8_t link_header[DVBCA_LINK_HEADER_SIZE];	// room for dvbca_link_write_prefixed()
 	uint8_t data[0];
 };
 
@@ -77,14 +87,22 @@ struct en50221_slot {
 
 	uint32_t response_timeout;
 	uint32_t poll_delay;
+
+	struct en50221_message *free_messages;	// the pool: only used under slot_lock
+
+	int pending;		// messages were queued since the slot was last serviced
+	uint64_t deadline;	// ms when a connection next needs a poll or times out, or 0
+	uint32_t generation;	// bumped each time the slot is destroyed
 };
 
 struct en50221_transport_layer {
 	uint8_t max_slots;
 	uint8_t max_connections_per_slot;
 	struct en50221_slot *slots;
-	struct pollfd *slot_pollfds;
-	int slots_changed;
+	int epoll_fd;
+	int wakeup_fd;		// eventfd: written when a message is queued
+	struct epoll_event *events;
+	uint32_t *slot_events;
 
 	pthread_mutex_t global_lock;
 	pthread_mutex_t setcallback_lock;
@@ -132,6 +150,88 @@ static int en50221_tl_handle_sb(struct en50221_transport_layer *tl,
 				uint8_t slot_id, uint8_t connection_id,
 				uint8_t * data, uint32_t data_length);
 
+static inline uint64_t timeval_ms(struct timeval *tv)
+{
+	struct timeval nowtime;
+
+	if (tv == NULL) {
+		gettimeofday(&nowtime, 0);
+		tv = &nowtime;
+	}
+	return ((uint64_t) tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+}
+
+/*
+ * Messages are queued and freed under their slot's lock, so each slot keeps
+ * its own pool of fixed size messages for the send queues. The pool grows to
+ * the most messages ever queued at once, and is freed with the transport layer.
+ */
+static struct en50221_message *message_alloc(struct en50221_slot *slot, uint32_t length)
+{
+	struct en50221_message *msg;
+
+	if (sizeof(struct en50221_message) + length > MESSAGE_POOL_SIZE) {
+		msg = malloc(sizeof(struct en50221_message) + length);
+		if (msg)
+			msg->pooled = 0;
+	} else if (slot->free_messages) {
+		msg = slot->free_messages;
+		slot->free_messages = msg->next;
+	} else {
+		msg = malloc(MESSAGE_POOL_SIZE);
+		if (msg)
+			msg->pooled = 1;
+	}
+	if (msg == NULL)
+		return NULL;
+
+	msg->next = NULL;
+	msg->length = length;
+	return msg;
+}
+
+static void message_free(struct en50221_slot *slot, struct en50221_message *msg)
+{
+	if (msg->pooled) {
+		msg->next = slot->free_messages;
+		slot->free_messages = msg;
+	} else {
+		free(msg);
+	}
+}
+
+/*
+ * When the slot next needs servicing without any data from the module: the
+ * earliest poll or response timeout of its connections, in the same terms as
+ * the time_after() checks in en50221_tl_poll_wait(). 0 if there is none.
+ */
+static uint64_t en50221_tl_slot_deadline(struct en50221_transport_layer *tl, uint8_t slot_id)
+{
+	struct en50221_slot *slot = &tl->slots[slot_id];
+	uint64_t deadline = 0;
+	uint64_t due;
+	int j;
+
+	for (j = 0; j < tl->max_connections_per_slot; j++) {
+		struct en50221_connection *conn = &slot->connections[j];
+
+		if (conn->state == T_STATE_IDLE)
+			continue;
+		if (conn->tx_time.tv_sec)
+			due = timeval_ms(&conn->tx_time) + slot->response_timeout + 1;
+		else if (conn->send_queue &&
+			 (conn->state & (T_STATE_IN_CREATION | T_STATE_ACTIVE | T_STATE_ACTIVE_DELETEQUEUED)))
+			due = 1;
+		else if (conn->state & T_STATE_ACTIVE)
+			due = timeval_ms(&conn->last_poll_time) + slot->poll_delay + 1;
+		else
+			continue;
+		if ((deadline == 0) || (due < deadline))
+			deadline = due;
+	}
+
+	return deadline;
+}
 
 struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 						  uint8_t
@@ -149,8 +249,10 @@ struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 	tl->max_slots = max_slots;
 	tl->max_connections_per_slot = max_connections_per_slot;
 	tl->slots = NULL;
-	tl->slot_pollfds = NULL;
-	tl->slots_changed = 1;
+	tl->epoll_fd = -1;
+	tl->wakeup_fd = -1;
+	tl->events = NULL;
+	tl->slot_events = NULL;
 	tl->callback = NULL;
 	tl->callback_arg = NULL;
 	tl->error_slot = 0;
@@ -166,6 +268,10 @@ struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 	// set them up
 	for (i = 0; i < max_slots; i++) {
 		tl->slots[i].ca_hndl = -1;
+		tl->slots[i].free_messages = NULL;
+		tl->slots[i].pending = 0;
+		tl->slots[i].deadline = 0;
+		tl->slots[i].generation = 0;
 
 		// create the connections for this slot
 		tl->slots[i].connections =
@@ -189,12 +295,20 @@ struct en50221_transport_layer *en50221_tl_create(uint8_t max_slots,
 		}
 	}
 
-	// create the pollfds
-	tl->slot_pollfds = malloc(sizeof(struct pollfd) * max_slots);
-	if (tl->slot_pollfds == NULL) {
+	// the slots' CA devices and the wakeup eventfd are waited on together
+	tl->events = malloc(sizeof(struct epoll_event) * (max_slots + 1));
+	tl->slot_events = malloc(sizeof(uint32_t) * max_slots);
+	if ((tl->events == NULL) || (tl->slot_events == NULL))
+		goto error_exit;
+	if ((tl->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		goto error_exit;
+	if ((tl->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+		goto error_exit;
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.u32 = WAKEUP_ID;
+	if (epoll_ctl(tl->epoll_fd, EPOLL_CTL_ADD, tl->wakeup_fd, &ev))
 		goto error_exit;
-	}
-	memset(tl->slot_pollfds, 0, sizeof(struct pollfd) * max_slots);
 
 	return tl;
 
@@ -227,15 +341,24 @@ void en50221_tl_destroy(struct en50221_transport_layer *tl)
 						tl->slots[i].connections[j].send_queue = NULL;
 						tl->slots[i].connections[j].send_queue_tail = NULL;
 					}
+					while (tl->slots[i].free_messages) {
+						struct en50221_message *next_msg =
+							tl->slots[i].free_messages->next;
+						free(tl->slots[i].free_messages);
+						tl->slots[i].free_messages = next_msg;
+					}
 					free(tl->slots[i].connections);
 					pthread_mutex_destroy(&tl->slots[i].slot_lock);
 				}
 			}
 			free(tl->slots);
 		}
-		if (tl->slot_pollfds) {
-			free(tl->slot_pollfds);
-		}
+		if (tl->epoll_fd != -1)
+			close(tl->epoll_fd);
+		if (tl->wakeup_fd != -1)
+			close(tl->wakeup_fd);
+		free(tl->events);
+		free(tl->slot_events);
 		pthread_mutex_destroy(&tl->setcallback_lock);
 		pthread_mutex_destroy(&tl->global_lock);
 		free(tl);
@@ -273,9 +396,23 @@ int en50221_tl_register_slot(struct en50221_transport_layer *tl,
 	tl->slots[slot_id].slot = slot;
 	tl->slots[slot_id].response_timeout = response_timeout;
 	tl->slots[slot_id].poll_delay = poll_delay;
+	tl->slots[slot_id].pending = 0;
+	tl->slots[slot_id].deadline = 0;
 	pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 
-	tl->slots_changed = 1;
+	// several slots may share a CA device: its events go to the first of them
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.u32 = slot_id;
+	if (epoll_ctl(tl->epoll_fd, EPOLL_CTL_ADD, ca_hndl, &ev) && (errno != EEXIST)) {
+		pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
+		tl->slots[slot_id].ca_hndl = -1;
+		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
+		tl->error = EN50221ERR_CAREAD;
+		pthread_mutex_unlock(&tl->global_lock);
+		return -1;
+	}
+
 	pthread_mutex_unlock(&tl->global_lock);
 	return slot_id;
 }
@@ -293,7 +430,11 @@ void en50221_tl_destroy_slot(struct en50221_transport_layer *tl,
 
 	// clear the slot
 	pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
+	int ca_hndl = tl->slots[slot_id].ca_hndl;
 	tl->slots[slot_id].ca_hndl = -1;
+	tl->slots[slot_id].generation++;
+	tl->slots[slot_id].pending = 0;
+	tl->slots[slot_id].deadline = 0;
 	for (i = 0; i < tl->max_connections_per_slot; i++) {
 		tl->slots[slot_id].connections[i].state = T_STATE_IDLE;
 		tl->slots[slot_id].connections[i].tx_time.tv_sec = 0;
@@ -310,7 +451,7 @@ void en50221_tl_destroy_slot(struct en50221_transport_layer *tl,
 		    tl->slots[slot_id].connections[i].send_queue;
 		while (cur_msg) {
 			struct en50221_message *next_msg = cur_msg->next;
-			free(cur_msg);
+			message_free(&tl->slots[slot_id], cur_msg);
 			cur_msg = next_msg;
 		}
 		tl->slots[slot_id].connections[i].send_queue = NULL;
@@ -326,42 +467,86 @@ void en50221_tl_destroy_slot(struct en50221_transport_layer *tl,
 	if (cb)
 		cb(cb_arg, T_CALLBACK_REASON_SLOTCLOSE, NULL, 0, slot_id, 0);
 
-	tl->slots_changed = 1;
+	// hand the CA device's events to another slot using it, if there is one
+	if (ca_hndl != -1) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLPRI;
+		for (i = 0; i < tl->max_slots; i++) {
+			if (tl->slots[i].ca_hndl == ca_hndl)
+				break;
+		}
+		ev.data.u32 = i;
+		if (i < tl->max_slots)
+			epoll_ctl(tl->epoll_fd, EPOLL_CTL_MOD, ca_hndl, &ev);
+		else
+			epoll_ctl(tl->epoll_fd, EPOLL_CTL_DEL, ca_hndl, &ev);
+	}
 	pthread_mutex_unlock(&tl->global_lock);
 }
 
 int en50221_tl_poll(struct en50221_transport_layer *tl)
 {
-	uint8_t data[4096];
+	return en50221_tl_poll_wait(tl, 10);
+}
+
+void en50221_tl_wakeup(struct en50221_transport_layer *tl)
+{
+	uint64_t one = 1;
+
+	if (write(tl->wakeup_fd, &one, sizeof(one)) < 0) {
+		// the counter can only be full if a wakeup is already pending
+	}
+}
+
+int en50221_tl_poll_wait(struct en50221_transport_layer *tl, int timeout_ms)
+{
+	uint8_t buf[DVBCA_LINK_HEADER_SIZE + 4096];
+	uint8_t *data = buf + DVBCA_LINK_HEADER_SIZE;
+	uint64_t now;
+	uint64_t deadline;
 	int slot_id;
+	int count;
+	int i;
 	int j;
 
-	// make up pollfds if the slots have changed
-	pthread_mutex_lock(&tl->global_lock);
-	if (tl->slots_changed) {
-		for (slot_id = 0; slot_id < tl->max_slots; slot_id++) {
-			if (tl->slots[slot_id].ca_hndl != -1) {
-				tl->slot_pollfds[slot_id].fd = tl->slots[slot_id].ca_hndl;
-				tl->slot_pollfds[slot_id].events = POLLIN | POLLPRI | POLLERR;
-				tl->slot_pollfds[slot_id].revents = 0;
-			} else {
-				tl->slot_pollfds[slot_id].fd = 0;
-				tl->slot_pollfds[slot_id].events = 0;
-				tl->slot_pollfds[slot_id].revents = 0;
-			}
-		}
-		tl->slots_changed = 0;
+	// wait no longer than the first connection which needs a poll or times out
+	now = timeval_ms(NULL);
+	for (slot_id = 0; slot_id < tl->max_slots; slot_id++) {
+		deadline = __atomic_load_n(&tl->slots[slot_id].deadline, __ATOMIC_RELAXED);
+		if (deadline && ((timeout_ms < 0) || (deadline < now + timeout_ms)))
+			timeout_ms = (deadline > now) ? (int) (deadline - now) : 0;
 	}
-	pthread_mutex_unlock(&tl->global_lock);
 
 	// anything happened?
-	if (poll(tl->slot_pollfds, tl->max_slots, 10) < 0) {
-		tl->error_slot = -1;
-		tl->error = EN50221ERR_CAREAD;
-		return -1;
+	count = epoll_wait(tl->epoll_fd, tl->events, tl->max_slots + 1, timeout_ms);
+	if (count < 0) {
+		if (errno != EINTR) {
+			tl->error_slot = -1;
+			tl->error = EN50221ERR_CAREAD;
+			return -1;
+		}
+		count = 0;
 	}
-	// go through all slots (even though poll may not have reported any events
+	memset(tl->slot_events, 0, sizeof(uint32_t) * tl->max_slots);
+	for (i = 0; i < count; i++) {
+		if (tl->events[i].data.u32 == WAKEUP_ID) {
+			uint64_t wakeups;
+			if (read(tl->wakeup_fd, &wakeups, sizeof(wakeups)) < 0) {
+				// another thread's poll consumed it
+			}
+		} else if (tl->events[i].data.u32 < tl->max_slots) {
+			tl->slot_events[tl->events[i].data.u32] |= tl->events[i].events;
+		}
+	}
+
+	// service the slots with data, queued messages, or a connection which is due
+	now = timeval_ms(NULL);
 	for (slot_id = 0; slot_id < tl->max_slots; slot_id++) {
+		deadline = __atomic_load_n(&tl->slots[slot_id].deadline, __ATOMIC_RELAXED);
+		if ((tl->slot_events[slot_id] == 0) &&
+		    (!__atomic_load_n(&tl->slots[slot_id].pending, __ATOMIC_ACQUIRE)) &&
+		    ((deadline == 0) || (deadline > now)))
+			continue;
 
 		// check if this slot is still used and get its handle
 		pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
@@ -370,14 +555,19 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 			continue;
 		}
 		int ca_hndl = tl->slots[slot_id].ca_hndl;
+		tl->slots[slot_id].pending = 0;
 
-		if (tl->slot_pollfds[slot_id].revents & (POLLPRI | POLLIN)) {
+		// come back soon if this pass bails out on an error
+		__atomic_store_n(&tl->slots[slot_id].deadline, now + tl->slots[slot_id].poll_delay,
+				 __ATOMIC_RELAXED);
+
+		if (tl->slot_events[slot_id] & (EPOLLPRI | EPOLLIN)) {
 			// read data
 			uint8_t r_slot_id;
 			uint8_t connection_id;
-			int readcnt = dvbca_link_read(ca_hndl, &r_slot_id,
-						      &connection_id,
-						      data, sizeof(data));
+			int readcnt = dvbca_link_read_prefixed(ca_hndl, &r_slot_id,
+							       &connection_id,
+							       buf, sizeof(buf));
 			if (readcnt < 0) {
 				tl->error_slot = slot_id;
 				tl->error = EN50221ERR_CAREAD;
@@ -402,7 +592,10 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 							pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 							return -1;
 						}
+						// its connections' deadlines are recalculated on the next pass
+						__atomic_store_n(&tl->slots[new_slot_id].pending, 1, __ATOMIC_RELEASE);
 						pthread_mutex_unlock(&tl->slots[new_slot_id].slot_lock);
+						en50221_tl_wakeup(tl);
 					} else {
 						tl->error = EN50221ERR_BADSLOTID;
 						pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
@@ -414,7 +607,7 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 					return -1;
 				}
 			}
-		} else if (tl->slot_pollfds[slot_id].revents & POLLERR) {
+		} else if (tl->slot_events[slot_id] & (EPOLLERR | EPOLLHUP)) {
 			// an error was reported
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAREAD;
@@ -445,11 +638,11 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 					}
 
 					// send the message
-					if (dvbca_link_write(tl->slots[slot_id].ca_hndl,
-					    		     tl->slots[slot_id].slot,
-							     j,
-							     msg->data, msg->length) < 0) {
-						free(msg);
+					if (dvbca_link_write_prefixed(tl->slots[slot_id].ca_hndl,
+								      tl->slots[slot_id].slot,
+								      j,
+								      msg->link_header, msg->length) < 0) {
+						message_free(&tl->slots[slot_id], msg);
 						pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 						tl->error_slot = slot_id;
 						tl->error = EN50221ERR_CAWRITE;
@@ -468,7 +661,7 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 						tl->slots[slot_id].connections[j].buffer_length = 0;
 					}
 
-					free(msg);
+					message_free(&tl->slots[slot_id], msg);
 				}
 			}
 			// poll it if we're not expecting a reponse and the poll time has elapsed
@@ -502,6 +695,8 @@ int en50221_tl_poll(struct en50221_transport_layer *tl)
 				}
 			}
 		}
+		__atomic_store_n(&tl->slots[slot_id].deadline, en50221_tl_slot_deadline(tl, slot_id),
+				 __ATOMIC_RELAXED);
 		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 	}
 
@@ -531,65 +726,11 @@ int en50221_tl_send_data(struct en50221_transport_layer *tl,
 			 uint8_t slot_id, uint8_t connection_id,
 			 uint8_t * data, uint32_t data_size)
 {
-#ifdef DEBUG_TXDATA
-	printf("[[[[[[[[[[[[[[[[[[[[\n");
-	uint32_t ii = 0;
-	for (ii = 0; ii < data_size; ii++) {
-		printf("%02x: %02x\n", ii, data[ii]);
-	}
-	printf("]]]]]]]]]]]]]]]]]]]]\n");
-#endif
+	struct iovec iov;
 
-	if (slot_id >= tl->max_slots) {
-		tl->error = EN50221ERR_BADSLOTID;
-		return -1;
-	}
-
-	pthread_mutex_lock(&tl->slots[slot_id].slot_lock);
-	if (tl->slots[slot_id].ca_hndl == -1) {
-		tl->error = EN50221ERR_BADSLOTID;
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-		return -1;
-	}
-	if (connection_id >= tl->max_connections_per_slot) {
-		tl->error_slot = slot_id;
-		tl->error = EN50221ERR_BADCONNECTIONID;
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-		return -1;
-	}
-	if (tl->slots[slot_id].connections[connection_id].state != T_STATE_ACTIVE) {
-		tl->error = EN50221ERR_BADCONNECTIONID;
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-		return -1;
-	}
-	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + data_size + 10);
-	if (msg == NULL) {
-		tl->error_slot = slot_id;
-		tl->error = EN50221ERR_OUTOFMEMORY;
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-		return -1;
-	}
-	// make up data to send
-	int length_field_len;
-	msg->data[0] = T_DATA_LAST;
-	if ((length_field_len = asn_1_encode(data_size + 1, msg->data + 1, 3)) < 0) {
-		free(msg);
-		tl->error_slot = slot_id;
-		tl->error = EN50221ERR_ASNENCODE;
-		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-		return -1;
-	}
-	msg->data[1 + length_field_len] = connection_id;
-	memcpy(msg->data + 1 + length_field_len + 1, data, data_size);
-	msg->length = 1 + length_field_len + 1 + data_size;
-
-	// queue it for transmission
-	queue_message(tl, slot_id, connection_id, msg);
-
-	pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
-	return 0;
+	iov.iov_base = data;
+	iov.iov_len = data_size;
+	return en50221_tl_send_datav(tl, slot_id, connection_id, &iov, 1);
 }
 
 int en50221_tl_send_datav(struct en50221_transport_layer *tl,
@@ -640,30 +781,31 @@ int en50221_tl_send_datav(struct en50221_transport_layer *tl,
 		data_size += vector[i].iov_len;
 	}
 
-	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + data_size + 10);
-	if (msg == NULL) {
+	// make up the header
+	uint8_t hdr[5];
+	int length_field_len;
+	hdr[0] = T_DATA_LAST;
+	if ((length_field_len = asn_1_encode(data_size + 1, hdr + 1, 3)) < 0) {
 		tl->error_slot = slot_id;
-		tl->error = EN50221ERR_OUTOFMEMORY;
+		tl->error = EN50221ERR_ASNENCODE;
 		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 		return -1;
 	}
-	// make up data to send
-	int length_field_len;
-	msg->data[0] = T_DATA_LAST;
-	if ((length_field_len = asn_1_encode(data_size + 1, msg->data + 1, 3)) < 0) {
-		free(msg);
+	hdr[1 + length_field_len] = connection_id;
+
+	// allocate msg structure
+	struct en50221_message *msg =
+	    message_alloc(&tl->slots[slot_id], 1 + length_field_len + 1 + data_size);
+	if (msg == NULL) {
 		tl->error_slot = slot_id;
-		tl->error = EN50221ERR_ASNENCODE;
+		tl->error = EN50221ERR_OUTOFMEMORY;
 		pthread_mutex_unlock(&tl->slots[slot_id].slot_lock);
 		return -1;
 	}
-	msg->data[1 + length_field_len] = connection_id;
-	msg->length = 1 + length_field_len + 1 + data_size;
-	msg->next = NULL;
+	memcpy(msg->data, hdr, 1 + length_field_len + 1);
 
-	// merge the iovecs
+	// merge the iovecs: the only copy of the data, as it is sent from the
+	// message after the caller's buffers have gone
 	uint32_t pos = 1 + length_field_len + 1;
 	for (i = 0; i < iov_count; i++) {
 		memcpy(msg->data + pos, vector[i].iov_base,
@@ -701,8 +843,7 @@ int en50221_tl_new_tc(struct en50221_transport_layer *tl, uint8_t slot_id)
 		return -1;
 	}
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + 3);
+	struct en50221_message *msg = message_alloc(&tl->slots[slot_id], 3);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -713,8 +854,6 @@ int en50221_tl_new_tc(struct en50221_transport_layer *tl, uint8_t slot_id)
 	msg->data[0] = T_CREATE_T_C;
 	msg->data[1] = 1;
 	msg->data[2] = conid;
-	msg->length = 3;
-	msg->next = NULL;
 
 	// queue it for transmission
 	queue_message(tl, slot_id, conid, msg);
@@ -753,8 +892,7 @@ int en50221_tl_del_tc(struct en50221_transport_layer *tl, uint8_t slot_id,
 		return -1;
 	}
 	// allocate msg structure
-	struct en50221_message *msg =
-	    malloc(sizeof(struct en50221_message) + 3);
+	struct en50221_message *msg = message_alloc(&tl->slots[slot_id], 3);
 	if (msg == NULL) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_OUTOFMEMORY;
@@ -765,8 +903,6 @@ int en50221_tl_del_tc(struct en50221_transport_layer *tl, uint8_t slot_id,
 	msg->data[0] = T_DELETE_T_C;
 	msg->data[1] = 1;
 	msg->data[2] = connection_id;
-	msg->length = 3;
-	msg->next = NULL;
 
 	// queue it for transmission
 	queue_message(tl, slot_id, connection_id, msg);
@@ -814,13 +950,14 @@ static int en50221_tl_poll_tc(struct en50221_transport_layer *tl,
 		     tx_time, 0);
 
 	// send command
-	uint8_t hdr[3];
+	uint8_t link_buf[DVBCA_LINK_HEADER_SIZE + 3];
+	uint8_t *hdr = link_buf + DVBCA_LINK_HEADER_SIZE;
 	hdr[0] = T_DATA_LAST;
 	hdr[1] = 1;
 	hdr[2] = connection_id;
-	if (dvbca_link_write(tl->slots[slot_id].ca_hndl,
-	    		     tl->slots[slot_id].slot,
-			     connection_id, hdr, 3) < 0) {
+	if (dvbca_link_write_prefixed(tl->slots[slot_id].ca_hndl,
+				      tl->slots[slot_id].slot,
+				      connection_id, link_buf, 3) < 0) {
 		tl->error_slot = slot_id;
 		tl->error = EN50221ERR_CAWRITE;
 		return -1;
@@ -833,6 +970,7 @@ static int en50221_tl_process_data(struct en50221_transport_layer *tl,
 				   uint8_t slot_id, uint8_t * data,
 				   uint32_t data_length)
 {
+	uint32_t generation = tl->slots[slot_id].generation;
 	int result;
 
 #ifdef DEBUG_RXDATA
@@ -936,6 +1074,12 @@ static int en50221_tl_process_data(struct en50221_transport_layer *tl,
 			return -1;
 		}
 
+		// the slot lock is dropped around data callbacks, so the slot
+		// may have been destroyed (and reused) under us; the rest is no
+		// longer wanted
+		if (tl->slots[slot_id].generation != generation)
+			return 0;
+
 		// skip over the consumed data
 		data += asn_data_length;
 		data_length -= asn_data_length;
@@ -989,13 +1133,14 @@ static int en50221_tl_handle_delete_tc(struct en50221_transport_layer *tl,
 		tl->slots[slot_id].connections[connection_id].buffer_length = 0;
 
 		// send the reply
-		uint8_t hdr[3];
+		uint8_t link_buf[DVBCA_LINK_HEADER_SIZE + 3];
+		uint8_t *hdr = link_buf + DVBCA_LINK_HEADER_SIZE;
 		hdr[0] = T_D_T_C_REPLY;
 		hdr[1] = 1;
 		hdr[2] = connection_id;
-		if (dvbca_link_write(tl->slots[slot_id].ca_hndl,
-		    		     tl->slots[slot_id].slot,
-				     connection_id, hdr, 3) < 0) {
+		if (dvbca_link_write_prefixed(tl->slots[slot_id].ca_hndl,
+					      tl->slots[slot_id].slot,
+					      connection_id, link_buf, 3) < 0) {
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAWRITE;
 			return -1;
@@ -1052,12 +1197,13 @@ static int en50221_tl_handle_request_tc(struct en50221_transport_layer *tl,
 		      slot_id);
 
 		// send the error
-		uint8_t hdr[4];
+		uint8_t link_buf[DVBCA_LINK_HEADER_SIZE + 4];
+		uint8_t *hdr = link_buf + DVBCA_LINK_HEADER_SIZE;
 		hdr[0] = T_T_C_ERROR;
 		hdr[1] = 2;
 		hdr[2] = connection_id;
 		hdr[3] = 1;
-		if (dvbca_link_write(ca_hndl, tl->slots[slot_id].slot, connection_id, hdr, 4) < 0) {
+		if (dvbca_link_write_prefixed(ca_hndl, tl->slots[slot_id].slot, connection_id, link_buf, 4) < 0) {
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAWRITE;
 			return -1;
@@ -1066,12 +1212,13 @@ static int en50221_tl_handle_request_tc(struct en50221_transport_layer *tl,
 		    tv_sec = 0;
 	} else {
 		// send the NEW_T_C on the connection we received it on
-		uint8_t hdr[4];
+		uint8_t link_buf[DVBCA_LINK_HEADER_SIZE + 4];
+		uint8_t *hdr = link_buf + DVBCA_LINK_HEADER_SIZE;
 		hdr[0] = T_NEW_T_C;
 		hdr[1] = 2;
 		hdr[2] = connection_id;
 		hdr[3] = conid;
-		if (dvbca_link_write(ca_hndl, tl->slots[slot_id].slot, connection_id, hdr, 4) < 0) {
+		if (dvbca_link_write_prefixed(ca_hndl, tl->slots[slot_id].slot, connection_id, link_buf, 4) < 0) {
 			tl->slots[slot_id].connections[conid].state = T_STATE_IDLE;
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAWRITE;
@@ -1083,7 +1230,7 @@ static int en50221_tl_handle_request_tc(struct en50221_transport_layer *tl,
 		hdr[0] = T_CREATE_T_C;
 		hdr[1] = 1;
 		hdr[2] = conid;
-		if (dvbca_link_write(ca_hndl, tl->slots[slot_id].slot, conid, hdr, 3) < 0) {
+		if (dvbca_link_write_prefixed(ca_hndl, tl->slots[slot_id].slot, conid, link_buf, 3) < 0) {
 			tl->slots[slot_id].connections[conid].state = T_STATE_IDLE;
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAWRITE;
@@ -1237,11 +1384,12 @@ static int en50221_tl_handle_sb(struct en50221_transport_layer *tl,
 		int ca_hndl = tl->slots[slot_id].ca_hndl;
 
 		// send the RCV
-		uint8_t hdr[3];
+		uint8_t link_buf[DVBCA_LINK_HEADER_SIZE + 3];
+		uint8_t *hdr = link_buf + DVBCA_LINK_HEADER_SIZE;
 		hdr[0] = T_RCV;
 		hdr[1] = 1;
 		hdr[2] = connection_id;
-		if (dvbca_link_write(ca_hndl, tl->slots[slot_id].slot, connection_id, hdr, 3) < 0) {
+		if (dvbca_link_write_prefixed(ca_hndl, tl->slots[slot_id].slot, connection_id, link_buf, 3) < 0) {
 			tl->error_slot = slot_id;
 			tl->error = EN50221ERR_CAWRITE;
 			return -1;
@@ -1293,4 +1441,8 @@ static void queue_message(struct en50221_transport_layer *tl,
 		tl->slots[slot_id].connections[connection_id].send_queue = msg;
 		tl->slots[slot_id].connections[connection_id].send_queue_tail = msg;
 	}
+
+	// send it now, rather than on the poller's next timeout
+	__atomic_store_n(&tl->slots[slot_id].pending, 1, __ATOMIC_RELEASE);
+	en50221_tl_wakeup(tl);
 }
@@ -131,6 +131,29 @@ extern void en50221_tl_destroy_slot(struct en50221_transport_layer *tl, uint8_t
  */
 extern int en50221_tl_poll(struct en50221_transport_layer *tl);
 
+/**
+ * Performs one iteration of the transport layer poll, as en50221_tl_poll(),
+ * but waits up to timeout_ms for something to do. It returns as soon as data
+ * arrives from a module, a message is queued for sending (from any thread),
+ * or a connection is due to be polled or has timed out, so it need not be
+ * called any more often than the application needs to do other work.
+ *
+ * en50221_tl_poll() is en50221_tl_poll_wait() with a 10ms timeout.
+ *
+ * @param tl The en50221_transport_layer instance.
+ * @param timeout_ms Maximum time to wait in ms, or -1 to wait until there is something to do.
+ * @return 0 on succes, or -1 if there was an error of some sort.
+ */
+extern int en50221_tl_poll_wait(struct en50221_transport_layer *tl, int timeout_ms);
+
+/**
+ * Make a call to en50221_tl_poll_wait() in another thread return now, e.g.
+ * when the application is shutting down.
+ *
+ * @param tl The en50221_transport_layer instance.
+ */
+extern void en50221_tl_wakeup(struct en50221_transport_layer *tl);
+
 /**
  * Register the callback for data reception.
  *
@@ -0,0 +1,74 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/atsc/vct_view.h>
+#include <libucsi/atsc/section.h>
+
+const struct atsc_vct_view *atsc_vct_view_init(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = section_ext_view_data(ext);
+	size_t pos = ATSC_VCT_VIEW_SIZE;
+	size_t len = section_ext_view_length(ext);
+	size_t descriptors_length;
+	int idx;
+
+	switch(section_ext_view_table_id(ext)) {
+	case stag_atsc_terrestrial_virtual_channel:
+	case stag_atsc_cable_virtual_channel:
+		break;
+	default:
+		return NULL;
+	}
+
+	if (len < ATSC_VCT_VIEW_SIZE)
+		return NULL;
+
+	for (idx = 0; idx < buf[9]; idx++) {
+		if ((pos + ATSC_VCT_CHANNEL_VIEW_SIZE) > len)
+			return NULL;
+
+		descriptors_length = load_be16(buf + pos + 30) & 0x3ff;
+		pos += ATSC_VCT_CHANNEL_VIEW_SIZE;
+
+		if ((pos + descriptors_length) > len)
+			return NULL;
+		if (verify_descriptors(buf + pos, descriptors_length))
+			return NULL;
+
+		pos += descriptors_length;
+	}
+
+	if ((pos + ATSC_VCT_VIEW_PART2_SIZE) > len)
+		return NULL;
+
+	descriptors_length = load_be16(buf + pos) & 0x3ff;
+	pos += ATSC_VCT_VIEW_PART2_SIZE;
+
+	if ((pos + descriptors_length) > len)
+		return NULL;
+
+	if (verify_descriptors(buf + pos, descriptors_length))
+		return NULL;
+
+	pos += descriptors_length;
+
+	if (pos != len)
+		return NULL;
+
+	return (const struct atsc_vct_view *) ext;
+}
@@ -0,0 +1,388 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_ATSC_VCT_VIEW_H
+#define _UCSI_ATSC_VCT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed TVCT or CVCT section.
+ * The two tables share a layout; path_select and out_of_band are only
+ * meaningful in a CVCT.
+ */
+struct atsc_vct_view;
+
+/**
+ * Opaque type for a view of a channel within an atsc_vct_view.
+ */
+struct atsc_vct_channel_view;
+
+#define ATSC_VCT_VIEW_SIZE (sizeof(struct section_ext) + 2)
+#define ATSC_VCT_CHANNEL_VIEW_SIZE 32
+#define ATSC_VCT_VIEW_PART2_SIZE 2
+
+/**
+ * Validate a TVCT or CVCT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the atsc_vct_view, or NULL on error.
+ */
+extern const struct atsc_vct_view *atsc_vct_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of a VCT.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *atsc_vct_view_head(const struct atsc_vct_view *vct)
+{
+	return (const struct section_ext_view *) vct;
+}
+
+/**
+ * Accessor for the transport_stream_id field of a VCT.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @return The transport_stream_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_view_transport_stream_id(const struct atsc_vct_view *vct)
+{
+	return section_ext_view_table_id_ext(atsc_vct_view_head(vct));
+}
+
+/**
+ * Accessor for the protocol_version field of a VCT.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @return The protocol_version.
+ */
+static inline __attribute__((always_inline))
+	uint8_t atsc_vct_view_protocol_version(const struct atsc_vct_view *vct)
+{
+	return ((const uint8_t *) vct)[8];
+}
+
+/**
+ * Accessor for the num_channels_in_section field of a VCT.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @return The num_channels_in_section.
+ */
+static inline __attribute__((always_inline))
+	uint8_t atsc_vct_view_num_channels_in_section(const struct atsc_vct_view *vct)
+{
+	return ((const uint8_t *) vct)[9];
+}
+
+/**
+ * Iterator for the channels field of an atsc_vct_view.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @param pos Variable holding a pointer to the current atsc_vct_channel_view.
+ * @param idx Integer used to count which channel we are in.
+ */
+#define atsc_vct_view_channels_for_each(vct, pos, idx) \
+	for ((pos) = atsc_vct_view_channels_first(vct), idx=0; \
+	     (pos); \
+	     (pos) = atsc_vct_view_channels_next(vct, pos, ++idx))
+
+/**
+ * Accessor for the additional descriptors of a VCT, which follow the channels.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @param len Set to the length of the descriptors in bytes.
+ * @return Pointer to the start of the descriptors.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *atsc_vct_view_additional_descriptors(const struct atsc_vct_view *vct, size_t *len);
+
+/**
+ * Iterator for the additional descriptors of an atsc_vct_view.
+ *
+ * @param vct atsc_vct_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ * @param len size_t variable used to hold the descriptors length.
+ */
+#define atsc_vct_view_descriptors_for_each(vct, pos, len) \
+	descriptor_view_for_each(atsc_vct_view_additional_descriptors(vct, &(len)), len, pos)
+
+/**
+ * Accessor for the short_name field of a VCT channel. This is 7 network
+ * ordered UTF-16 characters.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return Pointer to the 14 byte short_name.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *atsc_vct_channel_view_short_name(const struct atsc_vct_channel_view *channel)
+{
+	return (const uint8_t *) channel;
+}
+
+/**
+ * Accessor for the major_channel_number field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The major_channel_number.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_major_channel_number(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be32((const uint8_t *) channel + 14) >> 18) & 0x3ff;
+}
+
+/**
+ * Accessor for the minor_channel_number field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The minor_channel_number.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_minor_channel_number(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be32((const uint8_t *) channel + 14) >> 8) & 0x3ff;
+}
+
+/**
+ * Accessor for the modulation_mode field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The modulation_mode.
+ */
+static inline __attribute__((always_inline))
+	uint8_t atsc_vct_channel_view_modulation_mode(const struct atsc_vct_channel_view *channel)
+{
+	return ((const uint8_t *) channel)[17];
+}
+
+/**
+ * Accessor for the carrier_frequency field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The carrier_frequency.
+ */
+static inline __attribute__((always_inline))
+	uint32_t atsc_vct_channel_view_carrier_frequency(const struct atsc_vct_channel_view *channel)
+{
+	return load_be32((const uint8_t *) channel + 18);
+}
+
+/**
+ * Accessor for the channel_TSID field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The channel_TSID.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_channel_TSID(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 22);
+}
+
+/**
+ * Accessor for the program_number field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The program_number.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_program_number(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 24);
+}
+
+/**
+ * Accessor for the ETM_location field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The ETM_location.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_ETM_location(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 26) >> 14;
+}
+
+/**
+ * Accessor for the access_controlled field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The access_controlled flag.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_access_controlled(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be16((const uint8_t *) channel + 26) >> 13) & 1;
+}
+
+/**
+ * Accessor for the hidden field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The hidden flag.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_hidden(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be16((const uint8_t *) channel + 26) >> 12) & 1;
+}
+
+/**
+ * Accessor for the path_select field of a CVCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The path_select flag.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_path_select(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be16((const uint8_t *) channel + 26) >> 11) & 1;
+}
+
+/**
+ * Accessor for the out_of_band field of a CVCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The out_of_band flag.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_out_of_band(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be16((const uint8_t *) channel + 26) >> 10) & 1;
+}
+
+/**
+ * Accessor for the hide_guide field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The hide_guide flag.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_hide_guide(const struct atsc_vct_channel_view *channel)
+{
+	return (load_be16((const uint8_t *) channel + 26) >> 9) & 1;
+}
+
+/**
+ * Accessor for the service_type field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The service_type.
+ */
+static inline __attribute__((always_inline))
+	int atsc_vct_channel_view_service_type(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 26) & 0x3f;
+}
+
+/**
+ * Accessor for the source_id field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The source_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_source_id(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 28);
+}
+
+/**
+ * Accessor for the descriptors_length field of a VCT channel.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @return The descriptors_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t atsc_vct_channel_view_descriptors_length(const struct atsc_vct_channel_view *channel)
+{
+	return load_be16((const uint8_t *) channel + 30) & 0x3ff;
+}
+
+/**
+ * Iterator for the descriptors field of an atsc_vct_channel_view.
+ *
+ * @param channel atsc_vct_channel_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define atsc_vct_channel_view_descriptors_for_each(channel, pos) \
+	descriptor_view_for_each((const uint8_t *) (channel) + ATSC_VCT_CHANNEL_VIEW_SIZE, \
+				 atsc_vct_channel_view_descriptors_length(channel), pos)
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct atsc_vct_channel_view *
+	atsc_vct_view_channels_first(const struct atsc_vct_view *vct)
+{
+	if (atsc_vct_view_num_channels_in_section(vct) == 0)
+		return NULL;
+
+	return (const struct atsc_vct_channel_view *) ((const uint8_t *) vct + ATSC_VCT_VIEW_SIZE);
+}
+
+static inline __attribute__((always_inline)) const struct atsc_vct_channel_view *
+	atsc_vct_view_channels_next(const struct atsc_vct_view *vct,
+				    const struct atsc_vct_channel_view *pos,
+				    int idx)
+{
+	if (idx >= atsc_vct_view_num_channels_in_section(vct))
+		return NULL;
+
+	return (const struct atsc_vct_channel_view *)
+		((const uint8_t *) pos + ATSC_VCT_CHANNEL_VIEW_SIZE +
+		 atsc_vct_channel_view_descriptors_length(pos));
+}
+
+static inline __attribute__((always_inline))
+	const uint8_t *atsc_vct_view_additional_descriptors(const struct atsc_vct_view *vct, size_t *len)
+{
+	const struct atsc_vct_channel_view *channel;
+	const uint8_t *pos = (const uint8_t *) vct + ATSC_VCT_VIEW_SIZE;
+	int idx;
+
+	atsc_vct_view_channels_for_each(vct, channel, idx) {
+		pos += ATSC_VCT_CHANNEL_VIEW_SIZE;
+		pos += atsc_vct_channel_view_descriptors_length(channel);
+	}
+
+	*len = load_be16(pos) & 0x3ff;
+	return pos + ATSC_VCT_VIEW_PART2_SIZE;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
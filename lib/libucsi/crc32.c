@@ -19,6 +19,27 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#include "crc32.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_HAVE_CLMUL 1
+#define CRC32_CLMUL_TARGET __attribute__((target("pclmul,ssse3")))
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+#define CRC32_HAVE_CLMUL 1
+#define CRC32_CLMUL_TARGET
+#elif defined(__GNUC__) && !defined(__clang__)
+#define CRC32_HAVE_CLMUL 1
+#define CRC32_CLMUL_TARGET __attribute__((target("+crypto")))
+#endif
+#endif
+
+#define CRC32_POLY 0x04c11db7
 
 uint32_t crc32tbl[] =
 {
@@ -87,3 +108,323 @@ uint32_t crc32tbl[] =
 	0xafb010b1, 0xab710d06, 0xa6322bdf, 0xa2f33668,
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
+
+/* crc32_slice[k][i] is the CRC contribution of byte i followed by k zero bytes */
+static uint32_t crc32_slice[8][256];
+
+/* folding constants: x^n mod P for the distances used by crc32_clmul() */
+static uint64_t crc32_k_fold4[2];
+static uint64_t crc32_k_fold1[2];
+
+static int crc32_tables_ready;
+static int crc32_have_clmul;
+static enum crc32_engine crc32_engine_cur = crc32_engine_slice8;
+
+static uint32_t crc32_resolve(uint32_t crc, uint8_t *buf, size_t len);
+
+uint32_t (*crc32_engine_fn)(uint32_t crc, uint8_t *buf, size_t len) = crc32_resolve;
+
+static uint32_t crc32_xpow_mod(int n)
+{
+	uint32_t r = 1;
+
+	while (n--) {
+		if (r & 0x80000000)
+			r = (r << 1) ^ CRC32_POLY;
+		else
+			r <<= 1;
+	}
+
+	return r;
+}
+
+static int crc32_cpu_has_clmul(void)
+{
+#if defined(CRC32_HAVE_CLMUL) && defined(__x86_64__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#elif defined(CRC32_HAVE_CLMUL) && defined(__aarch64__)
+	return (getauxval(AT_HWCAP) & HWCAP_PMULL) != 0;
+#else
+	return 0;
+#endif
+}
+
+static void crc32_init_tables(void)
+{
+	int i, k;
+
+	if (crc32_tables_ready)
+		return;
+
+	/* the tables are always generated identically, so a racing caller
+	 * only ever stores the same values again. */
+	for (i = 0; i < 256; i++)
+		crc32_slice[0][i] = crc32tbl[i];
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++) {
+			uint32_t prev = crc32_slice[k-1][i];
+			crc32_slice[k][i] = (prev << 8) ^ crc32tbl[prev >> 24];
+		}
+	}
+
+	crc32_k_fold4[0] = crc32_xpow_mod(512);
+	crc32_k_fold4[1] = crc32_xpow_mod(512 + 64);
+	crc32_k_fold1[0] = crc32_xpow_mod(128);
+	crc32_k_fold1[1] = crc32_xpow_mod(128 + 64);
+
+	crc32_have_clmul = crc32_cpu_has_clmul();
+	crc32_tables_ready = 1;
+}
+
+static void crc32_constructor(void) __attribute__((constructor));
+static void crc32_constructor(void)
+{
+	crc32_engine_select(crc32_engine_auto);
+}
+
+static uint32_t crc32_resolve(uint32_t crc, uint8_t *buf, size_t len)
+{
+	crc32_engine_select(crc32_engine_auto);
+	return crc32_engine_fn(crc, buf, len);
+}
+
+uint32_t crc32_bytewise(uint32_t crc, uint8_t *buf, size_t len)
+{
+	size_t i;
+
+	for (i=0; i< len; i++) {
+		crc = (crc << 8) ^ crc32tbl[((crc >> 24) ^ buf[i]) & 0xff];
+	}
+
+	return crc;
+}
+
+uint32_t crc32_slice8(uint32_t crc, uint8_t *buf, size_t len)
+{
+	while (len >= 8) {
+		uint32_t hi = crc ^ (((uint32_t) buf[0] << 24) |
+				     ((uint32_t) buf[1] << 16) |
+				     ((uint32_t) buf[2] << 8) |
+				      (uint32_t) buf[3]);
+
+		crc = crc32_slice[7][hi >> 24] ^
+		      crc32_slice[6][(hi >> 16) & 0xff] ^
+		      crc32_slice[5][(hi >> 8) & 0xff] ^
+		      crc32_slice[4][hi & 0xff] ^
+		      crc32_slice[3][buf[4]] ^
+		      crc32_slice[2][buf[5]] ^
+		      crc32_slice[1][buf[6]] ^
+		      crc32_slice[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+
+	while (len--) {
+		crc = (crc << 8) ^ crc32tbl[((crc >> 24) ^ *buf++) & 0xff];
+	}
+
+	return crc;
+}
+
+/*
+ * The carry-less multiply engine treats the data as one big polynomial, most
+ * significant bit first (the same bit order as crc32tbl). Each 16 byte block
+ * is loaded byte-reversed so bit 127 of the register is the first bit of the
+ * block, and the running remainder is folded forward by multiplying its two
+ * 64 bit halves by x^(n+64) mod P and x^n mod P. The 128 bit result is then
+ * reduced by running it through crc32_slice8() from a zero CRC, which yields
+ * exactly the CRC state for everything processed so far. Any tail bytes are
+ * processed the same way.
+ */
+#define CRC32_CLMUL_MIN 64
+
+#if defined(CRC32_HAVE_CLMUL) && defined(__x86_64__)
+
+CRC32_CLMUL_TARGET
+static inline __m128i crc32_clmul_fold(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+			     _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+CRC32_CLMUL_TARGET
+static uint32_t crc32_clmul_impl(uint32_t crc, uint8_t *buf, size_t len)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+					   8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k4 = _mm_set_epi64x(crc32_k_fold4[1], crc32_k_fold4[0]);
+	const __m128i k1 = _mm_set_epi64x(crc32_k_fold1[1], crc32_k_fold1[0]);
+	__m128i x0, x1, x2, x3;
+	uint8_t tmp[16];
+
+#define CRC32_LOAD(p) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (p)), bswap)
+
+	x0 = _mm_xor_si128(CRC32_LOAD(buf), _mm_set_epi32(crc, 0, 0, 0));
+	x1 = CRC32_LOAD(buf + 16);
+	x2 = CRC32_LOAD(buf + 32);
+	x3 = CRC32_LOAD(buf + 48);
+	buf += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = _mm_xor_si128(crc32_clmul_fold(x0, k4), CRC32_LOAD(buf));
+		x1 = _mm_xor_si128(crc32_clmul_fold(x1, k4), CRC32_LOAD(buf + 16));
+		x2 = _mm_xor_si128(crc32_clmul_fold(x2, k4), CRC32_LOAD(buf + 32));
+		x3 = _mm_xor_si128(crc32_clmul_fold(x3, k4), CRC32_LOAD(buf + 48));
+		buf += 64;
+		len -= 64;
+	}
+
+	x0 = _mm_xor_si128(crc32_clmul_fold(x0, k1), x1);
+	x0 = _mm_xor_si128(crc32_clmul_fold(x0, k1), x2);
+	x0 = _mm_xor_si128(crc32_clmul_fold(x0, k1), x3);
+
+	while (len >= 16) {
+		x0 = _mm_xor_si128(crc32_clmul_fold(x0, k1), CRC32_LOAD(buf));
+		buf += 16;
+		len -= 16;
+	}
+
+#undef CRC32_LOAD
+
+	_mm_storeu_si128((__m128i*) tmp, _mm_shuffle_epi8(x0, bswap));
+	crc = crc32_slice8(0, tmp, 16);
+	return crc32_slice8(crc, buf, len);
+}
+
+#elif defined(CRC32_HAVE_CLMUL) && defined(__aarch64__)
+
+CRC32_CLMUL_TARGET
+static inline uint8x16_t crc32_clmul_load(const uint8_t *p)
+{
+	return vrev64q_u8(vextq_u8(vld1q_u8(p), vld1q_u8(p), 8));
+}
+
+CRC32_CLMUL_TARGET
+static inline uint8x16_t crc32_clmul_fold(uint8x16_t x, poly64_t klo, poly64_t khi)
+{
+	poly64x2_t px = vreinterpretq_p64_u8(x);
+	poly128_t hi = vmull_p64(vgetq_lane_p64(px, 1), khi);
+	poly128_t lo = vmull_p64(vgetq_lane_p64(px, 0), klo);
+
+	return veorq_u8(vreinterpretq_u8_p128(hi), vreinterpretq_u8_p128(lo));
+}
+
+CRC32_CLMUL_TARGET
+static uint32_t crc32_clmul_impl(uint32_t crc, uint8_t *buf, size_t len)
+{
+	poly64_t k4lo = crc32_k_fold4[0], k4hi = crc32_k_fold4[1];
+	poly64_t k1lo = crc32_k_fold1[0], k1hi = crc32_k_fold1[1];
+	uint8x16_t x0, x1, x2, x3;
+	uint32x4_t init = { 0, 0, 0, crc };
+	uint8_t tmp[16];
+
+	x0 = veorq_u8(crc32_clmul_load(buf), vreinterpretq_u8_u32(init));
+	x1 = crc32_clmul_load(buf + 16);
+	x2 = crc32_clmul_load(buf + 32);
+	x3 = crc32_clmul_load(buf + 48);
+	buf += 64;
+	len -= 64;
+
+	while (len >= 64) {
+		x0 = veorq_u8(crc32_clmul_fold(x0, k4lo, k4hi), crc32_clmul_load(buf));
+		x1 = veorq_u8(crc32_clmul_fold(x1, k4lo, k4hi), crc32_clmul_load(buf + 16));
+		x2 = veorq_u8(crc32_clmul_fold(x2, k4lo, k4hi), crc32_clmul_load(buf + 32));
+		x3 = veorq_u8(crc32_clmul_fold(x3, k4lo, k4hi), crc32_clmul_load(buf + 48));
+		buf += 64;
+		len -= 64;
+	}
+
+	x0 = veorq_u8(crc32_clmul_fold(x0, k1lo, k1hi), x1);
+	x0 = veorq_u8(crc32_clmul_fold(x0, k1lo, k1hi), x2);
+	x0 = veorq_u8(crc32_clmul_fold(x0, k1lo, k1hi), x3);
+
+	while (len >= 16) {
+		x0 = veorq_u8(crc32_clmul_fold(x0, k1lo, k1hi), crc32_clmul_load(buf));
+		buf += 16;
+		len -= 16;
+	}
+
+	vst1q_u8(tmp, vrev64q_u8(vextq_u8(x0, x0, 8)));
+	crc = crc32_slice8(0, tmp, 16);
+	return crc32_slice8(crc, buf, len);
+}
+
+#endif
+
+uint32_t crc32_clmul(uint32_t crc, uint8_t *buf, size_t len)
+{
+#ifdef CRC32_HAVE_CLMUL
+	if (crc32_have_clmul && (len >= CRC32_CLMUL_MIN))
+		return crc32_clmul_impl(crc, buf, len);
+#endif
+	return crc32_slice8(crc, buf, len);
+}
+
+int crc32_engine_supported(enum crc32_engine engine)
+{
+	switch(engine) {
+	case crc32_engine_auto:
+	case crc32_engine_bytewise:
+	case crc32_engine_slice8:
+		return 1;
+
+	case crc32_engine_clmul:
+		crc32_init_tables();
+		return crc32_have_clmul;
+	}
+
+	return 0;
+}
+
+int crc32_engine_select(enum crc32_engine engine)
+{
+	crc32_init_tables();
+
+	if (engine == crc32_engine_auto)
+		engine = crc32_have_clmul ? crc32_engine_clmul : crc32_engine_slice8;
+
+	switch(engine) {
+	case crc32_engine_bytewise:
+		crc32_engine_fn = crc32_bytewise;
+		break;
+
+	case crc32_engine_slice8:
+		crc32_engine_fn = crc32_slice8;
+		break;
+
+	case crc32_engine_clmul:
+		if (!crc32_have_clmul)
+			return -1;
+		crc32_engine_fn = crc32_clmul;
+		break;
+
+	default:
+		return -1;
+	}
+
+	crc32_engine_cur = engine;
+	return 0;
+}
+
+enum crc32_engine crc32_engine_current(void)
+{
+	return crc32_engine_cur;
+}
+
+const char *crc32_engine_name(enum crc32_engine engine)
+{
+	switch(engine) {
+	case crc32_engine_auto:
+		return "auto";
+	case crc32_engine_bytewise:
+		return "bytewise";
+	case crc32_engine_slice8:
+		return "slice8";
+	case crc32_engine_clmul:
+		return "clmul";
+	}
+
+	return "unknown";
+}
@@ -22,6 +22,7 @@
 #define _UCSI_CRC32_H 1
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -32,6 +33,71 @@ extern "C"
 
 extern uint32_t crc32tbl[];
 
+/**
+ * Enumeration of CRC32 engines. crc32() dispatches to one of these at runtime;
+ * crc32_engine_auto selects the fastest one supported by the running CPU.
+ */
+enum crc32_engine {
+	crc32_engine_auto			= 0x00,
+	crc32_engine_bytewise			= 0x01,
+	crc32_engine_slice8			= 0x02,
+	crc32_engine_clmul			= 0x03,
+};
+
+/**
+ * The engine currently used by crc32(). Do not call this directly - use
+ * crc32() or crc32_engine_select().
+ */
+extern uint32_t (*crc32_engine_fn)(uint32_t crc, uint8_t *buf, size_t len);
+
+/**
+ * Select the engine used by crc32().
+ *
+ * @param engine One of enum crc32_engine.
+ * @return 0 on success, nonzero if the engine is not supported on this CPU.
+ */
+extern int crc32_engine_select(enum crc32_engine engine);
+
+/**
+ * Determine whether an engine is supported on this CPU.
+ *
+ * @param engine One of enum crc32_engine.
+ * @return Nonzero if it is supported.
+ */
+extern int crc32_engine_supported(enum crc32_engine engine);
+
+/**
+ * Get the engine currently used by crc32().
+ *
+ * @return One of enum crc32_engine (never crc32_engine_auto).
+ */
+extern enum crc32_engine crc32_engine_current(void);
+
+/**
+ * Get a printable name for an engine.
+ *
+ * @param engine One of enum crc32_engine.
+ * @return The name.
+ */
+extern const char *crc32_engine_name(enum crc32_engine engine);
+
+/**
+ * Calculate a CRC32 one byte at a time using crc32tbl.
+ */
+extern uint32_t crc32_bytewise(uint32_t crc, uint8_t *buf, size_t len);
+
+/**
+ * Calculate a CRC32 eight bytes at a time using the slice-by-8 tables.
+ */
+extern uint32_t crc32_slice8(uint32_t crc, uint8_t *buf, size_t len);
+
+/**
+ * Calculate a CRC32 by folding with carry-less multiplication (PCLMULQDQ on
+ * x86-64, PMULL on ARMv8). Falls back to crc32_slice8() if the CPU does not
+ * support it.
+ */
+extern uint32_t crc32_clmul(uint32_t crc, uint8_t *buf, size_t len);
+
 /**
  * Calculate a CRC32 over a piece of data.
  *
@@ -42,13 +108,7 @@ extern uint32_t crc32tbl[];
  */
 static inline uint32_t crc32(uint32_t crc, uint8_t* buf, size_t len)
 {
-	size_t i;
-
-	for (i=0; i< len; i++) {
-		crc = (crc << 8) ^ crc32tbl[((crc >> 24) ^ buf[i]) & 0xff];
-	}
-
-	return crc;
+	return crc32_engine_fn(crc, buf, len);
 }
 
 #ifdef __cplusplus
@@ -105,7 +105,7 @@ static inline int
 
 
 /******************************** PRIVATE CODE ********************************/
-static inline int verify_descriptors(uint8_t * buf, size_t len)
+static inline int verify_descriptors(const uint8_t * buf, size_t len)
 {
 	size_t pos = 0;
 
@@ -0,0 +1,52 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/eit_view.h>
+
+const struct dvb_eit_view *dvb_eit_view_init(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = section_ext_view_data(ext);
+	size_t pos = DVB_EIT_VIEW_SIZE;
+	size_t len = section_ext_view_length(ext);
+
+	if (len < DVB_EIT_VIEW_SIZE)
+		return NULL;
+
+	while (pos < len) {
+		size_t descriptors_loop_length;
+
+		if ((pos + DVB_EIT_EVENT_VIEW_SIZE) > len)
+			return NULL;
+
+		descriptors_loop_length = load_be16(buf + pos + 10) & 0x0fff;
+		pos += DVB_EIT_EVENT_VIEW_SIZE;
+
+		if ((pos + descriptors_loop_length) > len)
+			return NULL;
+
+		if (verify_descriptors(buf + pos, descriptors_loop_length))
+			return NULL;
+
+		pos += descriptors_loop_length;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return (const struct dvb_eit_view *) ext;
+}
@@ -0,0 +1,255 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_EIT_VIEW_H
+#define _UCSI_DVB_EIT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed EIT section.
+ */
+struct dvb_eit_view;
+
+/**
+ * Opaque type for a view of an event within a dvb_eit_view.
+ */
+struct dvb_eit_event_view;
+
+#define DVB_EIT_VIEW_SIZE (sizeof(struct section_ext) + 6)
+#define DVB_EIT_EVENT_VIEW_SIZE 12
+
+/**
+ * Validate an EIT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the dvb_eit_view, or NULL on error.
+ */
+extern const struct dvb_eit_view *dvb_eit_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *dvb_eit_view_head(const struct dvb_eit_view *eit)
+{
+	return (const struct section_ext_view *) eit;
+}
+
+/**
+ * Accessor for the service_id field of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The service_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_eit_view_service_id(const struct dvb_eit_view *eit)
+{
+	return section_ext_view_table_id_ext(dvb_eit_view_head(eit));
+}
+
+/**
+ * Accessor for the transport_stream_id field of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The transport_stream_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_eit_view_transport_stream_id(const struct dvb_eit_view *eit)
+{
+	return load_be16((const uint8_t *) eit + 8);
+}
+
+/**
+ * Accessor for the original_network_id field of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The original_network_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_eit_view_original_network_id(const struct dvb_eit_view *eit)
+{
+	return load_be16((const uint8_t *) eit + 10);
+}
+
+/**
+ * Accessor for the segment_last_section_number field of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The segment_last_section_number.
+ */
+static inline __attribute__((always_inline))
+	uint8_t dvb_eit_view_segment_last_section_number(const struct dvb_eit_view *eit)
+{
+	return ((const uint8_t *) eit)[12];
+}
+
+/**
+ * Accessor for the last_table_id field of an EIT.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @return The last_table_id.
+ */
+static inline __attribute__((always_inline))
+	uint8_t dvb_eit_view_last_table_id(const struct dvb_eit_view *eit)
+{
+	return ((const uint8_t *) eit)[13];
+}
+
+/**
+ * Iterator for the events field of a dvb_eit_view.
+ *
+ * @param eit dvb_eit_view pointer.
+ * @param pos Variable holding a pointer to the current dvb_eit_event_view.
+ */
+#define dvb_eit_view_events_for_each(eit, pos) \
+	for ((pos) = dvb_eit_view_events_first(eit); \
+	     (pos); \
+	     (pos) = dvb_eit_view_events_next(eit, pos))
+
+/**
+ * Accessor for the event_id field of an EIT event.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return The event_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_eit_event_view_event_id(const struct dvb_eit_event_view *event)
+{
+	return load_be16((const uint8_t *) event);
+}
+
+/**
+ * Accessor for the start_time field of an EIT event. The field is already in
+ * the dvbdate_t format, so this points straight into the section.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return Pointer to the 5 byte start_time.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *dvb_eit_event_view_start_time(const struct dvb_eit_event_view *event)
+{
+	return (const uint8_t *) event + 2;
+}
+
+/**
+ * Accessor for the duration field of an EIT event, in the dvbduration_t format.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return Pointer to the 3 byte duration.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *dvb_eit_event_view_duration(const struct dvb_eit_event_view *event)
+{
+	return (const uint8_t *) event + 7;
+}
+
+/**
+ * Accessor for the running_status field of an EIT event.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return The running_status.
+ */
+static inline __attribute__((always_inline))
+	int dvb_eit_event_view_running_status(const struct dvb_eit_event_view *event)
+{
+	return ((const uint8_t *) event)[10] >> 5;
+}
+
+/**
+ * Accessor for the free_ca_mode field of an EIT event.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return The free_ca_mode.
+ */
+static inline __attribute__((always_inline))
+	int dvb_eit_event_view_free_ca_mode(const struct dvb_eit_event_view *event)
+{
+	return (((const uint8_t *) event)[10] >> 4) & 1;
+}
+
+/**
+ * Accessor for the descriptors_loop_length field of an EIT event.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @return The descriptors_loop_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_eit_event_view_descriptors_loop_length(const struct dvb_eit_event_view *event)
+{
+	return load_be16((const uint8_t *) event + 10) & 0x0fff;
+}
+
+/**
+ * Iterator for the descriptors field of a dvb_eit_event_view.
+ *
+ * @param event dvb_eit_event_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define dvb_eit_event_view_descriptors_for_each(event, pos) \
+	descriptor_view_for_each((const uint8_t *) (event) + DVB_EIT_EVENT_VIEW_SIZE, \
+				 dvb_eit_event_view_descriptors_loop_length(event), pos)
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct dvb_eit_event_view *
+	dvb_eit_view_events_first(const struct dvb_eit_view *eit)
+{
+	size_t pos = DVB_EIT_VIEW_SIZE;
+
+	if (pos >= section_ext_view_length(dvb_eit_view_head(eit)))
+		return NULL;
+
+	return (const struct dvb_eit_event_view *) ((const uint8_t *) eit + pos);
+}
+
+static inline __attribute__((always_inline)) const struct dvb_eit_event_view *
+	dvb_eit_view_events_next(const struct dvb_eit_view *eit,
+				 const struct dvb_eit_event_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) eit + section_ext_view_length(dvb_eit_view_head(eit));
+	const uint8_t *next = (const uint8_t *) pos + DVB_EIT_EVENT_VIEW_SIZE +
+			      dvb_eit_event_view_descriptors_loop_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_eit_event_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/dvb/nit_view.h>
+
+const struct dvb_nit_view *dvb_nit_view_init(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = section_ext_view_data(ext);
+	size_t pos = DVB_NIT_VIEW_SIZE;
+	size_t len = section_ext_view_length(ext);
+	size_t network_descriptors_length;
+
+	if (len < DVB_NIT_VIEW_SIZE)
+		return NULL;
+
+	network_descriptors_length = load_be16(buf + 8) & 0x0fff;
+	if ((pos + network_descriptors_length) > len)
+		return NULL;
+
+	if (verify_descriptors(buf + pos, network_descriptors_length))
+		return NULL;
+
+	pos += network_descriptors_length;
+
+	if ((pos + DVB_NIT_VIEW_PART2_SIZE) > len)
+		return NULL;
+
+	pos += DVB_NIT_VIEW_PART2_SIZE;
+
+	while (pos < len) {
+		size_t transport_descriptors_length;
+
+		if ((pos + DVB_NIT_TRANSPORT_VIEW_SIZE) > len)
+			return NULL;
+
+		transport_descriptors_length = load_be16(buf + pos + 4) & 0x0fff;
+		pos += DVB_NIT_TRANSPORT_VIEW_SIZE;
+
+		if ((pos + transport_descriptors_length) > len)
+			return NULL;
+
+		if (verify_descriptors(buf + pos, transport_descriptors_length))
+			return NULL;
+
+		pos += transport_descriptors_length;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return (const struct dvb_nit_view *) ext;
+}
@@ -0,0 +1,194 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_NIT_VIEW_H
+#define _UCSI_DVB_NIT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed NIT section.
+ */
+struct dvb_nit_view;
+
+/**
+ * Opaque type for a view of a transport within a dvb_nit_view.
+ */
+struct dvb_nit_transport_view;
+
+#define DVB_NIT_VIEW_SIZE (sizeof(struct section_ext) + 2)
+#define DVB_NIT_VIEW_PART2_SIZE 2
+#define DVB_NIT_TRANSPORT_VIEW_SIZE 6
+
+/**
+ * Validate a NIT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the dvb_nit_view, or NULL on error.
+ */
+extern const struct dvb_nit_view *dvb_nit_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of a NIT.
+ *
+ * @param nit dvb_nit_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *dvb_nit_view_head(const struct dvb_nit_view *nit)
+{
+	return (const struct section_ext_view *) nit;
+}
+
+/**
+ * Accessor for the network_id field of a NIT.
+ *
+ * @param nit dvb_nit_view pointer.
+ * @return The network_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_nit_view_network_id(const struct dvb_nit_view *nit)
+{
+	return section_ext_view_table_id_ext(dvb_nit_view_head(nit));
+}
+
+/**
+ * Accessor for the network_descriptors_length field of a NIT.
+ *
+ * @param nit dvb_nit_view pointer.
+ * @return The network_descriptors_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_nit_view_network_descriptors_length(const struct dvb_nit_view *nit)
+{
+	return load_be16((const uint8_t *) nit + 8) & 0x0fff;
+}
+
+/**
+ * Iterator for the network descriptors field of a dvb_nit_view.
+ *
+ * @param nit dvb_nit_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define dvb_nit_view_descriptors_for_each(nit, pos) \
+	descriptor_view_for_each((const uint8_t *) (nit) + DVB_NIT_VIEW_SIZE, \
+				 dvb_nit_view_network_descriptors_length(nit), pos)
+
+/**
+ * Iterator for the transports field of a dvb_nit_view.
+ *
+ * @param nit dvb_nit_view pointer.
+ * @param pos Variable holding a pointer to the current dvb_nit_transport_view.
+ */
+#define dvb_nit_view_transports_for_each(nit, pos) \
+	for ((pos) = dvb_nit_view_transports_first(nit); \
+	     (pos); \
+	     (pos) = dvb_nit_view_transports_next(nit, pos))
+
+/**
+ * Accessor for the transport_stream_id field of a NIT transport.
+ *
+ * @param transport dvb_nit_transport_view pointer.
+ * @return The transport_stream_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_nit_transport_view_transport_stream_id(const struct dvb_nit_transport_view *transport)
+{
+	return load_be16((const uint8_t *) transport);
+}
+
+/**
+ * Accessor for the original_network_id field of a NIT transport.
+ *
+ * @param transport dvb_nit_transport_view pointer.
+ * @return The original_network_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_nit_transport_view_original_network_id(const struct dvb_nit_transport_view *transport)
+{
+	return load_be16((const uint8_t *) transport + 2);
+}
+
+/**
+ * Accessor for the transport_descriptors_length field of a NIT transport.
+ *
+ * @param transport dvb_nit_transport_view pointer.
+ * @return The transport_descriptors_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_nit_transport_view_descriptors_length(const struct dvb_nit_transport_view *transport)
+{
+	return load_be16((const uint8_t *) transport + 4) & 0x0fff;
+}
+
+/**
+ * Iterator for the descriptors field of a dvb_nit_transport_view.
+ *
+ * @param transport dvb_nit_transport_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define dvb_nit_transport_view_descriptors_for_each(transport, pos) \
+	descriptor_view_for_each((const uint8_t *) (transport) + DVB_NIT_TRANSPORT_VIEW_SIZE, \
+				 dvb_nit_transport_view_descriptors_length(transport), pos)
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct dvb_nit_transport_view *
+	dvb_nit_view_transports_first(const struct dvb_nit_view *nit)
+{
+	size_t pos = DVB_NIT_VIEW_SIZE + dvb_nit_view_network_descriptors_length(nit) +
+		     DVB_NIT_VIEW_PART2_SIZE;
+
+	if (pos >= section_ext_view_length(dvb_nit_view_head(nit)))
+		return NULL;
+
+	return (const struct dvb_nit_transport_view *) ((const uint8_t *) nit + pos);
+}
+
+static inline __attribute__((always_inline)) const struct dvb_nit_transport_view *
+	dvb_nit_view_transports_next(const struct dvb_nit_view *nit,
+				     const struct dvb_nit_transport_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) nit + section_ext_view_length(dvb_nit_view_head(nit));
+	const uint8_t *next = (const uint8_t *) pos + DVB_NIT_TRANSPORT_VIEW_SIZE +
+			      dvb_nit_transport_view_descriptors_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_nit_transport_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
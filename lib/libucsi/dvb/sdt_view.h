@@ -0,0 +1,218 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_DVB_SDT_VIEW_H
+#define _UCSI_DVB_SDT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed SDT section.
+ */
+struct dvb_sdt_view;
+
+/**
+ * Opaque type for a view of a service within a dvb_sdt_view.
+ */
+struct dvb_sdt_service_view;
+
+#define DVB_SDT_VIEW_SIZE (sizeof(struct section_ext) + 3)
+#define DVB_SDT_SERVICE_VIEW_SIZE 5
+
+/**
+ * Validate an SDT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the dvb_sdt_view, or NULL on error.
+ */
+extern const struct dvb_sdt_view *dvb_sdt_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of an SDT.
+ *
+ * @param sdt dvb_sdt_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *dvb_sdt_view_head(const struct dvb_sdt_view *sdt)
+{
+	return (const struct section_ext_view *) sdt;
+}
+
+/**
+ * Accessor for the transport_stream_id field of an SDT.
+ *
+ * @param sdt dvb_sdt_view pointer.
+ * @return The transport_stream_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_sdt_view_transport_stream_id(const struct dvb_sdt_view *sdt)
+{
+	return section_ext_view_table_id_ext(dvb_sdt_view_head(sdt));
+}
+
+/**
+ * Accessor for the original_network_id field of an SDT.
+ *
+ * @param sdt dvb_sdt_view pointer.
+ * @return The original_network_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_sdt_view_original_network_id(const struct dvb_sdt_view *sdt)
+{
+	return load_be16((const uint8_t *) sdt + 8);
+}
+
+/**
+ * Iterator for the services field of a dvb_sdt_view.
+ *
+ * @param sdt dvb_sdt_view pointer.
+ * @param pos Variable holding a pointer to the current dvb_sdt_service_view.
+ */
+#define dvb_sdt_view_services_for_each(sdt, pos) \
+	for ((pos) = dvb_sdt_view_services_first(sdt); \
+	     (pos); \
+	     (pos) = dvb_sdt_view_services_next(sdt, pos))
+
+/**
+ * Accessor for the service_id field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The service_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_sdt_service_view_service_id(const struct dvb_sdt_service_view *service)
+{
+	return load_be16((const uint8_t *) service);
+}
+
+/**
+ * Accessor for the eit_schedule_flag field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The eit_schedule_flag.
+ */
+static inline __attribute__((always_inline))
+	int dvb_sdt_service_view_eit_schedule_flag(const struct dvb_sdt_service_view *service)
+{
+	return (((const uint8_t *) service)[2] >> 1) & 1;
+}
+
+/**
+ * Accessor for the eit_present_following_flag field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The eit_present_following_flag.
+ */
+static inline __attribute__((always_inline))
+	int dvb_sdt_service_view_eit_present_following_flag(const struct dvb_sdt_service_view *service)
+{
+	return ((const uint8_t *) service)[2] & 1;
+}
+
+/**
+ * Accessor for the running_status field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The running_status.
+ */
+static inline __attribute__((always_inline))
+	int dvb_sdt_service_view_running_status(const struct dvb_sdt_service_view *service)
+{
+	return ((const uint8_t *) service)[3] >> 5;
+}
+
+/**
+ * Accessor for the free_ca_mode field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The free_ca_mode.
+ */
+static inline __attribute__((always_inline))
+	int dvb_sdt_service_view_free_ca_mode(const struct dvb_sdt_service_view *service)
+{
+	return (((const uint8_t *) service)[3] >> 4) & 1;
+}
+
+/**
+ * Accessor for the descriptors_loop_length field of an SDT service.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @return The descriptors_loop_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t dvb_sdt_service_view_descriptors_loop_length(const struct dvb_sdt_service_view *service)
+{
+	return load_be16((const uint8_t *) service + 3) & 0x0fff;
+}
+
+/**
+ * Iterator for the descriptors field of a dvb_sdt_service_view.
+ *
+ * @param service dvb_sdt_service_view pointer.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define dvb_sdt_service_view_descriptors_for_each(service, pos) \
+	descriptor_view_for_each((const uint8_t *) (service) + DVB_SDT_SERVICE_VIEW_SIZE, \
+				 dvb_sdt_service_view_descriptors_loop_length(service), pos)
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct dvb_sdt_service_view *
+	dvb_sdt_view_services_first(const struct dvb_sdt_view *sdt)
+{
+	size_t pos = DVB_SDT_VIEW_SIZE;
+
+	if (pos >= section_ext_view_length(dvb_sdt_view_head(sdt)))
+		return NULL;
+
+	return (const struct dvb_sdt_service_view *) ((const uint8_t *) sdt + pos);
+}
+
+static inline __attribute__((always_inline)) const struct dvb_sdt_service_view *
+	dvb_sdt_view_services_next(const struct dvb_sdt_view *sdt,
+				   const struct dvb_sdt_service_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) sdt + section_ext_view_length(dvb_sdt_view_head(sdt));
+	const uint8_t *next = (const uint8_t *) pos + DVB_SDT_SERVICE_VIEW_SIZE +
+			      dvb_sdt_service_view_descriptors_loop_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct dvb_sdt_service_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
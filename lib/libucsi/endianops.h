@@ -121,6 +121,23 @@ static inline void bswap48(uint8_t * buf) {
 
 #endif // __BYTE_ORDER
 
+/*
+ * Load big-endian values from unprocessed (network ordered) data. These work
+ * on any byte alignment and never modify the source buffer.
+ */
+static inline __attribute__((always_inline)) uint16_t load_be16(const uint8_t *buf) {
+	return (buf[0] << 8) | buf[1];
+}
+
+static inline __attribute__((always_inline)) uint32_t load_be24(const uint8_t *buf) {
+	return ((uint32_t) buf[0] << 16) | (buf[1] << 8) | buf[2];
+}
+
+static inline __attribute__((always_inline)) uint32_t load_be32(const uint8_t *buf) {
+	return ((uint32_t) buf[0] << 24) | ((uint32_t) buf[1] << 16) |
+	       (buf[2] << 8) | buf[3];
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,146 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_MPEG_PAT_VIEW_H
+#define _UCSI_MPEG_PAT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed PAT section.
+ */
+struct mpeg_pat_view;
+
+/**
+ * Opaque type for a view of a program within an mpeg_pat_view.
+ */
+struct mpeg_pat_program_view;
+
+#define MPEG_PAT_PROGRAM_VIEW_SIZE 4
+
+/**
+ * Validate a PAT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the mpeg_pat_view, or NULL on error.
+ */
+extern const struct mpeg_pat_view *mpeg_pat_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of a PAT.
+ *
+ * @param pat mpeg_pat_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *mpeg_pat_view_head(const struct mpeg_pat_view *pat)
+{
+	return (const struct section_ext_view *) pat;
+}
+
+/**
+ * Accessor for the transport_stream_id field of a PAT.
+ *
+ * @param pat mpeg_pat_view pointer.
+ * @return The transport_stream_id.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pat_view_transport_stream_id(const struct mpeg_pat_view *pat)
+{
+	return section_ext_view_table_id_ext(mpeg_pat_view_head(pat));
+}
+
+/**
+ * Convenience iterator for the programs field of an mpeg_pat_view.
+ *
+ * @param pat Pointer to the mpeg_pat_view.
+ * @param pos Variable holding a pointer to the current mpeg_pat_program_view.
+ */
+#define mpeg_pat_view_programs_for_each(pat, pos) \
+	for ((pos) = mpeg_pat_view_programs_first(pat); \
+	     (pos); \
+	     (pos) = mpeg_pat_view_programs_next(pat, pos))
+
+/**
+ * Accessor for the program_number field of a PAT program.
+ *
+ * @param program mpeg_pat_program_view pointer.
+ * @return The program_number.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pat_program_view_program_number(const struct mpeg_pat_program_view *program)
+{
+	return load_be16((const uint8_t *) program);
+}
+
+/**
+ * Accessor for the pid field of a PAT program.
+ *
+ * @param program mpeg_pat_program_view pointer.
+ * @return The pid.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pat_program_view_pid(const struct mpeg_pat_program_view *program)
+{
+	return load_be16((const uint8_t *) program + 2) & 0x1fff;
+}
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct mpeg_pat_program_view *
+	mpeg_pat_view_programs_first(const struct mpeg_pat_view *pat)
+{
+	size_t pos = sizeof(struct section_ext);
+
+	if (pos >= section_ext_view_length(mpeg_pat_view_head(pat)))
+		return NULL;
+
+	return (const struct mpeg_pat_program_view *) ((const uint8_t *) pat + pos);
+}
+
+static inline __attribute__((always_inline)) const struct mpeg_pat_program_view *
+	mpeg_pat_view_programs_next(const struct mpeg_pat_view *pat,
+				    const struct mpeg_pat_program_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) pat + section_ext_view_length(mpeg_pat_view_head(pat));
+	const uint8_t *next = (const uint8_t *) pos + MPEG_PAT_PROGRAM_VIEW_SIZE;
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct mpeg_pat_program_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
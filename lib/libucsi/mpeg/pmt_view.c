@@ -0,0 +1,62 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/mpeg/pmt_view.h>
+
+const struct mpeg_pmt_view *mpeg_pmt_view_init(const struct section_ext_view *ext)
+{
+	const uint8_t *buf = section_ext_view_data(ext);
+	size_t pos = MPEG_PMT_VIEW_SIZE;
+	size_t len = section_ext_view_length(ext);
+	size_t program_info_length;
+
+	if (len < MPEG_PMT_VIEW_SIZE)
+		return NULL;
+
+	program_info_length = load_be16(buf + 10) & 0x0fff;
+	if ((pos + program_info_length) > len)
+		return NULL;
+
+	if (verify_descriptors(buf + pos, program_info_length))
+		return NULL;
+
+	pos += program_info_length;
+
+	while (pos < len) {
+		size_t es_info_length;
+
+		if ((pos + MPEG_PMT_STREAM_VIEW_SIZE) > len)
+			return NULL;
+
+		es_info_length = load_be16(buf + pos + 3) & 0x0fff;
+		pos += MPEG_PMT_STREAM_VIEW_SIZE;
+
+		if ((pos + es_info_length) > len)
+			return NULL;
+
+		if (verify_descriptors(buf + pos, es_info_length))
+			return NULL;
+
+		pos += es_info_length;
+	}
+
+	if (pos != len)
+		return NULL;
+
+	return (const struct mpeg_pmt_view *) ext;
+}
@@ -0,0 +1,204 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_MPEG_PMT_VIEW_H
+#define _UCSI_MPEG_PMT_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section_view.h>
+
+/**
+ * Opaque type for a read-only view of an unprocessed PMT section.
+ */
+struct mpeg_pmt_view;
+
+/**
+ * Opaque type for a view of a stream within an mpeg_pmt_view.
+ */
+struct mpeg_pmt_stream_view;
+
+#define MPEG_PMT_VIEW_SIZE (sizeof(struct section_ext) + 4)
+#define MPEG_PMT_STREAM_VIEW_SIZE 5
+
+/**
+ * Validate a PMT section without modifying it.
+ *
+ * @param section Pointer to the section_ext_view.
+ * @return Pointer to the mpeg_pmt_view, or NULL on error.
+ */
+extern const struct mpeg_pmt_view *mpeg_pmt_view_init(const struct section_ext_view *section);
+
+/**
+ * Accessor for the section_ext_view of a PMT.
+ *
+ * @param pmt mpeg_pmt_view pointer.
+ * @return The section_ext_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_ext_view *mpeg_pmt_view_head(const struct mpeg_pmt_view *pmt)
+{
+	return (const struct section_ext_view *) pmt;
+}
+
+/**
+ * Accessor for the program_number field of a PMT.
+ *
+ * @param pmt mpeg_pmt_view pointer.
+ * @return The program_number.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pmt_view_program_number(const struct mpeg_pmt_view *pmt)
+{
+	return section_ext_view_table_id_ext(mpeg_pmt_view_head(pmt));
+}
+
+/**
+ * Accessor for the pcr_pid field of a PMT.
+ *
+ * @param pmt mpeg_pmt_view pointer.
+ * @return The pcr_pid.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pmt_view_pcr_pid(const struct mpeg_pmt_view *pmt)
+{
+	return load_be16((const uint8_t *) pmt + 8) & 0x1fff;
+}
+
+/**
+ * Accessor for the program_info_length field of a PMT.
+ *
+ * @param pmt mpeg_pmt_view pointer.
+ * @return The program_info_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pmt_view_program_info_length(const struct mpeg_pmt_view *pmt)
+{
+	return load_be16((const uint8_t *) pmt + 10) & 0x0fff;
+}
+
+/**
+ * Convenience iterator for the descriptors field of an mpeg_pmt_view.
+ *
+ * @param pmt Pointer to the mpeg_pmt_view.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define mpeg_pmt_view_descriptors_for_each(pmt, pos) \
+	descriptor_view_for_each((const uint8_t *) (pmt) + MPEG_PMT_VIEW_SIZE, \
+				 mpeg_pmt_view_program_info_length(pmt), pos)
+
+/**
+ * Convenience iterator for the streams field of an mpeg_pmt_view.
+ *
+ * @param pmt Pointer to the mpeg_pmt_view.
+ * @param pos Variable holding a pointer to the current mpeg_pmt_stream_view.
+ */
+#define mpeg_pmt_view_streams_for_each(pmt, pos) \
+	for ((pos) = mpeg_pmt_view_streams_first(pmt); \
+	     (pos); \
+	     (pos) = mpeg_pmt_view_streams_next(pmt, pos))
+
+/**
+ * Accessor for the stream_type field of a PMT stream.
+ *
+ * @param stream mpeg_pmt_stream_view pointer.
+ * @return The stream_type.
+ */
+static inline __attribute__((always_inline))
+	uint8_t mpeg_pmt_stream_view_stream_type(const struct mpeg_pmt_stream_view *stream)
+{
+	return ((const uint8_t *) stream)[0];
+}
+
+/**
+ * Accessor for the pid field of a PMT stream.
+ *
+ * @param stream mpeg_pmt_stream_view pointer.
+ * @return The pid.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pmt_stream_view_pid(const struct mpeg_pmt_stream_view *stream)
+{
+	return load_be16((const uint8_t *) stream + 1) & 0x1fff;
+}
+
+/**
+ * Accessor for the es_info_length field of a PMT stream.
+ *
+ * @param stream mpeg_pmt_stream_view pointer.
+ * @return The es_info_length.
+ */
+static inline __attribute__((always_inline))
+	uint16_t mpeg_pmt_stream_view_es_info_length(const struct mpeg_pmt_stream_view *stream)
+{
+	return load_be16((const uint8_t *) stream + 3) & 0x0fff;
+}
+
+/**
+ * Convenience iterator for the descriptors field of an mpeg_pmt_stream_view.
+ *
+ * @param stream Pointer to the mpeg_pmt_stream_view.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define mpeg_pmt_stream_view_descriptors_for_each(stream, pos) \
+	descriptor_view_for_each((const uint8_t *) (stream) + MPEG_PMT_STREAM_VIEW_SIZE, \
+				 mpeg_pmt_stream_view_es_info_length(stream), pos)
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct mpeg_pmt_stream_view *
+	mpeg_pmt_view_streams_first(const struct mpeg_pmt_view *pmt)
+{
+	size_t pos = MPEG_PMT_VIEW_SIZE + mpeg_pmt_view_program_info_length(pmt);
+
+	if (pos >= section_ext_view_length(mpeg_pmt_view_head(pmt)))
+		return NULL;
+
+	return (const struct mpeg_pmt_stream_view *) ((const uint8_t *) pmt + pos);
+}
+
+static inline __attribute__((always_inline)) const struct mpeg_pmt_stream_view *
+	mpeg_pmt_view_streams_next(const struct mpeg_pmt_view *pmt,
+				   const struct mpeg_pmt_stream_view *pos)
+{
+	const uint8_t *end = (const uint8_t *) pmt + section_ext_view_length(mpeg_pmt_view_head(pmt));
+	const uint8_t *next = (const uint8_t *) pos + MPEG_PMT_STREAM_VIEW_SIZE +
+			      mpeg_pmt_stream_view_es_info_length(pos);
+
+	if (next >= end)
+		return NULL;
+
+	return (const struct mpeg_pmt_stream_view *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
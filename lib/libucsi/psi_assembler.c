@@ -0,0 +1,308 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "psi_assembler.h"
+
+#define HASH_BUCKETS 1024
+
+/* section_ext header plus CRC */
+#define MIN_SECTION_LENGTH 12
+
+/* allocation granularity for section storage */
+#define SLOT_ROUND 256
+
+#define bit_test(map, n) ((map)[(n) >> 5] & (1U << ((n) & 31)))
+#define bit_set(map, n) ((map)[(n) >> 5] |= (1U << ((n) & 31)))
+#define bit_clear(map, n) ((map)[(n) >> 5] &= ~(1U << ((n) & 31)))
+
+struct psi_assembler {
+	int check_crc;
+	int tables;
+	int complete;
+	psi_assembler_callback callback;
+	void *arg;
+	struct psi_table *free_tables;
+	struct psi_table *hash[HASH_BUCKETS];
+};
+
+static struct psi_table *psi_assembler_new_table(struct psi_assembler *assembler,
+						 uint8_t table_id, uint16_t table_id_ext);
+static int psi_table_start(struct psi_table *table, uint8_t version_number,
+			   uint8_t last_section_number);
+static void psi_table_eit_segment(struct psi_table *table, uint8_t section_number,
+				  uint8_t segment_last_section_number);
+static void psi_table_free(struct psi_table *table);
+
+
+static inline int psi_assembler_hash(uint8_t table_id, uint16_t table_id_ext)
+{
+	return ((table_id_ext * 31) + table_id) & (HASH_BUCKETS - 1);
+}
+
+struct psi_assembler *psi_assembler_create(int check_crc)
+{
+	struct psi_assembler *assembler;
+
+	assembler = (struct psi_assembler *) malloc(sizeof(struct psi_assembler));
+	if (assembler == NULL)
+		return NULL;
+	memset(assembler, 0, sizeof(struct psi_assembler));
+	assembler->check_crc = check_crc;
+
+	return assembler;
+}
+
+void psi_assembler_destroy(struct psi_assembler *assembler)
+{
+	struct psi_table *table;
+
+	psi_assembler_reset(assembler);
+	while ((table = assembler->free_tables) != NULL) {
+		assembler->free_tables = table->next;
+		psi_table_free(table);
+	}
+
+	free(assembler);
+}
+
+void psi_assembler_set_callback(struct psi_assembler *assembler,
+				psi_assembler_callback callback, void *arg)
+{
+	assembler->callback = callback;
+	assembler->arg = arg;
+}
+
+int psi_assembler_add(struct psi_assembler *assembler, uint8_t *buf, int len)
+{
+	struct psi_table *table;
+	struct psi_table_slot *slot;
+	struct section *section;
+	uint8_t table_id, version_number, section_number, last_section_number;
+	uint16_t table_id_ext;
+	int restart;
+
+	// parse the header without touching the buffer
+	if ((len < MIN_SECTION_LENGTH) || !(buf[1] & 0x80) ||
+	    (len != ((((buf[1] & 0x0f) << 8) | buf[2]) + 3)))
+		return -EINVAL;
+	table_id = buf[0];
+	table_id_ext = (buf[3] << 8) | buf[4];
+	version_number = (buf[5] >> 1) & 0x1f;
+	section_number = buf[6];
+	last_section_number = buf[7];
+	if (!(buf[5] & 0x01))
+		return psi_assembler_ignored;
+	if (section_number > last_section_number)
+		return -EINVAL;
+
+	// is it something we need?
+	table = psi_assembler_find(assembler, table_id, table_id_ext);
+	restart = (table == NULL) ||
+		  (table->version_number != version_number) ||
+		  (table->last_section_number != last_section_number);
+	if (!restart && (table->complete || bit_test(table->received, section_number)))
+		return psi_assembler_ignored;
+
+	// only check the CRC of sections which will be kept
+	if (assembler->check_crc && crc32(CRC32_INIT, buf, len))
+		return -EINVAL;
+
+	if (table == NULL) {
+		table = psi_assembler_new_table(assembler, table_id, table_id_ext);
+		if (table == NULL)
+			return -ENOMEM;
+	}
+	if (restart) {
+		if (table->complete) {
+			table->complete = 0;
+			assembler->complete--;
+		}
+		if (table->version_number != 0xff)
+			table->version_changes++;
+		if (psi_table_start(table, version_number, last_section_number))
+			return -ENOMEM;
+	}
+
+	// store it
+	slot = &table->slots[section_number];
+	if (slot->size < len) {
+		int size = (len + SLOT_ROUND - 1) & ~(SLOT_ROUND - 1);
+		uint8_t *data = (uint8_t *) malloc(size);
+
+		if (data == NULL)
+			return -ENOMEM;
+		free(slot->data);
+		slot->data = data;
+		slot->size = size;
+	}
+	memcpy(slot->data, buf, len);
+	section = section_codec(slot->data, len);
+	section_ext_decode(section, 0);
+
+	bit_set(table->received, section_number);
+	if (bit_test(table->expected, section_number))
+		table->missing--;
+
+	// EIT segments may be partly empty
+	if ((table_id >= 0x4e) && (table_id <= 0x6f) && (len >= MIN_SECTION_LENGTH + 6))
+		psi_table_eit_segment(table, section_number, buf[12]);
+
+	if (table->missing)
+		return psi_assembler_stored;
+
+	table->complete = 1;
+	assembler->complete++;
+	if (assembler->callback)
+		assembler->callback(assembler->arg, table);
+	return psi_assembler_complete;
+}
+
+struct psi_table *psi_assembler_find(struct psi_assembler *assembler,
+				     uint8_t table_id, uint16_t table_id_ext)
+{
+	struct psi_table *table = assembler->hash[psi_assembler_hash(table_id, table_id_ext)];
+
+	while (table) {
+		if ((table->table_id == table_id) && (table->table_id_ext == table_id_ext))
+			return table;
+		table = table->next;
+	}
+
+	return NULL;
+}
+
+int psi_assembler_tables(struct psi_assembler *assembler, int *complete)
+{
+	if (complete)
+		*complete = assembler->complete;
+	return assembler->tables;
+}
+
+void psi_assembler_reset(struct psi_assembler *assembler)
+{
+	int i;
+
+	for (i = 0; i < HASH_BUCKETS; i++) {
+		struct psi_table *table;
+
+		while ((table = assembler->hash[i]) != NULL) {
+			assembler->hash[i] = table->next;
+			table->next = assembler->free_tables;
+			assembler->free_tables = table;
+		}
+	}
+	assembler->tables = 0;
+	assembler->complete = 0;
+}
+
+static struct psi_table *psi_assembler_new_table(struct psi_assembler *assembler,
+						 uint8_t table_id, uint16_t table_id_ext)
+{
+	struct psi_table *table;
+	int bucket = psi_assembler_hash(table_id, table_id_ext);
+
+	// reuse a table from a previous reset if there is one
+	if ((table = assembler->free_tables) != NULL) {
+		assembler->free_tables = table->next;
+	} else {
+		table = (struct psi_table *) malloc(sizeof(struct psi_table));
+		if (table == NULL)
+			return NULL;
+		memset(table, 0, sizeof(struct psi_table));
+	}
+
+	table->table_id = table_id;
+	table->table_id_ext = table_id_ext;
+	table->version_number = 0xff;
+	table->complete = 0;
+	table->version_changes = 0;
+	table->next = assembler->hash[bucket];
+	assembler->hash[bucket] = table;
+	assembler->tables++;
+
+	return table;
+}
+
+static int psi_table_start(struct psi_table *table, uint8_t version_number,
+			   uint8_t last_section_number)
+{
+	int count = last_section_number + 1;
+	int i;
+
+	if (table->nslots < count) {
+		struct psi_table_slot *slots;
+
+		slots = (struct psi_table_slot *)
+			realloc(table->slots, count * sizeof(struct psi_table_slot));
+		if (slots == NULL) {
+			table->version_number = 0xff;
+			return -ENOMEM;
+		}
+		memset(slots + table->nslots, 0,
+		       (count - table->nslots) * sizeof(struct psi_table_slot));
+		table->slots = slots;
+		table->nslots = count;
+	}
+
+	table->version_number = version_number;
+	table->last_section_number = last_section_number;
+	table->complete = 0;
+	table->missing = count;
+	memset(table->received, 0, sizeof(table->received));
+	memset(table->expected, 0, sizeof(table->expected));
+	for (i = 0; i < count; i += 32)
+		table->expected[i >> 5] = (count - i >= 32) ? 0xffffffff :
+						((1U << (count - i)) - 1);
+
+	return 0;
+}
+
+static void psi_table_eit_segment(struct psi_table *table, uint8_t section_number,
+				  uint8_t segment_last_section_number)
+{
+	int segment_end = section_number | 7;
+	int i;
+
+	// ignore nonsense values rather than trusting them
+	if ((segment_last_section_number < section_number) ||
+	    ((segment_last_section_number | 7) != segment_end))
+		return;
+	if (segment_end > table->last_section_number)
+		segment_end = table->last_section_number;
+
+	for (i = segment_last_section_number + 1; i <= segment_end; i++) {
+		if (!bit_test(table->expected, i))
+			continue;
+		bit_clear(table->expected, i);
+		if (!bit_test(table->received, i))
+			table->missing--;
+	}
+}
+
+static void psi_table_free(struct psi_table *table)
+{
+	int i;
+
+	for (i = 0; i < table->nslots; i++)
+		free(table->slots[i].data);
+	free(table->slots);
+	free(table);
+}
@@ -0,0 +1,193 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_PSI_ASSEMBLER_H
+#define _UCSI_PSI_ASSEMBLER_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <libucsi/section.h>
+
+/**
+ * Maximum number of sections in a table.
+ */
+#define PSI_TABLE_MAX_SECTIONS 256
+
+/**
+ * Storage for one section of a psi_table.
+ */
+struct psi_table_slot {
+	uint8_t *data;			/* the decoded section, if it has been received */
+	int size;			/* bytes allocated for data */
+};
+
+/**
+ * A table being assembled from its sections, identified by table_id and
+ * table_id_ext. Sections are stored as they arrive, in any order, and the
+ * table is complete once every section it is made up of has been received.
+ *
+ * For EIT tables (table_id 0x4e to 0x6f), sections after the
+ * segment_last_section_number of each segment are never transmitted, so they
+ * are not waited for.
+ */
+struct psi_table {
+	uint8_t table_id;
+	uint16_t table_id_ext;
+	uint8_t version_number;		/* 0xff until a section has been received */
+	uint8_t last_section_number;
+	uint8_t complete:1;
+	uint16_t missing;		/* number of sections still to be received */
+	uint32_t version_changes;	/* number of times the version has changed */
+	uint32_t expected[PSI_TABLE_MAX_SECTIONS / 32];
+	uint32_t received[PSI_TABLE_MAX_SECTIONS / 32];
+	struct psi_table_slot *slots;	/* at least last_section_number + 1 entries */
+	int nslots;
+	struct psi_table *next;
+};
+
+/**
+ * Opaque type for a PSI table assembler, holding any number of tables.
+ */
+struct psi_assembler;
+
+/**
+ * Callback called when a table has been completely received. It is called
+ * again whenever a new version of the table is complete.
+ *
+ * @param arg Private argument.
+ * @param table The complete table. Its sections remain valid until a section
+ * of a new version of the table is added, or the assembler is reset.
+ */
+typedef void (*psi_assembler_callback)(void *arg, struct psi_table *table);
+
+/**
+ * Result codes of psi_assembler_add().
+ */
+enum psi_assembler_status {
+	psi_assembler_ignored	= 0,	/* already received, or not yet current */
+	psi_assembler_stored	= 1,	/* stored, the table is still incomplete */
+	psi_assembler_complete	= 2,	/* stored, and the table is now complete */
+};
+
+/**
+ * Create a psi_assembler.
+ *
+ * @param check_crc If 1, the CRC of each section is checked before it is
+ * stored. Sections which are discarded (e.g. repeats) are never checked.
+ * @return The psi_assembler, or NULL on error.
+ */
+extern struct psi_assembler *psi_assembler_create(int check_crc);
+
+/**
+ * Destroy a psi_assembler and all its tables.
+ *
+ * @param assembler The psi_assembler.
+ */
+extern void psi_assembler_destroy(struct psi_assembler *assembler);
+
+/**
+ * Set the callback called when a table is complete.
+ *
+ * @param assembler The psi_assembler.
+ * @param callback The callback, or NULL for none.
+ * @param arg Private argument for the callback.
+ */
+extern void psi_assembler_set_callback(struct psi_assembler *assembler,
+				       psi_assembler_callback callback, void *arg);
+
+/**
+ * Add a section to the assembler. The section is copied if it is needed, so
+ * the buffer is not modified and may be reused once this returns.
+ *
+ * A section with a different version number to the stored sections of its
+ * table starts the table again. Sections with current_next_indicator clear
+ * are ignored.
+ *
+ * @param assembler The psi_assembler.
+ * @param buf The raw section data, as read from a section filter.
+ * @param len Length of the data.
+ * @return One of enum psi_assembler_status, -EINVAL if the section is invalid
+ * or has a bad CRC, or -ENOMEM.
+ */
+extern int psi_assembler_add(struct psi_assembler *assembler, uint8_t *buf, int len);
+
+/**
+ * Find a table.
+ *
+ * @param assembler The psi_assembler.
+ * @param table_id The table_id.
+ * @param table_id_ext The table_id_ext.
+ * @return The psi_table, or NULL if no section of it has been received.
+ */
+extern struct psi_table *psi_assembler_find(struct psi_assembler *assembler,
+					    uint8_t table_id, uint16_t table_id_ext);
+
+/**
+ * Retrieve the number of tables known to the assembler.
+ *
+ * @param assembler The psi_assembler.
+ * @param complete If not NULL, set to the number of those which are complete.
+ * @return The number of tables.
+ */
+extern int psi_assembler_tables(struct psi_assembler *assembler, int *complete);
+
+/**
+ * Forget all tables. The memory used for sections is kept for reuse.
+ *
+ * @param assembler The psi_assembler.
+ */
+extern void psi_assembler_reset(struct psi_assembler *assembler);
+
+/**
+ * Retrieve a section of a table. The section has been processed with
+ * section_codec() and section_ext_decode(), and may be passed once to the
+ * table-specific codec (e.g. dvb_eit_section_codec()), which works in place.
+ *
+ * @param table The psi_table.
+ * @param section_number The section number.
+ * @return The section, or NULL if it has not been received.
+ */
+static inline struct section_ext *psi_table_section(struct psi_table *table, int section_number)
+{
+	if ((section_number > table->last_section_number) ||
+	    !(table->received[section_number >> 5] & (1U << (section_number & 31))))
+		return NULL;
+	return (struct section_ext *) table->slots[section_number].data;
+}
+
+/**
+ * Convenience iterator over the received sections of a table, in section
+ * number order.
+ *
+ * @param table The psi_table.
+ * @param n Integer variable to use as the section number.
+ * @param section Variable of type struct section_ext * to set to each section.
+ */
+#define psi_table_for_each_section(table, n, section) \
+	for ((n) = 0; (n) <= (table)->last_section_number; (n)++) \
+		if (((section) = psi_table_section((table), (n))) != NULL)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
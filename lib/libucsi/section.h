@@ -65,7 +65,9 @@ struct section_ext {
 } __ucsi_packed;
 
 /**
- * Structure for keeping track of sections of a PSI table.
+ * Structure for keeping track of sections of a PSI table. Sections must be
+ * received in order, starting from section 0: see psi_assembler.h for
+ * assembling whole tables from sections received in any order.
  */
 struct psi_table_state {
 	uint8_t version_number;
@@ -0,0 +1,315 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_SECTION_VIEW_H
+#define _UCSI_SECTION_VIEW_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <libucsi/section.h>
+
+/*
+ * Section views are a read-only alternative to the *_section_codec()
+ * functions. A view is simply a const pointer to the raw, network ordered
+ * section bytes: validation is done once by the *_view_init() functions, and
+ * every accessor loads its field directly from the buffer. The buffer is never
+ * modified, so it may be shared between threads, cached, and viewed any number
+ * of times. Do not pass the same buffer to a *_section_codec() function while
+ * views of it are in use.
+ *
+ * The accessors are forced inline, so walking a view costs no more than the
+ * equivalent loads from a decoded section even in unoptimised builds.
+ */
+
+/**
+ * Opaque type for a view of a raw section.
+ */
+struct section_view;
+
+/**
+ * Opaque type for a view of a raw section with the extended header.
+ */
+struct section_ext_view;
+
+/**
+ * Create a view of a raw section.
+ *
+ * @param buf Pointer to the unprocessed section data.
+ * @param len Length of data.
+ * @return Pointer to the section_view, or NULL if invalid.
+ */
+static inline __attribute__((always_inline))
+	const struct section_view *section_view_init(const uint8_t *buf, size_t len)
+{
+	if (len < 3)
+		return NULL;
+
+	if (len != (load_be16(buf + 1) & 0x0fffU) + 3U)
+		return NULL;
+
+	return (const struct section_view *) buf;
+}
+
+/**
+ * Accessor for the raw data of a section_view.
+ *
+ * @param section The section_view.
+ * @return Pointer to the unprocessed section data.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *section_view_data(const struct section_view *section)
+{
+	return (const uint8_t *) section;
+}
+
+/**
+ * Accessor for the table_id of a section_view.
+ *
+ * @param section The section_view.
+ * @return The table_id.
+ */
+static inline __attribute__((always_inline))
+	uint8_t section_view_table_id(const struct section_view *section)
+{
+	return section_view_data(section)[0];
+}
+
+/**
+ * Accessor for the syntax_indicator of a section_view.
+ *
+ * @param section The section_view.
+ * @return The syntax_indicator.
+ */
+static inline __attribute__((always_inline))
+	int section_view_syntax_indicator(const struct section_view *section)
+{
+	return section_view_data(section)[1] >> 7;
+}
+
+/**
+ * Determine the total length of a section_view, including the header.
+ *
+ * @param section The section_view.
+ * @return The length.
+ */
+static inline __attribute__((always_inline))
+	size_t section_view_length(const struct section_view *section)
+{
+	return (load_be16(section_view_data(section) + 1) & 0x0fff) + 3;
+}
+
+/**
+ * Check the CRC of a section_view. No byte swapping is needed since the data
+ * is still in network order.
+ *
+ * @param section The section_view.
+ * @return Nonzero on error, or 0 if the CRC was correct.
+ */
+static inline __attribute__((always_inline))
+	int section_view_check_crc(const struct section_view *section)
+{
+	if (crc32(CRC32_INIT, (uint8_t *) section_view_data(section),
+		  section_view_length(section)))
+		return -1;
+	return 0;
+}
+
+/**
+ * Create a view of the extended header of a section.
+ *
+ * @param section The section_view.
+ * @param check_crc If 1, the CRC of the section will also be checked.
+ * @return Pointer to the section_ext_view, or NULL if invalid.
+ */
+static inline __attribute__((always_inline)) const struct section_ext_view *
+	section_ext_view_init(const struct section_view *section, int check_crc)
+{
+	if (!section_view_syntax_indicator(section))
+		return NULL;
+
+	if (section_view_length(section) < sizeof(struct section_ext) + CRC_SIZE)
+		return NULL;
+
+	if (check_crc && section_view_check_crc(section))
+		return NULL;
+
+	return (const struct section_ext_view *) section;
+}
+
+/**
+ * Accessor for the generic section_view of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The section_view.
+ */
+static inline __attribute__((always_inline))
+	const struct section_view *section_ext_view_section(const struct section_ext_view *ext)
+{
+	return (const struct section_view *) ext;
+}
+
+/**
+ * Accessor for the raw data of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return Pointer to the unprocessed section data.
+ */
+static inline __attribute__((always_inline))
+	const uint8_t *section_ext_view_data(const struct section_ext_view *ext)
+{
+	return (const uint8_t *) ext;
+}
+
+/**
+ * Determine the length of a section_ext_view, including the header but
+ * omitting the CRC.
+ *
+ * @param ext The section_ext_view.
+ * @return The length.
+ */
+static inline __attribute__((always_inline))
+	size_t section_ext_view_length(const struct section_ext_view *ext)
+{
+	return section_view_length(section_ext_view_section(ext)) - CRC_SIZE;
+}
+
+/**
+ * Accessor for the table_id field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The table_id.
+ */
+static inline __attribute__((always_inline))
+	uint8_t section_ext_view_table_id(const struct section_ext_view *ext)
+{
+	return section_ext_view_data(ext)[0];
+}
+
+/**
+ * Accessor for the table_id_ext field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The table_id_ext.
+ */
+static inline __attribute__((always_inline))
+	uint16_t section_ext_view_table_id_ext(const struct section_ext_view *ext)
+{
+	return load_be16(section_ext_view_data(ext) + 3);
+}
+
+/**
+ * Accessor for the version_number field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The version_number.
+ */
+static inline __attribute__((always_inline))
+	uint8_t section_ext_view_version_number(const struct section_ext_view *ext)
+{
+	return (section_ext_view_data(ext)[5] >> 1) & 0x1f;
+}
+
+/**
+ * Accessor for the current_next_indicator field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The current_next_indicator.
+ */
+static inline __attribute__((always_inline))
+	int section_ext_view_current_next_indicator(const struct section_ext_view *ext)
+{
+	return section_ext_view_data(ext)[5] & 0x01;
+}
+
+/**
+ * Accessor for the section_number field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The section_number.
+ */
+static inline __attribute__((always_inline))
+	uint8_t section_ext_view_section_number(const struct section_ext_view *ext)
+{
+	return section_ext_view_data(ext)[6];
+}
+
+/**
+ * Accessor for the last_section_number field of a section_ext_view.
+ *
+ * @param ext The section_ext_view.
+ * @return The last_section_number.
+ */
+static inline __attribute__((always_inline))
+	uint8_t section_ext_view_last_section_number(const struct section_ext_view *ext)
+{
+	return section_ext_view_data(ext)[7];
+}
+
+/**
+ * Iterator for a block of unprocessed descriptors. Descriptor headers need no
+ * byte swapping, so these are ordinary descriptor pointers - but note that
+ * the *_descriptor_codec() functions modify the data in place, so descriptor
+ * payloads must be read with load_be16() and friends instead.
+ *
+ * @param buf Pointer to the start of the descriptors.
+ * @param len Length of the descriptors in bytes.
+ * @param pos Variable holding a pointer to the current descriptor.
+ */
+#define descriptor_view_for_each(buf, len, pos) \
+	for ((pos) = descriptor_view_first(buf, len); \
+	     (pos); \
+	     (pos) = descriptor_view_next(buf, len, pos))
+
+
+
+
+
+
+
+
+
+
+/******************************** PRIVATE CODE ********************************/
+static inline __attribute__((always_inline)) const struct descriptor *
+	descriptor_view_first(const uint8_t *buf, size_t len)
+{
+	if (len == 0)
+		return NULL;
+
+	return (const struct descriptor *) buf;
+}
+
+static inline __attribute__((always_inline)) const struct descriptor *
+	descriptor_view_next(const uint8_t *buf, size_t len, const struct descriptor *pos)
+{
+	const uint8_t *next = (const uint8_t *) pos + 2 + pos->len;
+
+	if (next >= buf + len)
+		return NULL;
+
+	return (const struct descriptor *) next;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
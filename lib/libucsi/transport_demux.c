@@ -0,0 +1,267 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "transport_demux.h"
+
+#define SINK_TYPE_SECTION 0
+#define SINK_TYPE_PACKET  1
+
+struct transport_demux_sink {
+	int type;
+	unsigned char continuity;
+	enum transport_value extract;
+	transport_demux_section_callback section_callback;
+	transport_demux_packet_callback packet_callback;
+	void *arg;
+	struct section_buf *section;
+};
+
+struct transport_demux {
+	struct transport_demux_stats stats;
+	struct transport_demux_sink *pids[TRANSPORT_MAX_PIDS];
+};
+
+static struct transport_demux_sink *transport_demux_add_sink(struct transport_demux *demux,
+							      int pid, int *error);
+static void transport_demux_section(struct transport_demux *demux,
+				    struct transport_demux_sink *sink, int pid,
+				    struct transport_packet *pkt,
+				    struct transport_values *values);
+
+
+struct transport_demux *transport_demux_create(void)
+{
+	struct transport_demux *demux;
+
+	demux = (struct transport_demux *) malloc(sizeof(struct transport_demux));
+	if (demux == NULL)
+		return NULL;
+	memset(demux, 0, sizeof(struct transport_demux));
+
+	return demux;
+}
+
+void transport_demux_destroy(struct transport_demux *demux)
+{
+	int pid;
+
+	for (pid = 0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if (demux->pids[pid])
+			transport_demux_remove(demux, pid);
+	}
+
+	free(demux);
+}
+
+int transport_demux_add_section(struct transport_demux *demux, int pid, int max,
+				transport_demux_section_callback callback, void *arg)
+{
+	struct transport_demux_sink *sink;
+	struct section_buf *section;
+	int error;
+
+	if ((max < 3) || (callback == NULL))
+		return -EINVAL;
+
+	section = (struct section_buf *) malloc(sizeof(struct section_buf) + max);
+	if (section == NULL)
+		return -ENOMEM;
+	section_buf_init(section, max);
+
+	if ((sink = transport_demux_add_sink(demux, pid, &error)) == NULL) {
+		free(section);
+		return error;
+	}
+	sink->type = SINK_TYPE_SECTION;
+	sink->section_callback = callback;
+	sink->arg = arg;
+	sink->section = section;
+
+	return 0;
+}
+
+int transport_demux_add_packet(struct transport_demux *demux, int pid,
+			       enum transport_value extract,
+			       transport_demux_packet_callback callback, void *arg)
+{
+	struct transport_demux_sink *sink;
+	int error;
+
+	if (callback == NULL)
+		return -EINVAL;
+
+	if ((sink = transport_demux_add_sink(demux, pid, &error)) == NULL)
+		return error;
+	sink->type = SINK_TYPE_PACKET;
+	sink->extract = extract;
+	sink->packet_callback = callback;
+	sink->arg = arg;
+
+	return 0;
+}
+
+int transport_demux_remove(struct transport_demux *demux, int pid)
+{
+	struct transport_demux_sink *sink;
+
+	if ((pid < 0) || (pid >= TRANSPORT_MAX_PIDS))
+		return -ENOENT;
+	if ((sink = demux->pids[pid]) == NULL)
+		return -ENOENT;
+
+	demux->pids[pid] = NULL;
+	if (sink->section)
+		free(sink->section);
+	free(sink);
+
+	return 0;
+}
+
+int transport_demux_feed(struct transport_demux *demux, uint8_t *buf, int len)
+{
+	uint8_t *end = buf + len - (len % TRANSPORT_PACKET_LENGTH);
+	uint8_t *pos;
+	struct transport_packet *pkt;
+	struct transport_demux_sink *sink;
+	struct transport_values values;
+	int pid;
+	int discontinuity;
+	int extracted;
+
+	for (pos = buf; pos < end; pos += TRANSPORT_PACKET_LENGTH) {
+		demux->stats.packets++;
+
+		if ((pkt = transport_packet_init(pos)) == NULL) {
+			demux->stats.sync_errors++;
+			continue;
+		}
+		if (pkt->transport_error_indicator) {
+			demux->stats.transport_errors++;
+			continue;
+		}
+
+		/* the only per-packet cost for unwanted PIDs is this lookup */
+		pid = transport_packet_pid(pkt);
+		if ((sink = demux->pids[pid]) == NULL)
+			continue;
+
+		if (sink->extract)
+			extracted = transport_packet_values_extract(pkt, &values, sink->extract);
+		else
+			extracted = transport_packet_values_extract_payload(pkt, &values);
+		if (extracted < 0) {
+			demux->stats.transport_errors++;
+			continue;
+		}
+
+		discontinuity = 0;
+		if (transport_packet_continuity_check(pkt,
+		    values.flags & transport_adaptation_flag_discontinuity,
+		    &sink->continuity)) {
+			demux->stats.continuity_errors++;
+			sink->continuity = 0;
+			discontinuity = 1;
+		}
+
+		if (sink->type == SINK_TYPE_PACKET) {
+			sink->packet_callback(sink->arg, pid, pkt, &values, discontinuity);
+			continue;
+		}
+
+		/* drop the partial section, and resync on the next section
+		 * start, which may be in this packet */
+		if (discontinuity) {
+			section_buf_reset(sink->section);
+			sink->section->wait_pdu = 1;
+		}
+		transport_demux_section(demux, sink, pid, pkt, &values);
+	}
+
+	return end - buf;
+}
+
+struct transport_demux_stats *transport_demux_get_stats(struct transport_demux *demux)
+{
+	return &demux->stats;
+}
+
+static struct transport_demux_sink *transport_demux_add_sink(struct transport_demux *demux,
+							      int pid, int *error)
+{
+	struct transport_demux_sink *sink;
+
+	if ((pid < 0) || (pid >= TRANSPORT_MAX_PIDS)) {
+		*error = -EINVAL;
+		return NULL;
+	}
+	if (demux->pids[pid]) {
+		*error = -EEXIST;
+		return NULL;
+	}
+
+	sink = (struct transport_demux_sink *) malloc(sizeof(struct transport_demux_sink));
+	if (sink == NULL) {
+		*error = -ENOMEM;
+		return NULL;
+	}
+	memset(sink, 0, sizeof(struct transport_demux_sink));
+	demux->pids[pid] = sink;
+
+	return sink;
+}
+
+static void transport_demux_section(struct transport_demux *demux,
+				    struct transport_demux_sink *sink, int pid,
+				    struct transport_packet *pkt,
+				    struct transport_values *values)
+{
+	struct section_buf *section = sink->section;
+	uint8_t *payload = values->payload;
+	int len = values->payload_length;
+	int pdu_start = pkt->payload_unit_start_indicator;
+	int section_status;
+	int used;
+
+	/* a packet may complete one section and start several more */
+	while (len) {
+		used = section_buf_add_transport_payload(section, payload, len,
+							 pdu_start, &section_status);
+		pdu_start = 0;
+		len -= used;
+		payload += used;
+
+		if (section_status == 1) {
+			/* resetting only clears the header, so the data stays
+			 * valid, and the callback is free to remove the sink */
+			int section_len = section->len;
+
+			section_buf_reset(section);
+			demux->stats.sections++;
+			sink->section_callback(sink->arg, pid,
+					       section_buf_data(section), section_len);
+			if (demux->pids[pid] != sink)
+				return;
+		} else if (section_status < 0) {
+			demux->stats.section_errors++;
+			section_buf_reset(section);
+		}
+	}
+}
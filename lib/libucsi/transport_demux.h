@@ -0,0 +1,155 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TRANSPORT_DEMUX_H
+#define _UCSI_TRANSPORT_DEMUX_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <libucsi/transport_packet.h>
+#include <libucsi/section_buf.h>
+
+/**
+ * Opaque type representing a transport stream demultiplexer. Whole buffers of
+ * transport packets are fed into it, and each packet is routed by PID to the
+ * sink registered for that PID.
+ */
+struct transport_demux;
+
+/**
+ * Callback called when a complete section has been received on a PID.
+ *
+ * @param arg Private argument supplied when the sink was registered.
+ * @param pid PID the section was received on.
+ * @param section Pointer to the raw section data. This may be processed in
+ * place (e.g. by section_codec()), but is only valid until the callback returns.
+ * @param len Length of the section in bytes.
+ */
+typedef void (*transport_demux_section_callback)(void *arg, int pid,
+						  uint8_t *section, int len);
+
+/**
+ * Callback called for every packet received on a PID (e.g. for PES data).
+ *
+ * @param arg Private argument supplied when the sink was registered.
+ * @param pid PID of the packet.
+ * @param pkt The transport packet.
+ * @param values Values extracted from the packet - the payload fields are always
+ * valid, any others depend on the extract flags supplied when registering.
+ * @param discontinuity Nonzero if a continuity error was detected just before
+ * this packet.
+ */
+typedef void (*transport_demux_packet_callback)(void *arg, int pid,
+						 struct transport_packet *pkt,
+						 struct transport_values *values,
+						 int discontinuity);
+
+/**
+ * Statistics collected by a transport_demux.
+ */
+struct transport_demux_stats {
+	uint64_t packets;		/* number of packets processed */
+	uint64_t sync_errors;		/* packets discarded due to a bad sync byte */
+	uint64_t transport_errors;	/* packets with transport_error_indicator set */
+	uint64_t continuity_errors;	/* continuity errors on registered PIDs */
+	uint64_t sections;		/* sections delivered to callbacks */
+	uint64_t section_errors;	/* sections discarded as invalid */
+};
+
+/**
+ * Create a transport_demux with no registered sinks.
+ *
+ * @return The new transport_demux, or NULL on error.
+ */
+extern struct transport_demux *transport_demux_create(void);
+
+/**
+ * Destroy a transport_demux and all its sinks.
+ *
+ * @param demux The transport_demux.
+ */
+extern void transport_demux_destroy(struct transport_demux *demux);
+
+/**
+ * Register a section sink on a PID. Payloads are reassembled with a
+ * section_buf, and the callback is called for each complete section.
+ *
+ * @param demux The transport_demux.
+ * @param pid PID to register.
+ * @param max Maximum size of a section (e.g. DVB_MAX_SECTION_BYTES).
+ * @param callback Callback to call for each section.
+ * @param arg Private argument to pass to the callback.
+ * @return 0 on success, -EEXIST if the PID already has a sink, -EINVAL or
+ * -ENOMEM on other errors.
+ */
+extern int transport_demux_add_section(struct transport_demux *demux, int pid, int max,
+				       transport_demux_section_callback callback, void *arg);
+
+/**
+ * Register a packet sink on a PID.
+ *
+ * @param demux The transport_demux.
+ * @param pid PID to register.
+ * @param extract Orred bitmask of enum transport_value to extract for the callback.
+ * @param callback Callback to call for each packet.
+ * @param arg Private argument to pass to the callback.
+ * @return 0 on success, -EEXIST if the PID already has a sink, -EINVAL or
+ * -ENOMEM on other errors.
+ */
+extern int transport_demux_add_packet(struct transport_demux *demux, int pid,
+				      enum transport_value extract,
+				      transport_demux_packet_callback callback, void *arg);
+
+/**
+ * Remove the sink registered on a PID.
+ *
+ * @param demux The transport_demux.
+ * @param pid PID to remove.
+ * @return 0 on success, -ENOENT if nothing was registered.
+ */
+extern int transport_demux_remove(struct transport_demux *demux, int pid);
+
+/**
+ * Feed a buffer of packets through the demux. Only whole packets are
+ * processed; the caller should keep any remaining bytes and supply them at
+ * the start of the next buffer.
+ *
+ * @param demux The transport_demux.
+ * @param buf Buffer of 188 byte transport packets.
+ * @param len Number of bytes in the buffer.
+ * @return Number of bytes consumed.
+ */
+extern int transport_demux_feed(struct transport_demux *demux, uint8_t *buf, int len);
+
+/**
+ * Get the statistics of a transport_demux.
+ *
+ * @param demux The transport_demux.
+ * @return Pointer to the statistics.
+ */
+extern struct transport_demux_stats *transport_demux_get_stats(struct transport_demux *demux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,640 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "transport_monitor.h"
+#include "transport_sync.h"
+#include "section_buf.h"
+#include "mpeg/pat_view.h"
+#include "mpeg/pmt_view.h"
+#include "mpeg/section.h"
+#include "dvb/section.h"
+
+#define HZ TRANSPORT_MONITOR_HZ
+#define PCR_MODULUS ((1ULL << 33) * 300)
+
+/* TR 101 290 limits */
+#define PAT_PERIOD		(HZ / 2)
+#define PMT_PERIOD		(HZ / 2)
+#define CAT_PERIOD		(HZ / 2)
+#define PCR_REPETITION		(HZ * 40 / 1000)
+#define PCR_DISCONTINUITY	(HZ / 10)
+#define PCR_ACCURACY		(HZ * 500 / 1000000000)
+#define PTS_REPETITION		(HZ * 700 / 1000)
+
+/* interval between timeout checks */
+#define SWEEP_PERIOD		(HZ / 100)
+
+/* PCR accuracy is measured against a bitrate estimated over at least this
+ * long, restarting after PCR_REBASE to follow bitrate changes */
+#define PCR_SETTLE		(HZ / 10)
+#define PCR_REBASE		(HZ * 60)
+
+/* PSI PIDs whose sections are CRC checked, and then the PMTs */
+static const int psi_pids[] = { 0x00, 0x01, 0x10, 0x11, 0x12, 0x14 };
+#define PSI_PIDS (sizeof(psi_pids) / sizeof(int))
+#define SECTION_SLOTS (PSI_PIDS + TRANSPORT_MONITOR_MAX_PROGRAMS)
+#define SECTION_SLOT_SIZE (sizeof(struct section_buf) + DVB_MAX_SECTION_BYTES)
+
+#define MAX_ES_PIDS 512
+
+#define PID_FLAG_PMT		0x01	/* program_map_PID in the PAT */
+#define PID_FLAG_ES		0x02	/* elementary stream in a PMT */
+#define PID_FLAG_PCR		0x04	/* PCR_PID in a PMT */
+#define PID_FLAG_PCR_VALID	0x08
+#define PID_FLAG_PTS_VALID	0x10
+
+struct transport_monitor_pid {
+	unsigned char continuity;
+	uint8_t flags;
+	uint8_t section;		/* section slot + 1, or 0 */
+	uint64_t last_seen;		/* time of the last packet (ES) or PMT section */
+	uint64_t pts_time;		/* time of the last PTS */
+	uint64_t pcr_time;		/* time of the last PCR */
+	uint64_t pcr_last;
+	uint64_t pcr_last_pos;
+	uint64_t pcr_base;
+	uint64_t pcr_base_pos;
+};
+
+struct transport_monitor {
+	struct transport_sync sync;
+	uint64_t sync_byte_errors;	/* sync byte errors already reported */
+
+	transport_monitor_callback callback;
+	void *arg;
+	uint64_t pid_timeout;
+
+	uint64_t packets;
+	uint64_t position;		/* bytes of aligned packets processed */
+	uint64_t section_errors;	/* sections which could not be assembled */
+
+	/* stream clock */
+	int clock_pid;
+	uint64_t clock_pcr;
+	uint64_t clock_pos;
+	uint64_t clock_time;
+	double clock_rate;		/* ticks per byte, 0 until running */
+	uint64_t next_sweep;
+
+	int pat_version;
+	uint64_t pat_time;
+	int cat_seen;
+	int scrambled_seen;
+	uint64_t cat_time;
+
+	int pmt_count;
+	uint16_t pmt_pids[TRANSPORT_MONITOR_MAX_PROGRAMS];
+	int es_count;
+	uint16_t es_pids[MAX_ES_PIDS];
+
+	uint8_t *sections;
+	uint64_t counts[TRANSPORT_MONITOR_INDICATORS];
+	uint32_t (*pid_counts)[TRANSPORT_MONITOR_INDICATORS];
+	struct transport_monitor_pid pids[TRANSPORT_MAX_PIDS];
+};
+
+static const char *indicator_names[TRANSPORT_MONITOR_INDICATORS] = {
+	"TS_sync_loss",
+	"Sync_byte_error",
+	"PAT_error",
+	"Continuity_count_error",
+	"PMT_error",
+	"PID_error",
+	"Transport_error",
+	"CRC_error",
+	"PCR_repetition_error",
+	"PCR_discontinuity_indicator_error",
+	"PCR_accuracy_error",
+	"PTS_error",
+	"CAT_error",
+};
+
+static void transport_monitor_lost(void *arg, uint64_t offset);
+static void transport_monitor_packet(struct transport_monitor *monitor, uint8_t *buf);
+static void transport_monitor_pcr(struct transport_monitor *monitor, int pid,
+				  uint64_t pcr, int discontinuity);
+static void transport_monitor_pts(struct transport_monitor *monitor, int pid,
+				  uint8_t *payload, int len);
+static void transport_monitor_sections(struct transport_monitor *monitor, int pid,
+				       struct transport_packet *pkt,
+				       struct transport_values *values);
+static void transport_monitor_section(struct transport_monitor *monitor, int pid,
+				      uint8_t *buf, int len);
+static void transport_monitor_sweep(struct transport_monitor *monitor, uint64_t now);
+
+
+struct transport_monitor *transport_monitor_create(int packet_size)
+{
+	struct transport_monitor *monitor;
+	unsigned int i;
+
+	monitor = (struct transport_monitor *) malloc(sizeof(struct transport_monitor));
+	if (monitor == NULL)
+		return NULL;
+	memset(monitor, 0, sizeof(struct transport_monitor));
+
+	monitor->pid_counts = calloc(TRANSPORT_MAX_PIDS, sizeof(*monitor->pid_counts));
+	monitor->sections = malloc(SECTION_SLOTS * SECTION_SLOT_SIZE);
+	if ((monitor->pid_counts == NULL) || (monitor->sections == NULL)) {
+		transport_monitor_destroy(monitor);
+		return NULL;
+	}
+
+	transport_sync_init(&monitor->sync, packet_size, transport_monitor_lost, monitor);
+	monitor->pid_timeout = 5 * HZ;
+	monitor->clock_pid = -1;
+	monitor->pat_version = -1;
+
+	for (i = 0; i < PSI_PIDS; i++) {
+		section_buf_init((struct section_buf *) (monitor->sections + (i * SECTION_SLOT_SIZE)),
+				 DVB_MAX_SECTION_BYTES);
+		monitor->pids[psi_pids[i]].section = i + 1;
+	}
+
+	return monitor;
+}
+
+void transport_monitor_destroy(struct transport_monitor *monitor)
+{
+	free(monitor->pid_counts);
+	free(monitor->sections);
+	free(monitor);
+}
+
+void transport_monitor_set_callback(struct transport_monitor *monitor,
+				    transport_monitor_callback callback, void *arg)
+{
+	monitor->callback = callback;
+	monitor->arg = arg;
+}
+
+void transport_monitor_set_pid_timeout(struct transport_monitor *monitor, int ms)
+{
+	monitor->pid_timeout = (HZ * ms) / 1000;
+}
+
+uint64_t transport_monitor_count(struct transport_monitor *monitor,
+				 enum transport_monitor_indicator indicator)
+{
+	return monitor->counts[indicator];
+}
+
+uint32_t transport_monitor_pid_count(struct transport_monitor *monitor, int pid,
+				     enum transport_monitor_indicator indicator)
+{
+	return monitor->pid_counts[pid][indicator];
+}
+
+uint64_t transport_monitor_packets(struct transport_monitor *monitor)
+{
+	return monitor->packets;
+}
+
+uint64_t transport_monitor_section_errors(struct transport_monitor *monitor)
+{
+	return monitor->section_errors;
+}
+
+const char *transport_monitor_indicator_name(enum transport_monitor_indicator indicator)
+{
+	if ((unsigned int) indicator >= TRANSPORT_MONITOR_INDICATORS)
+		return "Unknown";
+	return indicator_names[indicator];
+}
+
+uint64_t transport_monitor_time(struct transport_monitor *monitor)
+{
+	if (monitor->clock_rate == 0)
+		return 0;
+
+	return monitor->clock_time +
+		(uint64_t) ((monitor->position - monitor->clock_pos) * monitor->clock_rate);
+}
+
+int transport_monitor_feed(struct transport_monitor *monitor, uint8_t *buf, int len)
+{
+	int consumed;
+	int aligned;
+	int pos;
+
+	aligned = transport_sync_process(&monitor->sync, buf, len, &consumed);
+
+	while (monitor->sync_byte_errors < monitor->sync.sync_byte_errors) {
+		monitor->sync_byte_errors++;
+		monitor->counts[transport_monitor_sync_byte_error]++;
+		if (monitor->callback)
+			monitor->callback(monitor->arg, transport_monitor_sync_byte_error, -1,
+					  transport_monitor_time(monitor));
+	}
+
+	for (pos = 0; pos < aligned; pos += TRANSPORT_PACKET_LENGTH) {
+		transport_monitor_packet(monitor, buf + pos);
+		monitor->position += TRANSPORT_PACKET_LENGTH;
+	}
+
+	return consumed;
+}
+
+static void transport_monitor_error(struct transport_monitor *monitor,
+				    enum transport_monitor_indicator indicator,
+				    int pid)
+{
+	monitor->counts[indicator]++;
+	if (pid >= 0)
+		monitor->pid_counts[pid][indicator]++;
+
+	if (monitor->callback)
+		monitor->callback(monitor->arg, indicator, pid, transport_monitor_time(monitor));
+}
+
+static void transport_monitor_lost(void *arg, uint64_t offset)
+{
+	(void) offset;
+	transport_monitor_error((struct transport_monitor *) arg,
+				transport_monitor_ts_sync_loss, -1);
+}
+
+static void transport_monitor_packet(struct transport_monitor *monitor, uint8_t *buf)
+{
+	struct transport_packet *pkt = (struct transport_packet *) buf;
+	struct transport_monitor_pid *p;
+	struct transport_values values;
+	int pid = transport_packet_pid(pkt);
+	int scrambled = pkt->transport_scrambling_control;
+	int extracted;
+	int discontinuity;
+	uint64_t now;
+
+	monitor->packets++;
+	p = &monitor->pids[pid];
+
+	if (pkt->transport_error_indicator) {
+		transport_monitor_error(monitor, transport_monitor_transport_error, pid);
+		return;
+	}
+	if (pid == TRANSPORT_NULL_PID)
+		return;
+
+	if (scrambled) {
+		monitor->scrambled_seen = 1;
+		if (pid == 0)
+			transport_monitor_error(monitor, transport_monitor_pat_error, pid);
+		else if (p->flags & PID_FLAG_PMT)
+			transport_monitor_error(monitor, transport_monitor_pmt_error, pid);
+	}
+
+	if ((extracted = transport_packet_values_extract_pcr(pkt, &values)) < 0) {
+		transport_monitor_error(monitor, transport_monitor_transport_error, pid);
+		return;
+	}
+	discontinuity = values.flags & transport_adaptation_flag_discontinuity;
+
+	if (transport_packet_continuity_check(pkt, discontinuity, &p->continuity)) {
+		transport_monitor_error(monitor, transport_monitor_continuity_count_error, pid);
+		p->continuity = 0;
+		if (p->section)
+			section_buf_reset((struct section_buf *)
+					  (monitor->sections + ((p->section - 1) * SECTION_SLOT_SIZE)));
+	}
+
+	if (extracted & transport_value_pcr)
+		transport_monitor_pcr(monitor, pid, values.pcr, discontinuity);
+
+	if (values.payload_length && !scrambled) {
+		if (p->section)
+			transport_monitor_sections(monitor, pid, pkt, &values);
+		else if ((p->flags & PID_FLAG_ES) && pkt->payload_unit_start_indicator)
+			transport_monitor_pts(monitor, pid, values.payload, values.payload_length);
+	}
+
+	if ((now = transport_monitor_time(monitor)) == 0)
+		return;
+	if (p->flags & PID_FLAG_ES)
+		p->last_seen = now;
+	if (now >= monitor->next_sweep) {
+		transport_monitor_sweep(monitor, now);
+		monitor->next_sweep = now + SWEEP_PERIOD;
+	}
+}
+
+static void transport_monitor_clock(struct transport_monitor *monitor, uint64_t pcr,
+				    int discontinuity)
+{
+	uint64_t bytes = monitor->position - monitor->clock_pos;
+	uint64_t delta = (pcr + PCR_MODULUS - monitor->clock_pcr) % PCR_MODULUS;
+
+	if (discontinuity || (delta > HZ) || (bytes == 0)) {
+		// keep the clock running at the old rate across a discontinuity
+		monitor->clock_time = transport_monitor_time(monitor);
+	} else {
+		monitor->clock_time += delta;
+		monitor->clock_rate = (double) delta / bytes;
+	}
+
+	monitor->clock_pcr = pcr;
+	monitor->clock_pos = monitor->position;
+}
+
+static void transport_monitor_pcr(struct transport_monitor *monitor, int pid,
+				  uint64_t pcr, int discontinuity)
+{
+	struct transport_monitor_pid *p = &monitor->pids[pid];
+	uint64_t pos = monitor->position;
+	uint64_t now;
+	uint64_t delta;
+	uint64_t span;
+
+	// the first PCR PID seen drives the stream clock
+	if (monitor->clock_pid < 0) {
+		monitor->clock_pid = pid;
+		monitor->clock_pcr = pcr;
+		monitor->clock_pos = pos;
+	} else if (monitor->clock_pid == pid) {
+		transport_monitor_clock(monitor, pcr, discontinuity);
+	}
+	now = transport_monitor_time(monitor);
+
+	if (!(p->flags & PID_FLAG_PCR_VALID) || discontinuity)
+		goto rebase;
+
+	delta = (pcr + PCR_MODULUS - p->pcr_last) % PCR_MODULUS;
+	if (delta > PCR_DISCONTINUITY) {
+		transport_monitor_error(monitor, transport_monitor_pcr_discontinuity_indicator_error, pid);
+		goto rebase;
+	}
+
+	if (now && p->pcr_time && ((now - p->pcr_time) > PCR_REPETITION))
+		transport_monitor_error(monitor, transport_monitor_pcr_repetition_error, pid);
+
+	// compare with a constant bitrate interpolation from the earlier PCRs
+	span = (p->pcr_last + PCR_MODULUS - p->pcr_base) % PCR_MODULUS;
+	if ((span >= PCR_SETTLE) && (p->pcr_last_pos > p->pcr_base_pos)) {
+		double expected = (double) span * (pos - p->pcr_base_pos) /
+				  (p->pcr_last_pos - p->pcr_base_pos);
+		double actual = (double) ((pcr + PCR_MODULUS - p->pcr_base) % PCR_MODULUS);
+
+		if ((actual - expected > PCR_ACCURACY) || (expected - actual > PCR_ACCURACY))
+			transport_monitor_error(monitor, transport_monitor_pcr_accuracy_error, pid);
+
+		if (span >= PCR_REBASE) {
+			p->pcr_base = p->pcr_last;
+			p->pcr_base_pos = p->pcr_last_pos;
+		}
+	}
+
+	p->pcr_last = pcr;
+	p->pcr_last_pos = pos;
+	p->pcr_time = now;
+	return;
+
+rebase:
+	p->pcr_base = p->pcr_last = pcr;
+	p->pcr_base_pos = p->pcr_last_pos = pos;
+	p->pcr_time = now;
+	p->flags |= PID_FLAG_PCR_VALID;
+}
+
+static void transport_monitor_pts(struct transport_monitor *monitor, int pid,
+				  uint8_t *payload, int len)
+{
+	struct transport_monitor_pid *p = &monitor->pids[pid];
+
+	// a PES header with PTS_DTS_flags set
+	if ((len < 14) || (payload[0] != 0) || (payload[1] != 0) || (payload[2] != 1))
+		return;
+	if (!(payload[7] & 0x80))
+		return;
+
+	p->pts_time = transport_monitor_time(monitor);
+	p->flags |= PID_FLAG_PTS_VALID;
+}
+
+static void transport_monitor_sections(struct transport_monitor *monitor, int pid,
+				       struct transport_packet *pkt,
+				       struct transport_values *values)
+{
+	struct transport_monitor_pid *p = &monitor->pids[pid];
+	struct section_buf *section = (struct section_buf *)
+		(monitor->sections + ((p->section - 1) * SECTION_SLOT_SIZE));
+	uint8_t *payload = values->payload;
+	int len = values->payload_length;
+	int pdu_start = pkt->payload_unit_start_indicator;
+	int section_status;
+	int used;
+
+	// a packet may complete one section and start several more
+	while (len) {
+		used = section_buf_add_transport_payload(section, payload, len,
+							 pdu_start, &section_status);
+		pdu_start = 0;
+		len -= used;
+		payload += used;
+
+		if (section_status == 1) {
+			int section_len = section->len;
+
+			section_buf_reset(section);
+			transport_monitor_section(monitor, pid, section_buf_data(section), section_len);
+
+			// the PAT may have moved this PMT to another slot
+			if (p->section == 0)
+				return;
+			section = (struct section_buf *)
+				(monitor->sections + ((p->section - 1) * SECTION_SLOT_SIZE));
+		} else if (section_status < 0) {
+			// a framing or length error, not a CRC_error
+			monitor->section_errors++;
+			section_buf_reset(section);
+		}
+	}
+}
+
+static void transport_monitor_add_es(struct transport_monitor *monitor, int pid, int flag)
+{
+	struct transport_monitor_pid *p = &monitor->pids[pid];
+
+	if (!(p->flags & (PID_FLAG_ES | PID_FLAG_PCR))) {
+		if (monitor->es_count == MAX_ES_PIDS)
+			return;
+		monitor->es_pids[monitor->es_count++] = pid;
+		p->last_seen = transport_monitor_time(monitor);
+		p->pcr_time = p->last_seen;
+	}
+	p->flags |= flag;
+}
+
+static void transport_monitor_reset_programs(struct transport_monitor *monitor)
+{
+	int i;
+
+	for (i = 0; i < monitor->pmt_count; i++) {
+		struct transport_monitor_pid *p = &monitor->pids[monitor->pmt_pids[i]];
+
+		p->flags &= ~PID_FLAG_PMT;
+		if (p->section > PSI_PIDS)
+			p->section = 0;
+	}
+	for (i = 0; i < monitor->es_count; i++)
+		monitor->pids[monitor->es_pids[i]].flags &= ~(PID_FLAG_ES | PID_FLAG_PCR);
+
+	monitor->pmt_count = 0;
+	monitor->es_count = 0;
+}
+
+static void transport_monitor_pat(struct transport_monitor *monitor,
+				  const struct section_ext_view *ext)
+{
+	const struct mpeg_pat_view *pat;
+	const struct mpeg_pat_program_view *program;
+
+	if (!section_ext_view_current_next_indicator(ext))
+		return;
+	if ((pat = mpeg_pat_view_init(ext)) == NULL)
+		return;
+
+	if (section_ext_view_version_number(ext) != monitor->pat_version) {
+		transport_monitor_reset_programs(monitor);
+		monitor->pat_version = section_ext_view_version_number(ext);
+	}
+
+	mpeg_pat_view_programs_for_each(pat, program) {
+		int pid = mpeg_pat_program_view_pid(program);
+		struct transport_monitor_pid *p = &monitor->pids[pid];
+
+		// program 0 is the network PID
+		if (mpeg_pat_program_view_program_number(program) == 0)
+			continue;
+		if ((p->flags & PID_FLAG_PMT) || (monitor->pmt_count == TRANSPORT_MONITOR_MAX_PROGRAMS))
+			continue;
+
+		p->flags |= PID_FLAG_PMT;
+		p->last_seen = transport_monitor_time(monitor);
+		if (p->section == 0) {
+			int slot = PSI_PIDS + monitor->pmt_count;
+
+			section_buf_init((struct section_buf *) (monitor->sections + (slot * SECTION_SLOT_SIZE)),
+					 DVB_MAX_SECTION_BYTES);
+			p->section = slot + 1;
+		}
+		monitor->pmt_pids[monitor->pmt_count++] = pid;
+	}
+}
+
+static void transport_monitor_pmt(struct transport_monitor *monitor,
+				  const struct section_ext_view *ext)
+{
+	const struct mpeg_pmt_view *pmt;
+	const struct mpeg_pmt_stream_view *stream;
+
+	if ((pmt = mpeg_pmt_view_init(ext)) == NULL)
+		return;
+
+	if (mpeg_pmt_view_pcr_pid(pmt) != TRANSPORT_NULL_PID)
+		transport_monitor_add_es(monitor, mpeg_pmt_view_pcr_pid(pmt), PID_FLAG_PCR);
+	mpeg_pmt_view_streams_for_each(pmt, stream) {
+		transport_monitor_add_es(monitor, mpeg_pmt_stream_view_pid(stream), PID_FLAG_ES);
+	}
+}
+
+static void transport_monitor_section(struct transport_monitor *monitor, int pid,
+				      uint8_t *buf, int len)
+{
+	struct transport_monitor_pid *p = &monitor->pids[pid];
+	const struct section_view *section;
+	const struct section_ext_view *ext = NULL;
+	uint8_t table_id;
+
+	if ((section = section_view_init(buf, len)) == NULL)
+		return;
+	table_id = section_view_table_id(section);
+
+	// every table on the monitored PIDs carries a CRC, except the TDT
+	if (section_view_syntax_indicator(section) || (table_id == stag_dvb_time_offset)) {
+		if (section_view_check_crc(section)) {
+			transport_monitor_error(monitor, transport_monitor_crc_error, pid);
+			return;
+		}
+		ext = section_ext_view_init(section, 0);
+	}
+
+	if (pid == 0) {
+		if (table_id != stag_mpeg_program_association) {
+			transport_monitor_error(monitor, transport_monitor_pat_error, pid);
+			return;
+		}
+		monitor->pat_time = transport_monitor_time(monitor);
+		if (ext)
+			transport_monitor_pat(monitor, ext);
+	} else if (pid == 1) {
+		if (table_id != stag_mpeg_conditional_access) {
+			transport_monitor_error(monitor, transport_monitor_cat_error, pid);
+			return;
+		}
+		monitor->cat_seen = 1;
+	} else if ((p->flags & PID_FLAG_PMT) && (table_id == stag_mpeg_program_map)) {
+		p->last_seen = transport_monitor_time(monitor);
+		if (ext)
+			transport_monitor_pmt(monitor, ext);
+	}
+}
+
+static void transport_monitor_sweep(struct transport_monitor *monitor, uint64_t now)
+{
+	int i;
+
+	if ((now - monitor->pat_time) > PAT_PERIOD) {
+		transport_monitor_error(monitor, transport_monitor_pat_error, 0);
+		monitor->pat_time = now;
+	}
+
+	if (monitor->scrambled_seen && !monitor->cat_seen && ((now - monitor->cat_time) > CAT_PERIOD)) {
+		transport_monitor_error(monitor, transport_monitor_cat_error, -1);
+		monitor->cat_time = now;
+	}
+	monitor->scrambled_seen = 0;
+
+	for (i = 0; i < monitor->pmt_count; i++) {
+		int pid = monitor->pmt_pids[i];
+		struct transport_monitor_pid *p = &monitor->pids[pid];
+
+		if ((now - p->last_seen) > PMT_PERIOD) {
+			transport_monitor_error(monitor, transport_monitor_pmt_error, pid);
+			p->last_seen = now;
+		}
+	}
+
+	for (i = 0; i < monitor->es_count; i++) {
+		int pid = monitor->es_pids[i];
+		struct transport_monitor_pid *p = &monitor->pids[pid];
+
+		if ((p->flags & PID_FLAG_ES) && ((now - p->last_seen) > monitor->pid_timeout)) {
+			transport_monitor_error(monitor, transport_monitor_pid_error, pid);
+			p->last_seen = now;
+		}
+		if ((p->flags & PID_FLAG_PCR) && ((now - p->pcr_time) > PCR_REPETITION)) {
+			transport_monitor_error(monitor, transport_monitor_pcr_repetition_error, pid);
+			p->pcr_time = now;
+		}
+		if ((p->flags & PID_FLAG_PTS_VALID) && ((now - p->pts_time) > PTS_REPETITION)) {
+			transport_monitor_error(monitor, transport_monitor_pts_error, pid);
+			p->pts_time = now;
+		}
+	}
+}
@@ -0,0 +1,209 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TRANSPORT_MONITOR_H
+#define _UCSI_TRANSPORT_MONITOR_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <libucsi/transport_packet.h>
+
+/**
+ * Maximum number of programs whose PMTs are monitored.
+ */
+#define TRANSPORT_MONITOR_MAX_PROGRAMS 64
+
+/**
+ * Number of 27MHz clock ticks per second.
+ */
+#define TRANSPORT_MONITOR_HZ 27000000ULL
+
+/**
+ * The ETSI TR 101 290 priority 1 and 2 indicators.
+ */
+enum transport_monitor_indicator {
+	/* priority 1 */
+	transport_monitor_ts_sync_loss				= 0,
+	transport_monitor_sync_byte_error			= 1,
+	transport_monitor_pat_error				= 2,
+	transport_monitor_continuity_count_error		= 3,
+	transport_monitor_pmt_error				= 4,
+	transport_monitor_pid_error				= 5,
+
+	/* priority 2 */
+	transport_monitor_transport_error			= 6,
+	transport_monitor_crc_error				= 7,
+	transport_monitor_pcr_repetition_error			= 8,
+	transport_monitor_pcr_discontinuity_indicator_error	= 9,
+	transport_monitor_pcr_accuracy_error			= 10,
+	transport_monitor_pts_error				= 11,
+	transport_monitor_cat_error				= 12,
+};
+
+#define TRANSPORT_MONITOR_INDICATORS 13
+
+/**
+ * Callback called for each error found.
+ *
+ * @param arg Private argument.
+ * @param indicator The indicator which failed.
+ * @param pid The PID concerned, or -1 if the error is not specific to a PID.
+ * @param time Stream time of the error in 27MHz ticks, derived from the PCRs.
+ * This is 0 until the stream clock has been established.
+ */
+typedef void (*transport_monitor_callback)(void *arg,
+					   enum transport_monitor_indicator indicator,
+					   int pid, uint64_t time);
+
+/**
+ * Opaque type for a transport stream monitor.
+ *
+ * The monitor keeps a stream clock interpolated from the byte position of the
+ * PCRs of the first PCR PID seen, so timing checks give the same results
+ * whether the stream is read live or from a file at full speed. Checks which
+ * depend on time (repetition periods, PID_error, PCR accuracy) are only made
+ * once that clock is running.
+ *
+ * All memory is allocated by transport_monitor_create().
+ */
+struct transport_monitor;
+
+/**
+ * Create a transport stream monitor.
+ *
+ * @param packet_size TRANSPORT_PACKET_LENGTH, TRANSPORT_PACKET_LENGTH_M2TS,
+ * TRANSPORT_PACKET_LENGTH_RS, or 0 to detect the packet size.
+ * @return The transport_monitor, or NULL on error.
+ */
+extern struct transport_monitor *transport_monitor_create(int packet_size);
+
+/**
+ * Destroy a transport stream monitor.
+ *
+ * @param monitor The transport_monitor.
+ */
+extern void transport_monitor_destroy(struct transport_monitor *monitor);
+
+/**
+ * Set the callback called for each error found.
+ *
+ * @param monitor The transport_monitor.
+ * @param callback The callback, or NULL for none.
+ * @param arg Private argument for the callback.
+ */
+extern void transport_monitor_set_callback(struct transport_monitor *monitor,
+					   transport_monitor_callback callback, void *arg);
+
+/**
+ * Set the period after which a PID referred to by a PMT which has not been
+ * seen raises PID_error. The default is 5 seconds.
+ *
+ * @param monitor The transport_monitor.
+ * @param ms The period in milliseconds.
+ */
+extern void transport_monitor_set_pid_timeout(struct transport_monitor *monitor, int ms);
+
+/**
+ * Check a buffer of raw transport stream data. The buffer is realigned in
+ * place by transport_sync. Any bytes past the returned count were not
+ * processed: the caller should present them again at the start of the next
+ * buffer.
+ *
+ * @param monitor The transport_monitor.
+ * @param buf The data.
+ * @param len Length of the data.
+ * @return Number of bytes consumed.
+ */
+extern int transport_monitor_feed(struct transport_monitor *monitor, uint8_t *buf, int len);
+
+/**
+ * Retrieve the total number of errors for an indicator.
+ *
+ * @param monitor The transport_monitor.
+ * @param indicator The indicator.
+ * @return The number of errors.
+ */
+extern uint64_t transport_monitor_count(struct transport_monitor *monitor,
+					enum transport_monitor_indicator indicator);
+
+/**
+ * Retrieve the number of errors for an indicator on a single PID.
+ *
+ * @param monitor The transport_monitor.
+ * @param pid The PID.
+ * @param indicator The indicator.
+ * @return The number of errors.
+ */
+extern uint32_t transport_monitor_pid_count(struct transport_monitor *monitor, int pid,
+					    enum transport_monitor_indicator indicator);
+
+/**
+ * Retrieve the number of packets processed.
+ *
+ * @param monitor The transport_monitor.
+ * @return The number of packets.
+ */
+extern uint64_t transport_monitor_packets(struct transport_monitor *monitor);
+
+/**
+ * Retrieve the number of sections on the monitored PIDs which could not be
+ * assembled (a bad pointer_field, or a section overrunning its length). These
+ * are not a TR 101 290 indicator: only sections which fail their CRC32 check
+ * count as CRC_error.
+ *
+ * @param monitor The transport_monitor.
+ * @return The number of sections discarded.
+ */
+extern uint64_t transport_monitor_section_errors(struct transport_monitor *monitor);
+
+/**
+ * Retrieve the current stream time.
+ *
+ * @param monitor The transport_monitor.
+ * @return Stream time in 27MHz ticks, or 0 if the clock is not yet running.
+ */
+extern uint64_t transport_monitor_time(struct transport_monitor *monitor);
+
+/**
+ * Retrieve the name of an indicator, as used in TR 101 290.
+ *
+ * @param indicator The indicator.
+ * @return The name.
+ */
+extern const char *transport_monitor_indicator_name(enum transport_monitor_indicator indicator);
+
+/**
+ * Retrieve the TR 101 290 priority of an indicator.
+ *
+ * @param indicator The indicator.
+ * @return 1 or 2.
+ */
+static inline int transport_monitor_indicator_priority(enum transport_monitor_indicator indicator)
+{
+	return (indicator < transport_monitor_transport_error) ? 1 : 2;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
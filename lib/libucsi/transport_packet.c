@@ -23,9 +23,22 @@
 #define CONTINUITY_VALID 0x80
 #define CONTINUITY_DUPESEEN 0x40
 
-int transport_packet_values_extract(struct transport_packet *pkt,
-				    struct transport_values *out,
- 				    enum transport_value extract)
+/* values stored in the adaptation field after each point of the walk */
+#define VALUES_AFTER_PCR	(transport_value_opcr | VALUES_AFTER_OPCR)
+#define VALUES_AFTER_OPCR	(transport_value_splice_countdown | VALUES_AFTER_SPLICE)
+#define VALUES_AFTER_SPLICE	(transport_value_private_data | VALUES_EXTENSION)
+#define VALUES_EXTENSION	0xff00
+#define VALUES_AFTER_LTW	(transport_value_piecewise_rate | transport_value_seamless_splice)
+
+/*
+ * The extractor proper. It is always inlined, so when extract is a constant
+ * the compiler drops the tests for unwanted values, and the walk stops as soon
+ * as nothing more is wanted. Fields past that point are not validated.
+ */
+static inline __attribute__((always_inline))
+	int transport_packet_values_extract_fields(struct transport_packet *pkt,
+						   struct transport_values *out,
+						   enum transport_value extract)
 {
 	uint8_t *end = (uint8_t*) pkt + TRANSPORT_PACKET_LENGTH;
 	uint8_t *adapend;
@@ -77,6 +90,8 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		}
 		pos += 6;
 	}
+	if ((extract & VALUES_AFTER_PCR) == 0)
+		goto extract_payload;
 
 	/* OPCR? */
 	if (adapflags & transport_adaptation_flag_opcr) {
@@ -96,6 +111,8 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		}
 		pos += 6;
 	}
+	if ((extract & VALUES_AFTER_OPCR) == 0)
+		goto extract_payload;
 
 	/* splice countdown? */
 	if (adapflags & transport_adaptation_flag_splicing_point) {
@@ -108,6 +125,8 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		}
 		pos++;
 	}
+	if ((extract & VALUES_AFTER_SPLICE) == 0)
+		goto extract_payload;
 
 	/* private data? */
 	if (adapflags & transport_adaptation_flag_private_data) {
@@ -136,7 +155,7 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		return -1;
 
 	/* do we want/have anything in the adaptation extension? */
-	if (((extract & 0xff00) == 0) || (adapextlength == 0))
+	if (((extract & VALUES_EXTENSION) == 0) || (adapextlength == 0))
 		goto extract_payload;
 
 	/* extract the adaptation extension flags (we must have at least 1 byte
@@ -157,6 +176,8 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		}
 		pos += 2;
 	}
+	if ((extract & VALUES_AFTER_LTW) == 0)
+		goto extract_payload;
 
 	/* piecewise_rate? */
 	if (adapextflags & transport_adaptation_extension_flag_piecewise_rate) {
@@ -177,13 +198,13 @@ int transport_packet_values_extract(struct transport_packet *pkt,
 		if ((pos+5) > adapend)
 			return -1;
 
-		if (extract & transport_value_piecewise_rate) {
+		if (extract & transport_value_seamless_splice) {
 			out->splice_type = pos[0] >> 4;
-			out->dts_next_au = ((pos[0] & 0x0e) << 29) |
-					   (pos[1] << 22) |
-					   ((pos[2] & 0xfe) << 14) |
-					   (pos[3] << 7) |
-					   ((pos[4] & 0xfe) >> 1);
+			out->dts_next_au = (((uint64_t) pos[0] & 0x0e) << 29) |
+					   ((uint64_t) pos[1] << 22) |
+					   (((uint64_t) pos[2] & 0xfe) << 14) |
+					   ((uint64_t) pos[3] << 7) |
+					   (((uint64_t) pos[4] & 0xfe) >> 1);
 			extracted |= transport_value_seamless_splice;
 		}
 		pos += 5;
@@ -210,6 +231,25 @@ extract_payload:
 	return extracted;
 }
 
+int transport_packet_values_extract(struct transport_packet *pkt,
+				    struct transport_values *out,
+				    enum transport_value extract)
+{
+	return transport_packet_values_extract_fields(pkt, out, extract);
+}
+
+/* specialised extractors, each a copy of the walk for a constant set of values */
+#define TRANSPORT_PACKET_VALUES_EXTRACTOR(name, values) \
+	int name(struct transport_packet *pkt, struct transport_values *out) \
+	{ \
+		return transport_packet_values_extract_fields(pkt, out, values); \
+	}
+
+TRANSPORT_PACKET_VALUES_EXTRACTOR(transport_packet_values_extract_payload, 0)
+TRANSPORT_PACKET_VALUES_EXTRACTOR(transport_packet_values_extract_pcr, transport_value_pcr)
+TRANSPORT_PACKET_VALUES_EXTRACTOR(transport_packet_values_extract_pcr_opcr,
+				  transport_value_pcr | transport_value_opcr)
+
 int transport_packet_continuity_check(struct transport_packet *pkt,
 				      int discontinuity_indicator, unsigned char *cstate)
 {
@@ -183,11 +183,36 @@ extern int transport_packet_continuity_check(struct transport_packet *pkt,
  * to extract if they are available.
  * @return < 0 => error. Otherwise, an orred bitmask of enum transport_value
  * telling you what fields were successfully extracted.
+ *
+ * The adaptation field is only walked (and validated) as far as the last
+ * requested field. The flags, payload and payload_length are always extracted.
  */
 extern int transport_packet_values_extract(struct transport_packet *pkt,
 					   struct transport_values *out,
 					   enum transport_value extract);
 
+/**
+ * Specialised versions of transport_packet_values_extract() for common sets of
+ * fields. Each behaves exactly as transport_packet_values_extract() called with
+ * that set, but is compiled separately so the tests for other fields are
+ * removed. The discontinuity_indicator is available from the flags in all of
+ * them.
+ *
+ * transport_packet_values_extract_payload() extracts only the flags and payload.
+ * transport_packet_values_extract_pcr() also extracts the PCR.
+ * transport_packet_values_extract_pcr_opcr() also extracts the PCR and OPCR.
+ *
+ * @param pkt The packet.
+ * @param out Destination structure for values.
+ * @return As transport_packet_values_extract().
+ */
+extern int transport_packet_values_extract_payload(struct transport_packet *pkt,
+						   struct transport_values *out);
+extern int transport_packet_values_extract_pcr(struct transport_packet *pkt,
+					       struct transport_values *out);
+extern int transport_packet_values_extract_pcr_opcr(struct transport_packet *pkt,
+						    struct transport_values *out);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,486 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "transport_remux.h"
+#include "section_buf.h"
+#include "mpeg/section.h"
+
+/* PAT and PMT sections are limited to 1024 bytes by ISO 13818-1 */
+#define PSI_MAX_SECTION_BYTES 1024
+#define PMT_MAX_PACKETS (TRANSPORT_REMUX_MAX_PSI_PACKETS - 1)
+
+#define PID_TYPE_DROP 0
+#define PID_TYPE_PASS 1
+#define PID_TYPE_PAT  2
+#define PID_TYPE_PMT  3
+
+struct transport_remux_pid {
+	uint8_t type;
+	uint8_t added;			/* passed through even when not in the PMT */
+	uint16_t out;			/* output PID */
+};
+
+struct transport_remux {
+	struct transport_remux_stats stats;
+	int program_number;
+	int transport_stream_id;
+
+	/* the only thing looked at for most packets */
+	struct transport_remux_pid pids[TRANSPORT_MAX_PIDS];
+
+	/* PIDs currently routed because of the PMT */
+	uint16_t streams[PSI_MAX_SECTION_BYTES / 5];
+	int stream_count;
+
+	/* the generated tables, packetised, without continuity counters */
+	uint8_t pat[TRANSPORT_PACKET_LENGTH];
+	uint8_t pmt[PMT_MAX_PACKETS * TRANSPORT_PACKET_LENGTH];
+	int pmt_packets;
+	uint8_t pat_version;
+	uint8_t pmt_version;
+	uint8_t pat_cc;
+	uint8_t pmt_cc;
+
+	struct section_buf *pat_buf;
+	struct section_buf *pmt_buf;
+};
+
+static int transport_remux_psi_packet(struct transport_remux *remux, uint8_t *pos,
+				      struct section_buf *section, int type);
+static int transport_remux_pat(struct transport_remux *remux, uint8_t *buf, int len);
+static int transport_remux_pmt(struct transport_remux *remux, uint8_t *buf, int len);
+static void transport_remux_make_pat(struct transport_remux *remux);
+static int transport_remux_output_psi(struct transport_remux *remux, uint8_t *out);
+static int transport_remux_packetise(uint8_t *section, int len, int pid, uint8_t *out);
+
+
+struct transport_remux *transport_remux_create(int program_number)
+{
+	struct transport_remux *remux;
+	int pid;
+
+	if ((program_number <= 0) || (program_number > 0xffff))
+		return NULL;
+
+	remux = (struct transport_remux *) malloc(sizeof(struct transport_remux));
+	if (remux == NULL)
+		return NULL;
+	memset(remux, 0, sizeof(struct transport_remux));
+
+	remux->pat_buf = (struct section_buf *) malloc(sizeof(struct section_buf) + PSI_MAX_SECTION_BYTES);
+	remux->pmt_buf = (struct section_buf *) malloc(sizeof(struct section_buf) + PSI_MAX_SECTION_BYTES);
+	if ((remux->pat_buf == NULL) || (remux->pmt_buf == NULL)) {
+		transport_remux_destroy(remux);
+		return NULL;
+	}
+	section_buf_init(remux->pat_buf, PSI_MAX_SECTION_BYTES);
+	section_buf_init(remux->pmt_buf, PSI_MAX_SECTION_BYTES);
+
+	for (pid = 0; pid < TRANSPORT_MAX_PIDS; pid++)
+		remux->pids[pid].out = pid;
+	remux->pids[TRANSPORT_PAT_PID].type = PID_TYPE_PAT;
+
+	remux->program_number = program_number;
+	remux->transport_stream_id = -1;
+	remux->stats.pmt_pid = -1;
+	remux->stats.pmt_version = -1;
+
+	return remux;
+}
+
+void transport_remux_destroy(struct transport_remux *remux)
+{
+	if (remux->pat_buf)
+		free(remux->pat_buf);
+	if (remux->pmt_buf)
+		free(remux->pmt_buf);
+	free(remux);
+}
+
+int transport_remux_map_pid(struct transport_remux *remux, int pid, int new_pid)
+{
+	if ((pid <= TRANSPORT_PAT_PID) || (pid >= TRANSPORT_NULL_PID) ||
+	    (new_pid <= TRANSPORT_PAT_PID) || (new_pid >= TRANSPORT_NULL_PID))
+		return -EINVAL;
+
+	remux->pids[pid].out = new_pid;
+
+	// the PAT and PMT refer to the new PIDs
+	if (remux->stats.pmt_pid != -1) {
+		transport_remux_make_pat(remux);
+		remux->stats.pmt_version = -1;
+	}
+	return 0;
+}
+
+int transport_remux_add_pid(struct transport_remux *remux, int pid)
+{
+	if ((pid <= TRANSPORT_PAT_PID) || (pid >= TRANSPORT_MAX_PIDS))
+		return -EINVAL;
+
+	remux->pids[pid].added = 1;
+	if (remux->pids[pid].type == PID_TYPE_DROP)
+		remux->pids[pid].type = PID_TYPE_PASS;
+	return 0;
+}
+
+int transport_remux_feed(struct transport_remux *remux, uint8_t *buf, int len,
+			 uint8_t *out, int outsize, int *outlen)
+{
+	uint8_t *end = buf + len - (len % TRANSPORT_PACKET_LENGTH);
+	uint8_t *outend = out + outsize - ((1 + TRANSPORT_REMUX_MAX_PSI_PACKETS) * TRANSPORT_PACKET_LENGTH);
+	uint8_t *pos;
+	uint8_t *o = out;
+
+	for (pos = buf; (pos < end) && (o <= outend); pos += TRANSPORT_PACKET_LENGTH) {
+		struct transport_remux_pid *entry;
+		int pid;
+
+		remux->stats.packets++;
+		if (pos[0] != TRANSPORT_PACKET_SYNC) {
+			remux->stats.dropped++;
+			continue;
+		}
+
+		/* the only per-packet cost is this lookup, and the copy */
+		pid = ((pos[1] & 0x1f) << 8) | pos[2];
+		entry = &remux->pids[pid];
+		if (entry->type == PID_TYPE_PASS) {
+			memcpy(o, pos, TRANSPORT_PACKET_LENGTH);
+			o[1] = (o[1] & 0xe0) | (entry->out >> 8);
+			o[2] = entry->out;
+			o += TRANSPORT_PACKET_LENGTH;
+			remux->stats.output++;
+			continue;
+		}
+		if (entry->type == PID_TYPE_DROP) {
+			remux->stats.dropped++;
+			continue;
+		}
+
+		/* the original PAT and PMT are replaced with generated ones,
+		 * which go out where the PAT was, and when the PMT changes */
+		remux->stats.replaced++;
+		if (transport_remux_psi_packet(remux, pos,
+		    (entry->type == PID_TYPE_PAT) ? remux->pat_buf : remux->pmt_buf,
+		    entry->type) && (remux->stats.pmt_pid != -1))
+			o += transport_remux_output_psi(remux, o);
+	}
+
+	*outlen = o - out;
+	return pos - buf;
+}
+
+struct transport_remux_stats *transport_remux_get_stats(struct transport_remux *remux)
+{
+	return &remux->stats;
+}
+
+/*
+ * Reassemble the sections in a PAT or PMT packet.
+ *
+ * @return Nonzero if the generated PSI should be output now.
+ */
+static int transport_remux_psi_packet(struct transport_remux *remux, uint8_t *pos,
+				      struct section_buf *section, int type)
+{
+	struct transport_packet *pkt;
+	struct transport_values values;
+	uint8_t *payload;
+	int len;
+	int pdu_start;
+	int section_status;
+	int used;
+	int output = 0;
+
+	if ((pkt = transport_packet_init(pos)) == NULL)
+		return 0;
+	if (pkt->transport_error_indicator)
+		return 0;
+	if (transport_packet_values_extract_payload(pkt, &values) < 0)
+		return 0;
+
+	/* a new PAT packet is the cue to repeat the tables */
+	pdu_start = pkt->payload_unit_start_indicator;
+	if ((type == PID_TYPE_PAT) && pdu_start)
+		output = 1;
+
+	/* a packet may complete one section and start several more */
+	payload = values.payload;
+	len = values.payload_length;
+	while (len) {
+		used = section_buf_add_transport_payload(section, payload, len,
+							 pdu_start, &section_status);
+		pdu_start = 0;
+		len -= used;
+		payload += used;
+
+		if (section_status == 1) {
+			int section_len = section->len;
+
+			section_buf_reset(section);
+			if (type == PID_TYPE_PAT)
+				output |= transport_remux_pat(remux, section_buf_data(section), section_len);
+			else
+				output |= transport_remux_pmt(remux, section_buf_data(section), section_len);
+		} else if (section_status < 0) {
+			remux->stats.section_errors++;
+			section_buf_reset(section);
+		}
+	}
+
+	return output;
+}
+
+static int transport_remux_pat(struct transport_remux *remux, uint8_t *buf, int len)
+{
+	struct section *section;
+	struct section_ext *section_ext;
+	struct mpeg_pat_section *pat;
+	struct mpeg_pat_program *cur_program;
+	int pmt_pid = -1;
+	int i;
+
+	if ((section = section_codec(buf, len)) == NULL)
+		goto error;
+	if (section->table_id != stag_mpeg_program_association)
+		return 0;
+	if ((section_ext = section_ext_decode(section, 1)) == NULL)
+		goto error;
+	if (!section_ext->current_next_indicator)
+		return 0;
+	if ((pat = mpeg_pat_section_codec(section_ext)) == NULL)
+		goto error;
+
+	mpeg_pat_section_programs_for_each(pat, cur_program) {
+		if (cur_program->program_number == remux->program_number)
+			pmt_pid = cur_program->pid;
+	}
+	if ((pmt_pid == -1) || (pmt_pid == TRANSPORT_NULL_PID))
+		return 0;
+
+	if (pmt_pid == remux->stats.pmt_pid) {
+		if (section_ext->table_id_ext != remux->transport_stream_id) {
+			remux->transport_stream_id = section_ext->table_id_ext;
+			transport_remux_make_pat(remux);
+		}
+		return 0;
+	}
+
+	/* the program has moved: forget the old PMT and its streams */
+	if (remux->stats.pmt_pid != -1) {
+		struct transport_remux_pid *entry = &remux->pids[remux->stats.pmt_pid];
+
+		entry->type = entry->added ? PID_TYPE_PASS : PID_TYPE_DROP;
+	}
+	for (i = 0; i < remux->stream_count; i++) {
+		struct transport_remux_pid *entry = &remux->pids[remux->streams[i]];
+
+		entry->type = entry->added ? PID_TYPE_PASS : PID_TYPE_DROP;
+	}
+	remux->stream_count = 0;
+	remux->pmt_packets = 0;
+	remux->stats.pmt_version = -1;
+	section_buf_init(remux->pmt_buf, PSI_MAX_SECTION_BYTES);
+
+	remux->pids[pmt_pid].type = PID_TYPE_PMT;
+	remux->stats.pmt_pid = pmt_pid;
+	remux->transport_stream_id = section_ext->table_id_ext;
+	transport_remux_make_pat(remux);
+	return 0;
+
+error:
+	remux->stats.section_errors++;
+	return 0;
+}
+
+/*
+ * Rewrite the program's PMT for the output PIDs, and route its streams.
+ *
+ * @return Nonzero if the PMT changed.
+ */
+static int transport_remux_pmt(struct transport_remux *remux, uint8_t *buf, int len)
+{
+	uint8_t copy[PSI_MAX_SECTION_BYTES];
+	struct section *section;
+	struct section_ext *section_ext;
+	struct mpeg_pmt_section *pmt;
+	struct mpeg_pmt_stream *cur_stream;
+	int pcr_pid;
+	int pos;
+	int i;
+
+	if ((section = section_codec(buf, len)) == NULL)
+		goto error;
+	if (section->table_id != stag_mpeg_program_map)
+		return 0;
+	if ((section_ext = section_ext_decode(section, 1)) == NULL)
+		goto error;
+
+	/* a PMT PID may carry the PMTs of several programs */
+	if ((section_ext->table_id_ext != remux->program_number) ||
+	    !section_ext->current_next_indicator ||
+	    (section_ext->version_number == remux->stats.pmt_version))
+		return 0;
+
+	/* the header is now in host order, the rest still as broadcast */
+	memcpy(copy, buf, len);
+	if ((pmt = mpeg_pmt_section_codec(section_ext)) == NULL)
+		goto error;
+
+	/* route the new streams */
+	for (i = 0; i < remux->stream_count; i++) {
+		struct transport_remux_pid *entry = &remux->pids[remux->streams[i]];
+
+		entry->type = entry->added ? PID_TYPE_PASS : PID_TYPE_DROP;
+	}
+	remux->stream_count = 0;
+	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
+		if (remux->pids[cur_stream->pid].type >= PID_TYPE_PAT)
+			continue;
+		remux->pids[cur_stream->pid].type = PID_TYPE_PASS;
+		remux->streams[remux->stream_count++] = cur_stream->pid;
+	}
+	pcr_pid = pmt->pcr_pid;
+	if ((pcr_pid != TRANSPORT_NULL_PID) && (remux->pids[pcr_pid].type < PID_TYPE_PAT) &&
+	    (remux->stream_count < (int) (sizeof(remux->streams) / sizeof(remux->streams[0])))) {
+		remux->pids[pcr_pid].type = PID_TYPE_PASS;
+		remux->streams[remux->stream_count++] = pcr_pid;
+	}
+
+	/* rewrite the PIDs in the copy: mpeg_pmt_section_codec() has checked
+	 * the layout, so this walk stays in bounds */
+	if (pcr_pid != TRANSPORT_NULL_PID) {
+		copy[8] = (copy[8] & 0xe0) | (remux->pids[pcr_pid].out >> 8);
+		copy[9] = remux->pids[pcr_pid].out;
+	}
+	pos = sizeof(struct mpeg_pmt_section) + (((copy[10] & 0x0f) << 8) | copy[11]);
+	while (pos < len - CRC_SIZE) {
+		int pid = ((copy[pos + 1] & 0x1f) << 8) | copy[pos + 2];
+
+		copy[pos + 1] = (copy[pos + 1] & 0xe0) | (remux->pids[pid].out >> 8);
+		copy[pos + 2] = remux->pids[pid].out;
+		pos += sizeof(struct mpeg_pmt_stream) + (((copy[pos + 3] & 0x0f) << 8) | copy[pos + 4]);
+	}
+
+	section_ext = (struct section_ext *) copy;
+	section_ext->version_number = remux->pmt_version++;
+	section_ext_encode(section_ext, 1);
+	bswap16(copy + 1);
+
+	remux->pmt_packets = transport_remux_packetise(copy, len,
+						       remux->pids[remux->stats.pmt_pid].out,
+						       remux->pmt);
+	remux->stats.pmt_version = pmt->head.version_number;
+	return 1;
+
+error:
+	remux->stats.section_errors++;
+	return 0;
+}
+
+/*
+ * Generate a PAT listing only the program.
+ */
+static void transport_remux_make_pat(struct transport_remux *remux)
+{
+	uint8_t section[sizeof(struct mpeg_pat_section) + sizeof(struct mpeg_pat_program) + CRC_SIZE];
+	struct section_ext *ext = (struct section_ext *) section;
+	uint8_t *program = section + sizeof(struct mpeg_pat_section);
+	int pmt_pid = remux->pids[remux->stats.pmt_pid].out;
+
+	memset(section, 0, sizeof(section));
+	ext->table_id = stag_mpeg_program_association;
+	ext->syntax_indicator = 1;
+	ext->reserved = 3;
+	ext->length = sizeof(section) - sizeof(struct section);
+	ext->table_id_ext = remux->transport_stream_id;
+	ext->reserved1 = 3;
+	ext->version_number = remux->pat_version++;
+	ext->current_next_indicator = 1;
+	program[0] = remux->program_number >> 8;
+	program[1] = remux->program_number;
+	program[2] = 0xe0 | (pmt_pid >> 8);
+	program[3] = pmt_pid;
+	section_ext_encode(ext, 1);
+	bswap16(section + 1);
+
+	transport_remux_packetise(section, sizeof(section), TRANSPORT_PAT_PID, remux->pat);
+}
+
+static int transport_remux_output_psi(struct transport_remux *remux, uint8_t *out)
+{
+	int i;
+
+	memcpy(out, remux->pat, TRANSPORT_PACKET_LENGTH);
+	out[3] = 0x10 | (remux->pat_cc++ & 0x0f);
+	out += TRANSPORT_PACKET_LENGTH;
+
+	for (i = 0; i < remux->pmt_packets; i++) {
+		memcpy(out, remux->pmt + (i * TRANSPORT_PACKET_LENGTH), TRANSPORT_PACKET_LENGTH);
+		out[3] = 0x10 | (remux->pmt_cc++ & 0x0f);
+		out += TRANSPORT_PACKET_LENGTH;
+	}
+
+	remux->stats.psi += 1 + remux->pmt_packets;
+	remux->stats.output += 1 + remux->pmt_packets;
+	return (1 + remux->pmt_packets) * TRANSPORT_PACKET_LENGTH;
+}
+
+/*
+ * Split a section into packets, stuffed with 0xff, without continuity
+ * counters.
+ *
+ * @return Number of packets.
+ */
+static int transport_remux_packetise(uint8_t *section, int len, int pid, uint8_t *out)
+{
+	int count = 0;
+	int pos = 0;
+
+	while (pos < len) {
+		uint8_t *pkt = out + (count * TRANSPORT_PACKET_LENGTH);
+		int header = 4;
+		int copy;
+
+		pkt[0] = TRANSPORT_PACKET_SYNC;
+		pkt[1] = pid >> 8;
+		pkt[2] = pid;
+		pkt[3] = 0x10;
+		if (pos == 0) {
+			/* payload_unit_start_indicator, and a zero pointer_field */
+			pkt[1] |= 0x40;
+			pkt[4] = 0;
+			header = 5;
+		}
+
+		copy = len - pos;
+		if (copy > TRANSPORT_PACKET_LENGTH - header)
+			copy = TRANSPORT_PACKET_LENGTH - header;
+		memcpy(pkt + header, section + pos, copy);
+		memset(pkt + header + copy, 0xff, TRANSPORT_PACKET_LENGTH - header - copy);
+
+		pos += copy;
+		count++;
+	}
+
+	return count;
+}
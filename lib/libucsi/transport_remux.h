@@ -0,0 +1,136 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TRANSPORT_REMUX_H
+#define _UCSI_TRANSPORT_REMUX_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <libucsi/transport_packet.h>
+
+/**
+ * The most packets transport_remux_feed() generates for a single input
+ * packet: a PAT, and a PMT of up to 1024 bytes.
+ */
+#define TRANSPORT_REMUX_MAX_PSI_PACKETS 7
+
+/**
+ * Opaque type representing a single program remultiplexer. It extracts one
+ * program from a transport stream, as a single program transport stream:
+ *
+ * - The PAT and PMT are regenerated to describe only that program, with
+ *   their own version numbers, and output wherever the original PAT was.
+ * - The program's PIDs may be renumbered; the PMT describes the new PIDs.
+ * - Everything else (other programs, SI tables, null packets) is dropped,
+ *   except for PIDs explicitly added with transport_remux_add_pid().
+ *
+ * The program is found from the PAT and PMT in the input, which must
+ * therefore include them. Once they have been seen, the only per-packet work
+ * is a lookup in a table indexed by PID.
+ */
+struct transport_remux;
+
+/**
+ * Statistics collected by a transport_remux. Every input packet is either
+ * output, replaced or dropped, so packets == output - psi + replaced + dropped.
+ */
+struct transport_remux_stats {
+	uint64_t packets;		/* input packets processed */
+	uint64_t output;		/* packets output, including generated PSI */
+	uint64_t psi;			/* PAT and PMT packets generated */
+	uint64_t replaced;		/* input PAT and PMT packets, replaced by generated ones */
+	uint64_t dropped;		/* input packets not belonging to the program */
+	uint64_t section_errors;	/* PAT/PMT sections discarded as invalid */
+	int pmt_pid;			/* input PMT PID, or -1 if not yet known */
+	int pmt_version;		/* input PMT version, or -1 if not yet known */
+};
+
+/**
+ * Create a transport_remux.
+ *
+ * @param program_number The program to extract.
+ * @return The new transport_remux, or NULL on error.
+ */
+extern struct transport_remux *transport_remux_create(int program_number);
+
+/**
+ * Destroy a transport_remux.
+ *
+ * @param remux The transport_remux.
+ */
+extern void transport_remux_destroy(struct transport_remux *remux);
+
+/**
+ * Renumber a PID in the output. This applies to the PMT PID, elementary
+ * streams, the PCR PID and any added PIDs. Two input PIDs must not be mapped
+ * to the same output PID. Mappings should be set up before the first call to
+ * transport_remux_feed(): a later one only reaches the PMT when the program's
+ * PMT is next received.
+ *
+ * @param remux The transport_remux.
+ * @param pid Input PID.
+ * @param new_pid Output PID.
+ * @return 0 on success, -EINVAL if either PID is invalid, or is the PAT or
+ * null PID.
+ */
+extern int transport_remux_map_pid(struct transport_remux *remux, int pid, int new_pid);
+
+/**
+ * Pass a PID which is not part of the program (e.g. the TDT) through to the
+ * output, subject to any mapping.
+ *
+ * @param remux The transport_remux.
+ * @param pid Input PID.
+ * @return 0 on success, -EINVAL if the PID is invalid, or is the PAT PID.
+ */
+extern int transport_remux_add_pid(struct transport_remux *remux, int pid);
+
+/**
+ * Remultiplex a buffer of packets. Only whole packets are processed; the
+ * caller should keep any remaining bytes and supply them at the start of the
+ * next buffer. Processing stops early if the output buffer cannot take
+ * another input packet and the PSI it might generate.
+ *
+ * @param remux The transport_remux.
+ * @param buf Buffer of 188 byte transport packets.
+ * @param len Number of bytes in buf.
+ * @param out Where to put the output packets.
+ * @param outsize Size of out in bytes.
+ * @param outlen Set to the number of bytes put in out.
+ * @return Number of bytes of buf consumed.
+ */
+extern int transport_remux_feed(struct transport_remux *remux, uint8_t *buf, int len,
+				uint8_t *out, int outsize, int *outlen);
+
+/**
+ * Get the statistics of a transport_remux.
+ *
+ * @param remux The transport_remux.
+ * @return Pointer to the statistics.
+ */
+extern struct transport_remux_stats *transport_remux_get_stats(struct transport_remux *remux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <string.h>
+#include "transport_sync.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* unprocessed data kept while searching, so a lock straddling two buffers is found */
+#define TRANSPORT_SYNC_KEEP (TRANSPORT_SYNC_LOCK_COUNT * TRANSPORT_PACKET_LENGTH_RS)
+
+static const int transport_sync_strides[] = {
+	TRANSPORT_PACKET_LENGTH,
+	TRANSPORT_PACKET_LENGTH_M2TS,
+	TRANSPORT_PACKET_LENGTH_RS,
+};
+
+static int transport_sync_lost(struct transport_sync *sync, int pos);
+
+
+void transport_sync_init(struct transport_sync *sync, int packet_size,
+			 transport_sync_lost_callback callback, void *arg)
+{
+	memset(sync, 0, sizeof(struct transport_sync));
+	sync->packet_size = packet_size;
+	sync->lost_callback = callback;
+	sync->lost_arg = arg;
+}
+
+int transport_sync_find(const uint8_t *buf, int len, int stride, int count)
+{
+	int last = len - ((count - 1) * stride);
+	int pos = 0;
+	int k;
+
+	if ((count < 1) || (stride <= 0) || (last <= 0))
+		return -1;
+
+#if defined(__SSE2__)
+	{
+		/* test 16 candidate offsets at once: a bit survives only if every
+		 * byte at that offset plus a multiple of the stride is a sync byte */
+		__m128i sync_byte = _mm_set1_epi8(TRANSPORT_PACKET_SYNC);
+
+		for(; (pos + 16) <= last; pos += 16) {
+			unsigned int mask = 0xffff;
+
+			for(k = 0; (k < count) && mask; k++) {
+				__m128i v = _mm_loadu_si128((const __m128i *) (buf + pos + (k * stride)));
+				mask &= _mm_movemask_epi8(_mm_cmpeq_epi8(v, sync_byte));
+			}
+			if (mask)
+				return pos + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	while (pos < last) {
+		const uint8_t *cand = memchr(buf + pos, TRANSPORT_PACKET_SYNC, last - pos);
+		if (cand == NULL)
+			break;
+		pos = cand - buf;
+
+		for(k = 1; k < count; k++) {
+			if (buf[pos + (k * stride)] != TRANSPORT_PACKET_SYNC)
+				break;
+		}
+		if (k == count)
+			return pos;
+		pos++;
+	}
+
+	return -1;
+}
+
+int transport_sync_detect(const uint8_t *buf, int len, int *stride)
+{
+	int best = -1;
+	unsigned int i;
+
+	for(i = 0; i < sizeof(transport_sync_strides) / sizeof(int); i++) {
+		int limit = (best < 0) ? len : best + ((TRANSPORT_SYNC_LOCK_COUNT - 1) * transport_sync_strides[i]);
+		int off;
+
+		if (limit > len)
+			limit = len;
+
+		off = transport_sync_find(buf, limit, transport_sync_strides[i],
+					  TRANSPORT_SYNC_LOCK_COUNT);
+		if ((off >= 0) && ((best < 0) || (off < best))) {
+			best = off;
+			*stride = transport_sync_strides[i];
+		}
+	}
+
+	return best;
+}
+
+int transport_sync_process(struct transport_sync *sync, uint8_t *buf, int len,
+			   int *consumed)
+{
+	int pos = 0;
+	int out = 0;
+	int first_bad = -1;
+
+	// skip the tail of a packet started in the previous buffer
+	if (sync->skip) {
+		if (sync->skip >= len) {
+			sync->skip -= len;
+			pos = len;
+			goto exit;
+		}
+		pos = sync->skip;
+		sync->skip = 0;
+	}
+
+	while(pos < len) {
+		int stride;
+
+		// acquire sync
+		if (sync->stride == 0) {
+			int off;
+
+			stride = sync->packet_size;
+			if (stride)
+				off = transport_sync_find(buf + pos, len - pos, stride,
+							  TRANSPORT_SYNC_LOCK_COUNT);
+			else
+				off = transport_sync_detect(buf + pos, len - pos, &stride);
+
+			if (off < 0) {
+				if ((len - pos) > TRANSPORT_SYNC_KEEP) {
+					sync->skipped_bytes += len - pos - TRANSPORT_SYNC_KEEP;
+					pos = len - TRANSPORT_SYNC_KEEP;
+				}
+				break;
+			}
+
+			sync->skipped_bytes += off;
+			pos += off;
+			sync->stride = stride;
+			sync->bad = 0;
+		}
+
+		// copy out packets while locked
+		stride = sync->stride;
+		while((pos + TRANSPORT_PACKET_LENGTH) <= len) {
+			if (buf[pos] != TRANSPORT_PACKET_SYNC) {
+				if (sync->bad == 0)
+					first_bad = pos;
+				if (++sync->bad >= TRANSPORT_SYNC_LOSS_COUNT) {
+					pos = transport_sync_lost(sync, first_bad);
+					break;
+				}
+				pos += stride;
+				continue;
+			}
+
+			// after an isolated bad sync byte, a single matching byte could
+			// be chance: confirm it with the next packet as well
+			if (sync->bad) {
+				if ((pos + stride) >= len)
+					break;
+				if (buf[pos + stride] != TRANSPORT_PACKET_SYNC) {
+					pos = transport_sync_lost(sync, first_bad);
+					break;
+				}
+				sync->sync_byte_errors++;
+				sync->bad = 0;
+			}
+
+			if (out != pos)
+				memmove(buf + out, buf + pos, TRANSPORT_PACKET_LENGTH);
+			out += TRANSPORT_PACKET_LENGTH;
+			pos += stride;
+			sync->packets++;
+		}
+
+		// incomplete packet at the end of the buffer: wait for more data,
+		// keeping any unconfirmed bad sync byte so it can be searched from
+		if (sync->stride) {
+			if (sync->bad) {
+				pos = first_bad;
+				sync->bad = 0;
+			}
+			break;
+		}
+	}
+
+	if (pos > len) {
+		sync->skip = pos - len;
+		pos = len;
+	}
+
+exit:
+	sync->offset += pos;
+	*consumed = pos;
+	return out;
+}
+
+static int transport_sync_lost(struct transport_sync *sync, int pos)
+{
+	sync->stride = 0;
+	sync->bad = 0;
+	sync->sync_losses++;
+	if (sync->lost_callback)
+		sync->lost_callback(sync->lost_arg, sync->offset + pos);
+
+	// search again from just after the first bad sync byte
+	return pos + 1;
+}
@@ -0,0 +1,135 @@
+/*
+ * section and descriptor parser
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#ifndef _UCSI_TRANSPORT_SYNC_H
+#define _UCSI_TRANSPORT_SYNC_H 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <libucsi/transport_packet.h>
+
+#define TRANSPORT_PACKET_LENGTH_M2TS 192	/* 4 byte timestamp + packet */
+#define TRANSPORT_PACKET_LENGTH_RS   204	/* packet + 16 Reed-Solomon bytes */
+
+/* consecutive sync bytes needed to acquire sync (as in TR 101 290) */
+#define TRANSPORT_SYNC_LOCK_COUNT 5
+
+/* consecutive bad sync bytes which lose sync (as in TR 101 290) */
+#define TRANSPORT_SYNC_LOSS_COUNT 2
+
+/**
+ * Callback called when sync is lost.
+ *
+ * @param arg Private argument.
+ * @param offset Total number of input bytes processed before the bad sync byte.
+ */
+typedef void (*transport_sync_lost_callback)(void *arg, uint64_t offset);
+
+/**
+ * State for locating transport packets in an arbitrary byte stream. Initialise
+ * it with transport_sync_init(). The statistics may be read at any time.
+ */
+struct transport_sync {
+	int packet_size;		/* fixed stride, or 0 to autodetect */
+	int stride;			/* stride currently locked to, 0 if unlocked */
+	int skip;			/* bytes to skip at the start of the next buffer */
+	int bad;			/* consecutive bad sync bytes seen while locked */
+	uint64_t offset;		/* total input bytes consumed */
+
+	transport_sync_lost_callback lost_callback;
+	void *lost_arg;
+
+	uint64_t packets;		/* packets output */
+	uint64_t sync_byte_errors;	/* packets dropped for a single bad sync byte */
+	uint64_t sync_losses;		/* number of times sync was lost */
+	uint64_t skipped_bytes;		/* bytes discarded while searching for sync */
+};
+
+/**
+ * Initialise a transport_sync structure.
+ *
+ * @param sync The structure to initialise.
+ * @param packet_size TRANSPORT_PACKET_LENGTH, TRANSPORT_PACKET_LENGTH_M2TS,
+ * TRANSPORT_PACKET_LENGTH_RS, or 0 to detect any of them.
+ * @param callback Optional callback to call when sync is lost.
+ * @param arg Private argument for the callback.
+ */
+extern void transport_sync_init(struct transport_sync *sync, int packet_size,
+				transport_sync_lost_callback callback, void *arg);
+
+/**
+ * Find the first offset in a buffer which starts a run of sync bytes at the
+ * given stride. Candidate offsets are compared 16 at a time where SIMD is
+ * available.
+ *
+ * @param buf The buffer.
+ * @param len Length of the buffer.
+ * @param stride Distance between sync bytes.
+ * @param count Number of consecutive sync bytes required.
+ * @return Offset of the first sync byte, or -1 if none was found.
+ */
+extern int transport_sync_find(const uint8_t *buf, int len, int stride, int count);
+
+/**
+ * Detect the packet size of a stream and locate the first packet.
+ *
+ * @param buf The buffer.
+ * @param len Length of the buffer.
+ * @param stride Set to the detected packet size.
+ * @return Offset of the first sync byte, or -1 if none was found.
+ */
+extern int transport_sync_detect(const uint8_t *buf, int len, int *stride);
+
+/**
+ * Process a buffer of raw input, leaving only aligned 188 byte transport
+ * packets at the start of the buffer. Timestamp or Reed-Solomon bytes and any
+ * data outside sync are removed. When the input is already aligned 188 byte
+ * packets, nothing is copied.
+ *
+ * Any bytes past *consumed were not processed: the caller should keep them,
+ * and present them again at the start of the next buffer.
+ *
+ * @param sync The transport_sync state.
+ * @param buf The buffer. It is rewritten in place.
+ * @param len Length of the buffer.
+ * @param consumed Set to the number of input bytes consumed.
+ * @return Number of bytes of aligned packets now at the start of buf.
+ */
+extern int transport_sync_process(struct transport_sync *sync, uint8_t *buf, int len,
+				  int *consumed);
+
+/**
+ * Determine whether a transport_sync is currently locked.
+ *
+ * @param sync The transport_sync state.
+ * @return Nonzero if locked.
+ */
+static inline int transport_sync_locked(struct transport_sync *sync)
+{
+	return sync->stride != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
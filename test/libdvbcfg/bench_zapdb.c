@@ -0,0 +1,245 @@
+/*
+ * dvbcfg benchmark: channel lookup by parsing channels.conf against a
+ * compiled channel database.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libdvbcfg/dvbcfg_zapdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#define CHANNELS		5000
+#define SERVICES_PER_MUX	64
+#define LOOKUPS			200
+
+struct name_search {
+	const char *name;
+	struct dvbcfg_zapchannel channel;
+	int found;
+};
+
+struct service_search {
+	int service_id;
+	uint32_t frequency;
+	int found;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int find_name(struct dvbcfg_zapchannel *channel, void *private_data)
+{
+	struct name_search *search = private_data;
+
+	if (strcmp(channel->name, search->name) == 0) {
+		memcpy(&search->channel, channel, sizeof(struct dvbcfg_zapchannel));
+		search->found = 1;
+		return 1;
+	}
+	return 0;
+}
+
+static int count_service(struct dvbcfg_zapchannel *channel, void *private_data)
+{
+	struct service_search *search = private_data;
+
+	if ((channel->service_id == search->service_id) &&
+	    ((search->frequency == 0) || (channel->fe_params.frequency == search->frequency)))
+		search->found++;
+	return 0;
+}
+
+static int same_channel(const struct dvbcfg_zapchannel *a, const struct dvbcfg_zapchannel *b)
+{
+	return (strcmp(a->name, b->name) == 0) &&
+		(a->service_id == b->service_id) &&
+		(a->video_pid == b->video_pid) &&
+		(a->audio_pid == b->audio_pid) &&
+		(a->fe_type == b->fe_type) &&
+		(a->fe_params.frequency == b->fe_params.frequency);
+}
+
+/*
+ * ATSC channels, so the lines are short and the parse is as cheap as it gets.
+ * Service ids repeat on each multiplex, as they do across real networks.
+ */
+static void make_channels(FILE *f, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		fprintf(f, "Channel %05i:%i:8VSB:%i:%i:%i\n",
+			i, 57000000 + ((i / SERVICES_PER_MUX) * 6000000),
+			0x100 + (i % SERVICES_PER_MUX), 0x200 + (i % SERVICES_PER_MUX),
+			1 + (i % SERVICES_PER_MUX));
+}
+
+int main(int argc, char *argv[])
+{
+	char confname[] = "/tmp/bench_zapdbXXXXXX";
+	char dbname[sizeof(confname) + 3];
+	char names[LOOKUPS][32];
+	struct dvbcfg_zapdb *db;
+	FILE *f;
+	double start, parse_time, open_time, find_time;
+	int channels = CHANNELS;
+	int count;
+	int failures = 0;
+	int fd;
+	int i;
+
+	if (argc > 1)
+		channels = atoi(argv[1]);
+	if (channels <= 0) {
+		fprintf(stderr, "usage: bench_zapdb [<channels>]\n");
+		exit(1);
+	}
+
+	if (((fd = mkstemp(confname)) < 0) || ((f = fdopen(fd, "w+")) == NULL)) {
+		perror("mkstemp");
+		exit(1);
+	}
+	make_channels(f, channels);
+	fflush(f);
+	sprintf(dbname, "%s.db", confname);
+
+	rewind(f);
+	start = now();
+	count = dvbcfg_zapdb_compile(f, dbname);
+	printf("compile %i channels: %.2fms\n", count, (now() - start) * 1000);
+	if (count != channels) {
+		fprintf(stderr, "XXXX compiled %i channels, expected %i\n", count, channels);
+		failures++;
+	}
+
+	// spread the lookups over the file, plus one which is not there
+	for (i = 0; i < LOOKUPS - 1; i++)
+		sprintf(names[i], "Channel %05i", (int) (((long) i * 7919) % channels));
+	sprintf(names[LOOKUPS - 1], "No such channel");
+
+	// each zap parses the file until it finds the channel
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		struct name_search search = { .name = names[i] };
+
+		rewind(f);
+		dvbcfg_zapchannel_parse(f, find_name, &search);
+	}
+	parse_time = (now() - start) / LOOKUPS;
+
+	// each zap opens the database and finds the channel in it
+	start = now();
+	for (i = 0; i < LOOKUPS; i++) {
+		if ((db = dvbcfg_zapdb_open(dbname)) == NULL) {
+			perror("XXXX dvbcfg_zapdb_open");
+			exit(1);
+		}
+		dvbcfg_zapdb_find_name(db, names[i]);
+		dvbcfg_zapdb_close(db);
+	}
+	open_time = (now() - start) / LOOKUPS;
+
+	if ((db = dvbcfg_zapdb_open(dbname)) == NULL) {
+		perror("XXXX dvbcfg_zapdb_open");
+		exit(1);
+	}
+	start = now();
+	for (i = 0; i < LOOKUPS; i++)
+		dvbcfg_zapdb_find_name(db, names[i]);
+	find_time = (now() - start) / LOOKUPS;
+
+	printf("lookup by name: parse %.1fus, open+find %.1fus, find %.3fus (%.0fx)\n",
+	       parse_time * 1e6, open_time * 1e6, find_time * 1e6, parse_time / open_time);
+
+	// both must find the same channel, or none
+	for (i = 0; i < LOOKUPS; i++) {
+		struct name_search search = { .name = names[i] };
+		const struct dvbcfg_zapchannel *channel = dvbcfg_zapdb_find_name(db, names[i]);
+
+		rewind(f);
+		dvbcfg_zapchannel_parse(f, find_name, &search);
+		if ((channel == NULL) != (search.found == 0) ||
+		    (channel && !same_channel(channel, &search.channel))) {
+			fprintf(stderr, "XXXX lookup of %s differs\n", names[i]);
+			failures++;
+		}
+	}
+
+	// every channel with a service id, then only the one on a given frequency
+	for (i = 1; i <= SERVICES_PER_MUX + 1; i++) {
+		struct service_search search = { .service_id = i };
+		const struct dvbcfg_zapchannel *channel = NULL;
+		int found = 0;
+
+		rewind(f);
+		dvbcfg_zapchannel_parse(f, count_service, &search);
+		while ((channel = dvbcfg_zapdb_find_service(db, i, 0, channel)) != NULL)
+			found++;
+		if (found != search.found) {
+			fprintf(stderr, "XXXX service %i: %i channels, expected %i\n", i, found, search.found);
+			failures++;
+		}
+
+		search.frequency = 57000000;
+		search.found = 0;
+		found = 0;
+		rewind(f);
+		dvbcfg_zapchannel_parse(f, count_service, &search);
+		while ((channel = dvbcfg_zapdb_find_service(db, i, search.frequency, channel)) != NULL)
+			found++;
+		if (found != search.found) {
+			fprintf(stderr, "XXXX service %i at %u: %i channels, expected %i\n",
+				i, search.frequency, found, search.found);
+			failures++;
+		}
+	}
+
+	// the database must be in file order
+	for (i = 0; i < dvbcfg_zapdb_count(db); i++) {
+		char name[32];
+
+		sprintf(name, "Channel %05i", i);
+		if (strcmp(dvbcfg_zapdb_get(db, i)->name, name)) {
+			fprintf(stderr, "XXXX channel %i is %s\n", i, dvbcfg_zapdb_get(db, i)->name);
+			failures++;
+			break;
+		}
+	}
+	dvbcfg_zapdb_close(db);
+
+	// anything else is refused
+	if ((dvbcfg_zapdb_open(confname) != NULL) || (errno != EINVAL)) {
+		fprintf(stderr, "XXXX a channel file was opened as a database\n");
+		failures++;
+	}
+
+	fclose(f);
+	unlink(confname);
+	unlink(dbname);
+
+	if (failures)
+		printf("%i failures\n", failures);
+	return failures ? 1 : 0;
+}
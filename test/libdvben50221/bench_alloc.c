@@ -0,0 +1,257 @@
+/*
+ * en50221 benchmark: heap allocations on the transport layer's send path.
+ *
+ * Several simulated CAMs, each on one end of a socketpair, acknowledge
+ * everything the transport layer sends them, while bursts of CA PMT sized
+ * messages are queued to all of them, as on a channel change.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libdvben50221/en50221_transport.h>
+#include <libdvbapi/dvbca.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define CAMS			4
+#define BURSTS			2000
+#define BURST_LENGTH		8
+#define PMT_SIZE		180
+
+#define T_SB			0x80
+#define T_CREATE_T_C		0x82
+#define T_C_T_C_REPLY		0x83
+#define T_DATA_LAST		0xa0
+
+struct cam {
+	int fd;			/* the module's end of the socketpair */
+	int slot_id;
+	int connection_id;
+	pthread_t thread;
+	int received;
+	int bad;
+};
+
+static struct cam cams[CAMS];
+static struct en50221_transport_layer *tl;
+static volatile int shutdown_poller;
+
+/*
+ * Count the calls to malloc() from everything in the process.
+ */
+extern void *__libc_malloc(size_t size);
+static int counting;
+static long mallocs;
+
+void *malloc(size_t size)
+{
+	if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+		__atomic_add_fetch(&mallocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*
+ * Just enough of a module: accept the connection, and answer each TPDU with
+ * a status byte saying there is nothing to send back.
+ */
+static void *cam_func(void *arg)
+{
+	struct cam *cam = arg;
+	uint8_t buf[DVBCA_LINK_HEADER_SIZE + 4096];
+	uint8_t reply[DVBCA_LINK_HEADER_SIZE + 7];
+	int len;
+
+	while ((len = read(cam->fd, buf, sizeof(buf))) > DVBCA_LINK_HEADER_SIZE) {
+		uint8_t *tpdu = buf + DVBCA_LINK_HEADER_SIZE;
+		uint8_t connection_id = buf[1];
+		int pos = DVBCA_LINK_HEADER_SIZE;
+
+		reply[0] = buf[0];
+		reply[1] = connection_id;
+		if (tpdu[0] == T_CREATE_T_C) {
+			reply[pos++] = T_C_T_C_REPLY;
+			reply[pos++] = 1;
+			reply[pos++] = connection_id;
+		} else if ((tpdu[0] == T_DATA_LAST) && (len > DVBCA_LINK_HEADER_SIZE + 3)) {
+			// the PMT ends the message, and counts up from 0
+			int i;
+			for (i = 0; i < PMT_SIZE; i++) {
+				if (buf[len - PMT_SIZE + i] != (uint8_t) i) {
+					cam->bad++;
+					break;
+				}
+			}
+			__atomic_add_fetch(&cam->received, 1, __ATOMIC_RELEASE);
+		}
+		reply[pos++] = T_SB;
+		reply[pos++] = 2;
+		reply[pos++] = connection_id;
+		reply[pos++] = 0;
+		if (write(cam->fd, reply, pos) != pos)
+			break;
+	}
+
+	return NULL;
+}
+
+static void *poller_func(void *arg)
+{
+	(void) arg;
+
+	while (!shutdown_poller)
+		en50221_tl_poll_wait(tl, 100);
+
+	return NULL;
+}
+
+/*
+ * Queue a burst of messages to every CAM, as the session layer does: an
+ * SPDU header and the APDU as separate iovecs. Returns when all have arrived.
+ */
+static int send_burst(uint8_t *pmt, int *expected)
+{
+	struct iovec iov[2];
+	uint8_t spdu_hdr[4] = { 0x90, 0x02, 0x00, 0x03 };
+	int i, j;
+
+	iov[0].iov_base = spdu_hdr;
+	iov[0].iov_len = sizeof(spdu_hdr);
+	iov[1].iov_base = pmt;
+	iov[1].iov_len = PMT_SIZE;
+
+	for (j = 0; j < BURST_LENGTH; j++) {
+		for (i = 0; i < CAMS; i++) {
+			if (en50221_tl_send_datav(tl, cams[i].slot_id, cams[i].connection_id, iov, 2)) {
+				fprintf(stderr, "XXXX send to CAM %i failed: %i\n", i, en50221_tl_get_error(tl));
+				return -1;
+			}
+			expected[i]++;
+		}
+	}
+
+	for (i = 0; i < CAMS; i++) {
+		double timeout = now() + 5;
+
+		while (__atomic_load_n(&cams[i].received, __ATOMIC_ACQUIRE) < expected[i]) {
+			if (now() > timeout) {
+				fprintf(stderr, "XXXX CAM %i received %i of %i\n",
+					i, cams[i].received, expected[i]);
+				return -1;
+			}
+			usleep(10);
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	pthread_t poller;
+	uint8_t pmt[PMT_SIZE];
+	int expected[CAMS];
+	double start, elapsed;
+	long burst_mallocs;
+	int failures = 0;
+	int i;
+
+	for (i = 0; i < PMT_SIZE; i++)
+		pmt[i] = i;
+	memset(expected, 0, sizeof(expected));
+
+	if ((tl = en50221_tl_create(CAMS, 16)) == NULL) {
+		fprintf(stderr, "XXXX en50221_tl_create failed\n");
+		exit(1);
+	}
+
+	for (i = 0; i < CAMS; i++) {
+		int sv[2];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv)) {
+			perror("socketpair");
+			exit(1);
+		}
+		cams[i].fd = sv[1];
+		cams[i].slot_id = en50221_tl_register_slot(tl, sv[0], 0, 1000, 100);
+		pthread_create(&cams[i].thread, NULL, cam_func, &cams[i]);
+		cams[i].connection_id = en50221_tl_new_tc(tl, cams[i].slot_id);
+	}
+	pthread_create(&poller, NULL, poller_func, NULL);
+
+	for (i = 0; i < CAMS; i++) {
+		double timeout = now() + 5;
+
+		while (en50221_tl_get_connection_state(tl, cams[i].slot_id, cams[i].connection_id) != T_STATE_ACTIVE) {
+			if (now() > timeout) {
+				fprintf(stderr, "XXXX CAM %i connection was not opened\n", i);
+				exit(1);
+			}
+			usleep(1000);
+		}
+	}
+
+	// the first burst may fill any pools
+	if (send_burst(pmt, expected))
+		exit(1);
+
+	__atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+	start = now();
+	for (i = 0; i < BURSTS; i++) {
+		if (send_burst(pmt, expected)) {
+			failures++;
+			break;
+		}
+	}
+	elapsed = now() - start;
+	__atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+	burst_mallocs = mallocs;
+
+	printf("%i CAMs, %i bursts of %i messages of %i bytes: %.0f messages/s\n",
+	       CAMS, BURSTS, BURST_LENGTH, PMT_SIZE,
+	       (double) CAMS * BURSTS * BURST_LENGTH / elapsed);
+	printf("malloc calls: %li, %.2f per message\n",
+	       burst_mallocs, (double) burst_mallocs / (CAMS * BURSTS * BURST_LENGTH));
+
+	for (i = 0; i < CAMS; i++) {
+		if (cams[i].bad) {
+			fprintf(stderr, "XXXX CAM %i received %i corrupt messages\n", i, cams[i].bad);
+			failures++;
+		}
+	}
+
+	shutdown_poller = 1;
+	en50221_tl_wakeup(tl);
+	pthread_join(poller, NULL);
+	for (i = 0; i < CAMS; i++) {
+		shutdown(cams[i].fd, SHUT_RDWR);
+		pthread_join(cams[i].thread, NULL);
+	}
+	en50221_tl_destroy(tl);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,732 @@
+/*
+ * en50221 benchmark: the whole host stack against a simulated CAM.
+ *
+ * Measures session setup, CA PMT query round-trips and MMI menus through the
+ * transport, session and application layers, and checks that the errors the
+ * simulated CAM injects are either survived or reported.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libdvben50221/en50221_transport.h>
+#include <libdvben50221/en50221_session.h>
+#include <libdvben50221/en50221_app_rm.h>
+#include <libdvben50221/en50221_app_ai.h>
+#include <libdvben50221/en50221_app_ca.h>
+#include <libdvben50221/en50221_app_mmi.h>
+#include <libdvben50221/en50221_app_datetime.h>
+#include <libdvben50221/en50221_app_utils.h>
+#include <libdvben50221/en50221_errno.h>
+#include <libdvben50221/en50221_camsim.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define RESPONSE_TIMEOUT_MS	1000
+#define POLL_DELAY_MS		100
+#define EVENT_TIMEOUT_MS	5000
+#define PMT_BURST		16
+
+struct config {
+	char *name;
+	uint32_t latency_us;
+	uint16_t fragment_size;
+	int iterations;
+};
+
+static struct config default_configs[] = {
+	{ "unfragmented",       0,  0, 500 },
+	{ "32 byte fragments",  0, 32, 500 },
+	{ "1ms link latency",   1000,  0,  50 },
+};
+
+struct timing {
+	double min;
+	double max;
+	double total;
+	int count;
+};
+
+/* everything the host stack's callbacks report, under the lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int app_infos;
+static int ca_infos;
+static int pmt_replies;
+static int bad_pmt_replies;
+static int menus;
+static int bad_menus;
+static int closes;
+static int date_time_enquiries;
+static int tl_errors[16];
+static int ai_session_number = -1;
+static int ca_session_number = -1;
+static int mmi_session_number = -1;
+
+static uint32_t resource_ids[] = {
+	EN50221_APP_RM_RESOURCEID,
+	EN50221_APP_AI_RESOURCEID,
+	EN50221_APP_CA_RESOURCEID,
+	EN50221_APP_DATETIME_RESOURCEID,
+	EN50221_APP_MMI_RESOURCEID,
+};
+#define RESOURCE_IDS_COUNT (sizeof(resource_ids) / sizeof(uint32_t))
+
+static struct en50221_transport_layer *tl;
+static struct en50221_session_layer *sl;
+static struct en50221_app_send_functions sendfuncs;
+static struct en50221_app_rm *rm_resource;
+static struct en50221_app_ai *ai_resource;
+static struct en50221_app_ca *ca_resource;
+static struct en50221_app_mmi *mmi_resource;
+static struct en50221_app_datetime *datetime_resource;
+static int slot_id = -1;
+static volatile int shutdown_poller;
+
+static uint32_t menu_items = 4;
+
+/* a query for a program with a CA descriptor and two streams */
+static uint8_t ca_pmt[] = {
+	CA_LIST_MANAGEMENT_ONLY, 0x01, 0x01, 0x03, 0xf0, 0x07,
+	CA_PMT_CMD_ID_QUERY, 0x09, 0x04, 0x0b, 0x00, 0xe1, 0x00,
+	0x02, 0xe1, 0x01, 0xf0, 0x00,
+	0x04, 0xe1, 0x02, 0xf0, 0x00,
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void timing_add(struct timing *t, double seconds)
+{
+	if ((t->count == 0) || (seconds < t->min))
+		t->min = seconds;
+	if (seconds > t->max)
+		t->max = seconds;
+	t->total += seconds;
+	t->count++;
+}
+
+static void timing_print(char *what, struct timing *t)
+{
+	if (t->count == 0)
+		return;
+	printf("  %-22s %5i: mean %9.1fus  min %9.1fus  max %9.1fus\n", what, t->count,
+	       t->total * 1e6 / t->count, t->min * 1e6, t->max * 1e6);
+}
+
+static void event(int *counter)
+{
+	pthread_mutex_lock(&lock);
+	(*counter)++;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Wait until *counter reaches target. Returns 0, or -1 on timeout.
+ */
+static int wait_for(int *counter, int target)
+{
+	struct timespec deadline;
+	int result = 0;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += EVENT_TIMEOUT_MS / 1000;
+
+	pthread_mutex_lock(&lock);
+	while ((*counter < target) && (result == 0)) {
+		if (pthread_cond_timedwait(&cond, &lock, &deadline))
+			result = -1;
+	}
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+static int get(int *value)
+{
+	int result;
+
+	pthread_mutex_lock(&lock);
+	result = *value;
+	pthread_mutex_unlock(&lock);
+	return result;
+}
+
+
+
+
+/*
+ * The host's side, as en50221_stdcam_llci sets it up.
+ */
+static int lookup_callback(void *arg, uint8_t _slot_id, uint32_t requested_resource_id,
+			   en50221_sl_resource_callback *callback_out, void **arg_out,
+			   uint32_t *connected_resource_id)
+{
+	(void) arg;
+	(void) _slot_id;
+
+	switch (requested_resource_id) {
+	case EN50221_APP_RM_RESOURCEID:
+		*callback_out = (en50221_sl_resource_callback) en50221_app_rm_message;
+		*arg_out = rm_resource;
+		break;
+	case EN50221_APP_AI_RESOURCEID:
+		*callback_out = (en50221_sl_resource_callback) en50221_app_ai_message;
+		*arg_out = ai_resource;
+		break;
+	case EN50221_APP_CA_RESOURCEID:
+		*callback_out = (en50221_sl_resource_callback) en50221_app_ca_message;
+		*arg_out = ca_resource;
+		break;
+	case EN50221_APP_MMI_RESOURCEID:
+		*callback_out = (en50221_sl_resource_callback) en50221_app_mmi_message;
+		*arg_out = mmi_resource;
+		break;
+	case EN50221_APP_DATETIME_RESOURCEID:
+		*callback_out = (en50221_sl_resource_callback) en50221_app_datetime_message;
+		*arg_out = datetime_resource;
+		break;
+	default:
+		return -1;
+	}
+	*connected_resource_id = requested_resource_id;
+	return 0;
+}
+
+static int session_callback(void *arg, int reason, uint8_t _slot_id, uint16_t session_number, uint32_t resource_id)
+{
+	(void) arg;
+	(void) _slot_id;
+
+	pthread_mutex_lock(&lock);
+	switch (reason) {
+	case S_SCALLBACK_REASON_CAMCONNECTED:
+		if (resource_id == EN50221_APP_RM_RESOURCEID) {
+			en50221_app_rm_enq(rm_resource, session_number);
+		} else if (resource_id == EN50221_APP_AI_RESOURCEID) {
+			en50221_app_ai_enquiry(ai_resource, session_number);
+			ai_session_number = session_number;
+		} else if (resource_id == EN50221_APP_CA_RESOURCEID) {
+			en50221_app_ca_info_enq(ca_resource, session_number);
+			ca_session_number = session_number;
+		} else if (resource_id == EN50221_APP_MMI_RESOURCEID) {
+			mmi_session_number = session_number;
+		}
+		break;
+
+	case S_SCALLBACK_REASON_CLOSE:
+		if (resource_id == EN50221_APP_AI_RESOURCEID)
+			ai_session_number = -1;
+		else if (resource_id == EN50221_APP_CA_RESOURCEID)
+			ca_session_number = -1;
+		else if (resource_id == EN50221_APP_MMI_RESOURCEID)
+			mmi_session_number = -1;
+		break;
+	}
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+	return 0;
+}
+
+static int rm_enq_callback(void *arg, uint8_t _slot_id, uint16_t session_number)
+{
+	(void) arg;
+	(void) _slot_id;
+
+	en50221_app_rm_reply(rm_resource, session_number, RESOURCE_IDS_COUNT, resource_ids);
+	return 0;
+}
+
+static int rm_reply_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+			     uint32_t resource_id_count, uint32_t *_resource_ids)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) resource_id_count;
+	(void) _resource_ids;
+
+	en50221_app_rm_changed(rm_resource, session_number);
+	return 0;
+}
+
+static int rm_changed_callback(void *arg, uint8_t _slot_id, uint16_t session_number)
+{
+	(void) arg;
+	(void) _slot_id;
+
+	en50221_app_rm_enq(rm_resource, session_number);
+	return 0;
+}
+
+static int datetime_enquiry_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+				     uint8_t response_interval)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) response_interval;
+
+	en50221_app_datetime_send(datetime_resource, session_number, time(NULL), 0);
+	event(&date_time_enquiries);
+	return 0;
+}
+
+static int ai_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+		       uint8_t application_type, uint16_t application_manufacturer,
+		       uint16_t manufacturer_code, uint8_t menu_string_length,
+		       uint8_t *menu_string)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) session_number;
+	(void) application_type;
+	(void) application_manufacturer;
+	(void) manufacturer_code;
+	(void) menu_string_length;
+	(void) menu_string;
+
+	event(&app_infos);
+	return 0;
+}
+
+static int ca_info_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+			    uint32_t ca_id_count, uint16_t *ca_ids)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) session_number;
+	(void) ca_id_count;
+	(void) ca_ids;
+
+	event(&ca_infos);
+	return 0;
+}
+
+static int ca_pmt_reply_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+				 struct en50221_app_pmt_reply *reply, uint32_t reply_size)
+{
+	struct en50221_app_pmt_stream *pos;
+	int streams = 0;
+	(void) arg;
+	(void) _slot_id;
+	(void) session_number;
+
+	en50221_app_pmt_reply_streams_for_each(reply, pos, reply_size)
+		streams++;
+	if ((reply->program_number != 0x0101) || (streams != 2) ||
+	    (reply->CA_enable != CA_ENABLE_DESCRAMBLING_POSSIBLE))
+		event(&bad_pmt_replies);
+
+	event(&pmt_replies);
+	return 0;
+}
+
+static int mmi_menu_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+			     struct en50221_app_mmi_text *title,
+			     struct en50221_app_mmi_text *sub_title,
+			     struct en50221_app_mmi_text *bottom,
+			     uint32_t item_count, struct en50221_app_mmi_text *items,
+			     uint32_t item_raw_length, uint8_t *items_raw)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) session_number;
+	(void) title;
+	(void) sub_title;
+	(void) bottom;
+	(void) item_raw_length;
+	(void) items_raw;
+
+	if ((item_count != menu_items) ||
+	    (items[item_count - 1].text_length == 0))
+		event(&bad_menus);
+
+	event(&menus);
+	return 0;
+}
+
+static int mmi_close_callback(void *arg, uint8_t _slot_id, uint16_t session_number,
+			      uint8_t cmd_id, uint8_t delay)
+{
+	(void) arg;
+	(void) _slot_id;
+	(void) session_number;
+	(void) cmd_id;
+	(void) delay;
+
+	event(&closes);
+	return 0;
+}
+
+static void *poller_func(void *arg)
+{
+	(void) arg;
+
+	while (!shutdown_poller) {
+		if (en50221_tl_poll_wait(tl, 100)) {
+			int error = -en50221_tl_get_error(tl);
+
+			if ((error >= 0) && (error < 16))
+				event(&tl_errors[error]);
+		}
+	}
+
+	return NULL;
+}
+
+static void host_create(void)
+{
+	if ((tl = en50221_tl_create(1, 16)) == NULL) {
+		fprintf(stderr, "XXXX en50221_tl_create failed\n");
+		exit(1);
+	}
+	if ((sl = en50221_sl_create(tl, 16)) == NULL) {
+		fprintf(stderr, "XXXX en50221_sl_create failed\n");
+		exit(1);
+	}
+
+	sendfuncs.arg = sl;
+	sendfuncs.send_data = (en50221_send_data) en50221_sl_send_data;
+	sendfuncs.send_datav = (en50221_send_datav) en50221_sl_send_datav;
+
+	rm_resource = en50221_app_rm_create(&sendfuncs);
+	en50221_app_rm_register_enq_callback(rm_resource, rm_enq_callback, NULL);
+	en50221_app_rm_register_reply_callback(rm_resource, rm_reply_callback, NULL);
+	en50221_app_rm_register_changed_callback(rm_resource, rm_changed_callback, NULL);
+	datetime_resource = en50221_app_datetime_create(&sendfuncs);
+	en50221_app_datetime_register_enquiry_callback(datetime_resource, datetime_enquiry_callback, NULL);
+	ai_resource = en50221_app_ai_create(&sendfuncs);
+	en50221_app_ai_register_callback(ai_resource, ai_callback, NULL);
+	ca_resource = en50221_app_ca_create(&sendfuncs);
+	en50221_app_ca_register_info_callback(ca_resource, ca_info_callback, NULL);
+	en50221_app_ca_register_pmt_reply_callback(ca_resource, ca_pmt_reply_callback, NULL);
+	mmi_resource = en50221_app_mmi_create(&sendfuncs);
+	en50221_app_mmi_register_menu_callback(mmi_resource, mmi_menu_callback, NULL);
+	en50221_app_mmi_register_close_callback(mmi_resource, mmi_close_callback, NULL);
+
+	en50221_sl_register_lookup_callback(sl, lookup_callback, NULL);
+	en50221_sl_register_session_callback(sl, session_callback, NULL);
+}
+
+static void host_destroy(void)
+{
+	en50221_app_rm_destroy(rm_resource);
+	en50221_app_datetime_destroy(datetime_resource);
+	en50221_app_ai_destroy(ai_resource);
+	en50221_app_ca_destroy(ca_resource);
+	en50221_app_mmi_destroy(mmi_resource);
+	en50221_sl_destroy(sl);
+	en50221_tl_destroy(tl);
+}
+
+
+
+
+/*
+ * Plug a simulated CAM in. If setup_time is set, wait for the CAM to be
+ * usable and say how long that took. Returns NULL on failure.
+ */
+static struct en50221_camsim *attach(struct en50221_camsim_params *params, double *setup_time)
+{
+	struct en50221_camsim *camsim;
+	int target_app_infos = get(&app_infos) + 1;
+	int target_ca_infos = get(&ca_infos) + 1;
+	int target_date_time_enquiries = get(&date_time_enquiries) + 1;
+	double start;
+
+	if ((camsim = en50221_camsim_create(params)) == NULL) {
+		fprintf(stderr, "XXXX en50221_camsim_create failed\n");
+		return NULL;
+	}
+
+	start = now();
+	if ((slot_id = en50221_tl_register_slot(tl, en50221_camsim_get_fd(camsim), 0,
+						RESPONSE_TIMEOUT_MS, POLL_DELAY_MS)) < 0) {
+		fprintf(stderr, "XXXX en50221_tl_register_slot failed\n");
+		en50221_camsim_destroy(camsim);
+		return NULL;
+	}
+	if (en50221_tl_new_tc(tl, slot_id) < 0) {
+		fprintf(stderr, "XXXX en50221_tl_new_tc failed\n");
+		en50221_tl_destroy_slot(tl, slot_id);
+		en50221_camsim_destroy(camsim);
+		return NULL;
+	}
+	if (setup_time == NULL)
+		return camsim;
+
+	if (wait_for(&app_infos, target_app_infos) ||
+	    wait_for(&ca_infos, target_ca_infos) ||
+	    wait_for(&date_time_enquiries, target_date_time_enquiries)) {
+		fprintf(stderr, "XXXX CAM was not set up\n");
+		en50221_tl_destroy_slot(tl, slot_id);
+		en50221_camsim_destroy(camsim);
+		return NULL;
+	}
+	*setup_time = now() - start;
+	return camsim;
+}
+
+static void detach(struct en50221_camsim *camsim)
+{
+	en50221_tl_destroy_slot(tl, slot_id);
+	en50221_camsim_destroy(camsim);
+	slot_id = -1;
+}
+
+static int ca_pmt_query(void)
+{
+	if (en50221_app_ca_pmt(ca_resource, get(&ca_session_number), ca_pmt, sizeof(ca_pmt))) {
+		fprintf(stderr, "XXXX en50221_app_ca_pmt failed\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int run_config(struct config *config)
+{
+	struct en50221_camsim_params params;
+	struct en50221_camsim *camsim;
+	struct timing setup, ca_pmt_rtt, menu, menu_close;
+	double setup_time, start;
+	int setups = (config->iterations / 25) + 1;
+	int failures = 0;
+	int i, target;
+
+	memset(&params, 0, sizeof(params));
+	params.latency_us = config->latency_us;
+	params.fragment_size = config->fragment_size;
+	params.menu_items = menu_items;
+	memset(&setup, 0, sizeof(setup));
+	memset(&ca_pmt_rtt, 0, sizeof(ca_pmt_rtt));
+	memset(&menu, 0, sizeof(menu));
+	memset(&menu_close, 0, sizeof(menu_close));
+
+	printf("%s:\n", config->name);
+
+	// session setup, from the transport connection to the CA info
+	for (i = 0; i < setups; i++) {
+		if ((camsim = attach(&params, &setup_time)) == NULL)
+			return 1;
+		timing_add(&setup, setup_time);
+		if (i != setups - 1)
+			detach(camsim);
+	}
+	timing_print("session setup", &setup);
+
+	// CA PMT query to reply, one at a time
+	target = get(&pmt_replies);
+	for (i = 0; i < config->iterations; i++) {
+		start = now();
+		if (ca_pmt_query() || wait_for(&pmt_replies, ++target)) {
+			fprintf(stderr, "XXXX CA PMT reply %i did not arrive\n", i);
+			failures++;
+			break;
+		}
+		timing_add(&ca_pmt_rtt, now() - start);
+	}
+	timing_print("CA PMT round-trip", &ca_pmt_rtt);
+
+	// and queued in bursts, as for several services
+	start = now();
+	for (i = 0; i < config->iterations / PMT_BURST; i++) {
+		int j;
+
+		for (j = 0; j < PMT_BURST; j++) {
+			if (ca_pmt_query())
+				break;
+		}
+		target += PMT_BURST;
+		if (wait_for(&pmt_replies, target)) {
+			fprintf(stderr, "XXXX CA PMT burst %i did not arrive\n", i);
+			failures++;
+			break;
+		}
+	}
+	if (i)
+		printf("  %-22s %5i: %9.0f replies/s\n", "CA PMT bursts", i * PMT_BURST,
+		       (i * PMT_BURST) / (now() - start));
+
+	// entering the CAM menu to the menu, and answering it to its close
+	for (i = 0; i < (config->iterations / 5) + 1; i++) {
+		int target_menus = get(&menus) + 1;
+		int target_closes = get(&closes) + 1;
+
+		start = now();
+		if (en50221_app_ai_entermenu(ai_resource, get(&ai_session_number)) ||
+		    wait_for(&menus, target_menus)) {
+			fprintf(stderr, "XXXX MMI menu %i did not arrive\n", i);
+			failures++;
+			break;
+		}
+		// the first one opens the MMI session as well
+		if (i)
+			timing_add(&menu, now() - start);
+
+		start = now();
+		if (en50221_app_mmi_menu_answ(mmi_resource, get(&mmi_session_number), 1) ||
+		    wait_for(&closes, target_closes)) {
+			fprintf(stderr, "XXXX MMI close %i did not arrive\n", i);
+			failures++;
+			break;
+		}
+		timing_add(&menu_close, now() - start);
+	}
+	timing_print("MMI enter menu", &menu);
+	timing_print("MMI answer to close", &menu_close);
+
+	detach(camsim);
+	return failures;
+}
+
+/*
+ * Check the stack survives or reports each kind of error the CAM injects.
+ */
+static int run_errors(void)
+{
+	struct en50221_camsim_params params;
+	struct en50221_camsim_stats stats;
+	struct en50221_camsim *camsim;
+	double setup_time;
+	int failures = 0;
+	int i, target, errors;
+
+	printf("injected errors:\n");
+	memset(&params, 0, sizeof(params));
+	params.menu_items = menu_items;
+
+	// bogus APDUs are dropped by the application layer
+	params.error_interval = 3;
+	params.error_types = EN50221_CAMSIM_ERROR_BADAPDU;
+	if ((camsim = attach(&params, &setup_time)) == NULL)
+		return 1;
+	target = get(&pmt_replies);
+	for (i = 0; i < 100; i++) {
+		if (ca_pmt_query() || wait_for(&pmt_replies, ++target)) {
+			fprintf(stderr, "XXXX CA PMT reply %i did not arrive past a bad APDU\n", i);
+			failures++;
+			break;
+		}
+	}
+	en50221_camsim_get_stats(camsim, &stats);
+	printf("  %-22s %5u: %i CA PMT replies\n", "bad APDUs", stats.errors_injected, i);
+	if (stats.errors_injected == 0) {
+		fprintf(stderr, "XXXX no bad APDUs were injected\n");
+		failures++;
+	}
+	detach(camsim);
+
+	// a garbled TPDU and a missing reply are reported by the transport layer
+	params.error_interval = 20;
+	params.error_types = EN50221_CAMSIM_ERROR_BADTPDU;
+	errors = get(&tl_errors[-EN50221ERR_BADCAMDATA]);
+	if ((camsim = attach(&params, NULL)) == NULL)
+		return failures + 1;
+	if (wait_for(&tl_errors[-EN50221ERR_BADCAMDATA], errors + 1)) {
+		fprintf(stderr, "XXXX a garbled TPDU was not reported\n");
+		failures++;
+	}
+	detach(camsim);
+	printf("  %-22s %5s: reported\n", "garbled TPDUs", "");
+
+	params.error_types = EN50221_CAMSIM_ERROR_DROP;
+	errors = get(&tl_errors[-EN50221ERR_TIMEOUT]);
+	if ((camsim = attach(&params, NULL)) == NULL)
+		return failures + 1;
+	if (wait_for(&tl_errors[-EN50221ERR_TIMEOUT], errors + 1)) {
+		fprintf(stderr, "XXXX a missing reply was not reported\n");
+		failures++;
+	}
+	detach(camsim);
+	printf("  %-22s %5s: reported\n", "missing replies", "");
+
+	return failures;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: bench_camsim [-l <latency_us>] [-f <fragment_size>] [-n <iterations>] [-m <menu_items>]\n"
+		" With no options, runs a set of configurations and the error checks.\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct config config = { "custom", 0, 0, 500 };
+	pthread_t poller;
+	int custom = 0;
+	int failures = 0;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:f:n:m:")) != -1) {
+		switch (opt) {
+		case 'l':
+			config.latency_us = atoi(optarg);
+			custom = 1;
+			break;
+		case 'f':
+			config.fragment_size = atoi(optarg);
+			custom = 1;
+			break;
+		case 'n':
+			config.iterations = atoi(optarg);
+			custom = 1;
+			break;
+		case 'm':
+			menu_items = atoi(optarg);
+			if ((menu_items < 1) || (menu_items > 254))
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	host_create();
+	pthread_create(&poller, NULL, poller_func, NULL);
+
+	if (custom) {
+		failures += run_config(&config);
+	} else {
+		for (i = 0; i < sizeof(default_configs) / sizeof(struct config); i++)
+			failures += run_config(&default_configs[i]);
+		failures += run_errors();
+	}
+
+	if (get(&bad_pmt_replies)) {
+		fprintf(stderr, "XXXX %i CA PMT replies were wrong\n", get(&bad_pmt_replies));
+		failures++;
+	}
+	if (get(&bad_menus)) {
+		fprintf(stderr, "XXXX %i MMI menus were wrong\n", get(&bad_menus));
+		failures++;
+	}
+
+	shutdown_poller = 1;
+	en50221_tl_wakeup(tl);
+	pthread_join(poller, NULL);
+	host_destroy();
+
+	return failures ? 1 : 0;
+}
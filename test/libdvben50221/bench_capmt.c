@@ -0,0 +1,492 @@
+/*
+ * en50221 benchmark: formatting CA PMTs, directly and through a cache.
+ *
+ * Random PMTs are formatted by a copy of the old list based formatter, by
+ * en50221_ca_format_pmt() and by an en50221_ca_pmt_cache, which must all
+ * agree, and each is timed as a CA manager would use it: the same few PMTs
+ * sent to CAMs over and over with different list management.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libdvben50221/en50221_app_ca.h>
+#include <libucsi/crc32.h>
+#include <libucsi/mpeg/descriptor.h>
+#include <libucsi/mpeg/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PMTS			64
+#define CHECK_PMTS		5000
+#define ITERATIONS		200000
+#define CAPMT_SIZE		4096
+
+static const uint16_t ca_system_ids[] = { 0x0b00, 0x0500, 0x1800, 0x0100 };
+
+struct pmt {
+	uint8_t raw[1024];
+	int size;
+	uint8_t decoded[1024];
+	struct mpeg_pmt_section *section;
+};
+
+static struct pmt pmts[PMTS];
+
+/*
+ * Count the calls to malloc() from everything in the process.
+ */
+extern void *__libc_malloc(size_t size);
+static int counting;
+static long mallocs;
+
+void *malloc(size_t size)
+{
+	if (counting)
+		mallocs++;
+	return __libc_malloc(size);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int put_ca_descriptor(uint8_t *buf, uint16_t ca_system_id, uint16_t ca_pid)
+{
+	buf[0] = 0x09;
+	buf[1] = 4;
+	buf[2] = ca_system_id >> 8;
+	buf[3] = ca_system_id;
+	buf[4] = 0xe0 | (ca_pid >> 8);
+	buf[5] = ca_pid;
+	return 6;
+}
+
+static int put_descriptors(uint8_t *buf, int ca_count)
+{
+	int pos = 0;
+	int i;
+
+	// an ISO 639 descriptor among the CA ones, which must be dropped
+	if (rand() & 1) {
+		memcpy(buf + pos, "\x0a\x04" "eng\x00", 6);
+		pos += 6;
+	}
+	for (i = 0; i < ca_count; i++) {
+		pos += put_ca_descriptor(buf + pos, ca_system_ids[rand() % 4],
+					 0x100 + (rand() % 16));
+	}
+	return pos;
+}
+
+/*
+ * Build a random PMT: programme level CA descriptors or not, and streams with
+ * either random CA descriptors or all the same ones.
+ */
+static void make_pmt(struct pmt *pmt, uint16_t program_number, int version)
+{
+	uint8_t *buf = pmt->raw;
+	uint8_t same[64];
+	int same_length = 0;
+	int pos = 12;
+	int stream_count = 1 + (rand() % 8);
+	int shape = rand() % 3;
+	int i;
+
+	// programme info
+	int info_length = (shape == 0) ? put_descriptors(buf + pos, 1 + (rand() % 3)) : 0;
+	pos += info_length;
+	if (shape == 1)
+		same_length = put_descriptors(same, rand() % 3);
+
+	for (i = 0; i < stream_count; i++) {
+		int es_info_length;
+
+		buf[pos] = (i == 0) ? 0x02 : 0x04;
+		buf[pos + 1] = 0xe0 | ((0x200 + i) >> 8);
+		buf[pos + 2] = 0x200 + i;
+		if (shape == 1) {
+			memcpy(buf + pos + 5, same, same_length);
+			es_info_length = same_length;
+		} else {
+			es_info_length = put_descriptors(buf + pos + 5, rand() % 3);
+		}
+		buf[pos + 3] = 0xf0 | (es_info_length >> 8);
+		buf[pos + 4] = es_info_length;
+		pos += 5 + es_info_length;
+	}
+
+	int section_length = pos + 4 - 3;
+	buf[0] = stag_mpeg_program_map;
+	buf[1] = 0xb0 | (section_length >> 8);
+	buf[2] = section_length;
+	buf[3] = program_number >> 8;
+	buf[4] = program_number;
+	buf[5] = 0xc1 | (version << 1);
+	buf[6] = 0;
+	buf[7] = 0;
+	buf[8] = 0xe1;
+	buf[9] = 0x00;
+	buf[10] = 0xf0 | (info_length >> 8);
+	buf[11] = info_length;
+	uint32_t crc = crc32(CRC32_INIT, buf, pos);
+	buf[pos++] = crc >> 24;
+	buf[pos++] = crc >> 16;
+	buf[pos++] = crc >> 8;
+	buf[pos++] = crc;
+	pmt->size = pos;
+}
+
+static struct mpeg_pmt_section *decode_pmt(uint8_t *buf, int size)
+{
+	struct section *section;
+	struct section_ext *section_ext;
+
+	if ((section = section_codec(buf, size)) == NULL)
+		return NULL;
+	if ((section_ext = section_ext_decode(section, 1)) == NULL)
+		return NULL;
+	return mpeg_pmt_section_codec(section_ext);
+}
+
+static int decode(struct pmt *pmt)
+{
+	memcpy(pmt->decoded, pmt->raw, pmt->size);
+	pmt->section = decode_pmt(pmt->decoded, pmt->size);
+	return (pmt->section == NULL) ? -1 : 0;
+}
+
+/*
+ * The formatter as it was before, building lists of descriptors and streams,
+ * with CA system id filtering added.
+ */
+struct ref_descriptor {
+	uint8_t *descriptor;
+	uint16_t length;
+	struct ref_descriptor *next;
+};
+
+struct ref_stream {
+	uint8_t stream_type;
+	uint16_t pid;
+	struct ref_descriptor *descriptors;
+	uint32_t descriptors_length;
+	uint32_t descriptors_count;
+	struct ref_stream *next;
+};
+
+static int ref_wanted(struct descriptor *d, uint16_t *ca_ids, int ca_id_count)
+{
+	uint8_t *buf = (uint8_t *) d;
+	int i;
+
+	if (d->tag != dtag_mpeg_ca)
+		return 0;
+	if (ca_id_count == 0)
+		return 1;
+	for (i = 0; i < ca_id_count; i++) {
+		if (ca_ids[i] == ((buf[2] << 8) | buf[3]))
+			return 1;
+	}
+	return 0;
+}
+
+static void ref_append(struct ref_descriptor **list, struct descriptor *d)
+{
+	struct ref_descriptor *new_d = malloc(sizeof(struct ref_descriptor));
+
+	new_d->descriptor = (uint8_t *) d;
+	new_d->length = d->len + 2;
+	new_d->next = NULL;
+	while (*list)
+		list = &(*list)->next;
+	*list = new_d;
+}
+
+static void ref_free(struct ref_descriptor *d)
+{
+	while (d) {
+		struct ref_descriptor *next = d->next;
+		free(d);
+		d = next;
+	}
+}
+
+static int ref_format_pmt(struct mpeg_pmt_section *pmt, uint8_t *data, uint32_t data_length,
+			  int move_ca_descriptors, uint8_t list_management, uint8_t cmd_id,
+			  uint16_t *ca_ids, int ca_id_count)
+{
+	struct ref_descriptor *pmt_descriptors = NULL;
+	struct ref_stream *streams = NULL;
+	struct ref_stream **tail = &streams;
+	struct ref_stream *cur_s;
+	struct ref_descriptor *cur_d;
+	struct mpeg_pmt_stream *stream;
+	struct descriptor *d;
+	uint32_t pmt_descriptors_length = 0;
+	uint32_t data_pos = 0;
+
+	mpeg_pmt_section_descriptors_for_each(pmt, d) {
+		if (ref_wanted(d, ca_ids, ca_id_count))
+			ref_append(&pmt_descriptors, d);
+	}
+	mpeg_pmt_section_streams_for_each(pmt, stream) {
+		struct ref_stream *new_s = calloc(1, sizeof(struct ref_stream));
+		new_s->stream_type = stream->stream_type;
+		new_s->pid = stream->pid;
+		mpeg_pmt_stream_descriptors_for_each(stream, d) {
+			if (ref_wanted(d, ca_ids, ca_id_count)) {
+				ref_append(&new_s->descriptors, d);
+				new_s->descriptors_count++;
+			}
+		}
+		*tail = new_s;
+		tail = &new_s->next;
+	}
+
+	if ((pmt_descriptors == NULL) && move_ca_descriptors && streams) {
+		int match = 1;
+		for (cur_s = streams->next; cur_s && match; cur_s = cur_s->next) {
+			struct ref_descriptor *a = streams->descriptors;
+			struct ref_descriptor *b = cur_s->descriptors;
+			if (cur_s->descriptors_count != streams->descriptors_count)
+				match = 0;
+			for (; match && a; a = a->next, b = b->next) {
+				if ((a->length != b->length) || memcmp(a->descriptor, b->descriptor, a->length))
+					match = 0;
+			}
+		}
+		if (match) {
+			pmt_descriptors = streams->descriptors;
+			streams->descriptors = NULL;
+			for (cur_s = streams->next; cur_s; cur_s = cur_s->next) {
+				ref_free(cur_s->descriptors);
+				cur_s->descriptors = NULL;
+			}
+		}
+	}
+
+	for (cur_d = pmt_descriptors; cur_d; cur_d = cur_d->next)
+		pmt_descriptors_length += cur_d->length;
+	if (pmt_descriptors_length)
+		pmt_descriptors_length++;
+
+	data[data_pos++] = list_management;
+	data[data_pos++] = mpeg_pmt_section_program_number(pmt) >> 8;
+	data[data_pos++] = mpeg_pmt_section_program_number(pmt);
+	data[data_pos++] = (pmt->head.version_number << 1) | pmt->head.current_next_indicator;
+	data[data_pos++] = (pmt_descriptors_length >> 8) & 0x0f;
+	data[data_pos++] = pmt_descriptors_length;
+	if (pmt_descriptors_length) {
+		data[data_pos++] = cmd_id;
+		for (cur_d = pmt_descriptors; cur_d; cur_d = cur_d->next) {
+			memcpy(data + data_pos, cur_d->descriptor, cur_d->length);
+			data_pos += cur_d->length;
+		}
+	}
+	ref_free(pmt_descriptors);
+
+	while (streams) {
+		cur_s = streams;
+		cur_s->descriptors_length = 0;
+		for (cur_d = cur_s->descriptors; cur_d; cur_d = cur_d->next)
+			cur_s->descriptors_length += cur_d->length;
+		if (cur_s->descriptors_length)
+			cur_s->descriptors_length++;
+
+		data[data_pos++] = cur_s->stream_type;
+		data[data_pos++] = (cur_s->pid >> 8) & 0x1f;
+		data[data_pos++] = cur_s->pid;
+		data[data_pos++] = (cur_s->descriptors_length >> 8) & 0x0f;
+		data[data_pos++] = cur_s->descriptors_length;
+		if (cur_s->descriptors_length) {
+			data[data_pos++] = cmd_id;
+			for (cur_d = cur_s->descriptors; cur_d; cur_d = cur_d->next) {
+				memcpy(data + data_pos, cur_d->descriptor, cur_d->length);
+				data_pos += cur_d->length;
+			}
+		}
+		ref_free(cur_s->descriptors);
+		streams = cur_s->next;
+		free(cur_s);
+	}
+	(void) data_length;
+
+	return data_pos;
+}
+
+static int compare(const char *what, int i, uint8_t *expected, int expected_size,
+		   uint8_t *got, int got_size)
+{
+	if ((got_size != expected_size) || memcmp(expected, got, got_size)) {
+		fprintf(stderr, "XXXX PMT %i: %s gave %i bytes, expected %i\n",
+			i, what, got_size, expected_size);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Every way of formatting must agree with the old formatter, for every
+ * combination of options, for lots of random PMTs.
+ */
+static int check(void)
+{
+	struct en50221_ca_pmt_cache *cache[2];
+	uint8_t expected[CAPMT_SIZE];
+	uint8_t got[CAPMT_SIZE];
+	struct pmt pmt;
+	int failures = 0;
+	int i, move, repeat;
+
+	cache[0] = en50221_ca_pmt_cache_create(8, 0);
+	cache[1] = en50221_ca_pmt_cache_create(8, 1);
+
+	for (i = 0; i < CHECK_PMTS; i++) {
+		make_pmt(&pmt, 1 + (rand() % 16), rand() % 32);
+		if (decode(&pmt)) {
+			fprintf(stderr, "XXXX PMT %i did not decode\n", i);
+			return 1;
+		}
+
+		uint16_t ca_ids[2] = { ca_system_ids[rand() % 4], ca_system_ids[rand() % 4] };
+		int ca_id_count = rand() % 3;
+
+		for (move = 0; move < 2; move++) {
+			int size = ref_format_pmt(pmt.section, expected, sizeof(expected), move,
+						  CA_LIST_MANAGEMENT_ONLY, CA_PMT_CMD_ID_OK_DESCRAMBLING,
+						  NULL, 0);
+			int got_size = en50221_ca_format_pmt(pmt.section, got, sizeof(got), move,
+							     CA_LIST_MANAGEMENT_ONLY,
+							     CA_PMT_CMD_ID_OK_DESCRAMBLING);
+			failures += compare("en50221_ca_format_pmt", i, expected, size, got, got_size);
+
+			// a short buffer must be refused
+			if (en50221_ca_format_pmt(pmt.section, got, size - 1, move,
+						  CA_LIST_MANAGEMENT_ONLY,
+						  CA_PMT_CMD_ID_OK_DESCRAMBLING) != -1) {
+				fprintf(stderr, "XXXX PMT %i: overran a short buffer\n", i);
+				failures++;
+			}
+
+			// a miss, then hits with other list management and commands
+			for (repeat = 0; repeat < 3; repeat++) {
+				uint8_t list_management = CA_LIST_MANAGEMENT_MORE + repeat;
+				uint8_t cmd_id = CA_PMT_CMD_ID_OK_DESCRAMBLING + repeat;
+
+				size = ref_format_pmt(pmt.section, expected, sizeof(expected), move,
+						      list_management, cmd_id, ca_ids, ca_id_count);
+				got_size = en50221_ca_pmt_cache_format(cache[move], pmt.section,
+								       ca_ids, ca_id_count,
+								       got, sizeof(got),
+								       list_management, cmd_id);
+				failures += compare("en50221_ca_pmt_cache_format", i,
+						    expected, size, got, got_size);
+			}
+		}
+		if (failures)
+			break;
+	}
+
+	uint32_t hits, misses;
+	en50221_ca_pmt_cache_get_stats(cache[1], &hits, &misses);
+	if ((hits == 0) || (misses == 0)) {
+		fprintf(stderr, "XXXX cache reported %u hits and %u misses\n", hits, misses);
+		failures++;
+	}
+
+	en50221_ca_pmt_cache_destroy(cache[0]);
+	en50221_ca_pmt_cache_destroy(cache[1]);
+	if (failures == 0)
+		printf("%i random PMTs formatted identically\n", CHECK_PMTS);
+	return failures;
+}
+
+static void report(const char *what, double elapsed, long calls)
+{
+	printf("  %-30s %8.0f ns/CA PMT  malloc calls: %li\n", what,
+	       (elapsed * 1e9) / ITERATIONS, calls);
+}
+
+int main(void)
+{
+	struct en50221_ca_pmt_cache *cache;
+	uint8_t capmt[CAPMT_SIZE];
+	uint16_t ca_ids[1] = { 0x0b00 };
+	int failures;
+	int i;
+	double start;
+
+	srand(1);
+	failures = check();
+
+	for (i = 0; i < PMTS; i++) {
+		make_pmt(&pmts[i], i + 1, 0);
+		decode(&pmts[i]);
+	}
+	if ((cache = en50221_ca_pmt_cache_create(PMTS, 1)) == NULL) {
+		fprintf(stderr, "XXXX en50221_ca_pmt_cache_create failed\n");
+		return 1;
+	}
+
+	printf("%i PMTs, each sent %i times:\n", PMTS, ITERATIONS / PMTS);
+
+	counting = 1;
+	mallocs = 0;
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		ref_format_pmt(pmts[i % PMTS].section, capmt, sizeof(capmt), 1,
+			       CA_LIST_MANAGEMENT_ONLY + (i & 1), CA_PMT_CMD_ID_OK_DESCRAMBLING,
+			       NULL, 0);
+	}
+	report("old formatter", now() - start, mallocs);
+
+	mallocs = 0;
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		en50221_ca_format_pmt(pmts[i % PMTS].section, capmt, sizeof(capmt), 1,
+				      CA_LIST_MANAGEMENT_ONLY + (i & 1), CA_PMT_CMD_ID_OK_DESCRAMBLING);
+	}
+	report("en50221_ca_format_pmt", now() - start, mallocs);
+
+	// the first pass of the PMTs fills the cache
+	for (i = 0; i < PMTS; i++) {
+		en50221_ca_pmt_cache_format(cache, pmts[i].section, ca_ids, 1, capmt, sizeof(capmt),
+					    CA_LIST_MANAGEMENT_ONLY, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+	}
+	mallocs = 0;
+	start = now();
+	for (i = 0; i < ITERATIONS; i++) {
+		en50221_ca_pmt_cache_format(cache, pmts[i % PMTS].section, ca_ids, 1,
+					    capmt, sizeof(capmt),
+					    CA_LIST_MANAGEMENT_ONLY + (i & 1),
+					    CA_PMT_CMD_ID_OK_DESCRAMBLING);
+	}
+	report("en50221_ca_pmt_cache_format", now() - start, mallocs);
+	counting = 0;
+
+	if (mallocs) {
+		fprintf(stderr, "XXXX the cache allocated memory in the steady state\n");
+		failures++;
+	}
+
+	en50221_ca_pmt_cache_destroy(cache);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * crc32 engine comparison and micro-benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/crc32.h>
+#include <libucsi/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LEN 4096
+#define CHECK_LEN (MAX_LEN + 64)
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+static enum crc32_engine engines[] = {
+	crc32_engine_bytewise,
+	crc32_engine_slice8,
+	crc32_engine_clmul,
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static int sizes[] = { 16, 32, 64, 128, 188, 256, 512, 1024, 1500, 4096 };
+#define NUM_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static uint32_t run_engine(enum crc32_engine engine, uint8_t *buf, size_t len)
+{
+	switch(engine) {
+	case crc32_engine_bytewise:
+		return crc32_bytewise(CRC32_INIT, buf, len);
+	case crc32_engine_slice8:
+		return crc32_slice8(CRC32_INIT, buf, len);
+	case crc32_engine_clmul:
+		return crc32_clmul(CRC32_INIT, buf, len);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int check_engines(uint8_t *buf)
+{
+	size_t len, off, i;
+
+	for (off = 0; off < 16; off++) {
+		for (len = 0; len + off <= CHECK_LEN; len++) {
+			uint32_t ref = crc32_bytewise(CRC32_INIT, buf + off, len);
+
+			for (i = 0; i < NUM_ENGINES; i++) {
+				uint32_t crc;
+
+				if (!crc32_engine_supported(engines[i]))
+					continue;
+				crc = run_engine(engines[i], buf + off, len);
+				if (crc != ref) {
+					fprintf(stderr, "XXXX %s mismatch: off %zu len %zu (%08x != %08x)\n",
+						crc32_engine_name(engines[i]), off, len, crc, ref);
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int check_section(void)
+{
+	uint8_t buf[1024];
+	struct section_ext *ext = (struct section_ext *) buf;
+	struct section *section;
+	int len = sizeof(buf);
+	int i;
+
+	/* build a section with a valid CRC and make sure it validates */
+	memset(buf, 0, sizeof(buf));
+	for (i = sizeof(struct section_ext); i < len - CRC_SIZE; i++)
+		buf[i] = i * 7;
+	ext->table_id = 0x42;
+	ext->syntax_indicator = 1;
+	ext->length = len - sizeof(struct section);
+	ext->table_id_ext = 0x1234;
+	ext->version_number = 3;
+	ext->current_next_indicator = 1;
+	section_ext_encode(ext, 1);
+	bswap16(buf + 1);
+
+	if ((section = section_codec(buf, len)) == NULL)
+		return -1;
+	if (section_check_crc(section))
+		return -1;
+
+	buf[100] ^= 1;
+	if (!section_check_crc(section))
+		return -1;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buf;
+	size_t i, j;
+	double mb = BENCH_BYTES / (1024.0 * 1024.0);
+	(void) argv;
+
+	if ((buf = malloc(BENCH_BYTES + MAX_LEN)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	srandom(argc);
+	for (i = 0; i < BENCH_BYTES + MAX_LEN; i++)
+		buf[i] = random();
+
+	printf("Using engine %s by default\n", crc32_engine_name(crc32_engine_current()));
+
+	if (check_engines(buf)) {
+		fprintf(stderr, "XXXX crc32 engine check failed\n");
+		exit(1);
+	}
+	if (check_section()) {
+		fprintf(stderr, "XXXX section crc check failed\n");
+		exit(1);
+	}
+
+	printf("%8s", "size");
+	for (i = 0; i < NUM_ENGINES; i++)
+		printf(" %12s", crc32_engine_name(engines[i]));
+	printf("   (MB/s)\n");
+
+	for (j = 0; j < NUM_SIZES; j++) {
+		size_t len = sizes[j];
+
+		printf("%8zu", len);
+		for (i = 0; i < NUM_ENGINES; i++) {
+			volatile uint32_t sink = 0;
+			size_t pos;
+			double start;
+
+			if (!crc32_engine_supported(engines[i])) {
+				printf(" %12s", "-");
+				continue;
+			}
+
+			/* walk through the buffer a section at a time so we
+			 * are not just measuring an L1-resident block */
+			start = now();
+			for (pos = 0; pos < BENCH_BYTES; pos += len)
+				sink ^= run_engine(engines[i], buf + pos, len);
+			printf(" %12.1f", mb / (now() - start));
+		}
+		printf("\n");
+	}
+
+	free(buf);
+	return 0;
+}
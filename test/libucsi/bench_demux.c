@@ -0,0 +1,349 @@
+/*
+ * transport_demux throughput benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/transport_demux.h>
+#include <libucsi/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE (TRANSPORT_PACKET_LENGTH * 348)	/* ~64KB, as read from a DVR */
+
+static int psi_pids[] = { 0x00, 0x01, 0x10, 0x11, 0x12, 0x14 };
+#define NUM_PSI_PIDS (sizeof(psi_pids) / sizeof(psi_pids[0]))
+
+struct counts {
+	uint64_t sections;
+	uint64_t crc_errors;
+	uint64_t packets;
+	uint64_t payload_bytes;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void count_section(struct counts *counts, uint8_t *buf, int len)
+{
+	struct section *section;
+
+	counts->sections++;
+	if ((section = section_codec(buf, len)) == NULL) {
+		counts->crc_errors++;
+		return;
+	}
+	if (section->syntax_indicator && (section_ext_decode(section, 1) == NULL))
+		counts->crc_errors++;
+}
+
+static void section_cb(void *arg, int pid, uint8_t *section, int len)
+{
+	(void) pid;
+	count_section((struct counts *) arg, section, len);
+}
+
+static void packet_cb(void *arg, int pid, struct transport_packet *pkt,
+		      struct transport_values *values, int discontinuity)
+{
+	struct counts *counts = (struct counts *) arg;
+	(void) pid;
+	(void) pkt;
+	(void) discontinuity;
+
+	counts->packets++;
+	counts->payload_bytes += values->payload_length;
+}
+
+/*
+ * Packetise a section onto a PID, one section per PDU-start packet.
+ */
+static uint8_t *put_section(uint8_t *out, int pid, uint8_t *cc, uint8_t *section, int len)
+{
+	int first = 1;
+
+	while (len) {
+		int space = TRANSPORT_PACKET_LENGTH - 4 - first;
+		int copy = (len < space) ? len : space;
+
+		memset(out, 0xff, TRANSPORT_PACKET_LENGTH);
+		out[0] = TRANSPORT_PACKET_SYNC;
+		out[1] = (first ? 0x40 : 0) | (pid >> 8);
+		out[2] = pid & 0xff;
+		out[3] = 0x10 | (*cc & 0x0f);
+		if (first)
+			out[4] = 0;
+		memcpy(out + 4 + first, section, copy);
+		(*cc)++;
+		section += copy;
+		len -= copy;
+		first = 0;
+		out += TRANSPORT_PACKET_LENGTH;
+	}
+
+	return out;
+}
+
+static uint8_t *synthetic_mux(size_t size, size_t *outlen, uint64_t *nsections)
+{
+	uint8_t *buf = malloc(size + DVB_MAX_SECTION_BYTES * 2);
+	uint8_t *pos = buf;
+	uint8_t *end = buf + size;
+	uint8_t cc[TRANSPORT_MAX_PIDS];
+	uint8_t section[DVB_MAX_SECTION_BYTES];
+	int n = 0;
+
+	if (buf == NULL)
+		return NULL;
+	memset(cc, 0, sizeof(cc));
+	*nsections = 0;
+
+	while (pos < end) {
+		/* mostly A/V packets, with an SI section every 16 packets */
+		if ((n++ % 16) == 0) {
+			struct section_ext *ext = (struct section_ext *) section;
+			int pid = psi_pids[random() % NUM_PSI_PIDS];
+			int len = 16 + (random() % 1000);
+			int i;
+
+			memset(section, 0, sizeof(struct section_ext));
+			for (i = sizeof(struct section_ext); i < len; i++)
+				section[i] = random();
+			ext->table_id = 0x50;
+			ext->syntax_indicator = 1;
+			ext->length = len - sizeof(struct section);
+			ext->table_id_ext = n;
+			section_ext_encode(ext, 1);
+			bswap16(section + 1);
+			pos = put_section(pos, pid, &cc[pid], section, len);
+			(*nsections)++;
+		} else {
+			int pid = 0x100 + (random() % 8);
+
+			memset(pos, 0, TRANSPORT_PACKET_LENGTH);
+			pos[0] = TRANSPORT_PACKET_SYNC;
+			pos[1] = pid >> 8;
+			pos[2] = pid & 0xff;
+			pos[3] = 0x10 | (cc[pid]++ & 0x0f);
+			pos += TRANSPORT_PACKET_LENGTH;
+		}
+	}
+
+	*outlen = pos - buf;
+	return buf;
+}
+
+static uint8_t *load_file(char *filename, size_t *outlen)
+{
+	struct stat st;
+	uint8_t *buf;
+	size_t pos = 0;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || ((buf = malloc(st.st_size)) == NULL)) {
+		close(fd);
+		return NULL;
+	}
+	while (pos < (size_t) st.st_size) {
+		ssize_t sz = read(fd, buf + pos, st.st_size - pos);
+		if (sz <= 0)
+			break;
+		pos += sz;
+	}
+	close(fd);
+
+	*outlen = pos;
+	return buf;
+}
+
+/*
+ * Turn every 50th packet into a null packet, as if it was lost.
+ */
+static void drop_packets(uint8_t *buf, size_t len)
+{
+	size_t pos;
+
+	for (pos = 0; pos + TRANSPORT_PACKET_LENGTH <= len; pos += 50 * TRANSPORT_PACKET_LENGTH) {
+		buf[pos + 1] = (buf[pos + 1] & 0xe0) | (TRANSPORT_NULL_PID >> 8);
+		buf[pos + 2] = TRANSPORT_NULL_PID & 0xff;
+	}
+}
+
+/*
+ * One pass through transport_demux, with every PID routed at once.
+ */
+static double run_batch(uint8_t *buf, size_t len, struct counts *counts)
+{
+	struct transport_demux *demux = transport_demux_create();
+	double start;
+	size_t pos;
+	size_t i;
+
+	for (i = 0; i < NUM_PSI_PIDS; i++)
+		transport_demux_add_section(demux, psi_pids[i], DVB_MAX_SECTION_BYTES,
+					    section_cb, counts);
+	for (i = 0x100; i < 0x108; i++)
+		transport_demux_add_packet(demux, i, 0, packet_cb, counts);
+
+	start = now();
+	for (pos = 0; pos < len; pos += CHUNK_SIZE) {
+		size_t chunk = len - pos;
+		if (chunk > CHUNK_SIZE)
+			chunk = CHUNK_SIZE;
+		transport_demux_feed(demux, buf + pos, chunk);
+	}
+	start = now() - start;
+
+	transport_demux_destroy(demux);
+	return start;
+}
+
+/*
+ * The hand-rolled approach: one scan over the data per consumer PID.
+ */
+static double run_per_pid(uint8_t *buf, size_t len, struct counts *counts)
+{
+	struct section_buf *sbuf = malloc(sizeof(struct section_buf) + DVB_MAX_SECTION_BYTES);
+	struct transport_packet *pkt;
+	struct transport_values values;
+	double start = now();
+	size_t i, pos;
+
+	for (i = 0; i < NUM_PSI_PIDS; i++) {
+		unsigned char continuity = 0;
+
+		section_buf_init(sbuf, DVB_MAX_SECTION_BYTES);
+		for (pos = 0; pos + TRANSPORT_PACKET_LENGTH <= len; pos += TRANSPORT_PACKET_LENGTH) {
+			int pdu_start;
+
+			if ((pkt = transport_packet_init(buf + pos)) == NULL)
+				continue;
+			if (transport_packet_pid(pkt) != psi_pids[i])
+				continue;
+			if (transport_packet_values_extract(pkt, &values, 0) < 0)
+				continue;
+			if (transport_packet_continuity_check(pkt,
+			    values.flags & transport_adaptation_flag_discontinuity,
+			    &continuity)) {
+				continuity = 0;
+				section_buf_reset(sbuf);
+				sbuf->wait_pdu = 1;
+			}
+
+			pdu_start = pkt->payload_unit_start_indicator;
+			while (values.payload_length) {
+				int status;
+				int used = section_buf_add_transport_payload(sbuf, values.payload,
+									     values.payload_length,
+									     pdu_start, &status);
+				pdu_start = 0;
+				values.payload_length -= used;
+				values.payload += used;
+				if (status == 1) {
+					int slen = sbuf->len;
+					section_buf_reset(sbuf);
+					count_section(counts, section_buf_data(sbuf), slen);
+				} else if (status < 0) {
+					section_buf_reset(sbuf);
+				}
+			}
+		}
+	}
+	start = now() - start;
+
+	free(sbuf);
+	return start;
+}
+
+int main(int argc, char *argv[])
+{
+	struct counts batch, per_pid;
+	uint64_t expected = 0;
+	uint8_t *buf;
+	size_t len;
+	double mb, t1, t2;
+
+	if (argc != 2) {
+		fprintf(stderr, "Syntax: bench_demux <ts file>|-synthetic\n");
+		exit(1);
+	}
+
+	if (!strcmp(argv[1], "-synthetic"))
+		buf = synthetic_mux(256 * 1024 * 1024, &len, &expected);
+	else
+		buf = load_file(argv[1], &len);
+	if (buf == NULL) {
+		perror("load");
+		exit(1);
+	}
+	mb = len / (1024.0 * 1024.0);
+
+	memset(&batch, 0, sizeof(batch));
+	memset(&per_pid, 0, sizeof(per_pid));
+	t1 = run_batch(buf, len, &batch);
+	t2 = run_per_pid(buf, len, &per_pid);
+
+	printf("%.1f MB, %zu packets\n", mb, len / TRANSPORT_PACKET_LENGTH);
+	printf("batch:   %8.1f MB/s %10.0f pkt/s  sections:%llu crc_errors:%llu packets:%llu\n",
+	       mb / t1, (len / TRANSPORT_PACKET_LENGTH) / t1,
+	       (unsigned long long) batch.sections, (unsigned long long) batch.crc_errors,
+	       (unsigned long long) batch.packets);
+	printf("per-pid: %8.1f MB/s %10.0f pkt/s  sections:%llu crc_errors:%llu\n",
+	       mb / t2, (len / TRANSPORT_PACKET_LENGTH) / t2,
+	       (unsigned long long) per_pid.sections, (unsigned long long) per_pid.crc_errors);
+
+	if (expected && ((batch.sections != expected) || batch.crc_errors)) {
+		fprintf(stderr, "XXXX expected %llu sections\n", (unsigned long long) expected);
+		exit(1);
+	}
+	if (batch.sections != per_pid.sections) {
+		fprintf(stderr, "XXXX batch and per-pid section counts differ\n");
+		exit(1);
+	}
+
+	/* after a lost packet, sections must resync on the next section start */
+	if (expected) {
+		drop_packets(buf, len);
+		memset(&batch, 0, sizeof(batch));
+		memset(&per_pid, 0, sizeof(per_pid));
+		run_batch(buf, len, &batch);
+		run_per_pid(buf, len, &per_pid);
+		printf("lossy:   sections:%llu crc_errors:%llu\n",
+		       (unsigned long long) batch.sections, (unsigned long long) batch.crc_errors);
+		if (batch.crc_errors || per_pid.crc_errors) {
+			fprintf(stderr, "XXXX sections not resynced after lost packets\n");
+			exit(1);
+		}
+		if (batch.sections != per_pid.sections) {
+			fprintf(stderr, "XXXX batch and per-pid lossy section counts differ\n");
+			exit(1);
+		}
+	}
+
+	free(buf);
+	return 0;
+}
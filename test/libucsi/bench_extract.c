@@ -0,0 +1,266 @@
+/*
+ * transport_packet_values_extract() variant benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/transport_packet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define SYNTHETIC_PACKETS 500000
+
+#define ALL_VALUES (transport_value_pcr | transport_value_opcr | \
+		    transport_value_splice_countdown | transport_value_private_data | \
+		    transport_value_ltw | transport_value_piecewise_rate | \
+		    transport_value_seamless_splice)
+
+typedef int (*extractor)(struct transport_packet *pkt, struct transport_values *out);
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int extract_all(struct transport_packet *pkt, struct transport_values *out)
+{
+	return transport_packet_values_extract(pkt, out, ALL_VALUES);
+}
+
+static int extract_general_pcr(struct transport_packet *pkt, struct transport_values *out)
+{
+	return transport_packet_values_extract(pkt, out, transport_value_pcr);
+}
+
+static int extract_general_pcr_opcr(struct transport_packet *pkt, struct transport_values *out)
+{
+	return transport_packet_values_extract(pkt, out, transport_value_pcr | transport_value_opcr);
+}
+
+static int extract_general_payload(struct transport_packet *pkt, struct transport_values *out)
+{
+	return transport_packet_values_extract(pkt, out, 0);
+}
+
+static struct {
+	const char *name;
+	extractor fn;
+	extractor reference;
+} variants[] = {
+	{ "general, all values",    extract_all,                              NULL },
+	{ "general, pcr",           extract_general_pcr,                      NULL },
+	{ "extract_pcr",            transport_packet_values_extract_pcr,      extract_general_pcr },
+	{ "general, pcr+opcr",      extract_general_pcr_opcr,                 NULL },
+	{ "extract_pcr_opcr",       transport_packet_values_extract_pcr_opcr, extract_general_pcr_opcr },
+	{ "general, payload",       extract_general_payload,                  NULL },
+	{ "extract_payload",        transport_packet_values_extract_payload,  extract_general_payload },
+};
+#define NUM_VARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+/*
+ * Packets with a mix of adaptation fields: a PCR stream, some with OPCR,
+ * splice countdown, private data and extensions, and plain payload packets.
+ */
+static uint8_t *synthetic_mux(size_t *outlen)
+{
+	uint8_t *buf = malloc((size_t) SYNTHETIC_PACKETS * TRANSPORT_PACKET_LENGTH);
+	int i;
+
+	if (buf == NULL)
+		return NULL;
+
+	for (i = 0; i < SYNTHETIC_PACKETS; i++) {
+		uint8_t *pkt = buf + ((size_t) i * TRANSPORT_PACKET_LENGTH);
+		uint8_t *pos = pkt + 5;
+		int kind = i % 10;
+		uint64_t pcr = (uint64_t) i * 1234567;
+
+		memset(pkt, 0xff, TRANSPORT_PACKET_LENGTH);
+		pkt[0] = TRANSPORT_PACKET_SYNC;
+		pkt[1] = 0x01;
+		pkt[2] = kind;
+		pkt[3] = 0x10 | (i & 0x0f);
+		if (kind >= 4)
+			continue;
+
+		// adaptation field
+		pkt[3] |= 0x20;
+		*pos++ = 0;
+		if (kind <= 2) {
+			pkt[5] |= transport_adaptation_flag_pcr;
+			pos[0] = pcr >> 25; pos[1] = pcr >> 17; pos[2] = pcr >> 9;
+			pos[3] = pcr >> 1; pos[4] = ((pcr & 1) << 7) | 0x7e; pos[5] = i;
+			pos += 6;
+		}
+		if (kind == 1) {
+			pkt[5] |= transport_adaptation_flag_opcr;
+			memset(pos, 0x12, 6);
+			pos += 6;
+		}
+		if (kind == 2) {
+			pkt[5] |= transport_adaptation_flag_splicing_point |
+				  transport_adaptation_flag_private_data |
+				  transport_adaptation_flag_extension;
+			*pos++ = 5;
+			*pos++ = 2; *pos++ = 0xaa; *pos++ = 0xbb;
+			*pos++ = 11;
+			*pos++ = transport_adaptation_extension_flag_ltw |
+				 transport_adaptation_extension_flag_piecewise_rate |
+				 transport_adaptation_extension_flag_seamless_splice;
+			*pos++ = 0x81; *pos++ = 0x23;
+			*pos++ = 0x01; *pos++ = 0x02; *pos++ = 0x03;
+			*pos++ = 0x21; *pos++ = 0x00; *pos++ = 0x01; *pos++ = 0x00; *pos++ = 0x01;
+		}
+		if (kind == 3)
+			pkt[5] |= transport_adaptation_flag_discontinuity;
+		pkt[4] = pos - (pkt + 5) + 8;
+	}
+
+	*outlen = (size_t) SYNTHETIC_PACKETS * TRANSPORT_PACKET_LENGTH;
+	return buf;
+}
+
+static uint8_t *load_file(char *filename, size_t *outlen)
+{
+	struct stat st;
+	uint8_t *buf;
+	size_t pos = 0;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || ((buf = malloc(st.st_size)) == NULL)) {
+		close(fd);
+		return NULL;
+	}
+	while (pos < (size_t) st.st_size) {
+		ssize_t sz = read(fd, buf + pos, st.st_size - pos);
+		if (sz <= 0)
+			break;
+		pos += sz;
+	}
+	close(fd);
+
+	*outlen = pos - (pos % TRANSPORT_PACKET_LENGTH);
+	return buf;
+}
+
+/*
+ * Check a specialised extractor returns exactly what the general function
+ * does for the same set of values.
+ */
+static int check_variant(uint8_t *buf, size_t len, extractor fn, extractor reference)
+{
+	size_t pos;
+
+	for (pos = 0; pos < len; pos += TRANSPORT_PACKET_LENGTH) {
+		struct transport_packet *pkt = transport_packet_init(buf + pos);
+		struct transport_values a, b;
+		int ra, rb;
+
+		if (pkt == NULL)
+			continue;
+		memset(&a, 0, sizeof(a));
+		memset(&b, 0, sizeof(b));
+		ra = fn(pkt, &a);
+		rb = reference(pkt, &b);
+		if ((ra != rb) || memcmp(&a, &b, sizeof(a)))
+			return -1;
+	}
+
+	return 0;
+}
+
+static double run_variant(uint8_t *buf, size_t len, extractor fn, uint64_t *checksum)
+{
+	struct transport_values values;
+	uint64_t sum = 0;
+	size_t packets = 0;
+	double start = now();
+	double elapsed;
+
+	do {
+		size_t pos;
+
+		sum = 0;
+		for (pos = 0; pos < len; pos += TRANSPORT_PACKET_LENGTH) {
+			struct transport_packet *pkt = (struct transport_packet *) (buf + pos);
+			int ret = fn(pkt, &values);
+
+			if (ret < 0)
+				continue;
+			sum += values.payload_length + values.flags;
+			if (ret & transport_value_pcr)
+				sum += values.pcr;
+		}
+		packets += len / TRANSPORT_PACKET_LENGTH;
+	} while ((elapsed = now() - start) < 0.5);
+
+	// checksum of the last pass, to compare between variants
+	*checksum = sum;
+	return packets / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t *buf;
+	size_t len;
+	unsigned int i;
+	int failed = 0;
+
+	if (argc != 2) {
+		fprintf(stderr, "Syntax: bench_extract <ts file>|-synthetic\n");
+		exit(1);
+	}
+
+	if (!strcmp(argv[1], "-synthetic"))
+		buf = synthetic_mux(&len);
+	else
+		buf = load_file(argv[1], &len);
+	if (buf == NULL) {
+		perror("load");
+		exit(1);
+	}
+
+	for (i = 0; i < NUM_VARIANTS; i++) {
+		if (variants[i].reference &&
+		    check_variant(buf, len, variants[i].fn, variants[i].reference)) {
+			fprintf(stderr, "%s: results differ from the general function\n",
+				variants[i].name);
+			failed = 1;
+		}
+	}
+	if (failed)
+		return 1;
+
+	printf("%zu packets\n", len / TRANSPORT_PACKET_LENGTH);
+	for (i = 0; i < NUM_VARIANTS; i++) {
+		uint64_t checksum;
+		double rate = run_variant(buf, len, variants[i].fn, &checksum);
+
+		printf("%-22s %8.2f Mpkt/s  (checksum %llx)\n",
+		       variants[i].name, rate / 1e6, (unsigned long long) checksum);
+	}
+
+	return 0;
+}
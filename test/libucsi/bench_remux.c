@@ -0,0 +1,457 @@
+/*
+ * transport_remux benchmark, and file to file single program remultiplexer.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/transport_remux.h>
+#include <libucsi/transport_demux.h>
+#include <libucsi/mpeg/section.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CHUNK_SIZE (TRANSPORT_PACKET_LENGTH * 348)	/* ~64KB, as read from a DVR */
+#define OUT_SIZE (CHUNK_SIZE + (TRANSPORT_REMUX_MAX_PSI_PACKETS + 1) * TRANSPORT_PACKET_LENGTH)
+
+/* the synthetic mux: PROGRAMS programs, each with a PMT, video and audio */
+#define PROGRAMS 8
+#define PMT_PID(p) (0x1000 + (p))
+#define VIDEO_PID(p) (0x100 + ((p) * 0x10))
+#define AUDIO_PID(p) (0x101 + ((p) * 0x10))
+#define SYNTHETIC_PROGRAM 3
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*
+ * Packetise a section onto a PID, one section per PDU-start packet.
+ */
+static uint8_t *put_section(uint8_t *out, int pid, uint8_t *cc, uint8_t *section, int len)
+{
+	int first = 1;
+
+	while (len) {
+		int space = TRANSPORT_PACKET_LENGTH - 4 - first;
+		int copy = (len < space) ? len : space;
+
+		memset(out, 0xff, TRANSPORT_PACKET_LENGTH);
+		out[0] = TRANSPORT_PACKET_SYNC;
+		out[1] = (first ? 0x40 : 0) | (pid >> 8);
+		out[2] = pid & 0xff;
+		out[3] = 0x10 | (*cc & 0x0f);
+		if (first)
+			out[4] = 0;
+		memcpy(out + 4 + first, section, copy);
+		(*cc)++;
+		section += copy;
+		len -= copy;
+		first = 0;
+		out += TRANSPORT_PACKET_LENGTH;
+	}
+
+	return out;
+}
+
+static int make_section(uint8_t *section, int table_id, int table_id_ext, uint8_t *body, int bodylen)
+{
+	struct section_ext *ext = (struct section_ext *) section;
+	int len = sizeof(struct section_ext) + bodylen + CRC_SIZE;
+
+	memset(section, 0, sizeof(struct section_ext));
+	ext->table_id = table_id;
+	ext->syntax_indicator = 1;
+	ext->reserved = 3;
+	ext->length = len - sizeof(struct section);
+	ext->table_id_ext = table_id_ext;
+	ext->reserved1 = 3;
+	ext->current_next_indicator = 1;
+	memcpy(section + sizeof(struct section_ext), body, bodylen);
+	section_ext_encode(ext, 1);
+	bswap16(section + 1);
+
+	return len;
+}
+
+/*
+ * A multiplex of PROGRAMS programs with SI and null packets, and the PAT and
+ * PMTs every 64 packets.
+ */
+static uint8_t *synthetic_mux(size_t size, size_t *outlen, uint64_t *program_packets)
+{
+	uint8_t *buf = malloc(size + 64 * TRANSPORT_PACKET_LENGTH);
+	uint8_t *pos = buf;
+	uint8_t *end = buf + size;
+	uint8_t cc[TRANSPORT_MAX_PIDS];
+	uint8_t pat[1024];
+	uint8_t pmts[PROGRAMS][1024];
+	int pmt_lens[PROGRAMS];
+	uint8_t body[1024];
+	int pat_len;
+	int n = 0;
+	int p;
+
+	if (buf == NULL)
+		return NULL;
+	memset(cc, 0, sizeof(cc));
+	*program_packets = 0;
+
+	for (p = 0; p < PROGRAMS; p++) {
+		body[p * 4] = (p + 1) >> 8;
+		body[(p * 4) + 1] = p + 1;
+		body[(p * 4) + 2] = 0xe0 | (PMT_PID(p) >> 8);
+		body[(p * 4) + 3] = PMT_PID(p);
+	}
+	pat_len = make_section(pat, stag_mpeg_program_association, 0x1234, body, PROGRAMS * 4);
+
+	for (p = 0; p < PROGRAMS; p++) {
+		uint8_t pmt[] = {
+			0xe0 | (VIDEO_PID(p) >> 8), VIDEO_PID(p), 0xf0, 0x00,
+			0x02, 0xe0 | (VIDEO_PID(p) >> 8), VIDEO_PID(p), 0xf0, 0x00,
+			0x04, 0xe0 | (AUDIO_PID(p) >> 8), AUDIO_PID(p), 0xf0, 0x06,
+			0x0a, 0x04, 'e', 'n', 'g', 0x00,
+		};
+		pmt_lens[p] = make_section(pmts[p], stag_mpeg_program_map, p + 1, pmt, sizeof(pmt));
+	}
+
+	while (pos < end) {
+		int pid;
+
+		if ((n % 64) == 0) {
+			pos = put_section(pos, TRANSPORT_PAT_PID, &cc[0], pat, pat_len);
+			for (p = 0; p < PROGRAMS; p++)
+				pos = put_section(pos, PMT_PID(p), &cc[PMT_PID(p)], pmts[p], pmt_lens[p]);
+		}
+
+		/* mostly A/V, with some SI and stuffing the remux should drop */
+		switch (n++ % 16) {
+		case 0:
+			pid = 0x11;
+			break;
+		case 1:
+			pid = 0x12;
+			break;
+		case 2:
+			pid = TRANSPORT_NULL_PID;
+			break;
+		default:
+			p = random() % PROGRAMS;
+			pid = (random() & 1) ? VIDEO_PID(p) : AUDIO_PID(p);
+			if (p == SYNTHETIC_PROGRAM - 1)
+				(*program_packets)++;
+		}
+		memset(pos, 0, TRANSPORT_PACKET_LENGTH);
+		pos[0] = TRANSPORT_PACKET_SYNC;
+		pos[1] = pid >> 8;
+		pos[2] = pid & 0xff;
+		pos[3] = 0x10 | (cc[pid]++ & 0x0f);
+		pos += TRANSPORT_PACKET_LENGTH;
+	}
+
+	*outlen = pos - buf;
+	return buf;
+}
+
+static uint8_t *load_file(char *filename, size_t *outlen)
+{
+	struct stat st;
+	uint8_t *buf;
+	size_t pos = 0;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat(fd, &st) || ((buf = malloc(st.st_size)) == NULL)) {
+		close(fd);
+		return NULL;
+	}
+	while (pos < (size_t) st.st_size) {
+		ssize_t sz = read(fd, buf + pos, st.st_size - pos);
+		if (sz <= 0)
+			break;
+		pos += sz;
+	}
+	close(fd);
+
+	*outlen = pos;
+	return buf;
+}
+
+/*
+ * Remultiplex the buffer in DVR sized chunks, as an application would.
+ * The output is kept if out is not NULL.
+ */
+static double run_remux(struct transport_remux *remux, uint8_t *buf, size_t len,
+			uint8_t *out, size_t *outlen)
+{
+	uint8_t *chunkout = malloc(OUT_SIZE);
+	double start;
+	size_t pos = 0;
+
+	*outlen = 0;
+	start = now();
+	while (pos + TRANSPORT_PACKET_LENGTH <= len) {
+		size_t chunk = len - pos;
+		int olen;
+
+		if (chunk > CHUNK_SIZE)
+			chunk = CHUNK_SIZE;
+		pos += transport_remux_feed(remux, buf + pos, chunk, chunkout, OUT_SIZE, &olen);
+		if (out)
+			memcpy(out + *outlen, chunkout, olen);
+		*outlen += olen;
+	}
+	start = now() - start;
+
+	free(chunkout);
+	return start;
+}
+
+struct check {
+	int errors;
+	int pats;
+	int pmts;
+	uint64_t es_packets;
+};
+
+static void check_pat(void *arg, int pid, uint8_t *buf, int len)
+{
+	struct check *check = (struct check *) arg;
+	struct section *section;
+	struct section_ext *ext;
+	struct mpeg_pat_section *pat;
+	struct mpeg_pat_program *program;
+	int count = 0;
+	(void) pid;
+
+	check->pats++;
+	if (((section = section_codec(buf, len)) == NULL) ||
+	    ((ext = section_ext_decode(section, 1)) == NULL) ||
+	    ((pat = mpeg_pat_section_codec(ext)) == NULL)) {
+		fprintf(stderr, "XXXX invalid PAT\n");
+		check->errors++;
+		return;
+	}
+	mpeg_pat_section_programs_for_each(pat, program) {
+		if ((program->program_number != SYNTHETIC_PROGRAM) || (program->pid != 0x20)) {
+			fprintf(stderr, "XXXX unexpected PAT entry %i -> %i\n",
+				program->program_number, program->pid);
+			check->errors++;
+		}
+		count++;
+	}
+	if ((count != 1) || (ext->table_id_ext != 0x1234)) {
+		fprintf(stderr, "XXXX PAT has %i programs, transport_stream_id %i\n",
+			count, ext->table_id_ext);
+		check->errors++;
+	}
+}
+
+static void check_pmt(void *arg, int pid, uint8_t *buf, int len)
+{
+	struct check *check = (struct check *) arg;
+	struct section *section;
+	struct section_ext *ext;
+	struct mpeg_pmt_section *pmt;
+	struct mpeg_pmt_stream *stream;
+	int count = 0;
+	(void) pid;
+
+	check->pmts++;
+	if (((section = section_codec(buf, len)) == NULL) ||
+	    ((ext = section_ext_decode(section, 1)) == NULL) ||
+	    ((pmt = mpeg_pmt_section_codec(ext)) == NULL)) {
+		fprintf(stderr, "XXXX invalid PMT\n");
+		check->errors++;
+		return;
+	}
+	if ((ext->table_id_ext != SYNTHETIC_PROGRAM) || (pmt->pcr_pid != 0x100)) {
+		fprintf(stderr, "XXXX PMT for program %i, PCR PID %i\n",
+			ext->table_id_ext, pmt->pcr_pid);
+		check->errors++;
+	}
+	mpeg_pmt_section_streams_for_each(pmt, stream) {
+		if (stream->pid != 0x100 + count) {
+			fprintf(stderr, "XXXX PMT stream %i has PID %i\n", count, stream->pid);
+			check->errors++;
+		}
+		count++;
+	}
+	if (count != 2) {
+		fprintf(stderr, "XXXX PMT has %i streams\n", count);
+		check->errors++;
+	}
+}
+
+static void check_es(void *arg, int pid, struct transport_packet *pkt,
+		     struct transport_values *values, int discontinuity)
+{
+	struct check *check = (struct check *) arg;
+	(void) pid;
+	(void) pkt;
+	(void) values;
+
+	check->es_packets++;
+	if (discontinuity)
+		check->errors++;
+}
+
+/*
+ * Check the output is a clean single program stream, with the PIDs mapped.
+ */
+static int check_output(uint8_t *buf, size_t len, uint64_t program_packets)
+{
+	struct transport_demux *demux = transport_demux_create();
+	struct transport_demux_stats *stats;
+	struct check check;
+	uint64_t other;
+
+	memset(&check, 0, sizeof(check));
+	transport_demux_add_section(demux, TRANSPORT_PAT_PID, 1024, check_pat, &check);
+	transport_demux_add_section(demux, 0x20, 1024, check_pmt, &check);
+	transport_demux_add_packet(demux, 0x100, 0, check_es, &check);
+	transport_demux_add_packet(demux, 0x101, 0, check_es, &check);
+	transport_demux_feed(demux, buf, len);
+	stats = transport_demux_get_stats(demux);
+
+	other = stats->packets - check.es_packets;
+	if (check.es_packets != program_packets) {
+		fprintf(stderr, "XXXX %llu program packets output, expected %llu\n",
+			(unsigned long long) check.es_packets, (unsigned long long) program_packets);
+		check.errors++;
+	}
+	if ((check.pats == 0) || (check.pmts == 0) || (other != (uint64_t) (check.pats + check.pmts))) {
+		fprintf(stderr, "XXXX %i PATs and %i PMTs, but %llu other packets\n",
+			check.pats, check.pmts, (unsigned long long) other);
+		check.errors++;
+	}
+	if (stats->continuity_errors) {
+		fprintf(stderr, "XXXX %llu continuity errors in output\n",
+			(unsigned long long) stats->continuity_errors);
+		check.errors++;
+	}
+
+	transport_demux_destroy(demux);
+	return check.errors;
+}
+
+static int write_file(char *filename, uint8_t *buf, size_t len)
+{
+	size_t pos = 0;
+	int fd;
+
+	if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+		return -1;
+	while (pos < len) {
+		ssize_t sz = write(fd, buf + pos, len - pos);
+		if (sz <= 0) {
+			close(fd);
+			return -1;
+		}
+		pos += sz;
+	}
+	return close(fd);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Syntax: bench_remux <in ts file> <out ts file> <program number> [<pid>=<new pid> ...]\n");
+	fprintf(stderr, "        bench_remux -synthetic\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct transport_remux *remux;
+	struct transport_remux_stats *stats;
+	uint64_t program_packets = 0;
+	uint8_t *buf;
+	uint8_t *out;
+	size_t len;
+	size_t outlen;
+	double mb, t;
+	int synthetic;
+	int i;
+
+	synthetic = (argc == 2) && !strcmp(argv[1], "-synthetic");
+	if (!synthetic && (argc < 4))
+		usage();
+
+	if (synthetic) {
+		buf = synthetic_mux(64 * 1024 * 1024, &len, &program_packets);
+		remux = transport_remux_create(SYNTHETIC_PROGRAM);
+		transport_remux_map_pid(remux, PMT_PID(SYNTHETIC_PROGRAM - 1), 0x20);
+		transport_remux_map_pid(remux, VIDEO_PID(SYNTHETIC_PROGRAM - 1), 0x100);
+		transport_remux_map_pid(remux, AUDIO_PID(SYNTHETIC_PROGRAM - 1), 0x101);
+	} else {
+		buf = load_file(argv[1], &len);
+		remux = transport_remux_create(strtol(argv[3], NULL, 0));
+		if (remux == NULL)
+			usage();
+		for (i = 4; i < argc; i++) {
+			char *eq = strchr(argv[i], '=');
+
+			if ((eq == NULL) ||
+			    transport_remux_map_pid(remux, strtol(argv[i], NULL, 0), strtol(eq + 1, NULL, 0)))
+				usage();
+		}
+	}
+	if (buf == NULL) {
+		perror("load");
+		exit(1);
+	}
+	out = malloc(len + len / 2);
+	if ((remux == NULL) || (out == NULL)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	mb = len / (1024.0 * 1024.0);
+
+	t = run_remux(remux, buf, len, out, &outlen);
+	stats = transport_remux_get_stats(remux);
+
+	printf("%.1f MB, %zu packets in, %llu out (%llu PSI), %llu PSI replaced, %llu dropped, %llu section errors\n",
+	       mb, len / TRANSPORT_PACKET_LENGTH, (unsigned long long) stats->output,
+	       (unsigned long long) stats->psi, (unsigned long long) stats->replaced,
+	       (unsigned long long) stats->dropped, (unsigned long long) stats->section_errors);
+	if (stats->packets != stats->output - stats->psi + stats->replaced + stats->dropped) {
+		fprintf(stderr, "XXXX packet counts do not add up\n");
+		exit(1);
+	}
+	printf("remux: %8.1f MB/s %10.0f pkt/s  PMT PID %i version %i\n",
+	       mb / t, (len / TRANSPORT_PACKET_LENGTH) / t, stats->pmt_pid, stats->pmt_version);
+
+	if (synthetic) {
+		if (check_output(out, outlen, program_packets))
+			exit(1);
+	} else if (write_file(argv[2], out, outlen)) {
+		perror("write");
+		exit(1);
+	}
+
+	transport_remux_destroy(remux);
+	free(out);
+	free(buf);
+	return 0;
+}
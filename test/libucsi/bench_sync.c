@@ -0,0 +1,307 @@
+/*
+ * transport_sync correctness check and throughput benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/transport_sync.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHUNK_SIZE (TRANSPORT_PACKET_LENGTH * 348)	/* ~64KB, as read from a DVR */
+#define CHECK_PACKETS 20000
+#define BENCH_PACKETS 500000
+
+static int strides[] = { TRANSPORT_PACKET_LENGTH,
+			 TRANSPORT_PACKET_LENGTH_M2TS,
+			 TRANSPORT_PACKET_LENGTH_RS };
+#define NUM_STRIDES (sizeof(strides) / sizeof(strides[0]))
+
+struct stream {
+	uint8_t *buf;
+	size_t len;
+	int packets;		/* packets written */
+	int dropped;		/* packets written with a corrupt sync byte */
+	int garbage;		/* garbage runs inserted */
+	int lost;		/* lost-sync callbacks received */
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint8_t payload_byte(uint32_t seq, int i)
+{
+	return (uint8_t) ((seq * 2654435761u) >> (i & 31)) ^ i;
+}
+
+/*
+ * Build a stream of packets at the given stride, numbering each packet. When
+ * corrupt is set, runs of garbage are inserted and some sync bytes damaged.
+ */
+static void build_stream(struct stream *s, int stride, int npackets, int corrupt)
+{
+	uint8_t *p;
+	int i;
+	int j;
+
+	memset(s, 0, sizeof(struct stream));
+	s->buf = malloc((size_t) npackets * (stride + 300) + 16);
+	if (s->buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	p = s->buf;
+
+	// some leading junk
+	if (corrupt) {
+		for(j = 0; j < 100; j++)
+			*p++ = 0x55;
+	}
+
+	for(i = 0; i < npackets; i++) {
+		uint8_t *pkt;
+
+		if (corrupt && (rand() % 1000) == 0 && i > 10) {
+			int len = 1 + (rand() % 299);
+
+			// a run of exactly one stride is indistinguishable from a damaged sync byte
+			if (len == stride)
+				len--;
+			for(j = 0; j < len; j++) {
+				*p = rand();
+				if (*p == TRANSPORT_PACKET_SYNC)
+					*p = 0;
+				p++;
+			}
+			s->garbage++;
+		}
+
+		if (stride == TRANSPORT_PACKET_LENGTH_M2TS) {
+			p[0] = i >> 24; p[1] = i >> 16; p[2] = i >> 8; p[3] = i;
+			p += 4;
+		}
+
+		pkt = p;
+		pkt[0] = TRANSPORT_PACKET_SYNC;
+		pkt[1] = (i >> 8) & 0x1f;
+		pkt[2] = i;
+		pkt[3] = 0x10 | (i & 0x0f);
+		pkt[4] = i >> 24; pkt[5] = i >> 16; pkt[6] = i >> 8; pkt[7] = i;
+		for(j = 8; j < TRANSPORT_PACKET_LENGTH; j++)
+			pkt[j] = payload_byte(i, j);
+		p += TRANSPORT_PACKET_LENGTH;
+
+		if (stride == TRANSPORT_PACKET_LENGTH_RS) {
+			for(j = 0; j < 16; j++)
+				*p++ = rand();
+		}
+
+		// isolated damaged sync bytes, well away from garbage runs
+		if (corrupt && (rand() % 997) == 0 && i > 10 && i < npackets - 10) {
+			pkt[0] = 0x00;
+			s->dropped++;
+		}
+		s->packets++;
+	}
+
+	s->len = p - s->buf;
+}
+
+static void lost_cb(void *arg, uint64_t offset)
+{
+	(void) offset;
+	((struct stream *) arg)->lost++;
+}
+
+/*
+ * Feed a stream through transport_sync in randomly sized chunks, checking
+ * every packet which comes out is intact and in order.
+ */
+static int check_stream(int stride, int packet_size)
+{
+	struct transport_sync sync;
+	struct stream s;
+	uint8_t *buf;
+	size_t in = 0;
+	int have = 0;
+	int next = 0;
+	int got = 0;
+	int bad = 0;
+
+	build_stream(&s, stride, CHECK_PACKETS, 1);
+	transport_sync_init(&sync, packet_size, lost_cb, &s);
+	buf = malloc(CHUNK_SIZE + TRANSPORT_PACKET_LENGTH_RS * 8);
+
+	while(in < s.len) {
+		int space = CHUNK_SIZE + TRANSPORT_PACKET_LENGTH_RS * 8 - have;
+		int len = 1 + (rand() % space);
+		int consumed;
+		int out;
+		int i;
+
+		if ((size_t) len > s.len - in)
+			len = s.len - in;
+		memcpy(buf + have, s.buf + in, len);
+		in += len;
+		have += len;
+
+		out = transport_sync_process(&sync, buf, have, &consumed);
+		for(i = 0; i < out; i += TRANSPORT_PACKET_LENGTH) {
+			uint8_t *pkt = buf + i;
+			int seq = (pkt[4] << 24) | (pkt[5] << 16) | (pkt[6] << 8) | pkt[7];
+			int j;
+
+			if ((pkt[0] != TRANSPORT_PACKET_SYNC) || (seq < next))
+				bad++;
+			for(j = 8; j < TRANSPORT_PACKET_LENGTH; j++) {
+				if (pkt[j] != payload_byte(seq, j)) {
+					bad++;
+					break;
+				}
+			}
+			next = seq + 1;
+			got++;
+		}
+
+		memmove(buf, buf + consumed, have - consumed);
+		have -= consumed;
+	}
+
+	printf("stride %d (%s): %d packets, %d out, %d damaged sync, %d garbage runs, "
+	       "%llu sync losses, %llu sync byte errors, %llu skipped: ",
+	       stride, packet_size ? "fixed" : "detect",
+	       s.packets, got, s.dropped, s.garbage,
+	       (unsigned long long) sync.sync_losses,
+	       (unsigned long long) sync.sync_byte_errors,
+	       (unsigned long long) sync.skipped_bytes);
+
+	if (bad ||
+	    (got != s.packets - s.dropped) ||
+	    (sync.sync_losses != (uint64_t) s.garbage) ||
+	    (s.lost != s.garbage) ||
+	    (sync.sync_byte_errors != (uint64_t) s.dropped)) {
+		printf("FAILED (%d bad packets)\n", bad);
+		free(buf);
+		free(s.buf);
+		return 1;
+	}
+	printf("ok\n");
+
+	free(buf);
+	free(s.buf);
+	return 0;
+}
+
+/*
+ * Process a clean stream in DVR sized chunks.
+ */
+static void bench_stream(int stride)
+{
+	struct transport_sync sync;
+	struct stream s;
+	uint8_t *copy;
+	double elapsed;
+	size_t total = 0;
+	int iterations = 0;
+	double start;
+
+	build_stream(&s, stride, BENCH_PACKETS, 0);
+	copy = malloc(s.len);
+
+	start = now();
+	do {
+		size_t pos = 0;
+
+		// output is written in place, so start from a fresh copy each time
+		memcpy(copy, s.buf, s.len);
+		transport_sync_init(&sync, 0, NULL, NULL);
+		while(pos < s.len) {
+			int len = CHUNK_SIZE;
+			int consumed;
+
+			if ((size_t) len > s.len - pos)
+				len = s.len - pos;
+			transport_sync_process(&sync, copy + pos, len, &consumed);
+			pos += consumed;
+			if (consumed == 0)
+				break;
+		}
+		total += s.len;
+		iterations++;
+	} while ((elapsed = now() - start) < 0.5);
+
+	printf("stride %d: %8.1f MB/s (including memcpy of input)\n",
+	       stride, total / elapsed / 1e6);
+
+	free(copy);
+	free(s.buf);
+}
+
+static void bench_find(void)
+{
+	struct stream s;
+	double start;
+	double elapsed;
+	size_t total = 0;
+	size_t i;
+	int off = 0;
+
+	// worst case: a long run of data containing no lock at all
+	build_stream(&s, TRANSPORT_PACKET_LENGTH, BENCH_PACKETS / 10, 0);
+	for(i = 0; i < s.len; i += TRANSPORT_PACKET_LENGTH * 4)
+		s.buf[i] = 0;
+
+	start = now();
+	do {
+		off = transport_sync_find(s.buf, s.len, TRANSPORT_PACKET_LENGTH_RS,
+					  TRANSPORT_SYNC_LOCK_COUNT);
+		total += s.len;
+	} while ((elapsed = now() - start) < 0.5);
+
+	printf("find (no lock present): %8.1f MB/s, result %d\n", total / elapsed / 1e6, off);
+	free(s.buf);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	int failed = 0;
+	(void) argc;
+	(void) argv;
+
+	srand(1);
+
+	for(i = 0; i < NUM_STRIDES; i++) {
+		failed |= check_stream(strides[i], strides[i]);
+		failed |= check_stream(strides[i], 0);
+	}
+	if (failed) {
+		fprintf(stderr, "transport_sync check FAILED\n");
+		return 1;
+	}
+
+	for(i = 0; i < NUM_STRIDES; i++)
+		bench_stream(strides[i]);
+	bench_find();
+
+	return 0;
+}
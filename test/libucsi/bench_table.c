@@ -0,0 +1,350 @@
+/*
+ * psi_assembler benchmark: table acquisition from a section carousel.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/psi_assembler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#define SERVICES		20
+#define SCHEDULE_TABLES		8
+#define SEGMENTS		32
+#define MAX_CYCLES		20
+
+struct table {
+	uint8_t table_id;
+	uint16_t table_id_ext;
+	int count;			/* sections transmitted */
+	int first;			/* index of the first section in sections[] */
+	struct psi_table_state state;
+};
+
+struct carousel_section {
+	uint8_t *data;
+	int len;
+	int table;
+};
+
+static struct table tables[2 + SERVICES * (1 + SCHEDULE_TABLES)];
+static int num_tables;
+static struct carousel_section *sections;
+static int num_sections;
+static struct carousel_section *cycle;
+static int callbacks;
+static int loss_percent;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void make_section(struct carousel_section *s, int table, uint8_t version,
+			 uint8_t section_number, uint8_t last_section_number,
+			 uint8_t segment_last_section_number, int body)
+{
+	struct table *t = &tables[table];
+	int len = 8 + body + CRC_SIZE;
+	uint8_t *buf = malloc(len);
+	uint32_t crc;
+	int i;
+
+	buf[0] = t->table_id;
+	buf[1] = 0xb0 | ((len - 3) >> 8);
+	buf[2] = len - 3;
+	buf[3] = t->table_id_ext >> 8;
+	buf[4] = t->table_id_ext;
+	buf[5] = 0xc1 | (version << 1);
+	buf[6] = section_number;
+	buf[7] = last_section_number;
+	for (i = 8; i < len - CRC_SIZE; i++)
+		buf[i] = i + section_number + table;
+	if ((t->table_id >= 0x4e) && (t->table_id <= 0x6f)) {
+		buf[8] = 0x04; buf[9] = 0x01;		/* transport_stream_id */
+		buf[10] = 0x20; buf[11] = 0x3a;		/* original_network_id */
+		buf[12] = segment_last_section_number;
+		buf[13] = t->table_id | 0x07;		/* last_table_id */
+	}
+	crc = crc32(CRC32_INIT, buf, len - CRC_SIZE);
+	buf[len - 4] = crc >> 24;
+	buf[len - 3] = crc >> 16;
+	buf[len - 2] = crc >> 8;
+	buf[len - 1] = crc;
+
+	s->data = buf;
+	s->len = len;
+	s->table = table;
+}
+
+static int add_table(uint8_t table_id, uint16_t table_id_ext)
+{
+	tables[num_tables].table_id = table_id;
+	tables[num_tables].table_id_ext = table_id_ext;
+	tables[num_tables].first = num_sections;
+	return num_tables++;
+}
+
+/*
+ * A NIT, an SDT, and present/following and 4 days of schedule EIT for each
+ * service. Each schedule segment holds 1 to 3 sections, so most segments are
+ * partly empty as in a real stream.
+ */
+static void build_carousel(void)
+{
+	int t, i, s, seg, pos, round;
+
+	sections = malloc(sizeof(struct carousel_section) *
+			  (8 + 4 + SERVICES * (2 + SCHEDULE_TABLES * SEGMENTS * 8)));
+
+	t = add_table(0x40, 0x3001);
+	for (i = 0; i < 8; i++)
+		make_section(&sections[num_sections++], t, 3, i, 7, 0, 600);
+	tables[t].count = 8;
+
+	t = add_table(0x42, 0x0401);
+	for (i = 0; i < 4; i++)
+		make_section(&sections[num_sections++], t, 9, i, 3, 0, 900);
+	tables[t].count = 4;
+
+	for (s = 0; s < SERVICES; s++) {
+		t = add_table(0x4e, 0x1000 + s);
+		make_section(&sections[num_sections++], t, 1, 0, 1, 1, 180);
+		make_section(&sections[num_sections++], t, 1, 1, 1, 1, 180);
+		tables[t].count = 2;
+
+		for (i = 0; i < SCHEDULE_TABLES; i++) {
+			t = add_table(0x50 + i, 0x1000 + s);
+			for (seg = 0; seg < SEGMENTS; seg++) {
+				int n = 1 + ((seg + s + i) % 3);
+				int k;
+
+				for (k = 0; k < n; k++)
+					make_section(&sections[num_sections++], t, (s + i) & 0x1f,
+						     seg * 8 + k, SEGMENTS * 8 - 1,
+						     seg * 8 + n - 1, 200 + 40 * k);
+				tables[t].count += n;
+			}
+		}
+	}
+
+	// interleave the tables, each table's sections in order
+	cycle = malloc(sizeof(struct carousel_section) * num_sections);
+	pos = 0;
+	for (round = 0; pos < num_sections; round++) {
+		for (t = 0; t < num_tables; t++) {
+			if (round < tables[t].count)
+				cycle[pos++] = sections[tables[t].first + round];
+		}
+	}
+}
+
+static void complete_cb(void *arg, struct psi_table *table)
+{
+	(void) arg;
+	(void) table;
+	callbacks++;
+}
+
+/*
+ * Verify the stored sections of every table against the carousel.
+ */
+static int check_tables(struct psi_assembler *assembler)
+{
+	int t, i;
+
+	for (t = 0; t < num_tables; t++) {
+		struct psi_table *table = psi_assembler_find(assembler, tables[t].table_id,
+							     tables[t].table_id_ext);
+		struct section_ext *section;
+		int n, count = 0;
+
+		if ((table == NULL) || !table->complete) {
+			fprintf(stderr, "XXXX table %02x/%04x incomplete\n",
+				tables[t].table_id, tables[t].table_id_ext);
+			return -1;
+		}
+		psi_table_for_each_section(table, n, section) {
+			struct carousel_section *s = NULL;
+
+			for (i = 0; i < tables[t].count; i++) {
+				if (sections[tables[t].first + i].data[6] == n)
+					s = &sections[tables[t].first + i];
+			}
+			if ((s == NULL) || (section->section_number != n) ||
+			    memcmp((uint8_t *) section + 8, s->data + 8, s->len - 8)) {
+				fprintf(stderr, "XXXX table %02x/%04x section %d differs\n",
+					tables[t].table_id, tables[t].table_id_ext, n);
+				return -1;
+			}
+			count++;
+		}
+		if (count != tables[t].count) {
+			fprintf(stderr, "XXXX table %02x/%04x has %d sections, expected %d\n",
+				tables[t].table_id, tables[t].table_id_ext, count, tables[t].count);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Receive the carousel from a random point, losing some sections, until all
+ * tables are complete. Returns the number of sections received.
+ */
+static int acquire_assembler(struct psi_assembler *assembler, int start)
+{
+	int received = 0;
+	int complete;
+
+	do {
+		struct carousel_section *s = &cycle[(start + received) % num_sections];
+
+		received++;
+		if ((rand() % 100) < loss_percent)
+			continue;
+		if (psi_assembler_add(assembler, s->data, s->len) < 0)
+			return -1;
+	} while ((psi_assembler_tables(assembler, &complete) != num_tables) ||
+		 (complete != num_tables));
+
+	return received;
+}
+
+/*
+ * The same with a psi_table_state per table. Tables which are still
+ * incomplete after MAX_CYCLES are counted in *incomplete, and the number of
+ * sections received until the last of the others was completed is returned.
+ */
+static int acquire_table_state(int start, int *incomplete)
+{
+	uint8_t buf[4096];
+	int received = 0;
+	int complete = 0;
+	int last = 0;
+	int t;
+
+	for (t = 0; t < num_tables; t++) {
+		memset(&tables[t].state, 0, sizeof(struct psi_table_state));
+		psi_table_state_reset(&tables[t].state);
+	}
+
+	while ((complete < num_tables) && (received < MAX_CYCLES * num_sections)) {
+		struct carousel_section *s = &cycle[(start + received) % num_sections];
+		struct section_ext *section;
+		struct table *table = &tables[s->table];
+
+		received++;
+		if ((rand() % 100) < loss_percent)
+			continue;
+
+		memcpy(buf, s->data, s->len);
+		section = section_ext_decode(section_codec(buf, s->len), 1);
+		if (section == NULL)
+			return -1;
+		if (section_ext_useful(section, &table->state) && table->state.complete) {
+			complete++;
+			last = received;
+		}
+	}
+
+	*incomplete = num_tables - complete;
+	return last;
+}
+
+int main(int argc, char *argv[])
+{
+	struct psi_assembler *assembler;
+	struct psi_table *table;
+	uint8_t corrupt[4096];
+	double start, elapsed;
+	int received, incomplete, i, run;
+	uint64_t bytes = 0;
+	(void) argc;
+	(void) argv;
+
+	srand(1);
+	build_carousel();
+	for (i = 0; i < num_sections; i++)
+		bytes += sections[i].len;
+	printf("%d tables, %d sections, %.1f kB per carousel cycle\n",
+	       num_tables, num_sections, bytes / 1024.0);
+
+	assembler = psi_assembler_create(1);
+	psi_assembler_set_callback(assembler, complete_cb, NULL);
+
+	// acquisition from a random point, compared with psi_table_state
+	for (run = 0; run < 4; run++) {
+		int offset = rand() % num_sections;
+
+		loss_percent = run & 1;
+		printf("start at section %d, %d%% sections lost\n", offset, loss_percent);
+
+		psi_assembler_reset(assembler);
+		callbacks = 0;
+		received = acquire_assembler(assembler, offset);
+		if ((received < 0) || check_tables(assembler) || (callbacks != num_tables)) {
+			fprintf(stderr, "XXXX psi_assembler acquisition failed\n");
+			return 1;
+		}
+		printf("  psi_assembler:    %5.2f cycles\n", (double) received / num_sections);
+
+		received = acquire_table_state(offset, &incomplete);
+		if (received < 0) {
+			fprintf(stderr, "XXXX psi_table_state acquisition failed\n");
+			return 1;
+		}
+		printf("  psi_table_state:  %5.2f cycles for %d tables, %d incomplete after %d cycles\n",
+		       (double) received / num_sections, num_tables - incomplete,
+		       incomplete, MAX_CYCLES);
+	}
+
+	// version change and CRC errors
+	table = psi_assembler_find(assembler, 0x40, 0x3001);
+	make_section(&sections[0], 0, 4, 0, 0, 0, 100);
+	if ((psi_assembler_add(assembler, sections[0].data, sections[0].len) != psi_assembler_complete) ||
+	    (table->version_number != 4) || (table->version_changes != 1) ||
+	    (table->last_section_number != 0)) {
+		fprintf(stderr, "XXXX version change not detected\n");
+		return 1;
+	}
+	memcpy(corrupt, sections[1].data, sections[1].len);
+	corrupt[20] ^= 0x01;
+	if (psi_assembler_add(assembler, corrupt, sections[1].len) != -EINVAL) {
+		fprintf(stderr, "XXXX CRC error not detected\n");
+		return 1;
+	}
+
+	// throughput over the first cycle (stored) and later ones (repeats)
+	psi_assembler_reset(assembler);
+	start = now();
+	for (run = 0; run < 10; run++) {
+		for (i = 0; i < num_sections; i++)
+			psi_assembler_add(assembler, cycle[i].data, cycle[i].len);
+	}
+	elapsed = now() - start;
+	printf("throughput:       %.0f sections/s, %.1f MB/s\n",
+	       10 * num_sections / elapsed, 10 * bytes / elapsed / 1e6);
+
+	psi_assembler_destroy(assembler);
+	return 0;
+}
@@ -0,0 +1,463 @@
+/*
+ * section view vs. in-place codec benchmark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ */
+
+#include <libucsi/mpeg/section.h>
+#include <libucsi/mpeg/pat_view.h>
+#include <libucsi/mpeg/pmt_view.h>
+#include <libucsi/dvb/section.h>
+#include <libucsi/dvb/nit_view.h>
+#include <libucsi/dvb/sdt_view.h>
+#include <libucsi/dvb/eit_view.h>
+#include <libucsi/atsc/section.h>
+#include <libucsi/atsc/vct_view.h>
+#include <libucsi/section_buf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 200000
+
+struct table {
+	const char *name;
+	uint8_t buf[DVB_MAX_SECTION_BYTES];
+	int len;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint8_t *put16(uint8_t *pos, int val)
+{
+	pos[0] = val >> 8;
+	pos[1] = val;
+	return pos + 2;
+}
+
+static uint8_t *put_descriptors(uint8_t *pos, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		pos[0] = 0x80 + i;
+		pos[1] = 4;
+		memset(pos + 2, i, 4);
+		pos += 6;
+	}
+	return pos;
+}
+
+static uint8_t *put_header(uint8_t *buf, int table_id, int table_id_ext)
+{
+	buf[0] = table_id;
+	put16(buf + 3, table_id_ext);
+	buf[5] = 0xc1 | (5 << 1);
+	buf[6] = 0;
+	buf[7] = 0;
+	return buf + 8;
+}
+
+static void finish(struct table *t, uint8_t *end)
+{
+	int len = end - t->buf + CRC_SIZE;
+	uint32_t crc;
+
+	t->buf[1] = 0xb0 | ((len - 3) >> 8);
+	t->buf[2] = (len - 3);
+	crc = crc32(CRC32_INIT, t->buf, len - CRC_SIZE);
+	end[0] = crc >> 24;
+	end[1] = crc >> 16;
+	end[2] = crc >> 8;
+	end[3] = crc;
+	t->len = len;
+}
+
+static void build_tables(struct table *t)
+{
+	uint8_t *pos, *loop;
+	int i;
+
+	t[0].name = "PAT";
+	pos = put_header(t[0].buf, stag_mpeg_program_association, 0x0401);
+	for (i = 0; i < 64; i++) {
+		pos = put16(pos, i + 1);
+		pos = put16(pos, 0xe000 | (0x100 + i));
+	}
+	finish(&t[0], pos);
+
+	t[1].name = "PMT";
+	pos = put_header(t[1].buf, stag_mpeg_program_map, 0x1234);
+	pos = put16(pos, 0xe000 | 0x101);
+	pos = put16(pos, 0xf000 | 12);
+	pos = put_descriptors(pos, 2);
+	for (i = 0; i < 12; i++) {
+		*pos++ = 0x02 + (i & 3);
+		pos = put16(pos, 0xe000 | (0x200 + i));
+		pos = put16(pos, 0xf000 | 18);
+		pos = put_descriptors(pos, 3);
+	}
+	finish(&t[1], pos);
+
+	t[2].name = "NIT";
+	pos = put_header(t[2].buf, stag_dvb_network_information_actual, 0x3001);
+	pos = put16(pos, 0xf000 | 12);
+	pos = put_descriptors(pos, 2);
+	loop = pos;
+	pos += 2;
+	for (i = 0; i < 40; i++) {
+		pos = put16(pos, i);
+		pos = put16(pos, 0x22);
+		pos = put16(pos, 0xf000 | 12);
+		pos = put_descriptors(pos, 2);
+	}
+	put16(loop, 0xf000 | (pos - loop - 2));
+	finish(&t[2], pos);
+
+	t[3].name = "SDT";
+	pos = put_header(t[3].buf, stag_dvb_service_description_actual, 0x0401);
+	pos = put16(pos, 0x22);
+	*pos++ = 0xff;
+	for (i = 0; i < 40; i++) {
+		pos = put16(pos, i + 1);
+		*pos++ = 0xfc | (i & 3);
+		pos = put16(pos, 0x8000 | 24);
+		pos = put_descriptors(pos, 4);
+	}
+	finish(&t[3], pos);
+
+	t[4].name = "EIT";
+	pos = put_header(t[4].buf, stag_dvb_event_information_nownext_actual, 0x1234);
+	pos = put16(pos, 0x0401);
+	pos = put16(pos, 0x22);
+	*pos++ = 0;
+	*pos++ = stag_dvb_event_information_nownext_actual;
+	for (i = 0; i < 30; i++) {
+		pos = put16(pos, 0x1000 + i);
+		memcpy(pos, "\xd6\x3d\x12\x45\x00", 5);
+		memcpy(pos + 5, "\x01\x30\x00", 3);
+		pos += 8;
+		pos = put16(pos, 0x8000 | 36);
+		pos = put_descriptors(pos, 6);
+	}
+	finish(&t[4], pos);
+
+	t[5].name = "TVCT";
+	pos = put_header(t[5].buf, stag_atsc_terrestrial_virtual_channel, 0x0801);
+	*pos++ = 0;
+	*pos++ = 20;
+	for (i = 0; i < 20; i++) {
+		memset(pos, 0, 14);
+		pos[1] = 'A' + i;
+		pos += 14;
+		pos[0] = 0xf0 | (((i + 2) >> 6) & 0x0f);
+		pos[1] = ((i + 2) << 2) | 0;
+		pos[2] = 1 + i;
+		pos[3] = 0x04;
+		pos += 4;
+		memset(pos, 0, 4);
+		pos += 4;
+		pos = put16(pos, 0x0801);
+		pos = put16(pos, i + 1);
+		pos = put16(pos, 0x0dc2);
+		pos = put16(pos, i + 1);
+		pos = put16(pos, 0xfc00 | 12);
+		pos = put_descriptors(pos, 2);
+	}
+	pos = put16(pos, 0xfc00);
+	finish(&t[5], pos);
+}
+
+static int sum_descriptors(const struct descriptor *d)
+{
+	return d->tag + d->len;
+}
+
+/*
+ * Decode a private copy of the section with the in-place codecs, summing all
+ * the interesting fields.
+ */
+static long codec_walk(struct table *t, uint8_t *copy)
+{
+	struct section *section;
+	struct section_ext *ext;
+	struct descriptor *d;
+	long sum = 0;
+
+	memcpy(copy, t->buf, t->len);
+	if ((section = section_codec(copy, t->len)) == NULL)
+		return -1;
+	if ((ext = section_ext_decode(section, 1)) == NULL)
+		return -1;
+	sum += ext->table_id_ext + ext->version_number;
+
+	switch(section->table_id) {
+	case stag_mpeg_program_association:
+	{
+		struct mpeg_pat_section *pat = mpeg_pat_section_codec(ext);
+		struct mpeg_pat_program *cur;
+		if (pat == NULL)
+			return -1;
+		mpeg_pat_section_programs_for_each(pat, cur)
+			sum += cur->program_number + cur->pid;
+		break;
+	}
+	case stag_mpeg_program_map:
+	{
+		struct mpeg_pmt_section *pmt = mpeg_pmt_section_codec(ext);
+		struct mpeg_pmt_stream *cur;
+		if (pmt == NULL)
+			return -1;
+		sum += pmt->pcr_pid;
+		mpeg_pmt_section_descriptors_for_each(pmt, d)
+			sum += sum_descriptors(d);
+		mpeg_pmt_section_streams_for_each(pmt, cur) {
+			sum += cur->stream_type + cur->pid;
+			mpeg_pmt_stream_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_network_information_actual:
+	{
+		struct dvb_nit_section *nit = dvb_nit_section_codec(ext);
+		struct dvb_nit_section_part2 *part2;
+		struct dvb_nit_transport *cur;
+		if (nit == NULL)
+			return -1;
+		dvb_nit_section_descriptors_for_each(nit, d)
+			sum += sum_descriptors(d);
+		part2 = dvb_nit_section_part2(nit);
+		dvb_nit_section_transports_for_each(nit, part2, cur) {
+			sum += cur->transport_stream_id + cur->original_network_id;
+			dvb_nit_transport_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_service_description_actual:
+	{
+		struct dvb_sdt_section *sdt = dvb_sdt_section_codec(ext);
+		struct dvb_sdt_service *cur;
+		if (sdt == NULL)
+			return -1;
+		sum += sdt->original_network_id;
+		dvb_sdt_section_services_for_each(sdt, cur) {
+			sum += cur->service_id + cur->eit_schedule_flag +
+			       cur->running_status + cur->free_ca_mode;
+			dvb_sdt_service_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_event_information_nownext_actual:
+	{
+		struct dvb_eit_section *eit = dvb_eit_section_codec(ext);
+		struct dvb_eit_event *cur;
+		if (eit == NULL)
+			return -1;
+		sum += eit->transport_stream_id + eit->original_network_id;
+		dvb_eit_section_events_for_each(eit, cur) {
+			sum += cur->event_id + cur->start_time[0] + cur->duration[1] +
+			       cur->running_status;
+			dvb_eit_event_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_atsc_terrestrial_virtual_channel:
+	{
+		struct atsc_section_psip *psip = atsc_section_psip_decode(ext);
+		struct atsc_tvct_section *tvct;
+		struct atsc_tvct_channel *cur;
+		int idx;
+		if ((psip == NULL) || ((tvct = atsc_tvct_section_codec(psip)) == NULL))
+			return -1;
+		atsc_tvct_section_channels_for_each(tvct, cur, idx) {
+			sum += cur->major_channel_number + cur->minor_channel_number +
+			       cur->program_number + cur->source_id + cur->service_type;
+			atsc_tvct_channel_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	}
+
+	return sum;
+}
+
+/*
+ * Walk the shared, unmodified section through the view accessors.
+ */
+static long view_walk(struct table *t)
+{
+	const struct section_view *section;
+	const struct section_ext_view *ext;
+	const struct descriptor *d;
+	long sum = 0;
+
+	if ((section = section_view_init(t->buf, t->len)) == NULL)
+		return -1;
+	if ((ext = section_ext_view_init(section, 1)) == NULL)
+		return -1;
+	sum += section_ext_view_table_id_ext(ext) + section_ext_view_version_number(ext);
+
+	switch(section_view_table_id(section)) {
+	case stag_mpeg_program_association:
+	{
+		const struct mpeg_pat_view *pat = mpeg_pat_view_init(ext);
+		const struct mpeg_pat_program_view *cur;
+		if (pat == NULL)
+			return -1;
+		mpeg_pat_view_programs_for_each(pat, cur)
+			sum += mpeg_pat_program_view_program_number(cur) +
+			       mpeg_pat_program_view_pid(cur);
+		break;
+	}
+	case stag_mpeg_program_map:
+	{
+		const struct mpeg_pmt_view *pmt = mpeg_pmt_view_init(ext);
+		const struct mpeg_pmt_stream_view *cur;
+		if (pmt == NULL)
+			return -1;
+		sum += mpeg_pmt_view_pcr_pid(pmt);
+		mpeg_pmt_view_descriptors_for_each(pmt, d)
+			sum += sum_descriptors(d);
+		mpeg_pmt_view_streams_for_each(pmt, cur) {
+			sum += mpeg_pmt_stream_view_stream_type(cur) +
+			       mpeg_pmt_stream_view_pid(cur);
+			mpeg_pmt_stream_view_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_network_information_actual:
+	{
+		const struct dvb_nit_view *nit = dvb_nit_view_init(ext);
+		const struct dvb_nit_transport_view *cur;
+		if (nit == NULL)
+			return -1;
+		dvb_nit_view_descriptors_for_each(nit, d)
+			sum += sum_descriptors(d);
+		dvb_nit_view_transports_for_each(nit, cur) {
+			sum += dvb_nit_transport_view_transport_stream_id(cur) +
+			       dvb_nit_transport_view_original_network_id(cur);
+			dvb_nit_transport_view_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_service_description_actual:
+	{
+		const struct dvb_sdt_view *sdt = dvb_sdt_view_init(ext);
+		const struct dvb_sdt_service_view *cur;
+		if (sdt == NULL)
+			return -1;
+		sum += dvb_sdt_view_original_network_id(sdt);
+		dvb_sdt_view_services_for_each(sdt, cur) {
+			sum += dvb_sdt_service_view_service_id(cur) +
+			       dvb_sdt_service_view_eit_schedule_flag(cur) +
+			       dvb_sdt_service_view_running_status(cur) +
+			       dvb_sdt_service_view_free_ca_mode(cur);
+			dvb_sdt_service_view_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_dvb_event_information_nownext_actual:
+	{
+		const struct dvb_eit_view *eit = dvb_eit_view_init(ext);
+		const struct dvb_eit_event_view *cur;
+		if (eit == NULL)
+			return -1;
+		sum += dvb_eit_view_transport_stream_id(eit) +
+		       dvb_eit_view_original_network_id(eit);
+		dvb_eit_view_events_for_each(eit, cur) {
+			sum += dvb_eit_event_view_event_id(cur) +
+			       dvb_eit_event_view_start_time(cur)[0] +
+			       dvb_eit_event_view_duration(cur)[1] +
+			       dvb_eit_event_view_running_status(cur);
+			dvb_eit_event_view_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	case stag_atsc_terrestrial_virtual_channel:
+	{
+		const struct atsc_vct_view *vct = atsc_vct_view_init(ext);
+		const struct atsc_vct_channel_view *cur;
+		int idx;
+		if (vct == NULL)
+			return -1;
+		atsc_vct_view_channels_for_each(vct, cur, idx) {
+			sum += atsc_vct_channel_view_major_channel_number(cur) +
+			       atsc_vct_channel_view_minor_channel_number(cur) +
+			       atsc_vct_channel_view_program_number(cur) +
+			       atsc_vct_channel_view_source_id(cur) +
+			       atsc_vct_channel_view_service_type(cur);
+			atsc_vct_channel_view_descriptors_for_each(cur, d)
+				sum += sum_descriptors(d);
+		}
+		break;
+	}
+	}
+
+	return sum;
+}
+
+int main(void)
+{
+	static struct table tables[6];
+	uint8_t copy[DVB_MAX_SECTION_BYTES];
+	int i, j;
+
+	build_tables(tables);
+
+	printf("%6s %6s %14s %14s\n", "table", "bytes", "copy+codec/s", "view/s");
+	for (i = 0; i < 6; i++) {
+		struct table *t = &tables[i];
+		long expect = codec_walk(t, copy);
+		volatile long sink = 0;
+		double t1, t2;
+
+		if ((expect < 0) || (view_walk(t) != expect)) {
+			fprintf(stderr, "XXXX %s: view and codec disagree (%li != %li)\n",
+				t->name, view_walk(t), expect);
+			exit(1);
+		}
+
+		t1 = now();
+		for (j = 0; j < ITERATIONS; j++)
+			sink += codec_walk(t, copy);
+		t1 = now() - t1;
+
+		t2 = now();
+		for (j = 0; j < ITERATIONS; j++)
+			sink += view_walk(t);
+		t2 = now() - t2;
+
+		printf("%6s %6i %14.0f %14.0f\n", t->name, t->len,
+		       ITERATIONS / t1, ITERATIONS / t2);
+	}
+
+	return 0;
+}
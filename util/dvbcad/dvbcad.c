@@ -0,0 +1,447 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include "dvbcad.h"
+#include "dvbcad_cam.h"
+#include "dvbcad_service.h"
+
+#define MAX_CLIENTS 64
+#define MAX_CLIENT_PROGRAMS 64
+#define MAX_MESSAGE_SIZE 4096
+#define TICK_MS 100
+
+struct client {
+	int fd;
+	uint16_t programs[MAX_CLIENT_PROGRAMS];
+	int program_count;
+};
+
+static void signal_handler(int _signal);
+
+static struct client clients[MAX_CLIENTS];
+static int client_count = 0;
+static int quit_app = 0;
+static int dump_stats = 0;
+
+void usage(void)
+{
+	static const char *_usage = "\n"
+		" dvbcad: CA manager for several CAMs shared by several clients\n\n"
+		" usage: dvbcad <options> as follows:\n"
+		" -h			help\n"
+		" -c <adapter>[:<slot>]	Manage the CAM in a CI slot, or in every slot of the adapter\n"
+		"			(may be repeated; default is every slot of adapter 0)\n"
+		" -simulate <count>[:<caid>[,<caid>...]]\n"
+		"			Manage simulated CAMs reporting the given CA system ids\n"
+		" -socket <path>		Socket to accept clients on (default " DVBCAD_DEFAULT_SOCKET ")\n"
+		" -m <services>		Services each CAM may descramble at once (default 2)\n"
+		" -noquery		Do not ask a CAM whether it can descramble a service first\n"
+		" -querytimeout <ms>	Time after which a CAM not answering is assumed willing (default 2000)\n"
+		" -nomoveca		Do not attempt to move CA descriptors from stream to programme level\n"
+		"\n"
+		" SIGUSR1 prints the state of the CAMs and services to stderr.\n";
+	fprintf(stderr, "%s\n", _usage);
+
+	exit(1);
+}
+
+static int parse_simulate(char *arg)
+{
+	uint16_t caids[DVBCAD_MAX_CAIDS];
+	int caid_count = 0;
+	int count;
+	int pos;
+	int caid;
+
+	if (sscanf(arg, "%i%n", &count, &pos) != 1)
+		return -1;
+	if (count <= 0)
+		return -1;
+	arg += pos;
+
+	if (*arg == ':') {
+		do {
+			arg++;
+			if (caid_count == DVBCAD_MAX_CAIDS)
+				return -1;
+			if (sscanf(arg, "%i%n", &caid, &pos) != 1)
+				return -1;
+			caids[caid_count++] = caid;
+			arg += pos;
+		} while(*arg == ',');
+	}
+	if (*arg)
+		return -1;
+
+	return dvbcad_cam_add_simulated(count, caid_count ? caids : NULL, caid_count);
+}
+
+static int open_socket(char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long\n");
+		return -1;
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, 16)) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void send_reply(int fd, uint8_t type, int status, uint16_t program_number, int cam_index)
+{
+	uint8_t reply[DVBCAD_REPLY_SIZE];
+
+	reply[0] = type | DVBCAD_MSG_REPLY;
+	reply[1] = status;
+	reply[2] = program_number >> 8;
+	reply[3] = program_number;
+	reply[4] = cam_index;
+
+	// a client too slow to read its replies is not waited for
+	send(fd, reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static int client_holds(struct client *client, uint16_t program_number)
+{
+	int i;
+
+	for(i=0; i < client->program_count; i++) {
+		if (client->programs[i] == program_number)
+			return i;
+	}
+
+	return -1;
+}
+
+static void client_pmt(struct client *client, uint8_t *buf, int size)
+{
+	uint16_t program_number = 0;
+	int cam_index = DVBCAD_NO_CAM;
+	int held = 0;
+	int status;
+
+	// the program number is the table_id_extension of the section
+	if (size >= 5) {
+		program_number = (buf[3] << 8) | buf[4];
+		held = client_holds(client, program_number) >= 0;
+	}
+	if ((!held) && (client->program_count == MAX_CLIENT_PROGRAMS)) {
+		send_reply(client->fd, DVBCAD_MSG_PMT, -ENOSPC, program_number, DVBCAD_NO_CAM);
+		return;
+	}
+
+	status = dvbcad_service_pmt(buf, size, !held, &program_number, &cam_index);
+	if ((status == -EINVAL) || (status == -ENOMEM) || (status == -EBUSY)) {
+		send_reply(client->fd, DVBCAD_MSG_PMT, status, program_number, DVBCAD_NO_CAM);
+		return;
+	}
+	if (!held)
+		client->programs[client->program_count++] = program_number;
+
+	if (status != DVBCAD_STATUS_PENDING)
+		send_reply(client->fd, DVBCAD_MSG_PMT, status, program_number, cam_index);
+}
+
+static void client_stop(struct client *client, uint8_t *buf, int size)
+{
+	uint16_t program_number;
+	int idx;
+
+	if (size != 2) {
+		send_reply(client->fd, DVBCAD_MSG_STOP, -EINVAL, 0, DVBCAD_NO_CAM);
+		return;
+	}
+	program_number = (buf[0] << 8) | buf[1];
+
+	if ((idx = client_holds(client, program_number)) < 0) {
+		send_reply(client->fd, DVBCAD_MSG_STOP, -ENOENT, program_number, DVBCAD_NO_CAM);
+		return;
+	}
+	client->programs[idx] = client->programs[--client->program_count];
+	dvbcad_service_release(program_number);
+	send_reply(client->fd, DVBCAD_MSG_STOP, 0, program_number, DVBCAD_NO_CAM);
+}
+
+static void client_status(struct client *client)
+{
+	char *text = NULL;
+	size_t size = 0;
+	FILE *out;
+
+	if ((out = open_memstream(&text, &size)) == NULL)
+		return;
+	fputc(DVBCAD_MSG_STATUS | DVBCAD_MSG_REPLY, out);
+	dvbcad_cam_dump(out);
+	dvbcad_service_dump(out);
+	fclose(out);
+
+	send(client->fd, text, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+	free(text);
+}
+
+static void client_close(int idx)
+{
+	struct client *client = &clients[idx];
+	int i;
+
+	for(i=0; i < client->program_count; i++)
+		dvbcad_service_release(client->programs[i]);
+	close(client->fd);
+
+	clients[idx] = clients[--client_count];
+}
+
+static void client_message(int idx)
+{
+	struct client *client = &clients[idx];
+	uint8_t buf[MAX_MESSAGE_SIZE];
+	int size;
+
+	if ((size = recv(client->fd, buf, sizeof(buf), 0)) <= 0) {
+		if ((size < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+			return;
+		client_close(idx);
+		return;
+	}
+
+	switch(buf[0]) {
+	case DVBCAD_MSG_PMT:
+		client_pmt(client, buf+1, size-1);
+		break;
+
+	case DVBCAD_MSG_STOP:
+		client_stop(client, buf+1, size-1);
+		break;
+
+	case DVBCAD_MSG_STATUS:
+		client_status(client);
+		break;
+
+	default:
+		send_reply(client->fd, buf[0], -EINVAL, 0, DVBCAD_NO_CAM);
+		break;
+	}
+}
+
+void dvbcad_notify(uint16_t program_number, int status, int cam_index)
+{
+	int i;
+
+	for(i=0; i < client_count; i++) {
+		if (client_holds(&clients[i], program_number) >= 0)
+			send_reply(clients[i].fd, DVBCAD_MSG_PMT, status, program_number, cam_index);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char *socket_path = DVBCAD_DEFAULT_SOCKET;
+	int max_services = 2;
+	int have_cams = 0;
+	int argpos = 1;
+	struct dvbcad_service_params service_params;
+	struct pollfd pollfds[MAX_CLIENTS + 2];
+	int listenfd;
+	int wakeupfd;
+	int i;
+
+	service_params.moveca = 1;
+	service_params.query = 1;
+	service_params.query_timeout_ms = 2000;
+
+	while(argpos != argc) {
+		if (!strcmp(argv[argpos], "-h")) {
+			usage();
+		} else if (!strcmp(argv[argpos], "-c")) {
+			int adapter;
+			int slot = -1;
+			if ((argc - argpos) < 2)
+				usage();
+			if ((sscanf(argv[argpos+1], "%i:%i", &adapter, &slot) < 1) || (slot < -1))
+				usage();
+			if (dvbcad_cam_add_adapter(adapter, slot) < 0)
+				exit(1);
+			have_cams = 1;
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-simulate")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (parse_simulate(argv[argpos+1]))
+				usage();
+			have_cams = 1;
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-socket")) {
+			if ((argc - argpos) < 2)
+				usage();
+			socket_path = argv[argpos+1];
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-m")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &max_services) != 1)
+				usage();
+			if (max_services <= 0)
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-noquery")) {
+			service_params.query = 0;
+			argpos++;
+		} else if (!strcmp(argv[argpos], "-querytimeout")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &service_params.query_timeout_ms) != 1)
+				usage();
+			if (service_params.query_timeout_ms <= 0)
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-nomoveca")) {
+			service_params.moveca = 0;
+			argpos++;
+		} else {
+			usage();
+		}
+	}
+
+	if (!have_cams) {
+		if (dvbcad_cam_add_adapter(0, -1) < 0)
+			exit(1);
+	}
+
+	// setup any signals
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+	signal(SIGUSR1, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	// the CA thread wakes the main loop through this when the CAMs have said something
+	if ((wakeupfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		perror("eventfd");
+		exit(1);
+	}
+
+	dvbcad_service_init(&service_params);
+	if (dvbcad_cam_start(max_services, wakeupfd)) {
+		dvbcad_cam_stop();
+		exit(1);
+	}
+	if ((listenfd = open_socket(socket_path)) < 0) {
+		dvbcad_cam_stop();
+		exit(1);
+	}
+	fprintf(stderr, "Managing %i CAMs on %s\n", dvbcad_cam_count(), socket_path);
+
+	while(!quit_app) {
+		pollfds[0].fd = listenfd;
+		pollfds[0].events = POLLIN;
+		pollfds[1].fd = wakeupfd;
+		pollfds[1].events = POLLIN;
+		for(i=0; i < client_count; i++) {
+			pollfds[i+2].fd = clients[i].fd;
+			pollfds[i+2].events = POLLIN;
+		}
+		int nfds = client_count + 2;
+
+		if (poll(pollfds, nfds, TICK_MS) < 0) {
+			if (errno != EINTR) {
+				perror("poll");
+				break;
+			}
+		} else {
+			if (pollfds[1].revents & POLLIN)
+				dvbcad_cam_process_events();
+
+			// backwards, as closing a client moves the last one into its place
+			for(i = nfds - 3; i >= 0; i--) {
+				if (pollfds[i+2].revents & (POLLIN | POLLERR | POLLHUP))
+					client_message(i);
+			}
+
+			if (pollfds[0].revents & POLLIN) {
+				int fd = accept(listenfd, NULL, NULL);
+				if (fd >= 0) {
+					if (client_count == MAX_CLIENTS) {
+						close(fd);
+					} else {
+						clients[client_count].fd = fd;
+						clients[client_count].program_count = 0;
+						client_count++;
+					}
+				}
+			}
+		}
+
+		dvbcad_service_tick();
+
+		if (dump_stats) {
+			dvbcad_cam_dump(stderr);
+			dvbcad_service_dump(stderr);
+			dump_stats = 0;
+		}
+	}
+
+	// shutdown
+	while(client_count)
+		client_close(client_count - 1);
+	close(listenfd);
+	unlink(socket_path);
+	dvbcad_cam_stop();
+	close(wakeupfd);
+
+	return 0;
+}
+
+static void signal_handler(int _signal)
+{
+	if (_signal == SIGUSR1)
+		dump_stats = 1;
+	else
+		quit_app = 1;
+}
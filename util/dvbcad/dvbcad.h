@@ -0,0 +1,75 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef DVBCAD_H
+#define DVBCAD_H 1
+
+#include <stdint.h>
+
+/*
+ * Clients talk to dvbcad over a SOCK_SEQPACKET unix socket, one request or
+ * reply per packet. Every request is a type byte followed by its payload:
+ *
+ *   DVBCAD_MSG_PMT     the raw PMT section of a program to descramble. Sending
+ *                      a new version of it later updates the CAM.
+ *   DVBCAD_MSG_STOP    two byte program number of a program no longer needed.
+ *   DVBCAD_MSG_STATUS  no payload.
+ *
+ * PMT and STOP are answered with DVBCAD_REPLY_SIZE bytes:
+ *
+ *   [type | DVBCAD_MSG_REPLY] [int8 status] [program hi] [program lo] [cam]
+ *
+ * where cam is the index of the CAM descrambling the program, or 0xff. The
+ * state of a program can change after the first reply (a CAM was removed, or
+ * one which can take it was inserted), so a client holding a program may be
+ * sent further PMT replies for it at any time. STATUS is answered with the
+ * reply type byte followed by a text report of the CAMs and programs.
+ */
+#define DVBCAD_DEFAULT_SOCKET "/var/run/dvbcad.socket"
+
+#define DVBCAD_MSG_PMT		0x01
+#define DVBCAD_MSG_STOP		0x02
+#define DVBCAD_MSG_STATUS	0x03
+#define DVBCAD_MSG_REPLY	0x80
+
+#define DVBCAD_REPLY_SIZE	5
+#define DVBCAD_NO_CAM		0xff
+
+/*
+ * Reply status: one of these, or a negative errno:
+ *   -ENOENT no CAM supports the program's CA systems,
+ *   -ENOSPC every CAM which could is descrambling as much as it can,
+ *   -EACCES every CAM which could refused to,
+ *   -EBUSY  another PMT of the program is held by other clients: it is
+ *           taken to be a program of the same number on another multiplex,
+ *   -EINVAL the request was malformed.
+ */
+#define DVBCAD_STATUS_DESCRAMBLING	0
+#define DVBCAD_STATUS_CLEAR		1	/* the program has no CA descriptors */
+
+/**
+ * Tell every client holding a program of a change in its state.
+ *
+ * @param program_number The program concerned.
+ * @param status One of the DVBCAD_STATUS_*, or a negative errno.
+ * @param cam_index Index of the CAM descrambling it, or DVBCAD_NO_CAM.
+ */
+extern void dvbcad_notify(uint16_t program_number, int status, int cam_index);
+
+#endif
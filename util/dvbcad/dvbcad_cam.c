@@ -0,0 +1,457 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <libdvbapi/dvbca.h>
+#include "dvbcad_cam.h"
+#include "dvbcad_service.h"
+
+#define MAX_ADAPTERS 16
+#define MAX_SLOTS 8
+#define SESSIONS_PER_CAM 16
+#define EVENT_QUEUE_SIZE 256
+#define CAM_POLL_MS 100
+
+#define CAM_EVENT_READY 0
+#define CAM_EVENT_GONE 1
+#define CAM_EVENT_REPLY 2
+
+/*
+ * The CA thread never touches the services: it queues what the CAMs said, and
+ * the main thread acts on it.
+ */
+struct cam_event {
+	int type;
+	int cam_index;
+	uint16_t program_number;
+	int ca_enable;
+	struct timeval when;
+};
+
+static int ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+			    uint32_t ca_id_count, uint16_t *ca_ids);
+static int ca_pmt_reply_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+				 struct en50221_app_pmt_reply *reply, uint32_t reply_size);
+static void queue_event(struct cam_event *event);
+static void *camthread_func(void *arg);
+
+static struct dvbcad_cam cams[DVBCAD_MAX_CAMS];
+static int cam_count = 0;
+static int adapter_fds[MAX_ADAPTERS];
+static int adapter_fds_valid = 0;
+
+static struct en50221_transport_layer *tl = NULL;
+static struct en50221_session_layer *sl = NULL;
+static pthread_t camthread;
+static int camthread_started = 0;
+static int camthread_shutdown = 0;
+static int wakeupfd = -1;
+
+// CA system ids as last reported by each CAM; copied to the cam by its READY event
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t reported_caids[DVBCAD_MAX_CAMS][DVBCAD_MAX_CAIDS];
+static int reported_caid_count[DVBCAD_MAX_CAMS];
+static struct cam_event events[EVENT_QUEUE_SIZE];
+static int event_head = 0;
+static int event_count = 0;
+
+
+int dvbcad_cam_add_adapter(int adapter, int slot)
+{
+	int i;
+	int added = 0;
+
+	if ((adapter < 0) || (adapter >= MAX_ADAPTERS)) {
+		fprintf(stderr, "Adapter %i out of range\n", adapter);
+		return -1;
+	}
+	if (!adapter_fds_valid) {
+		for(i=0; i < MAX_ADAPTERS; i++)
+			adapter_fds[i] = -1;
+		adapter_fds_valid = 1;
+	}
+
+	// every slot of an adapter is on its ca0, which is opened only once
+	if (adapter_fds[adapter] == -1) {
+		if ((adapter_fds[adapter] = dvbca_open(adapter, 0)) < 0) {
+			fprintf(stderr, "Failed to open CA device of adapter %i\n", adapter);
+			return -1;
+		}
+	}
+
+	int first_slot = (slot == -1) ? 0 : slot;
+	int last_slot = (slot == -1) ? MAX_SLOTS-1 : slot;
+	for(i = first_slot; i <= last_slot; i++) {
+		int type = dvbca_get_interface_type(adapter_fds[adapter], i);
+		if (type == -1) {
+			if (slot != -1) {
+				fprintf(stderr, "Adapter %i has no CA slot %i\n", adapter, slot);
+				return -1;
+			}
+			break;
+		}
+		if (type != DVBCA_INTERFACE_LINK) {
+			fprintf(stderr, "Skipping adapter %i slot %i: only link level CI is supported\n", adapter, i);
+			continue;
+		}
+		if (cam_count == DVBCAD_MAX_CAMS) {
+			fprintf(stderr, "Too many CAMs\n");
+			return -1;
+		}
+
+		memset(&cams[cam_count], 0, sizeof(struct dvbcad_cam));
+		cams[cam_count].index = cam_count;
+		cams[cam_count].adapter = adapter;
+		cams[cam_count].slot = i;
+		cams[cam_count].cafd = adapter_fds[adapter];
+		cam_count++;
+		added++;
+	}
+
+	return added;
+}
+
+int dvbcad_cam_add_simulated(int count, uint16_t *caids, int caid_count)
+{
+	int i;
+
+	if ((cam_count + count) > DVBCAD_MAX_CAMS) {
+		fprintf(stderr, "Too many CAMs\n");
+		return -1;
+	}
+
+	for(i=0; i < count; i++) {
+		struct en50221_camsim_params params;
+		memset(&params, 0, sizeof(params));
+		params.ca_system_ids = caids;
+		params.ca_system_id_count = caid_count;
+
+		struct dvbcad_cam *cam = &cams[cam_count];
+		memset(cam, 0, sizeof(struct dvbcad_cam));
+		if ((cam->camsim = en50221_camsim_create(&params)) == NULL) {
+			fprintf(stderr, "Failed to create simulated CAM\n");
+			return -1;
+		}
+		cam->index = cam_count;
+		cam->adapter = -1;
+		cam->slot = 0;
+		cam->cafd = en50221_camsim_get_fd(cam->camsim);
+		cam_count++;
+	}
+
+	return 0;
+}
+
+int dvbcad_cam_start(int max_services, int wakeup_fd)
+{
+	int i;
+
+	if (cam_count == 0) {
+		fprintf(stderr, "No CAMs to manage\n");
+		return -1;
+	}
+	wakeupfd = wakeup_fd;
+
+	// one transport and session layer drive every slot
+	if ((tl = en50221_tl_create(cam_count, 16)) == NULL) {
+		fprintf(stderr, "Failed to create transport layer\n");
+		return -1;
+	}
+	if ((sl = en50221_sl_create(tl, cam_count * SESSIONS_PER_CAM)) == NULL) {
+		fprintf(stderr, "Failed to create session layer\n");
+		return -1;
+	}
+
+	for(i=0; i < cam_count; i++) {
+		struct dvbcad_cam *cam = &cams[i];
+
+		cam->max_services = max_services;
+		if ((cam->stdcam = en50221_stdcam_llci_create(cam->cafd, cam->slot, tl, sl)) == NULL) {
+			fprintf(stderr, "Failed to create stdcam for CAM %i\n", i);
+			return -1;
+		}
+		if (cam->stdcam->ca_resource) {
+			en50221_app_ca_register_info_callback(cam->stdcam->ca_resource, ca_info_callback, cam);
+			en50221_app_ca_register_pmt_reply_callback(cam->stdcam->ca_resource, ca_pmt_reply_callback, cam);
+		}
+	}
+
+	pthread_create(&camthread, NULL, camthread_func, NULL);
+	camthread_started = 1;
+	return 0;
+}
+
+void dvbcad_cam_stop(void)
+{
+	int i;
+
+	if (camthread_started) {
+		camthread_shutdown = 1;
+		en50221_tl_wakeup(tl);
+		pthread_join(camthread, NULL);
+	}
+
+	// the adapters' CA devices are shared between their slots, so are closed here
+	for(i=0; i < cam_count; i++) {
+		if (cams[i].stdcam)
+			cams[i].stdcam->destroy(cams[i].stdcam, 0);
+		if (cams[i].camsim)
+			en50221_camsim_destroy(cams[i].camsim);
+	}
+	if (sl)
+		en50221_sl_destroy(sl);
+	if (tl)
+		en50221_tl_destroy(tl);
+	if (adapter_fds_valid) {
+		for(i=0; i < MAX_ADAPTERS; i++) {
+			if (adapter_fds[i] != -1)
+				close(adapter_fds[i]);
+		}
+	}
+}
+
+int dvbcad_cam_count(void)
+{
+	return cam_count;
+}
+
+struct dvbcad_cam *dvbcad_cam_get(int index)
+{
+	return &cams[index];
+}
+
+int dvbcad_cam_supports(struct dvbcad_cam *cam, uint16_t *caids, int caid_count)
+{
+	int i, j;
+
+	for(i=0; i < caid_count; i++) {
+		for(j=0; j < cam->caid_count; j++) {
+			if (caids[i] == cam->caids[j])
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+int dvbcad_cam_send(struct dvbcad_cam *cam, uint8_t *capmt, int size)
+{
+	int session_number = cam->stdcam->ca_session_number;
+
+	if (session_number == -1)
+		return -1;
+	if (en50221_app_ca_pmt(cam->stdcam->ca_resource, session_number, capmt, size))
+		return -1;
+
+	cam->ca_pmts++;
+	return 0;
+}
+
+void dvbcad_cam_process_events(void)
+{
+	struct cam_event event;
+	uint64_t tmp;
+
+	if (read(wakeupfd, &tmp, sizeof(tmp)) < 0) {
+		// nothing new; the queue is still checked
+	}
+
+	while(1) {
+		pthread_mutex_lock(&event_lock);
+		if (event_count == 0) {
+			pthread_mutex_unlock(&event_lock);
+			break;
+		}
+		event = events[event_head];
+		event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+		event_count--;
+
+		struct dvbcad_cam *cam = &cams[event.cam_index];
+		if (event.type == CAM_EVENT_READY) {
+			cam->caid_count = reported_caid_count[event.cam_index];
+			memcpy(cam->caids, reported_caids[event.cam_index],
+			       cam->caid_count * sizeof(uint16_t));
+		}
+		pthread_mutex_unlock(&event_lock);
+
+		switch(event.type) {
+		case CAM_EVENT_READY:
+			cam->ready = 1;
+			dvbcad_service_cam_ready(cam);
+			break;
+
+		case CAM_EVENT_GONE:
+			if (cam->ready) {
+				cam->ready = 0;
+				dvbcad_service_cam_gone(cam);
+			}
+			break;
+
+		case CAM_EVENT_REPLY:
+			cam->replies++;
+			dvbcad_service_reply(cam, event.program_number, event.ca_enable, &event.when);
+			break;
+		}
+	}
+}
+
+void dvbcad_cam_dump(FILE *out)
+{
+	int i, j;
+
+	for(i=0; i < cam_count; i++) {
+		struct dvbcad_cam *cam = &cams[i];
+
+		if (cam->adapter == -1)
+			fprintf(out, "cam %i: simulated", i);
+		else
+			fprintf(out, "cam %i: adapter %i slot %i", i, cam->adapter, cam->slot);
+		fprintf(out, " %s services %i/%i caids", cam->ready ? "ready" : "not-ready",
+			cam->services, cam->max_services);
+		for(j=0; j < cam->caid_count; j++)
+			fprintf(out, " %04x", cam->caids[j]);
+		fprintf(out, "\n");
+
+		uint32_t mean = 0;
+		if (cam->replies)
+			mean = cam->latency_total_us / cam->replies;
+		fprintf(out, "  ca_pmts %u queries %u replies %u timeouts %u refused %u"
+			" latency mean %uus max %uus\n",
+			cam->ca_pmts, cam->queries, cam->replies, cam->timeouts, cam->refused,
+			mean, cam->latency_max_us);
+	}
+}
+
+static void *camthread_func(void *arg)
+{
+	enum en50221_stdcam_status status[DVBCAD_MAX_CAMS];
+	struct cam_event event;
+	int i;
+	(void) arg;
+
+	for(i=0; i < cam_count; i++)
+		status[i] = EN50221_STDCAM_CAM_NONE;
+
+	while(!camthread_shutdown) {
+		// the CAMs share the transport layer, so it is polled once for all
+		// of them; it wakes for anything it has to do, so only the CAM
+		// states need checking at an interval
+		if (en50221_tl_poll_wait(tl, CAM_POLL_MS))
+			fprintf(stderr, "Error reported by CAM transport layer on slot %i: %i\n",
+				en50221_tl_get_error_slot(tl), en50221_tl_get_error(tl));
+
+		for(i=0; i < cam_count; i++) {
+			struct en50221_stdcam *stdcam = cams[i].stdcam;
+			enum en50221_stdcam_status new_status = en50221_stdcam_llci_poll_slot(stdcam);
+
+			// there is no TDT here, so the CAMs are given the system time
+			stdcam->dvbtime(stdcam, time(NULL));
+
+			if ((status[i] == EN50221_STDCAM_CAM_OK) && (new_status != EN50221_STDCAM_CAM_OK)) {
+				memset(&event, 0, sizeof(event));
+				event.type = CAM_EVENT_GONE;
+				event.cam_index = i;
+				queue_event(&event);
+			}
+			status[i] = new_status;
+		}
+	}
+
+	return 0;
+}
+
+static int ca_info_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+			    uint32_t ca_id_count, uint16_t *ca_ids)
+{
+	struct dvbcad_cam *cam = arg;
+	struct cam_event event;
+	(void) slot_id;
+	(void) session_number;
+
+	if (ca_id_count > DVBCAD_MAX_CAIDS)
+		ca_id_count = DVBCAD_MAX_CAIDS;
+
+	pthread_mutex_lock(&event_lock);
+	memcpy(reported_caids[cam->index], ca_ids, ca_id_count * sizeof(uint16_t));
+	reported_caid_count[cam->index] = ca_id_count;
+	pthread_mutex_unlock(&event_lock);
+
+	memset(&event, 0, sizeof(event));
+	event.type = CAM_EVENT_READY;
+	event.cam_index = cam->index;
+	queue_event(&event);
+	return 0;
+}
+
+static int ca_pmt_reply_callback(void *arg, uint8_t slot_id, uint16_t session_number,
+				 struct en50221_app_pmt_reply *reply, uint32_t reply_size)
+{
+	struct dvbcad_cam *cam = arg;
+	struct en50221_app_pmt_stream *pos;
+	struct cam_event event;
+	(void) slot_id;
+	(void) session_number;
+
+	memset(&event, 0, sizeof(event));
+	gettimeofday(&event.when, NULL);
+	event.type = CAM_EVENT_REPLY;
+	event.cam_index = cam->index;
+	event.program_number = reply->program_number;
+
+	// the programme level CA_enable if given, otherwise that of the first
+	// stream with one; a reply with none at all is taken as a yes
+	event.ca_enable = CA_ENABLE_DESCRAMBLING_POSSIBLE;
+	if (reply->CA_enable_flag) {
+		event.ca_enable = reply->CA_enable;
+	} else {
+		en50221_app_pmt_reply_streams_for_each(reply, pos, reply_size) {
+			if (pos->CA_enable_flag) {
+				event.ca_enable = pos->CA_enable;
+				break;
+			}
+		}
+	}
+
+	queue_event(&event);
+	return 0;
+}
+
+static void queue_event(struct cam_event *event)
+{
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&event_lock);
+	if (event_count < EVENT_QUEUE_SIZE) {
+		events[(event_head + event_count) % EVENT_QUEUE_SIZE] = *event;
+		event_count++;
+	} else {
+		// a lost reply is handled as a timeout
+		fprintf(stderr, "CAM event queue full, dropping event\n");
+	}
+	pthread_mutex_unlock(&event_lock);
+
+	if (write(wakeupfd, &one, sizeof(one)) < 0) {
+		// already signalled
+	}
+}
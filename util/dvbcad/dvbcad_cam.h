@@ -0,0 +1,138 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef DVBCAD_CAM_H
+#define DVBCAD_CAM_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <libdvben50221/en50221_stdcam.h>
+#include <libdvben50221/en50221_camsim.h>
+
+#define DVBCAD_MAX_CAMS 32
+#define DVBCAD_MAX_CAIDS 64
+
+struct dvbcad_cam {
+	int index;
+	int adapter;		/* -1 for a simulated CAM */
+	int slot;
+
+	int cafd;
+	struct en50221_stdcam *stdcam;
+	struct en50221_camsim *camsim;
+
+	/* CA system ids, valid once ready; only changed by dvbcad_cam_process_events() */
+	int ready;
+	uint16_t caids[DVBCAD_MAX_CAIDS];
+	int caid_count;
+
+	/* services allocated to it, and how many it may take */
+	int services;
+	int max_services;
+
+	/* statistics */
+	uint32_t ca_pmts;
+	uint32_t queries;
+	uint32_t replies;
+	uint32_t timeouts;
+	uint32_t refused;
+	uint64_t latency_total_us;
+	uint32_t latency_max_us;
+};
+
+/**
+ * Add the CI slots of an adapter. Each is probed, and the LLCI ones are
+ * added as CAMs.
+ *
+ * @param adapter The DVB adapter concerned.
+ * @param slot A single slot to add, or -1 for all of them.
+ * @return Number of CAMs added, or -1 on error.
+ */
+extern int dvbcad_cam_add_adapter(int adapter, int slot);
+
+/**
+ * Add simulated CAMs.
+ *
+ * @param count Number to add.
+ * @param caids CA system ids they should report, or NULL for the default.
+ * @param caid_count Number of entries in caids.
+ * @return 0 on success, or -1 on error.
+ */
+extern int dvbcad_cam_add_simulated(int count, uint16_t *caids, int caid_count);
+
+/**
+ * Create the transport and session layers shared by all the CAMs, and start
+ * the thread driving them.
+ *
+ * @param max_services Number of services each CAM may descramble at once.
+ * @param wakeup_fd An eventfd written whenever there are events to process.
+ * @return 0 on success, or -1 on error.
+ */
+extern int dvbcad_cam_start(int max_services, int wakeup_fd);
+
+/**
+ * Stop the CA thread and destroy everything.
+ */
+extern void dvbcad_cam_stop(void);
+
+/**
+ * @return Number of CAMs.
+ */
+extern int dvbcad_cam_count(void);
+
+/**
+ * @param index Index of a CAM.
+ * @return The CAM.
+ */
+extern struct dvbcad_cam *dvbcad_cam_get(int index);
+
+/**
+ * Check whether a CAM handles any of a list of CA system ids.
+ *
+ * @param cam The CAM.
+ * @param caids The CA system ids.
+ * @param caid_count Number of entries in caids.
+ * @return 1 if it does, 0 if not.
+ */
+extern int dvbcad_cam_supports(struct dvbcad_cam *cam, uint16_t *caids, int caid_count);
+
+/**
+ * Send a CA PMT to a CAM.
+ *
+ * @param cam The CAM.
+ * @param capmt The formatted CA PMT.
+ * @param size Its size in bytes.
+ * @return 0 on success, or -1 on error.
+ */
+extern int dvbcad_cam_send(struct dvbcad_cam *cam, uint8_t *capmt, int size);
+
+/**
+ * Handle the events queued by the CA thread, passing them on to the
+ * services. Called from the main thread when the wakeup fd is readable.
+ */
+extern void dvbcad_cam_process_events(void);
+
+/**
+ * Print the state and statistics of every CAM.
+ *
+ * @param out Where to print them.
+ */
+extern void dvbcad_cam_dump(FILE *out);
+
+#endif
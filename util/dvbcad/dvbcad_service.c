@@ -0,0 +1,541 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libucsi/section.h>
+#include <libucsi/mpeg/section.h>
+#include <libucsi/mpeg/descriptor.h>
+#include "dvbcad.h"
+#include "dvbcad_service.h"
+
+#define MAX_SECTION_SIZE 1024
+#define MAX_CAPMT_SIZE 4096
+#define MAX_SERVICE_CAIDS 32
+#define CAPMT_CACHE_ENTRIES 64
+
+#define SERVICE_WAITING 0	/* no CAM can take it at the moment */
+#define SERVICE_QUERYING 1	/* its CAM has been asked whether it can descramble it */
+#define SERVICE_DESCRAMBLING 2
+
+struct dvbcad_service {
+	struct dvbcad_service *next;
+
+	uint16_t program_number;
+	uint8_t version;
+	uint8_t pmt[MAX_SECTION_SIZE];
+	int pmt_size;
+	uint8_t decoded[MAX_SECTION_SIZE];
+	struct mpeg_pmt_section *section;	/* pmt, decoded in place */
+	uint16_t caids[MAX_SERVICE_CAIDS];
+	int caid_count;
+
+	int users;
+	int state;
+	struct dvbcad_cam *cam;
+	uint32_t refused_by;	/* bitmask of the indexes of CAMs which refused it */
+	struct timeval query_sent;
+
+	/* last status passed to dvbcad_notify() */
+	int status;
+	int status_cam;
+};
+
+static void service_allocate(struct dvbcad_service *svc);
+static void service_detach(struct dvbcad_service *svc);
+static void service_descramble(struct dvbcad_service *svc);
+static void service_set_status(struct dvbcad_service *svc, int status);
+static void retry_waiting(void);
+static void send_list(struct dvbcad_cam *cam);
+static int send_capmt(struct dvbcad_service *svc, struct dvbcad_cam *cam,
+		      uint8_t list_management, uint8_t cmd_id);
+static struct mpeg_pmt_section *decode_pmt(uint8_t *buf, int size);
+static void get_caids(struct mpeg_pmt_section *pmt, uint16_t *caids, int *caid_count);
+static struct dvbcad_service *find_service(uint16_t program_number);
+
+static struct dvbcad_service_params params;
+static struct dvbcad_service *services = NULL;
+static struct en50221_ca_pmt_cache *capmt_cache = NULL;
+static int notified;
+
+
+void dvbcad_service_init(struct dvbcad_service_params *_params)
+{
+	params = *_params;
+
+	// the same CA PMTs are sent over and over as CAM lists change
+	capmt_cache = en50221_ca_pmt_cache_create(CAPMT_CACHE_ENTRIES, params.moveca);
+}
+
+int dvbcad_service_pmt(uint8_t *buf, int size, int new_user,
+		       uint16_t *program_number, int *cam_index)
+{
+	uint8_t tmp[MAX_SECTION_SIZE];
+	uint16_t caids[MAX_SERVICE_CAIDS];
+	int caid_count;
+	struct mpeg_pmt_section *pmt;
+	struct dvbcad_service *svc;
+
+	if ((size < 3) || (size > MAX_SECTION_SIZE))
+		return -EINVAL;
+	memcpy(tmp, buf, size);
+	if ((pmt = decode_pmt(tmp, size)) == NULL)
+		return -EINVAL;
+	*program_number = mpeg_pmt_section_program_number(pmt);
+	get_caids(pmt, caids, &caid_count);
+
+	notified = 0;
+	svc = find_service(*program_number);
+	if (svc == NULL) {
+		if (caid_count == 0)
+			return DVBCAD_STATUS_CLEAR;
+
+		if ((svc = malloc(sizeof(struct dvbcad_service))) == NULL)
+			return -ENOMEM;
+		memset(svc, 0, sizeof(struct dvbcad_service));
+		svc->program_number = *program_number;
+		svc->version = pmt->head.version_number;
+		memcpy(svc->pmt, buf, size);
+		svc->pmt_size = size;
+		memcpy(svc->decoded, tmp, size);
+		svc->section = (struct mpeg_pmt_section *) svc->decoded;
+		memcpy(svc->caids, caids, caid_count * sizeof(uint16_t));
+		svc->caid_count = caid_count;
+		svc->users = 1;
+		svc->state = SERVICE_WAITING;
+		svc->status = DVBCAD_STATUS_PENDING;
+		svc->status_cam = DVBCAD_NO_CAM;
+		svc->next = services;
+		services = svc;
+
+		service_allocate(svc);
+		*cam_index = svc->status_cam;
+		return svc->status;
+	}
+
+	// a PMT sent again unchanged only needs answering
+	if ((size == svc->pmt_size) && (!memcmp(buf, svc->pmt, size))) {
+		if (new_user)
+			svc->users++;
+		*cam_index = svc->status_cam;
+		return svc->status;
+	}
+
+	// A PMT can't change without a new version, so this one is from another
+	// multiplex, with a program of the same number. Services are only known
+	// by program number (as they are to a CAM), so it can't be taken as well.
+	// Only the clients already holding a program may update it: a new one
+	// sending another version is as likely to be on another multiplex.
+	if (new_user || (pmt->head.version_number == svc->version)) {
+		*cam_index = DVBCAD_NO_CAM;
+		return -EBUSY;
+	}
+
+	svc->version = pmt->head.version_number;
+	memcpy(svc->pmt, buf, size);
+	svc->pmt_size = size;
+	memcpy(svc->decoded, tmp, size);
+	svc->section = (struct mpeg_pmt_section *) svc->decoded;
+	memcpy(svc->caids, caids, caid_count * sizeof(uint16_t));
+	svc->caid_count = caid_count;
+
+	switch(svc->state) {
+	case SERVICE_WAITING:
+		service_allocate(svc);
+		break;
+
+	case SERVICE_QUERYING:
+		gettimeofday(&svc->query_sent, NULL);
+		svc->cam->queries++;
+		send_capmt(svc, svc->cam, CA_LIST_MANAGEMENT_UPDATE, CA_PMT_CMD_ID_QUERY);
+		break;
+
+	case SERVICE_DESCRAMBLING:
+		send_capmt(svc, svc->cam, CA_LIST_MANAGEMENT_UPDATE, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+		break;
+	}
+
+	// the client was told of any change along with the others holding it
+	if (notified)
+		return DVBCAD_STATUS_PENDING;
+	*cam_index = svc->status_cam;
+	return svc->status;
+}
+
+void dvbcad_service_release(uint16_t program_number)
+{
+	struct dvbcad_service *svc = find_service(program_number);
+	struct dvbcad_service **pprev;
+
+	if (svc == NULL)
+		return;
+	if (--svc->users > 0)
+		return;
+
+	if (svc->cam)
+		service_detach(svc);
+
+	pprev = &services;
+	while(*pprev != svc)
+		pprev = &(*pprev)->next;
+	*pprev = svc->next;
+	free(svc);
+
+	// it may have made room for another
+	retry_waiting();
+}
+
+void dvbcad_service_cam_ready(struct dvbcad_cam *cam)
+{
+	struct dvbcad_service *svc;
+
+	// a CAM reinserted into a slot may not be the one which refused before
+	for(svc = services; svc; svc = svc->next)
+		svc->refused_by &= ~(1U << cam->index);
+
+	// a CAM which has been reset has forgotten its list
+	send_list(cam);
+	retry_waiting();
+}
+
+void dvbcad_service_cam_gone(struct dvbcad_cam *cam)
+{
+	struct dvbcad_service *svc;
+
+	for(svc = services; svc; svc = svc->next) {
+		if (svc->cam != cam)
+			continue;
+
+		svc->cam = NULL;
+		cam->services--;
+		svc->state = SERVICE_WAITING;
+	}
+
+	retry_waiting();
+}
+
+void dvbcad_service_reply(struct dvbcad_cam *cam, uint16_t program_number,
+			  int ca_enable, struct timeval *when)
+{
+	struct dvbcad_service *svc = find_service(program_number);
+
+	// replies to queries superseded by something else are ignored
+	if ((svc == NULL) || (svc->cam != cam) || (svc->state != SERVICE_QUERYING))
+		return;
+
+	uint32_t latency = ((when->tv_sec - svc->query_sent.tv_sec) * 1000000) +
+			   (when->tv_usec - svc->query_sent.tv_usec);
+	cam->latency_total_us += latency;
+	if (latency > cam->latency_max_us)
+		cam->latency_max_us = latency;
+
+	switch(ca_enable) {
+	case CA_ENABLE_DESCRAMBLING_POSSIBLE:
+	case CA_ENABLE_DESCRAMBLING_POSSIBLE_PURCHASE:
+	case CA_ENABLE_DESCRAMBLING_POSSIBLE_TECHNICAL:
+		service_descramble(svc);
+		break;
+
+	default:
+		// try another CAM
+		cam->refused++;
+		svc->refused_by |= 1U << cam->index;
+		service_detach(svc);
+		service_allocate(svc);
+		break;
+	}
+}
+
+void dvbcad_service_tick(void)
+{
+	struct dvbcad_service *svc;
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	for(svc = services; svc; svc = svc->next) {
+		if (svc->state != SERVICE_QUERYING)
+			continue;
+
+		int elapsed_ms = ((now.tv_sec - svc->query_sent.tv_sec) * 1000) +
+				 ((now.tv_usec - svc->query_sent.tv_usec) / 1000);
+		if (elapsed_ms < params.query_timeout_ms)
+			continue;
+
+		// plenty of CAMs never answer queries
+		svc->cam->timeouts++;
+		service_descramble(svc);
+	}
+}
+
+void dvbcad_service_dump(FILE *out)
+{
+	static const char *states[] = { "waiting", "querying", "descrambling" };
+	struct dvbcad_service *svc;
+	int i;
+
+	for(svc = services; svc; svc = svc->next) {
+		fprintf(out, "program %u: version %u users %i %s", svc->program_number,
+			svc->version, svc->users, states[svc->state]);
+		if (svc->cam)
+			fprintf(out, " cam %i", svc->cam->index);
+		else if (svc->status < 0)
+			fprintf(out, " (%s)", strerror(-svc->status));
+		fprintf(out, " caids");
+		for(i=0; i < svc->caid_count; i++)
+			fprintf(out, " %04x", svc->caids[i]);
+		fprintf(out, "\n");
+	}
+
+	if (capmt_cache) {
+		uint32_t hits, misses;
+		en50221_ca_pmt_cache_get_stats(capmt_cache, &hits, &misses);
+		fprintf(out, "CA PMT cache: %u hits %u misses\n", hits, misses);
+	}
+}
+
+/*
+ * Give a service to the least loaded ready CAM which handles its CA systems,
+ * has room for it, and has not refused it.
+ */
+static void service_allocate(struct dvbcad_service *svc)
+{
+	struct dvbcad_cam *best = NULL;
+	int full = 0;
+	int refused = 0;
+	int i;
+
+	for(i=0; i < dvbcad_cam_count(); i++) {
+		struct dvbcad_cam *cam = dvbcad_cam_get(i);
+
+		if ((!cam->ready) || (!dvbcad_cam_supports(cam, svc->caids, svc->caid_count)))
+			continue;
+		if (svc->refused_by & (1U << i)) {
+			refused = 1;
+			continue;
+		}
+		if (cam->services >= cam->max_services) {
+			full = 1;
+			continue;
+		}
+		if ((best == NULL) || (cam->services < best->services))
+			best = cam;
+	}
+
+	if (best == NULL) {
+		svc->state = SERVICE_WAITING;
+		if (full)
+			service_set_status(svc, -ENOSPC);
+		else if (refused)
+			service_set_status(svc, -EACCES);
+		else
+			service_set_status(svc, -ENOENT);
+		return;
+	}
+
+	// the first service on a CAM replaces whatever list it may have
+	uint8_t list_management = best->services ? CA_LIST_MANAGEMENT_ADD : CA_LIST_MANAGEMENT_ONLY;
+	svc->cam = best;
+	best->services++;
+
+	if (params.query) {
+		svc->state = SERVICE_QUERYING;
+		gettimeofday(&svc->query_sent, NULL);
+		best->queries++;
+		send_capmt(svc, best, list_management, CA_PMT_CMD_ID_QUERY);
+		service_set_status(svc, DVBCAD_STATUS_PENDING);
+	} else {
+		svc->state = SERVICE_DESCRAMBLING;
+		send_capmt(svc, best, list_management, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+		service_set_status(svc, DVBCAD_STATUS_DESCRAMBLING);
+	}
+}
+
+/*
+ * Take a service off its CAM. The CAM is sent the list of the services it
+ * still has, or told to stop descrambling if there are none.
+ */
+static void service_detach(struct dvbcad_service *svc)
+{
+	struct dvbcad_cam *cam = svc->cam;
+
+	svc->cam = NULL;
+	svc->state = SERVICE_WAITING;
+	cam->services--;
+
+	if (!cam->ready)
+		return;
+	if (cam->services)
+		send_list(cam);
+	else
+		send_capmt(svc, cam, CA_LIST_MANAGEMENT_ONLY, CA_PMT_CMD_ID_NOT_SELECTED);
+}
+
+static void service_descramble(struct dvbcad_service *svc)
+{
+	svc->state = SERVICE_DESCRAMBLING;
+	send_capmt(svc, svc->cam, CA_LIST_MANAGEMENT_UPDATE, CA_PMT_CMD_ID_OK_DESCRAMBLING);
+	service_set_status(svc, DVBCAD_STATUS_DESCRAMBLING);
+}
+
+static void service_set_status(struct dvbcad_service *svc, int status)
+{
+	int cam_index = svc->cam ? svc->cam->index : DVBCAD_NO_CAM;
+
+	if ((status == svc->status) && (cam_index == svc->status_cam))
+		return;
+	svc->status = status;
+	svc->status_cam = cam_index;
+
+	if (status != DVBCAD_STATUS_PENDING) {
+		dvbcad_notify(svc->program_number, status, cam_index);
+		notified = 1;
+	}
+}
+
+static void retry_waiting(void)
+{
+	struct dvbcad_service *svc;
+
+	for(svc = services; svc; svc = svc->next) {
+		if (svc->state == SERVICE_WAITING)
+			service_allocate(svc);
+	}
+}
+
+/*
+ * Send a CAM the complete list of its services.
+ */
+static void send_list(struct dvbcad_cam *cam)
+{
+	struct dvbcad_service *svc;
+	int sent = 0;
+
+	if (!cam->ready)
+		return;
+
+	for(svc = services; svc; svc = svc->next) {
+		if (svc->cam != cam)
+			continue;
+
+		uint8_t list_management;
+		if (cam->services == 1)
+			list_management = CA_LIST_MANAGEMENT_ONLY;
+		else if (sent == 0)
+			list_management = CA_LIST_MANAGEMENT_FIRST;
+		else if (sent == (cam->services - 1))
+			list_management = CA_LIST_MANAGEMENT_LAST;
+		else
+			list_management = CA_LIST_MANAGEMENT_MORE;
+
+		send_capmt(svc, cam, list_management,
+			   (svc->state == SERVICE_QUERYING) ? CA_PMT_CMD_ID_QUERY : CA_PMT_CMD_ID_OK_DESCRAMBLING);
+		sent++;
+	}
+}
+
+static int send_capmt(struct dvbcad_service *svc, struct dvbcad_cam *cam,
+		      uint8_t list_management, uint8_t cmd_id)
+{
+	uint8_t capmt[MAX_CAPMT_SIZE];
+	int size;
+
+	// the CAM is only sent the CA descriptors of its own CA systems
+	if (capmt_cache)
+		size = en50221_ca_pmt_cache_format(capmt_cache, svc->section,
+						   cam->caids, cam->caid_count,
+						   capmt, sizeof(capmt),
+						   list_management, cmd_id);
+	else
+		size = en50221_ca_format_pmt(svc->section, capmt, sizeof(capmt), params.moveca,
+					     list_management, cmd_id);
+	if (size < 0) {
+		fprintf(stderr, "Failed to format PMT of program %u\n", svc->program_number);
+		return -1;
+	}
+	if (dvbcad_cam_send(cam, capmt, size)) {
+		fprintf(stderr, "Failed to send PMT of program %u to CAM %i\n", svc->program_number, cam->index);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct mpeg_pmt_section *decode_pmt(uint8_t *buf, int size)
+{
+	struct section *section;
+	struct section_ext *section_ext;
+
+	if ((section = section_codec(buf, size)) == NULL)
+		return NULL;
+	if (section->table_id != stag_mpeg_program_map)
+		return NULL;
+	if ((section_ext = section_ext_decode(section, 1)) == NULL)
+		return NULL;
+
+	return mpeg_pmt_section_codec(section_ext);
+}
+
+static void add_caid(struct descriptor *d, uint16_t *caids, int *caid_count)
+{
+	uint8_t *buf = (uint8_t *) d;
+	uint16_t ca_system_id;
+	int i;
+
+	if ((d->tag != dtag_mpeg_ca) || (d->len < 2))
+		return;
+
+	// not decoded with mpeg_ca_descriptor_codec(), which would swap it in place
+	ca_system_id = (buf[2] << 8) | buf[3];
+	for(i=0; i < *caid_count; i++) {
+		if (caids[i] == ca_system_id)
+			return;
+	}
+	if (*caid_count < MAX_SERVICE_CAIDS)
+		caids[(*caid_count)++] = ca_system_id;
+}
+
+static void get_caids(struct mpeg_pmt_section *pmt, uint16_t *caids, int *caid_count)
+{
+	struct descriptor *d;
+	struct mpeg_pmt_stream *stream;
+
+	*caid_count = 0;
+	mpeg_pmt_section_descriptors_for_each(pmt, d) {
+		add_caid(d, caids, caid_count);
+	}
+	mpeg_pmt_section_streams_for_each(pmt, stream) {
+		mpeg_pmt_stream_descriptors_for_each(stream, d) {
+			add_caid(d, caids, caid_count);
+		}
+	}
+}
+
+static struct dvbcad_service *find_service(uint16_t program_number)
+{
+	struct dvbcad_service *svc;
+
+	for(svc = services; svc; svc = svc->next) {
+		if (svc->program_number == program_number)
+			return svc;
+	}
+
+	return NULL;
+}
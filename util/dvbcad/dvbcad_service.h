@@ -0,0 +1,104 @@
+/*
+	dvbcad utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef DVBCAD_SERVICE_H
+#define DVBCAD_SERVICE_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "dvbcad_cam.h"
+
+/* returned by dvbcad_service_pmt() while a CAM is still being asked */
+#define DVBCAD_STATUS_PENDING 2
+
+struct dvbcad_service_params {
+	int moveca;		/* move CA descriptors to programme level */
+	int query;		/* ask a CAM before having it descramble */
+	int query_timeout_ms;	/* after which a CAM which did not answer is assumed willing */
+};
+
+/**
+ * Set up the service manager.
+ *
+ * @param params Parameters to use.
+ */
+extern void dvbcad_service_init(struct dvbcad_service_params *params);
+
+/**
+ * Handle a PMT sent by a client. A program seen for the first time is
+ * allocated a CAM; a new version of one already known updates its CAM.
+ *
+ * @param buf The raw PMT section.
+ * @param size Its size in bytes.
+ * @param new_user Non-zero if the client did not already hold the program.
+ * @param program_number Set to the program number of the PMT.
+ * @param cam_index Set to the index of the CAM descrambling it, or DVBCAD_NO_CAM.
+ * @return One of the DVBCAD_STATUS_*, or a negative errno. With
+ * DVBCAD_STATUS_PENDING, the final status will be passed to dvbcad_notify().
+ */
+extern int dvbcad_service_pmt(uint8_t *buf, int size, int new_user,
+			      uint16_t *program_number, int *cam_index);
+
+/**
+ * Release a program held by a client. When the last client releases it, it is
+ * removed from its CAM.
+ *
+ * @param program_number The program concerned.
+ */
+extern void dvbcad_service_release(uint16_t program_number);
+
+/**
+ * A CAM has become ready to take CA PMTs (again).
+ *
+ * @param cam The CAM.
+ */
+extern void dvbcad_service_cam_ready(struct dvbcad_cam *cam);
+
+/**
+ * A CAM has been removed or reset.
+ *
+ * @param cam The CAM.
+ */
+extern void dvbcad_service_cam_gone(struct dvbcad_cam *cam);
+
+/**
+ * A CAM has answered a CA PMT query.
+ *
+ * @param cam The CAM.
+ * @param program_number The program concerned.
+ * @param ca_enable CA_enable value of the reply.
+ * @param when Time the reply was received.
+ */
+extern void dvbcad_service_reply(struct dvbcad_cam *cam, uint16_t program_number,
+				 int ca_enable, struct timeval *when);
+
+/**
+ * Handle timeouts; to be called regularly.
+ */
+extern void dvbcad_service_tick(void);
+
+/**
+ * Print every service.
+ *
+ * @param out Where to print them.
+ */
+extern void dvbcad_service_dump(FILE *out);
+
+#endif
@@ -8,15 +8,23 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <time.h>
-#include <sys/poll.h>
-#include <sys/time.h>
 #include <string.h>
+#include <errno.h>
 #include <limits.h>
 #include <libdvbapi/dvbdemux.h>
+#include <libucsi/transport_sync.h>
+#include "dvbtraffic_stats.h"
 
-#define BSIZE 188
+#define DEFAULT_BLOCK_SIZE (4 * 1024 * 1024)
 
-static int pidt[0x2001];
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+#define OUTPUT_CSV  2
+
+static struct dvbtraffic traffic;
+static struct transport_sync tsync;
+static uint64_t last_sync_losses;
+static int output_format = OUTPUT_TEXT;
 
 static void usage(FILE *output)
 {
@@ -25,126 +33,289 @@ static void usage(FILE *output)
 		"Options:\n"
 		"	-a N	use dvb adapter N\n"
 		"	-d N	use demux N\n"
+		"	-f FILE	read a transport stream from FILE instead (- for stdin)\n"
+		"	-s STR	only count packets containing STR (may be repeated)\n"
+		"	-o FMT	output format: text (default), json or csv\n"
+		"	-i SECS	reporting interval in seconds (default 1)\n"
+		"	-b KB	read block size in kilobytes (default 4096)\n"
 		"	-h	display this help\n");
 }
 
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void desync(void *arg, uint64_t offset)
+{
+	(void) arg;
+	fprintf(stderr, "dvbtraffic: lost sync at offset %llu\n", (unsigned long long) offset);
+}
+
+static void report_text(double elapsed)
+{
+	int searching = traffic.search != NULL;
+	uint64_t total = searching ? traffic.matches : traffic.packets;
+	int pid;
+
+	for (pid = 0; pid <= DVBTRAFFIC_PIDS; pid++) {
+		double count;
+
+		if (pid == DVBTRAFFIC_PIDS)
+			count = total;
+		else if (searching)
+			count = traffic.pids[pid].matches;
+		else
+			count = traffic.pids[pid].packets;
+		if (count == 0)
+			continue;
+
+		printf("%04x %5d p/s %5d kb/s %5d kbit\n",
+		       pid,
+		       (int) (count / elapsed),
+		       (int) (count / elapsed * 188 / 1024),
+		       (int) (count / elapsed * 8 * 188 / 1000));
+	}
+	printf("-PID--FREQ-----BANDWIDTH-BANDWIDTH-\n");
+}
+
+static void report_json(double time, double elapsed)
+{
+	int first = 1;
+	int pid;
+
+	printf("{\"time\":%.3f,\"interval\":%.3f,\"packets\":%llu,\"kbit\":%.1f,\"sync_losses\":%llu,\"pids\":[",
+	       time, elapsed, (unsigned long long) traffic.packets,
+	       traffic.packets / elapsed * 8 * 188 / 1000,
+	       (unsigned long long) (tsync.sync_losses - last_sync_losses));
+
+	for (pid = 0; pid < DVBTRAFFIC_PIDS; pid++) {
+		struct dvbtraffic_pid *p = &traffic.pids[pid];
+		struct dvbtraffic_pcr *pcr = &traffic.pcrs[pid];
+
+		if (p->packets == 0)
+			continue;
+
+		printf("%s{\"pid\":%d,\"packets\":%u,\"pps\":%.1f,\"kbit\":%.1f,"
+		       "\"cc_errors\":%u,\"te_errors\":%u,\"scrambled\":%.3f",
+		       first ? "" : ",", pid, p->packets,
+		       p->packets / elapsed, p->packets / elapsed * 8 * 188 / 1000,
+		       p->cc_errors, p->te_errors, (double) p->scrambled / p->packets);
+		if (traffic.search)
+			printf(",\"matches\":%u", p->matches);
+		if (pcr->count)
+			printf(",\"pcrs\":%u,\"pcr_jitter_ns\":%u,\"pcr_interval_ms\":%u",
+			       pcr->count, pcr->jitter_max, pcr->interval_max);
+		printf("}");
+		first = 0;
+	}
+	printf("]}\n");
+}
+
+static void report_csv(double time, double elapsed)
+{
+	static int header;
+	int pid;
+
+	if (!header) {
+		printf("time,pid,packets,pps,kbit,cc_errors,te_errors,scrambled,matches,"
+		       "pcrs,pcr_jitter_ns,pcr_interval_ms\n");
+		header = 1;
+	}
+
+	for (pid = 0; pid < DVBTRAFFIC_PIDS; pid++) {
+		struct dvbtraffic_pid *p = &traffic.pids[pid];
+		struct dvbtraffic_pcr *pcr = &traffic.pcrs[pid];
+
+		if (p->packets == 0)
+			continue;
+
+		printf("%.3f,%d,%u,%.1f,%.1f,%u,%u,%.3f,%u,%u,%u,%u\n",
+		       time, pid, p->packets,
+		       p->packets / elapsed, p->packets / elapsed * 8 * 188 / 1000,
+		       p->cc_errors, p->te_errors, (double) p->scrambled / p->packets,
+		       p->matches, pcr->count, pcr->jitter_max, pcr->interval_max);
+	}
+}
+
+static void report(double time, double elapsed)
+{
+	if (elapsed <= 0)
+		elapsed = 1e-6;
+
+	switch (output_format) {
+	case OUTPUT_TEXT:
+		report_text(elapsed);
+		break;
+	case OUTPUT_JSON:
+		report_json(time, elapsed);
+		break;
+	case OUTPUT_CSV:
+		report_csv(time, elapsed);
+		break;
+	}
+	fflush(stdout);
+
+	dvbtraffic_next_interval(&traffic);
+	last_sync_losses = tsync.sync_losses;
+}
+
 int main(int argc, char **argv)
 {
-	struct timeval startt;
+	struct dvbtraffic_search search;
 	int adapter = 0, demux = 0;
-	char *search = NULL;
-	int fd, ffd, packets = 0;
+	char *filename = NULL;
+	double interval = 1.0;
+	int block_size = DEFAULT_BLOCK_SIZE;
+	uint8_t *buffer;
+	int fd, ffd = -1;
+	int have = 0;
+	uint64_t total = 0;
+	double start, last;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "a:d:hs:")) != -1) {
+	memset(&search, 0, sizeof(search));
+
+	while ((opt = getopt(argc, argv, "a:b:d:f:hi:o:s:")) != -1) {
 		switch (opt) {
 		case 'a':
 			adapter = atoi(optarg);
 			break;
+		case 'b':
+			block_size = atoi(optarg) * 1024;
+			break;
 		case 'd':
 			demux = atoi(optarg);
 			break;
+		case 'f':
+			filename = optarg;
+			break;
 		case 'h':
 			usage(stdout);
 			exit(0);
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text"))
+				output_format = OUTPUT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				output_format = OUTPUT_JSON;
+			else if (!strcmp(optarg, "csv"))
+				output_format = OUTPUT_CSV;
+			else {
+				usage(stderr);
+				exit(1);
+			}
+			break;
 		case 's':
-			search = strdup(optarg);
+			if (dvbtraffic_search_add(&search, (uint8_t *) optarg, strlen(optarg))) {
+				fprintf(stderr, "dvbtraffic: Invalid search string\n");
+				exit(1);
+			}
 			break;
 		default:
 			usage(stderr);
 			exit(1);
 		}
 	}
-
-	// open the DVR device
-	fd = dvbdemux_open_dvr(adapter, demux, 1, 0);
-	if (fd < 0) {
- 		fprintf(stderr, "dvbtraffic: Could not open dvr device: %m\n");
+	if ((block_size < 188 * 8) || (interval <= 0)) {
+		usage(stderr);
 		exit(1);
 	}
-	dvbdemux_set_buffer(fd, 1024 * 1024);
 
-	ffd = dvbdemux_open_demux(adapter, demux, 0);
-	if (ffd < 0) {
-		fprintf(stderr, "dvbtraffic: Could not open demux device: %m\n");
-		exit(1);
+	if (filename) {
+		// read from a file or stdin
+		if (!strcmp(filename, "-")) {
+			fd = 0;
+		} else if ((fd = open(filename, O_RDONLY)) < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open %s: %m\n", filename);
+			exit(1);
+		}
+	} else {
+		// open the DVR device
+		fd = dvbdemux_open_dvr(adapter, demux, 1, 0);
+		if (fd < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open dvr device: %m\n");
+			exit(1);
+		}
+		dvbdemux_set_buffer(fd, block_size * 2);
+
+		ffd = dvbdemux_open_demux(adapter, demux, 0);
+		if (ffd < 0) {
+			fprintf(stderr, "dvbtraffic: Could not open demux device: %m\n");
+			exit(1);
+		}
+
+		if (dvbdemux_set_pid_filter(ffd, -1, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
+			perror("dvbdemux_set_pid_filter");
+			return -1;
+		}
 	}
 
-	if (dvbdemux_set_pid_filter(ffd, -1, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
-		perror("dvbdemux_set_pid_filter");
-		return -1;
+	buffer = malloc(block_size);
+	if (buffer == NULL) {
+		fprintf(stderr, "dvbtraffic: Out of memory\n");
+		exit(1);
 	}
 
-	gettimeofday(&startt, 0);
+	dvbtraffic_init(&traffic, search.count ? &search : NULL);
+	transport_sync_init(&tsync, 0, desync, NULL);
+	start = last = now();
 
 	while (1) {
-		unsigned char buffer[BSIZE];
-		int pid, ok;
+		int consumed, len;
 		ssize_t r;
+		double t;
 
-		if ((r = read(fd, buffer, BSIZE)) <= 0) {
+		if ((r = read(fd, buffer + have, block_size - have)) < 0) {
+			if (errno == EOVERFLOW) {
+				fprintf(stderr, "dvbtraffic: DVR buffer overflow\n");
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
 			perror("read");
 			break;
 		}
-		if (r != BSIZE) {
-			fprintf(stderr, "dvbtraffic: only read %zd bytes\n", r);
+		if (r == 0)
 			break;
-		}
-		if (buffer[0] != 0x47) {
-			continue;
-			printf("desync (%x)\n", buffer[0]);
-			while (buffer[0] != 0x47)
-				read(fd, buffer, 1);
-			continue;
-		}
-		ok = 1;
-		pid = ((((unsigned) buffer[1]) << 8) |
-		       ((unsigned) buffer[2])) & 0x1FFF;
-
-		if (search) {
-			int i, sl = strlen(search);
-			ok = 0;
-			if (pid != 0x1fff) {
-				for (i = 0; i < (188 - sl); ++i) {
-					if (!memcmp(buffer + i, search, sl))
-						ok = 1;
-				}
-			}
-		}
+		have += r;
+		total += r;
 
-		if (ok) {
-			pidt[pid]++;
-			pidt[0x2000]++;
-		}
+		// realign the data, dropping anything outside sync
+		len = transport_sync_process(&tsync, buffer, have, &consumed);
+		dvbtraffic_feed(&traffic, buffer, len);
 
-		packets++;
-
-		if (!(packets & 0xFF)) {
-			struct timeval now;
-			int diff;
-			gettimeofday(&now, 0);
-			diff =
-			    (now.tv_sec - startt.tv_sec) * 1000 +
-			    (now.tv_usec - startt.tv_usec) / 1000;
-			if (diff > 1000) {
-				int _pid = 0;
-				for (_pid = 0; _pid < 0x2001; _pid++) {
-					if (pidt[_pid]) {
-						printf("%04x %5d p/s %5d kb/s %5d kbit\n",
-						     _pid,
-						     pidt[_pid] * 1000 / diff,
-						     pidt[_pid] * 1000 / diff * 188 / 1024,
-						     pidt[_pid] * 8 * 1000 / diff * 188 / 1000);
-					}
-					pidt[_pid] = 0;
-				}
-				printf("-PID--FREQ-----BANDWIDTH-BANDWIDTH-\n");
-				startt = now;
-			}
+		// keep any partial packet for the next read
+		memmove(buffer, buffer + consumed, have - consumed);
+		have -= consumed;
+
+		t = now();
+		if ((t - last) >= interval) {
+			report(t - start, t - last);
+			last = t;
 		}
 	}
 
-	close(ffd);
+	// report the final partial interval
+	if (filename) {
+		double t = now();
+
+		if (traffic.packets)
+			report(t - start, t - last);
+		fprintf(stderr, "dvbtraffic: %llu bytes in %.3f s (%.1f MB/s), %llu sync losses\n",
+			(unsigned long long) total, t - start, total / (t - start) / 1e6,
+			(unsigned long long) tsync.sync_losses);
+	}
+
+	dvbtraffic_search_free(&search);
+	free(buffer);
+	if (ffd >= 0)
+		close(ffd);
 	close(fd);
 	return 0;
 }
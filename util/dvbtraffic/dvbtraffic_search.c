@@ -0,0 +1,78 @@
+/* This file is released into the public domain by its authors */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dvbtraffic_search.h"
+
+int dvbtraffic_search_add(struct dvbtraffic_search *search,
+			  const uint8_t *pattern, int len)
+{
+	struct dvbtraffic_pattern *patterns;
+	struct dvbtraffic_pattern *p;
+	int i;
+
+	if ((len < 1) || (len > 188))
+		return -1;
+
+	patterns = realloc(search->patterns,
+			   (search->count + 1) * sizeof(struct dvbtraffic_pattern));
+	if (patterns == NULL)
+		return -1;
+	search->patterns = patterns;
+
+	p = &patterns[search->count];
+	p->data = malloc(len);
+	if (p->data == NULL)
+		return -1;
+	memcpy(p->data, pattern, len);
+	p->len = len;
+
+	// distance from the last occurrence of each byte to the end of the pattern
+	memset(p->shift, len, sizeof(p->shift));
+	for (i = 0; i < len - 1; i++)
+		p->shift[pattern[i]] = len - 1 - i;
+
+	search->count++;
+	return 0;
+}
+
+static int dvbtraffic_search_horspool(struct dvbtraffic_pattern *p,
+				      const uint8_t *buf, int len)
+{
+	const uint8_t *end = buf + len - p->len;
+	uint8_t last = p->data[p->len - 1];
+
+	while (buf <= end) {
+		uint8_t c = buf[p->len - 1];
+
+		if ((c == last) && !memcmp(buf, p->data, p->len - 1))
+			return 1;
+		buf += p->shift[c];
+	}
+
+	return 0;
+}
+
+int dvbtraffic_search_match(struct dvbtraffic_search *search,
+			    const uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < search->count; i++) {
+		if (dvbtraffic_search_horspool(&search->patterns[i], buf, len))
+			return 1;
+	}
+
+	return 0;
+}
+
+void dvbtraffic_search_free(struct dvbtraffic_search *search)
+{
+	int i;
+
+	for (i = 0; i < search->count; i++)
+		free(search->patterns[i].data);
+	free(search->patterns);
+	search->patterns = NULL;
+	search->count = 0;
+}
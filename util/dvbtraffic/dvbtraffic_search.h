@@ -0,0 +1,54 @@
+/* This file is released into the public domain by its authors */
+
+#ifndef DVBTRAFFIC_SEARCH_H
+#define DVBTRAFFIC_SEARCH_H 1
+
+#include <stdint.h>
+
+/**
+ * A compiled search pattern, with its Boyer-Moore-Horspool shift table.
+ */
+struct dvbtraffic_pattern {
+	uint8_t *data;
+	int len;
+	uint8_t shift[256];
+};
+
+/**
+ * A set of patterns searched for in every packet.
+ */
+struct dvbtraffic_search {
+	struct dvbtraffic_pattern *patterns;
+	int count;
+};
+
+/**
+ * Add a pattern to a search set. The set must be zeroed before first use.
+ *
+ * @param search The search set.
+ * @param pattern The pattern bytes.
+ * @param len Length of the pattern, 1 to 188 bytes.
+ * @return 0 on success, or -1 on error.
+ */
+extern int dvbtraffic_search_add(struct dvbtraffic_search *search,
+				 const uint8_t *pattern, int len);
+
+/**
+ * Determine whether any pattern in a search set occurs in a buffer.
+ *
+ * @param search The search set.
+ * @param buf The buffer.
+ * @param len Length of the buffer.
+ * @return 1 if a pattern was found, 0 if not.
+ */
+extern int dvbtraffic_search_match(struct dvbtraffic_search *search,
+				   const uint8_t *buf, int len);
+
+/**
+ * Free the patterns in a search set.
+ *
+ * @param search The search set.
+ */
+extern void dvbtraffic_search_free(struct dvbtraffic_search *search);
+
+#endif
@@ -0,0 +1,164 @@
+/* This file is released into the public domain by its authors */
+
+#include <string.h>
+#include "dvbtraffic_stats.h"
+
+#define PCR_HZ 27000000ULL
+#define PCR_MODULUS ((1ULL << 33) * 300)
+
+/* start a new rate estimate after this long, to follow bitrate changes */
+#define PCR_REBASE (60 * PCR_HZ)
+
+/* estimate the rate over at least this long before measuring jitter */
+#define PCR_SETTLE (PCR_HZ / 10)
+
+static void dvbtraffic_pcr(struct dvbtraffic *traffic, int pid,
+			   const uint8_t *buf, int discontinuity);
+
+
+void dvbtraffic_init(struct dvbtraffic *traffic, struct dvbtraffic_search *search)
+{
+	int pid;
+
+	memset(traffic, 0, sizeof(struct dvbtraffic));
+	for (pid = 0; pid < DVBTRAFFIC_PIDS; pid++)
+		traffic->pids[pid].cc = DVBTRAFFIC_NO_CC;
+	traffic->search = search;
+}
+
+void dvbtraffic_feed(struct dvbtraffic *traffic, const uint8_t *buf, int len)
+{
+	traffic->packets += len / 188;
+
+	for (; len >= 188; buf += 188, len -= 188, traffic->position += 188) {
+		int pid = ((buf[1] & 0x1f) << 8) | buf[2];
+		struct dvbtraffic_pid *p = &traffic->pids[pid];
+		uint8_t flags = buf[3];
+		int discontinuity = 0;
+
+		p->packets++;
+
+		// the rest of the header can't be trusted
+		if (buf[1] & 0x80) {
+			p->te_errors++;
+			continue;
+		}
+
+		if (flags & 0xc0)
+			p->scrambled++;
+
+		if (pid == 0x1fff)
+			continue;
+
+		if (traffic->search && dvbtraffic_search_match(traffic->search, buf, 188)) {
+			p->matches++;
+			traffic->matches++;
+		}
+
+		// adaptation field: discontinuity_indicator and PCR
+		if ((flags & 0x20) && buf[4]) {
+			discontinuity = buf[5] & 0x80;
+			if ((buf[5] & 0x10) && (buf[4] >= 7))
+				dvbtraffic_pcr(traffic, pid, buf + 6, discontinuity);
+		}
+
+		// continuity_counter only advances on packets with a payload, and
+		// a single duplicate packet is allowed
+		if (flags & 0x10) {
+			uint8_t cc = flags & 0x0f;
+
+			if ((p->cc != DVBTRAFFIC_NO_CC) && !discontinuity) {
+				if (cc == p->cc) {
+					if (p->dup)
+						p->cc_errors++;
+					p->dup = 1;
+				} else {
+					if (cc != ((p->cc + 1) & 0x0f))
+						p->cc_errors++;
+					p->dup = 0;
+				}
+			} else {
+				p->dup = 0;
+			}
+			p->cc = cc;
+		}
+	}
+}
+
+void dvbtraffic_next_interval(struct dvbtraffic *traffic)
+{
+	int pid;
+
+	for (pid = 0; pid < DVBTRAFFIC_PIDS; pid++) {
+		struct dvbtraffic_pid *p = &traffic->pids[pid];
+		struct dvbtraffic_pcr *pcr = &traffic->pcrs[pid];
+
+		p->packets = 0;
+		p->matches = 0;
+		p->scrambled = 0;
+		p->cc_errors = 0;
+		p->te_errors = 0;
+
+		pcr->count = 0;
+		pcr->jitter_max = 0;
+		pcr->interval_max = 0;
+	}
+	traffic->packets = 0;
+	traffic->matches = 0;
+}
+
+static void dvbtraffic_pcr(struct dvbtraffic *traffic, int pid,
+			   const uint8_t *buf, int discontinuity)
+{
+	struct dvbtraffic_pcr *p = &traffic->pcrs[pid];
+	uint64_t pos = traffic->position;
+	uint64_t pcr;
+	uint64_t delta;
+	uint64_t span;
+
+	pcr = (((uint64_t) buf[0] << 25) |
+	       ((uint64_t) buf[1] << 17) |
+	       ((uint64_t) buf[2] << 9) |
+	       ((uint64_t) buf[3] << 1) |
+	       (buf[4] >> 7)) * 300;
+	pcr += ((buf[4] & 1) << 8) | buf[5];
+
+	p->count++;
+
+	if ((!p->valid) || discontinuity)
+		goto rebase;
+
+	// a gap of over a second is an unsignalled discontinuity
+	delta = (pcr + PCR_MODULUS - p->last_pcr) % PCR_MODULUS;
+	if (delta > PCR_HZ)
+		goto rebase;
+	if ((delta / 27000) > p->interval_max)
+		p->interval_max = delta / 27000;
+
+	span = (p->last_pcr + PCR_MODULUS - p->base_pcr) % PCR_MODULUS;
+	if ((span >= PCR_SETTLE) && (p->last_pos > p->base_pos)) {
+		double expected = (double) span * (pos - p->base_pos) / (p->last_pos - p->base_pos);
+		double actual = (double) ((pcr + PCR_MODULUS - p->base_pcr) % PCR_MODULUS);
+		double jitter = (actual > expected) ? actual - expected : expected - actual;
+
+		jitter = jitter * 1000 / 27;
+		if (jitter > 4e9)
+			jitter = 4e9;
+		if (jitter > p->jitter_max)
+			p->jitter_max = jitter;
+
+		if (span >= PCR_REBASE) {
+			p->base_pcr = p->last_pcr;
+			p->base_pos = p->last_pos;
+		}
+	}
+
+	p->last_pcr = pcr;
+	p->last_pos = pos;
+	return;
+
+rebase:
+	p->base_pcr = p->last_pcr = pcr;
+	p->base_pos = p->last_pos = pos;
+	p->valid = 1;
+}
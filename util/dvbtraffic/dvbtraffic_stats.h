@@ -0,0 +1,80 @@
+/* This file is released into the public domain by its authors */
+
+#ifndef DVBTRAFFIC_STATS_H
+#define DVBTRAFFIC_STATS_H 1
+
+#include <stdint.h>
+#include "dvbtraffic_search.h"
+
+#define DVBTRAFFIC_PIDS 0x2000
+
+#define DVBTRAFFIC_NO_CC 0xff
+
+/**
+ * Per PID counters, touched for every packet. Kept small so the whole table
+ * stays in cache. All counters except cc and dup cover the current interval.
+ */
+struct dvbtraffic_pid {
+	uint32_t packets;
+	uint32_t matches;		/* packets matching the search patterns */
+	uint32_t scrambled;
+	uint32_t cc_errors;
+	uint32_t te_errors;		/* transport_error_indicator set */
+	uint8_t cc;			/* last continuity_counter, or DVBTRAFFIC_NO_CC */
+	uint8_t dup;			/* last packet was a duplicate */
+};
+
+/**
+ * Per PID PCR state, only touched for packets carrying a PCR.
+ *
+ * Jitter is measured against a constant bitrate interpolation: the rate is
+ * estimated from the PCRs seen so far, and each new PCR is compared with the
+ * value expected from its byte position in the stream.
+ */
+struct dvbtraffic_pcr {
+	uint64_t base_pcr;		/* start of the rate estimate */
+	uint64_t base_pos;
+	uint64_t last_pcr;
+	uint64_t last_pos;
+	int valid;
+
+	uint32_t count;			/* PCRs this interval */
+	uint32_t jitter_max;		/* largest jitter this interval, ns */
+	uint32_t interval_max;		/* largest gap between PCRs this interval, ms */
+};
+
+struct dvbtraffic {
+	struct dvbtraffic_pid pids[DVBTRAFFIC_PIDS];
+	struct dvbtraffic_pcr pcrs[DVBTRAFFIC_PIDS];
+	struct dvbtraffic_search *search;
+	uint64_t position;		/* bytes of packets processed */
+	uint64_t packets;		/* packets this interval */
+	uint64_t matches;		/* matching packets this interval */
+};
+
+/**
+ * Initialise the traffic counters.
+ *
+ * @param traffic The structure to initialise.
+ * @param search Patterns to search for, or NULL.
+ */
+extern void dvbtraffic_init(struct dvbtraffic *traffic, struct dvbtraffic_search *search);
+
+/**
+ * Count a buffer of aligned 188 byte packets.
+ *
+ * @param traffic The traffic counters.
+ * @param buf The packets.
+ * @param len Length of the buffer, a multiple of 188.
+ */
+extern void dvbtraffic_feed(struct dvbtraffic *traffic, const uint8_t *buf, int len);
+
+/**
+ * Clear the counters for the current interval, keeping continuity and PCR
+ * state.
+ *
+ * @param traffic The traffic counters.
+ */
+extern void dvbtraffic_next_interval(struct dvbtraffic *traffic);
+
+#endif
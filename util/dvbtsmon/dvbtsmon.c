@@ -0,0 +1,250 @@
+/*
+	dvbtsmon - check a transport stream against ETSI TR 101 290
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <libdvbapi/dvbdemux.h>
+#include <libucsi/transport_monitor.h>
+
+#define BLOCK_SIZE (188 * 1024 * 4)
+
+#define OUTPUT_TEXT 0
+#define OUTPUT_JSON 1
+
+static int output_format = OUTPUT_TEXT;
+static int quiet = 0;
+static volatile sig_atomic_t quit = 0;
+
+static void usage(FILE *output)
+{
+	fprintf(output,
+		"Usage: dvbtsmon [OPTION]...\n"
+		"Check a transport stream for ETSI TR 101 290 priority 1 and 2 errors.\n"
+		"Options:\n"
+		"	-a N	use dvb adapter N\n"
+		"	-d N	use demux N\n"
+		"	-f FILE	read a transport stream from FILE instead (- for stdin)\n"
+		"	-o FMT	output format: text (default) or json\n"
+		"	-i SECS	print a summary every SECS seconds (default: only at exit)\n"
+		"	-t MS	PID_error timeout in milliseconds (default 5000)\n"
+		"	-q	do not print each error, only the summaries\n"
+		"	-h	display this help\n");
+}
+
+static void signal_handler(int _signal)
+{
+	(void) _signal;
+	quit = 1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void error_cb(void *arg, enum transport_monitor_indicator indicator, int pid, uint64_t time)
+{
+	double t = (double) time / TRANSPORT_MONITOR_HZ;
+	(void) arg;
+
+	if (quiet)
+		return;
+
+	if (output_format == OUTPUT_JSON) {
+		printf("{\"time\":%.3f,\"priority\":%d,\"indicator\":\"%s\",\"pid\":%d}\n",
+		       t, transport_monitor_indicator_priority(indicator),
+		       transport_monitor_indicator_name(indicator), pid);
+	} else if (pid >= 0) {
+		printf("%10.3f  %d.  %-34s pid 0x%04x\n",
+		       t, transport_monitor_indicator_priority(indicator),
+		       transport_monitor_indicator_name(indicator), pid);
+	} else {
+		printf("%10.3f  %d.  %s\n",
+		       t, transport_monitor_indicator_priority(indicator),
+		       transport_monitor_indicator_name(indicator));
+	}
+}
+
+static void summary(struct transport_monitor *monitor)
+{
+	uint64_t time = transport_monitor_time(monitor);
+	int i;
+
+	if (output_format == OUTPUT_JSON) {
+		printf("{\"summary\":true,\"time\":%.3f,\"packets\":%llu",
+		       (double) time / TRANSPORT_MONITOR_HZ,
+		       (unsigned long long) transport_monitor_packets(monitor));
+		for (i = 0; i < TRANSPORT_MONITOR_INDICATORS; i++)
+			printf(",\"%s\":%llu", transport_monitor_indicator_name(i),
+			       (unsigned long long) transport_monitor_count(monitor, i));
+		printf(",\"section_errors\":%llu}\n",
+		       (unsigned long long) transport_monitor_section_errors(monitor));
+	} else {
+		printf("-- %llu packets, %.3f s stream time\n",
+		       (unsigned long long) transport_monitor_packets(monitor),
+		       (double) time / TRANSPORT_MONITOR_HZ);
+		for (i = 0; i < TRANSPORT_MONITOR_INDICATORS; i++)
+			printf("   %d.  %-34s %llu\n",
+			       transport_monitor_indicator_priority(i),
+			       transport_monitor_indicator_name(i),
+			       (unsigned long long) transport_monitor_count(monitor, i));
+		printf("       %-34s %llu\n", "sections discarded",
+		       (unsigned long long) transport_monitor_section_errors(monitor));
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	struct transport_monitor *monitor;
+	int adapter = 0, demux = 0;
+	char *filename = NULL;
+	double interval = 0;
+	int pid_timeout = 5000;
+	uint8_t *buffer;
+	int fd, ffd = -1;
+	int have = 0;
+	double last;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:d:f:hi:o:qt:")) != -1) {
+		switch (opt) {
+		case 'a':
+			adapter = atoi(optarg);
+			break;
+		case 'd':
+			demux = atoi(optarg);
+			break;
+		case 'f':
+			filename = optarg;
+			break;
+		case 'h':
+			usage(stdout);
+			exit(0);
+		case 'i':
+			interval = atof(optarg);
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text"))
+				output_format = OUTPUT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				output_format = OUTPUT_JSON;
+			else {
+				usage(stderr);
+				exit(1);
+			}
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 't':
+			pid_timeout = atoi(optarg);
+			break;
+		default:
+			usage(stderr);
+			exit(1);
+		}
+	}
+
+	if (filename) {
+		// read from a file or stdin
+		if (!strcmp(filename, "-")) {
+			fd = 0;
+		} else if ((fd = open(filename, O_RDONLY)) < 0) {
+			fprintf(stderr, "dvbtsmon: Could not open %s: %m\n", filename);
+			exit(1);
+		}
+	} else {
+		// take the whole multiplex from the DVR device
+		fd = dvbdemux_open_dvr(adapter, demux, 1, 0);
+		if (fd < 0) {
+			fprintf(stderr, "dvbtsmon: Could not open dvr device: %m\n");
+			exit(1);
+		}
+		dvbdemux_set_buffer(fd, BLOCK_SIZE * 2);
+
+		ffd = dvbdemux_open_demux(adapter, demux, 0);
+		if (ffd < 0) {
+			fprintf(stderr, "dvbtsmon: Could not open demux device: %m\n");
+			exit(1);
+		}
+		if (dvbdemux_set_pid_filter(ffd, -1, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
+			fprintf(stderr, "dvbtsmon: Could not set pid filter: %m\n");
+			exit(1);
+		}
+	}
+
+	buffer = malloc(BLOCK_SIZE);
+	monitor = transport_monitor_create(0);
+	if ((buffer == NULL) || (monitor == NULL)) {
+		fprintf(stderr, "dvbtsmon: Out of memory\n");
+		exit(1);
+	}
+	transport_monitor_set_callback(monitor, error_cb, NULL);
+	transport_monitor_set_pid_timeout(monitor, pid_timeout);
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	last = now();
+	while (!quit) {
+		int consumed;
+		ssize_t r;
+
+		if ((r = read(fd, buffer + have, BLOCK_SIZE - have)) < 0) {
+			if (errno == EOVERFLOW) {
+				fprintf(stderr, "dvbtsmon: DVR buffer overflow\n");
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			perror("read");
+			break;
+		}
+		if (r == 0)
+			break;
+		have += r;
+
+		consumed = transport_monitor_feed(monitor, buffer, have);
+		memmove(buffer, buffer + consumed, have - consumed);
+		have -= consumed;
+
+		if ((interval > 0) && ((now() - last) >= interval)) {
+			summary(monitor);
+			last = now();
+		}
+	}
+
+	summary(monitor);
+
+	transport_monitor_destroy(monitor);
+	free(buffer);
+	if (ffd >= 0)
+		close(ffd);
+	close(fd);
+	return 0;
+}
@@ -31,12 +31,15 @@
 #include <libdvbapi/dvbdemux.h>
 #include <libdvbapi/dvbaudio.h>
 #include <libdvbsec/dvbsec_cfg.h>
+#include <libdvbcfg/dvbcfg_zapdb.h>
 #include <libucsi/mpeg/section.h>
 #include "gnutv.h"
 #include "gnutv_dvb.h"
 #include "gnutv_ca.h"
 #include "gnutv_data.h"
+#include "gnutv_multi.h"
 
+#define MAX_REMAPS 64
 
 static void signal_handler(int _signal);
 
@@ -54,7 +57,7 @@ void usage(void)
 		" -frontend <id>	frontend to use (default 0)\n"
 		" -demux <id>		demux to use (default 0)\n"
 		" -caslotnum <id>	ca slot number to use (default 0)\n"
-		" -channels <filename>	channels.conf file.\n"
+		" -channels <filename>	channels.conf file, or a database compiled from one by zapdb.\n"
 		" -secfile <filename>	Optional sec.conf file.\n"
 		" -secid <secid>	ID of the SEC configuration to use, one of:\n"
 		"			 * UNIVERSAL (default) - Europe, 10800 to 11800 MHz and 11600 to 12700 Mhz,\n"
@@ -67,6 +70,16 @@ void usage(void)
 		"						Dual LO, H:5150MHz, V:5750MHz.\n"
 		"			 * One of the sec definitions from the secfile if supplied\n"
 		" -buffer <size>	Custom DVR buffer size\n"
+		" -splice		Record to stdout/file with splice() rather than copying\n"
+		" -pace <ms>		Smooth udp/rtp output to the stream's PCR rate, with the given latency\n"
+		" -xfersize <bytes>	Transfer size when recording to stdout/file\n"
+		"			(default 4096, or 262144 with -splice)\n"
+		" -ring <megabytes>	Buffer between reading the DVR and writing stdout/file (without -splice)\n"
+		"			or udp/rtp (without -pace) output, in a thread of its own\n"
+		"			(default 16, 0 to read and write in the same thread)\n"
+		" -remap <pid>=<newpid>	Renumber a PID in stdout/file/udp/rtp output (may be repeated)\n"
+		" -noremux		Output a single channel as broadcast, with the original PAT, instead\n"
+		"			of as a single program stream with its own PAT and PMT\n"
 		" -out decoder		Output to hardware decoder (default)\n"
 		"      decoderabypass	Output to hardware decoder using audio bypass\n"
 		"      dvr		Output stream to dvr device\n"
@@ -79,11 +92,18 @@ void usage(void)
 		"      rtp <address> <port>			Output stream to address:port using udp-rtp\n"
 		"      rtpif <address> <port> <interface> 	Output stream to address:port using udp-rtp\n"
 		"							forcing the specified interface\n"
+		" -infile <filename>	Read a recorded transport stream instead of using the frontend\n"
+		"				(the channel may then be given as a service id)\n"
+		" -fast			Read the -infile as fast as possible instead of in real time\n"
+		" -loop			Restart the -infile at its end\n"
 		" -timeout <secs>	Number of seconds to output channel for\n"
 		"				(0=>exit immediately after successful tuning, default is to output forever)\n"
 		" -cammenu		Show the CAM menu\n"
 		" -nomoveca		Do not attempt to move CA descriptors from stream to programme level\n"
-		" <channel name>\n";
+		" <channel name> [<channel name>...]\n"
+		"			Several channels from the same multiplex may be given with file\n"
+		"			or udp/rtp output. A %s in the filename is replaced by each channel's\n"
+		"			name, and each channel after the first is sent to the next port up.\n";
 	fprintf(stderr, "%s\n", _usage);
 
 	exit(1);
@@ -101,6 +121,43 @@ int find_channel(struct dvbcfg_zapchannel *channel, void *private_data)
 	return 0;
 }
 
+/*
+ * A compiled channel database (see zapdb) is searched through its index
+ * rather than parsed. Returns 1 if the channel was found, 0 if not, or -1 if
+ * chanfile is not a database.
+ */
+static int find_db_channel(char *chanfile, struct dvbcfg_zapchannel *channel)
+{
+	struct dvbcfg_zapdb *db;
+	const struct dvbcfg_zapchannel *found;
+
+	if ((db = dvbcfg_zapdb_open(chanfile)) == NULL)
+		return -1;
+
+	found = dvbcfg_zapdb_find_name(db, channel->name);
+	if (found)
+		memcpy(channel, found, sizeof(struct dvbcfg_zapchannel));
+	dvbcfg_zapdb_close(db);
+
+	return found ? 1 : 0;
+}
+
+/*
+ * With a recorded file, a channel may be given as a service id: no tuning
+ * parameters are needed.
+ */
+static int find_file_service(char *infile, struct dvbcfg_zapchannel *channel)
+{
+	int service_id;
+	char tmp;
+
+	if ((infile == NULL) || (sscanf(channel->name, "%i%c", &service_id, &tmp) != 1))
+		return 0;
+
+	channel->service_id = service_id;
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {
 	int adapter_id = 0;
@@ -111,6 +168,10 @@ int main(int argc, char *argv[])
 	char *secfile = NULL;
 	char *secid = NULL;
 	char *channel_name = NULL;
+	char *channel_names[GNUTV_MULTI_MAX_SERVICES];
+	struct dvbcfg_zapchannel channels[GNUTV_MULTI_MAX_SERVICES];
+	int channel_count = 0;
+	int i;
 	int output_type = OUTPUT_TYPE_DECODER;
 	char *outfile = NULL;
 	char *outhost = NULL;
@@ -126,6 +187,16 @@ int main(int argc, char *argv[])
 	int ffaudiofd = -1;
 	int usertp = 0;
 	int buffer_size = 0;
+	int use_splice = 0;
+	int pace_ms = 0;
+	int xfer_size = 0;
+	int ring_mb = 16;
+	char *infile = NULL;
+	int infile_flags = DVBDEMUX_FILE_REALTIME;
+	int use_remux = 1;
+	int remaps[MAX_REMAPS][2];
+	int remap_count = 0;
+	struct transport_remux *remuxes[GNUTV_MULTI_MAX_SERVICES];
 
 	while(argpos != argc) {
 		if (!strcmp(argv[argpos], "-h")) {
@@ -177,6 +248,45 @@ int main(int argc, char *argv[])
 			if (buffer_size < 0)
 				usage();
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-pace")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &pace_ms) != 1)
+				usage();
+			if (pace_ms <= 0)
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-splice")) {
+			use_splice = 1;
+			argpos++;
+		} else if (!strcmp(argv[argpos], "-xfersize")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &xfer_size) != 1)
+				usage();
+			if (xfer_size < 188)
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-ring")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (sscanf(argv[argpos+1], "%i", &ring_mb) != 1)
+				usage();
+			if ((ring_mb < 0) || (ring_mb > 1024))
+				usage();
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-remap")) {
+			if ((argc - argpos) < 2)
+				usage();
+			if (remap_count == MAX_REMAPS)
+				usage();
+			if (sscanf(argv[argpos+1], "%i=%i", &remaps[remap_count][0], &remaps[remap_count][1]) != 2)
+				usage();
+			remap_count++;
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-noremux")) {
+			use_remux = 0;
+			argpos++;
 		} else if (!strcmp(argv[argpos], "-out")) {
 			if ((argc - argpos) < 2)
 				usage();
@@ -229,6 +339,17 @@ int main(int argc, char *argv[])
 			if (sscanf(argv[argpos+1], "%i", &timeout) != 1)
 				usage();
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-infile")) {
+			if ((argc - argpos) < 2)
+				usage();
+			infile = argv[argpos+1];
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-fast")) {
+			infile_flags &= ~DVBDEMUX_FILE_REALTIME;
+			argpos++;
+		} else if (!strcmp(argv[argpos], "-loop")) {
+			infile_flags |= DVBDEMUX_FILE_LOOP;
+			argpos++;
 		} else if (!strcmp(argv[argpos], "-nomoveca")) {
 			moveca = 0;
 			argpos++;
@@ -236,13 +357,29 @@ int main(int argc, char *argv[])
 			cammenu = 1;
 			argpos++;
 		} else {
-			if ((argc - argpos) != 1)
-				usage();
-			channel_name = argv[argpos];
-			argpos++;
+			// everything from here on is a channel
+			while(argpos != argc) {
+				if (channel_count == GNUTV_MULTI_MAX_SERVICES)
+					usage();
+				channel_names[channel_count++] = argv[argpos];
+				argpos++;
+			}
+			channel_name = channel_names[0];
 		}
 	}
 
+	// several channels are split out of the DVR stream in userspace
+	if ((channel_count > 1) &&
+	    (((output_type != OUTPUT_TYPE_FILE) && (output_type != OUTPUT_TYPE_UDP)) ||
+	     use_splice || pace_ms)) {
+		fprintf(stderr, "Several channels need file or udp/rtp output, without -splice or -pace\n");
+		exit(1);
+	}
+	if ((!use_remux) && ((channel_count > 1) || remap_count)) {
+		fprintf(stderr, "-noremux can only be used with a single channel, without -remap\n");
+		exit(1);
+	}
+
 	// the user didn't select anything!
 	if ((channel_name == NULL) && (!cammenu))
 		usage();
@@ -264,6 +401,14 @@ int main(int argc, char *argv[])
 	signal(SIGINT, signal_handler);
 	signal(SIGPIPE, SIG_IGN);
 
+	// replace the demux hardware with a recorded file if requested
+	if (infile != NULL) {
+		if (dvbdemux_set_file_input(infile, infile_flags)) {
+			fprintf(stderr, "Failed to open input file %s: %m\n", infile);
+			exit(1);
+		}
+	}
+
 	// start the CA stuff
 	gnutv_ca_params.adapter_id = adapter_id;
 	gnutv_ca_params.caslot_num = caslot_num;
@@ -273,22 +418,45 @@ int main(int argc, char *argv[])
 
 	// frontend setup if a channel name was supplied
 	if ((!cammenu) && (channel_name != NULL)) {
-		// find the requested channel
-		if (strlen(channel_name) >= sizeof(gnutv_dvb_params.channel.name)) {
-			fprintf(stderr, "Channel name is too long %s\n", channel_name);
-			exit(1);
-		}
-		FILE *channel_file = fopen(chanfile, "r");
-		if (channel_file == NULL) {
-			fprintf(stderr, "Could open channel file %s\n", chanfile);
-			exit(1);
-		}
-		memcpy(gnutv_dvb_params.channel.name, channel_name, strlen(channel_name) + 1);
-		if (dvbcfg_zapchannel_parse(channel_file, find_channel, &gnutv_dvb_params.channel) != 1) {
-			fprintf(stderr, "Unable to find requested channel %s\n", channel_name);
-			exit(1);
+		// find the requested channels
+		for(i=0; i < channel_count; i++) {
+			struct dvbcfg_zapchannel *channel = &channels[i];
+
+			if (strlen(channel_names[i]) >= sizeof(channel->name)) {
+				fprintf(stderr, "Channel name is too long %s\n", channel_names[i]);
+				exit(1);
+			}
+			memset(channel, 0, sizeof(struct dvbcfg_zapchannel));
+			memcpy(channel->name, channel_names[i], strlen(channel_names[i]) + 1);
+			if (!find_file_service(infile, channel)) {
+				int found = find_db_channel(chanfile, channel);
+
+				if (found < 0) {
+					FILE *channel_file = fopen(chanfile, "r");
+					if (channel_file == NULL) {
+						fprintf(stderr, "Could open channel file %s\n", chanfile);
+						exit(1);
+					}
+					found = dvbcfg_zapchannel_parse(channel_file, find_channel, channel) == 1;
+					fclose(channel_file);
+				}
+				if (!found) {
+					fprintf(stderr, "Unable to find requested channel %s\n", channel_names[i]);
+					exit(1);
+				}
+			}
+
+			// there is only one tuner
+			if ((infile == NULL) &&
+			    (channel->fe_params.frequency != channels[0].fe_params.frequency)) {
+				fprintf(stderr, "Channel %s is not on the same multiplex as %s\n",
+					channel_names[i], channel_names[0]);
+				exit(1);
+			}
 		}
-		fclose(channel_file);
+
+		// the first channel is tuned, and gets the CAM
+		memcpy(&gnutv_dvb_params.channel, &channels[0], sizeof(struct dvbcfg_zapchannel));
 
 		// default SEC with a DVBS card
 		if ((secid == NULL) && (gnutv_dvb_params.channel.fe_type == DVBFE_TYPE_DVBS))
@@ -305,11 +473,14 @@ int main(int argc, char *argv[])
 			gnutv_dvb_params.valid_sec = 1;
 		}
 
-		// open the frontend
-		gnutv_dvb_params.fe = dvbfe_open(adapter_id, frontend_id, 0);
-		if (gnutv_dvb_params.fe == NULL) {
-			fprintf(stderr, "Failed to open frontend\n");
-			exit(1);
+		// open the frontend, unless reading from a file
+		gnutv_dvb_params.fe = NULL;
+		if (infile == NULL) {
+			gnutv_dvb_params.fe = dvbfe_open(adapter_id, frontend_id, 0);
+			if (gnutv_dvb_params.fe == NULL) {
+				fprintf(stderr, "Failed to open frontend\n");
+				exit(1);
+			}
 		}
 
 		// failover decoder to dvr output if decoder not available
@@ -322,15 +493,44 @@ int main(int argc, char *argv[])
 			}
 		}
 
+		// each channel is output as a single program stream
+		for(i=0; i < channel_count; i++) {
+			int j;
+
+			remuxes[i] = NULL;
+			if (!use_remux)
+				continue;
+			remuxes[i] = transport_remux_create(channels[i].service_id);
+			if (remuxes[i] == NULL) {
+				fprintf(stderr, "Failed to create remultiplexer\n");
+				exit(1);
+			}
+			for(j=0; j < remap_count; j++) {
+				if (transport_remux_map_pid(remuxes[i], remaps[j][0], remaps[j][1])) {
+					fprintf(stderr, "Invalid PID remapping %i=%i\n", remaps[j][0], remaps[j][1]);
+					exit(1);
+				}
+			}
+		}
+
+		// start the data stuff first: without a frontend to tune, the DVB
+		// thread may see the PMT at once
+		if (channel_count > 1)
+			gnutv_multi_start(output_type, adapter_id, demux_id, buffer_size,
+					  outfile, outif, outaddrs, usertp, channels, remuxes, channel_count);
+		else
+			gnutv_data_start(output_type, ffaudiofd, adapter_id, demux_id, buffer_size,
+					 use_splice, xfer_size, outfile, outif, outaddrs, usertp, pace_ms,
+					 remuxes[0], ring_mb * 1024 * 1024);
+
 		// start the DVB stuff
 		gnutv_dvb_params.adapter_id = adapter_id;
 		gnutv_dvb_params.frontend_id = frontend_id;
 		gnutv_dvb_params.demux_id = demux_id;
 		gnutv_dvb_params.output_type = output_type;
+		gnutv_dvb_params.channels = channels;
+		gnutv_dvb_params.channel_count = channel_count;
 		gnutv_dvb_start(&gnutv_dvb_params);
-
-		// start the data stuff
-		gnutv_data_start(output_type, ffaudiofd, adapter_id, demux_id, buffer_size, outfile, outif, outaddrs, usertp);
 	}
 
 	// the UI
@@ -345,6 +545,10 @@ int main(int argc, char *argv[])
 				break;
 		}
 
+		// end of the input file
+		if (gnutv_data_finished() || gnutv_multi_finished())
+			break;
+
 		if (cammenu)
 			gnutv_ca_ui();
 		else
@@ -353,6 +557,7 @@ int main(int argc, char *argv[])
 
 	// stop data handling
 	gnutv_data_stop();
+	gnutv_multi_stop();
 
 	// shutdown DVB stuff
 	if (channel_name != NULL)
@@ -140,6 +140,7 @@ void gnutv_ca_stop(void)
 
 	// shutdown the cam thread
 	camthread_shutdown = 1;
+	en50221_tl_wakeup(tl);
 	pthread_join(camthread, NULL);
 
 	// destroy the stdcam
@@ -20,11 +20,13 @@
 	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 
+#define _GNU_SOURCE 1
 #define _FILE_OFFSET_BITS 64
 #define _LARGEFILE_SOURCE 1
 #define _LARGEFILE64_SOURCE 1
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
 #include <string.h>
@@ -32,7 +34,12 @@
 #include <signal.h>
 #include <pthread.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/poll.h>
+#include <sys/uio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -43,9 +50,20 @@
 #include "gnutv_dvb.h"
 #include "gnutv_ca.h"
 #include "gnutv_data.h"
+#include "gnutv_udp.h"
+#include "gnutv_pace.h"
+#include "gnutv_ring.h"
 
 static void *fileoutputthread_func(void* arg);
+static int fileoutput_write(uint8_t *buf, int size);
+static int fileoutput_vmsplice(int pipefds[2], uint8_t *buf, int size);
+static int fileoutput_drain_pipe(int pipefd, uint8_t *buf, int size);
 static void *udpoutputthread_func(void* arg);
+static void *udppacedoutputthread_func(void* arg);
+static void *dvrreaderthread_func(void* arg);
+static void *fileringoutputthread_func(void* arg);
+static void *udpringoutputthread_func(void* arg);
+static int gnutv_data_read(int fd, uint8_t *buf, int size);
 
 static int gnutv_data_create_decoder_filter(int adapter, int demux, uint16_t pid, int pestype);
 static int gnutv_data_create_dvr_filter(int adapter, int demux, uint16_t pid);
@@ -57,17 +75,50 @@ static void gnutv_data_append_pid_fd(int pid, int fd);
 static void gnutv_data_free_pid_fds(void);
 
 static pthread_t outputthread;
+static pthread_t readerthread;
 static int outfd = -1;
 static int dvrfd = -1;
 static int pat_fd_dvrout = -1;
 static int pmt_fd_dvrout = -1;
 static int outputthread_shutdown = 0;
+static volatile int outputthread_finished = 0;
+
+#define DEFAULT_XFER_SIZE 4096
+#define DEFAULT_SPLICE_XFER_SIZE (256*1024)
+
+#define FILE_OUTPUT_COPY 0
+#define FILE_OUTPUT_VMSPLICE 1
+#define FILE_OUTPUT_SPLICE 2
+
+static const char *file_output_modes[] = { "read/write", "read/vmsplice", "splice" };
+
+static int use_splice = 0;
+static int xfer_size = DEFAULT_XFER_SIZE;
+static int file_output_mode = FILE_OUTPUT_COPY;
+static uint64_t file_output_bytes = 0;
+static struct timespec file_output_start;
+static struct timespec file_output_end;
+static struct rusage file_output_rusage;
 
 static int usertp = 0;
 static int adapter_id = -1;
 static int demux_id = -1;
 static int output_type = 0;
 static struct addrinfo *outaddrs = NULL;
+static struct gnutv_udp_stream *udpstream = NULL;
+static struct gnutv_pace *pace = NULL;
+
+// with a ring, one thread reads the DVR and another writes the output
+#define RING_READ_SIZE (256*1024)
+#define RING_WRITE_SIZE (GNUTV_UDP_PAYLOAD_SIZE * GNUTV_UDP_BATCH)
+static struct gnutv_ring *ring = NULL;
+
+// the recorded/streamed data is remultiplexed as a single program if set
+#define REMUX_READ_SIZE (TRANSPORT_PACKET_LENGTH * 348)
+#define REMUX_MIN_SIZE ((TRANSPORT_REMUX_MAX_PSI_PACKETS + 1) * TRANSPORT_PACKET_LENGTH)
+static struct transport_remux *remux = NULL;
+static uint8_t *remux_buf = NULL;
+static int remux_buf_len = 0;
 
 struct pid_fd {
 	int pid;
@@ -78,13 +129,53 @@ static int pid_fds_count = 0;
 
 void gnutv_data_start(int _output_type,
 		    int ffaudiofd, int _adapter_id, int _demux_id, int buffer_size,
+		    int _use_splice, int _xfer_size,
 		    char *outfile,
-		    char* outif, struct addrinfo *_outaddrs, int _usertp)
+		    char* outif, struct addrinfo *_outaddrs, int _usertp, int pace_ms,
+		    struct transport_remux *_remux, int ring_size)
 {
 	usertp = _usertp;
 	demux_id = _demux_id;
 	adapter_id = _adapter_id;
 	output_type = _output_type;
+	use_splice = _use_splice;
+	if (_xfer_size > 0)
+		xfer_size = _xfer_size;
+	else if (use_splice)
+		xfer_size = DEFAULT_SPLICE_XFER_SIZE;
+
+	// only the DVR outputs are remultiplexed
+	switch(output_type) {
+	case OUTPUT_TYPE_FILE:
+	case OUTPUT_TYPE_STDOUT:
+	case OUTPUT_TYPE_UDP:
+		if (_remux == NULL)
+			break;
+		remux = _remux;
+		remux_buf = (uint8_t *) malloc(REMUX_READ_SIZE);
+		if (remux_buf == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if (xfer_size < REMUX_MIN_SIZE)
+			xfer_size = REMUX_MIN_SIZE;
+		break;
+
+	default:
+		if (_remux)
+			transport_remux_destroy(_remux);
+	}
+
+	// the splice and paced outputs have their own ways of buffering
+	if ((ring_size > 0) &&
+	    ((((output_type == OUTPUT_TYPE_FILE) || (output_type == OUTPUT_TYPE_STDOUT)) && !use_splice) ||
+	     ((output_type == OUTPUT_TYPE_UDP) && (pace_ms == 0)))) {
+		ring = gnutv_ring_create(ring_size);
+		if (ring == NULL) {
+			fprintf(stderr, "Failed to create %i byte ring buffer\n", ring_size);
+			exit(1);
+		}
+	}
 
 	// setup output
 	switch(output_type) {
@@ -122,7 +213,12 @@ void gnutv_data_start(int _output_type,
 			}
 		}
 
-		pthread_create(&outputthread, NULL, fileoutputthread_func, NULL);
+		if (ring) {
+			pthread_create(&outputthread, NULL, fileringoutputthread_func, NULL);
+			pthread_create(&readerthread, NULL, dvrreaderthread_func, NULL);
+		} else {
+			pthread_create(&outputthread, NULL, fileoutputthread_func, NULL);
+		}
 		break;
 
 	case OUTPUT_TYPE_UDP:
@@ -158,17 +254,27 @@ void gnutv_data_start(int _output_type,
 			}
 		}
 
-		pthread_create(&outputthread, NULL, udpoutputthread_func, NULL);
-		break;
-	}
+		udpstream = gnutv_udp_create(outfd, outaddrs, usertp);
+		if (udpstream == NULL) {
+			fprintf(stderr, "Failed to create UDP stream\n");
+			exit(1);
+		}
 
-	// output PAT to DVR if requested
-	switch(output_type) {
-	case OUTPUT_TYPE_DVR:
-	case OUTPUT_TYPE_FILE:
-	case OUTPUT_TYPE_STDOUT:
-	case OUTPUT_TYPE_UDP:
-		pat_fd_dvrout = gnutv_data_create_dvr_filter(adapter_id, demux_id, TRANSPORT_PAT_PID);
+		// optionally smooth the output according to the PCRs
+		if (pace_ms > 0) {
+			pace = gnutv_pace_create(pace_ms, GNUTV_UDP_PAYLOAD_SIZE);
+			if (pace == NULL) {
+				fprintf(stderr, "Failed to create pacer\n");
+				exit(1);
+			}
+			pthread_create(&outputthread, NULL, udppacedoutputthread_func, NULL);
+		} else if (ring) {
+			pthread_create(&outputthread, NULL, udpringoutputthread_func, NULL);
+			pthread_create(&readerthread, NULL, dvrreaderthread_func, NULL);
+		} else {
+			pthread_create(&outputthread, NULL, udpoutputthread_func, NULL);
+		}
+		break;
 	}
 }
 
@@ -178,7 +284,85 @@ void gnutv_data_stop()
 	if (dvrfd != -1) {
 		outputthread_shutdown = 1;
 		pthread_join(outputthread, NULL);
+		if (ring)
+			pthread_join(readerthread, NULL);
+	}
+
+	// recording statistics
+	if ((output_type == OUTPUT_TYPE_FILE) || (output_type == OUTPUT_TYPE_STDOUT)) {
+		double elapsed = (file_output_end.tv_sec - file_output_start.tv_sec) +
+				 (file_output_end.tv_nsec - file_output_start.tv_nsec) / 1e9;
+		double user = file_output_rusage.ru_utime.tv_sec +
+			      file_output_rusage.ru_utime.tv_usec / 1e6;
+		double sys = file_output_rusage.ru_stime.tv_sec +
+			     file_output_rusage.ru_stime.tv_usec / 1e6;
+
+		fprintf(stderr, "Recorded %llu bytes in %.1f s (%.2f Mbit/s) using %s, %i byte transfers\n",
+			(unsigned long long) file_output_bytes, elapsed,
+			(elapsed > 0) ? (file_output_bytes * 8 / elapsed / 1e6) : 0.0,
+			file_output_modes[file_output_mode], xfer_size);
+		fprintf(stderr, "Output thread CPU: %.3f s user, %.3f s system (%.1f%%)\n",
+			user, sys, (elapsed > 0) ? ((user + sys) * 100 / elapsed) : 0.0);
+	}
+
+	// streaming statistics
+	if (udpstream) {
+		struct gnutv_udp_stats stats;
+
+		gnutv_udp_get_stats(udpstream, &stats);
+		fprintf(stderr, "Streamed %llu datagrams, %llu bytes, %llu dropped, %llu DVR overflows\n",
+			(unsigned long long) stats.datagrams, (unsigned long long) stats.bytes,
+			(unsigned long long) stats.dropped, (unsigned long long) stats.overflows);
+		fprintf(stderr, "%llu send calls (%.1f datagrams per call)%s\n",
+			(unsigned long long) stats.calls,
+			stats.calls ? ((double) stats.datagrams / stats.calls) : 0.0,
+			stats.gso ? " using UDP GSO" : "");
+		gnutv_udp_destroy(udpstream);
+		udpstream = NULL;
+	}
+	if (pace) {
+		struct gnutv_pace_stats stats;
+
+		gnutv_pace_get_stats(pace, &stats);
+		fprintf(stderr, "Paced %llu datagrams at %.3f Mbit/s: release error mean %.1f us, max %.1f us, %llu late\n",
+			(unsigned long long) stats.datagrams, stats.bitrate / 1e6,
+			stats.error_mean * 1e6, stats.error_max * 1e6,
+			(unsigned long long) stats.late);
+		fprintf(stderr, "%llu datagrams unpaced, %llu resyncs\n",
+			(unsigned long long) stats.unpaced, (unsigned long long) stats.resyncs);
+		gnutv_pace_destroy(pace);
+		pace = NULL;
 	}
+
+	// ring statistics
+	if (ring) {
+		struct gnutv_ring_stats stats;
+
+		gnutv_ring_get_stats(ring, &stats);
+		fprintf(stderr, "Ring of %zu bytes%s: high water %zu bytes (%.1f%%), full %llu times (longest %.1f ms), %llu DVR overflows\n",
+			stats.size, stats.hugepages ? " in huge pages" : "",
+			stats.high_water, stats.high_water * 100.0 / stats.size,
+			(unsigned long long) stats.full, stats.full_max * 1e3,
+			(unsigned long long) stats.overflows);
+		fprintf(stderr, "%llu output stalls over %i ms (longest write %.1f ms, %.2f s stalled in total)\n",
+			(unsigned long long) stats.stalls, GNUTV_RING_STALL_MS,
+			stats.stall_max * 1e3, stats.stall_total);
+		gnutv_ring_destroy(ring);
+		ring = NULL;
+	}
+
+	if (remux) {
+		struct transport_remux_stats *stats = transport_remux_get_stats(remux);
+
+		fprintf(stderr, "Remultiplexed %llu packets: %llu output, %llu PSI, %llu PSI replaced, %llu dropped, %llu bad sections\n",
+			(unsigned long long) stats->packets, (unsigned long long) stats->output,
+			(unsigned long long) stats->psi, (unsigned long long) stats->replaced,
+			(unsigned long long) stats->dropped, (unsigned long long) stats->section_errors);
+		transport_remux_destroy(remux);
+		free(remux_buf);
+		remux = NULL;
+	}
+
 	gnutv_data_free_pid_fds();
 	if (pat_fd_dvrout != -1)
 		close(pat_fd_dvrout);
@@ -188,14 +372,23 @@ void gnutv_data_stop()
 		freeaddrinfo(outaddrs);
 }
 
+int gnutv_data_finished(void)
+{
+	return outputthread_finished;
+}
+
 void gnutv_data_new_pat(int pmt_pid)
 {
-	// output PMT to DVR if requested
+	// output PAT and PMT to DVR if requested. The PAT filter is only
+	// created now so that a -fast input file is not read before the DVB
+	// thread's section filters are in place.
 	switch(output_type) {
 	case OUTPUT_TYPE_DVR:
 	case OUTPUT_TYPE_FILE:
 	case OUTPUT_TYPE_STDOUT:
 	case OUTPUT_TYPE_UDP:
+		if (pat_fd_dvrout == -1)
+			pat_fd_dvrout = gnutv_data_create_dvr_filter(adapter_id, demux_id, TRANSPORT_PAT_PID);
 		if (pmt_fd_dvrout != -1)
 			close(pmt_fd_dvrout);
 		pmt_fd_dvrout = gnutv_data_create_dvr_filter(adapter_id, demux_id, pmt_pid);
@@ -228,138 +421,513 @@ int gnutv_data_new_pmt(struct mpeg_pmt_section *pmt)
 static void *fileoutputthread_func(void* arg)
 {
 	(void)arg;
-	uint8_t buf[4096];
+	uint8_t *buf;
 	struct pollfd pollfd;
-	int written;
+	struct timespec timeout = { 1, 0 };
+	int pipefds[2] = { -1, -1 };
+	int splicefd = -1;
+
+	buf = (uint8_t *) malloc(xfer_size);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 0;
+	}
+
+	// splice() moves data DVR -> pipe -> file without copying it through
+	// userspace. If the DVR can't splice, read() it and vmsplice() the buffer
+	// into the pipe instead, which still saves the copy on the write side.
+	// The remux has to see the data, so it can only be vmsplice()d.
+	file_output_mode = FILE_OUTPUT_COPY;
+	if (use_splice) {
+		if (pipe(pipefds) == 0) {
+			fcntl(pipefds[1], F_SETPIPE_SZ, xfer_size);
+			file_output_mode = remux ? FILE_OUTPUT_VMSPLICE : FILE_OUTPUT_SPLICE;
+		} else {
+			fprintf(stderr, "Failed to create pipe, not using splice: %m\n");
+		}
+	}
+	if (file_output_mode == FILE_OUTPUT_SPLICE)
+		splicefd = pipefds[1];
 
 	pollfd.fd = dvrfd;
-	pollfd.events = POLLIN|POLLPRI|POLLERR;
+	pollfd.events = POLLIN|POLLPRI;
 
+	clock_gettime(CLOCK_MONOTONIC, &file_output_start);
 	while(!outputthread_shutdown) {
-		if (poll(&pollfd, 1, 1000) == -1) {
-			if (errno == EINTR)
-				continue;
-			fprintf(stderr, "DVR device poll failure\n");
-			return 0;
-		}
+		int size;
 
-		if (pollfd.revents == 0)
+		size = gnutv_data_dvr_read(&pollfd, &timeout, buf, xfer_size, &splicefd);
+		if ((file_output_mode == FILE_OUTPUT_SPLICE) && (splicefd == -1))
+			file_output_mode = FILE_OUTPUT_VMSPLICE;
+		if (size == GNUTV_DVR_OVERFLOW) {
+			fprintf(stderr, "DVR overflow\n");
+			continue;
+		}
+		if (size < 0)
+			break;
+		if (size == 0)
 			continue;
 
-		int size = read(dvrfd, buf, sizeof(buf));
-		if (size < 0) {
-			if (errno == EINTR)
-				continue;
+		if (file_output_mode == FILE_OUTPUT_COPY) {
+			if (fileoutput_write(buf, size))
+				break;
+		} else if (file_output_mode == FILE_OUTPUT_SPLICE) {
+			if (fileoutput_drain_pipe(pipefds[0], buf, size))
+				break;
+		} else {
+			if (fileoutput_vmsplice(pipefds, buf, size))
+				break;
+		}
+		file_output_bytes += size;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &file_output_end);
+	getrusage(RUSAGE_THREAD, &file_output_rusage);
 
-			if (errno == EOVERFLOW) {
-				// The error flag has been cleared, next read should succeed.
-				fprintf(stderr, "DVR overflow\n");
-				continue;
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
+
+	if (pipefds[0] != -1) {
+		close(pipefds[0]);
+		close(pipefds[1]);
+	}
+	free(buf);
+	return 0;
+}
+
+static int fileoutput_write(uint8_t *buf, int size)
+{
+	int written = 0;
+
+	while(written < size) {
+		int tmp = write(outfd, buf + written, size - written);
+		if (tmp == -1) {
+			if (errno != EINTR) {
+				fprintf(stderr, "Write error: %m\n");
+				return -1;
 			}
+		} else {
+			written += tmp;
+		}
+	}
 
-			fprintf(stderr, "DVR device read failure\n");
-			return 0;
+	return 0;
+}
+
+static int fileoutput_vmsplice(int pipefds[2], uint8_t *buf, int size)
+{
+	int done = 0;
+
+	// the pipe may be smaller than the buffer: feed it in pieces
+	while(done < size) {
+		struct iovec iov = { buf + done, size - done };
+		int tmp;
+
+		// the output turned out not to support splice
+		if (file_output_mode == FILE_OUTPUT_COPY)
+			return fileoutput_write(buf + done, size - done);
+
+		tmp = vmsplice(pipefds[1], &iov, 1, SPLICE_F_NONBLOCK);
+		if (tmp < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			fprintf(stderr, "vmsplice error: %m\n");
+			return -1;
 		}
 
-		written = 0;
-		while(written < size) {
-			int tmp = write(outfd, buf + written, size - written);
-			if (tmp == -1) {
-				if (errno != EINTR) {
-					fprintf(stderr, "Write error: %m\n");
-					break;
+		// the pipe must be empty before buf may be reused
+		if (fileoutput_drain_pipe(pipefds[0], buf + done, tmp))
+			return -1;
+		done += tmp;
+	}
+
+	return 0;
+}
+
+/*
+ * Move size bytes from the pipe to the output. If the output does not
+ * support splice(), they are read back into buf (which must be large enough)
+ * and written, and copying is used from then on.
+ */
+static int fileoutput_drain_pipe(int pipefd, uint8_t *buf, int size)
+{
+	while(size > 0) {
+		int tmp = splice(pipefd, NULL, outfd, NULL, size, SPLICE_F_MOVE);
+
+		if (tmp < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EINVAL) {
+				fprintf(stderr, "Write error: %m\n");
+				return -1;
+			}
+
+			fprintf(stderr, "Output does not support splice, copying instead\n");
+			file_output_mode = FILE_OUTPUT_COPY;
+			while(size > 0) {
+				tmp = read(pipefd, buf, size);
+				if (tmp < 0) {
+					if (errno == EINTR)
+						continue;
+					return -1;
 				}
-			} else {
-				written += tmp;
+				if (fileoutput_write(buf, tmp))
+					return -1;
+				size -= tmp;
 			}
+			return 0;
 		}
+		size -= tmp;
 	}
 
 	return 0;
 }
 
-#define TS_PAYLOAD_SIZE (188*7)
-
 static void *udpoutputthread_func(void* arg)
 {
 	(void)arg;
-	uint8_t buf[12 + TS_PAYLOAD_SIZE];
+	uint8_t *buf;
 	struct pollfd pollfd;
+	struct timespec timeout = { 1, 0 };
 	int bufsize = 0;
-	int bufbase = 0;
-	int readsize;
-	uint16_t rtpseq = 0;
+	int bufmax = GNUTV_UDP_PAYLOAD_SIZE * GNUTV_UDP_BATCH;
+
+	buf = (uint8_t *) malloc(bufmax);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 0;
+	}
 
 	pollfd.fd = dvrfd;
-	pollfd.events = POLLIN|POLLPRI|POLLERR;
-
-	if (usertp) {
-		srandom(time(NULL));
-		int ssrc = random();
-		rtpseq = random();
-		buf[0x0] = 0x80;
-		buf[0x1] = 0x21;
-		buf[0x4] = 0x00; // }
-		buf[0x5] = 0x00; // } FIXME: should really be a valid stamp
-		buf[0x6] = 0x00; // }
-		buf[0x7] = 0x00; // }
-		buf[0x8] = ssrc >> 24;
-		buf[0x9] = ssrc >> 16;
-		buf[0xa] = ssrc >> 8;
-		buf[0xb] = ssrc;
-		bufbase = 12;
+	pollfd.events = POLLIN|POLLPRI;
+
+	// read as much as is available, and send all complete datagrams at once
+	while(!outputthread_shutdown) {
+		int readsize;
+		int sent;
+
+		readsize = gnutv_data_dvr_read(&pollfd, &timeout, buf + bufsize, bufmax - bufsize, NULL);
+		if (readsize == GNUTV_DVR_OVERFLOW) {
+			gnutv_udp_overflow(udpstream);
+			continue;
+		}
+		if (readsize < 0)
+			break;
+		if (readsize == 0)
+			continue;
+		bufsize += readsize;
+
+		sent = gnutv_udp_send(udpstream, buf, bufsize, 0);
+		if (sent < 0)
+			break;
+		memmove(buf, buf + sent, bufsize - sent);
+		bufsize -= sent;
 	}
 
+	if (bufsize)
+		gnutv_udp_send(udpstream, buf, bufsize, 1);
+
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
+
+	free(buf);
+	return 0;
+}
+
+/*
+ * As udpoutputthread_func(), but the data goes through the pacer, which
+ * releases it at the stream's own rate. The thread sleeps until either more
+ * data arrives or the next datagram is due.
+ */
+static void *udppacedoutputthread_func(void* arg)
+{
+	(void)arg;
+	struct pollfd pollfd;
+	int eof = 0;
+
+	// the default timer slack of 50us would add to the release jitter
+	prctl(PR_SET_TIMERSLACK, 1000UL);
+
+	pollfd.events = POLLIN|POLLPRI;
+
 	while(!outputthread_shutdown) {
-		if (poll(&pollfd, 1, 1000) != 1)
+		struct timespec next;
+		struct timespec timeout;
+		uint8_t *data;
+		int have_next;
+		int len;
+		int final;
+		int space;
+		uint8_t *spacebuf;
+
+		// send whatever is due
+		final = eof && (gnutv_pace_buffered(pace) < GNUTV_UDP_PAYLOAD_SIZE);
+		len = gnutv_pace_due(pace, final, &data, &next, &have_next);
+		if (len > 0) {
+			int sent = gnutv_udp_send(udpstream, data, len, final);
+
+			if (sent < 0)
+				break;
+			gnutv_pace_release(pace, sent);
 			continue;
-		if (pollfd.revents & POLLERR) {
-			if (errno == EINTR)
-				continue;
-			fprintf(stderr, "DVR device read failure\n");
-			return 0;
+		}
+		if (final) {
+			// end of a recorded input file, and everything has been sent
+			break;
 		}
 
-		readsize = TS_PAYLOAD_SIZE - bufsize;
-		readsize = read(dvrfd, buf + bufbase + bufsize, readsize);
-		if (readsize < 0) {
-			if (errno == EINTR)
+		// wait for more data, or until the next datagram is due
+		timeout.tv_sec = 1;
+		timeout.tv_nsec = 0;
+		if (have_next) {
+			struct timespec now;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			timeout.tv_sec = next.tv_sec - now.tv_sec;
+			timeout.tv_nsec = next.tv_nsec - now.tv_nsec;
+			if (timeout.tv_nsec < 0) {
+				timeout.tv_sec--;
+				timeout.tv_nsec += 1000000000;
+			}
+			if (timeout.tv_sec < 0)
 				continue;
-			fprintf(stderr, "DVR device read failure\n");
-			return 0;
 		}
-		bufsize += readsize;
+		spacebuf = gnutv_pace_space(pace, &space);
+		if (remux && (space < REMUX_MIN_SIZE))
+			space = 0;
+
+		// with no room for more data, the DVR is left alone (a negative fd
+		// is ignored by ppoll) until the next datagram is due
+		pollfd.fd = (space && !eof) ? dvrfd : -1;
+		len = gnutv_data_dvr_read(&pollfd, &timeout, spacebuf, space, NULL);
+		if (len == GNUTV_DVR_OVERFLOW) {
+			gnutv_udp_overflow(udpstream);
+			continue;
+		}
+		if (len == GNUTV_DVR_EOF) {
+			eof = 1;
+			continue;
+		}
+		if (len < 0)
+			break;
+		if (len > 0)
+			gnutv_pace_queued(pace, len);
+	}
 
-		if (bufsize == TS_PAYLOAD_SIZE) {
-			if (usertp) {
-				buf[2] = rtpseq >> 8;
-				buf[3] = rtpseq;
-			}
-			if (sendto(outfd, buf, bufbase + bufsize, 0, outaddrs->ai_addr, outaddrs->ai_addrlen) < 0) {
-				if (errno != EINTR) {
-					fprintf(stderr, "Socket send failure: %m\n");
-					return 0;
-				}
-			}
-			rtpseq++;
-			bufsize = 0;
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
+	return 0;
+}
+
+/*
+ * With a ring, this thread only reads the DVR into it, so the DVR is emptied
+ * even while the output thread is stuck in a write.
+ */
+static void *dvrreaderthread_func(void* arg)
+{
+	(void)arg;
+	struct pollfd pollfd;
+	struct timespec timeout = { 0, 100000000 };
+
+	pollfd.fd = dvrfd;
+	pollfd.events = POLLIN|POLLPRI;
+
+	while(!outputthread_shutdown) {
+		uint8_t *space;
+		int size;
+		int len;
+
+		// the writer has fallen a whole ring behind
+		if (gnutv_ring_wait_space(ring, RING_READ_SIZE, 100))
+			continue;
+
+		space = gnutv_ring_space(ring, &size);
+		len = gnutv_data_dvr_read(&pollfd, &timeout, space, RING_READ_SIZE, NULL);
+		if (len == GNUTV_DVR_OVERFLOW) {
+			gnutv_ring_overflow(ring);
+			continue;
 		}
+		if (len < 0) {
+			// at the end of the input, and also after an error, the
+			// writer finishes off what was read, then gnutv stops
+			gnutv_ring_eof(ring);
+			break;
+		}
+		if (len > 0)
+			gnutv_ring_produced(ring, len);
 	}
 
-	if (bufsize) {
-		if (usertp) {
-			buf[2] = rtpseq >> 8;
-			buf[3] = rtpseq;
+	return 0;
+}
+
+static void *fileringoutputthread_func(void* arg)
+{
+	(void)arg;
+
+	file_output_mode = FILE_OUTPUT_COPY;
+	clock_gettime(CLOCK_MONOTONIC, &file_output_start);
+	while(!outputthread_shutdown) {
+		uint8_t *data;
+		int res;
+		int len;
+
+		res = gnutv_ring_wait_data(ring, 1, 100);
+		if (res < 0)
+			continue;
+		if (res > 0) {
+			// the reader has finished, and everything is written
+			break;
 		}
-		if (sendto(outfd, buf, bufbase + bufsize, 0, outaddrs->ai_addr, outaddrs->ai_addrlen) < 0) {
-			if (errno != EINTR)
-				fprintf(stderr, "Socket send failure: %m\n");
+
+		data = gnutv_ring_data(ring, &len);
+		if (len > xfer_size)
+			len = xfer_size;
+		if (fileoutput_write(data, len))
+			break;
+		gnutv_ring_consumed(ring, len);
+		file_output_bytes += len;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &file_output_end);
+	getrusage(RUSAGE_THREAD, &file_output_rusage);
+
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
+
+	return 0;
+}
+
+static void *udpringoutputthread_func(void* arg)
+{
+	(void)arg;
+	uint8_t *data;
+	int partial = 0;
+	int len;
+
+	while(!outputthread_shutdown) {
+		int res;
+		int sent;
+
+		// wait for more than a partial datagram
+		res = gnutv_ring_wait_data(ring, partial + 1, 100);
+		if (res < 0)
+			continue;
+		if (res > 0) {
+			// the reader has finished
+			break;
 		}
+
+		data = gnutv_ring_data(ring, &len);
+		if (len > RING_WRITE_SIZE)
+			len = RING_WRITE_SIZE;
+		sent = gnutv_udp_send(udpstream, data, len, 0);
+		if (sent < 0)
+			break;
+		gnutv_ring_consumed(ring, sent);
+		partial = len - sent;
+	}
+
+	data = gnutv_ring_data(ring, &len);
+	if (len) {
+		if (len > RING_WRITE_SIZE)
+			len = RING_WRITE_SIZE;
+		gnutv_udp_send(udpstream, data, len, 1);
+		gnutv_ring_consumed(ring, len);
 	}
 
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
 	return 0;
 }
 
+int gnutv_data_dvr_read(struct pollfd *pollfd, const struct timespec *timeout,
+			uint8_t *buf, int size, int *splicefd)
+{
+	int len;
+
+	// a POLLERR is a DVR overflow, which the read reports as EOVERFLOW, and
+	// a POLLHUP the end of a recorded input file, where the read returns 0
+	pollfd->revents = 0;
+	if (ppoll(pollfd, 1, timeout, NULL) < 0) {
+		if (errno == EINTR)
+			return 0;
+		fprintf(stderr, "DVR device poll failure\n");
+		return GNUTV_DVR_ERROR;
+	}
+	if (pollfd->revents == 0)
+		return 0;
+
+	if (splicefd && (*splicefd != -1)) {
+		len = splice(pollfd->fd, NULL, *splicefd, NULL, size, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if ((len < 0) && (errno == EINVAL)) {
+			// the DVR can't be spliced
+			*splicefd = -1;
+			return 0;
+		}
+	} else {
+		len = gnutv_data_read(pollfd->fd, buf, size);
+	}
+	if (len < 0) {
+		if ((errno == EINTR) || (errno == EAGAIN))
+			return 0;
+
+		// the error flag has been cleared, the next read should succeed
+		if (errno == EOVERFLOW)
+			return GNUTV_DVR_OVERFLOW;
+
+		fprintf(stderr, "DVR device read failure\n");
+		return GNUTV_DVR_ERROR;
+	}
+	if (len == 0)
+		return GNUTV_DVR_EOF;
+	return len;
+}
+
+/*
+ * read() the DVR, through the remux if there is one. size must then be at
+ * least REMUX_MIN_SIZE, or -1 is returned with errno EINVAL. Returns as read(),
+ * except that -1 with errno EAGAIN means everything read was dropped by the
+ * remux.
+ */
+static int gnutv_data_read(int fd, uint8_t *buf, int size)
+{
+	int readsize;
+	int used;
+	int outlen;
+
+	if (remux == NULL)
+		return read(fd, buf, size);
+	if (size < REMUX_MIN_SIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// packets left over when the output filled up go before any new ones
+	if (remux_buf_len < TRANSPORT_PACKET_LENGTH) {
+		// leave room for the PSI the remux may add
+		readsize = size - (TRANSPORT_REMUX_MAX_PSI_PACKETS * TRANSPORT_PACKET_LENGTH) - remux_buf_len;
+		if (readsize > REMUX_READ_SIZE - remux_buf_len)
+			readsize = REMUX_READ_SIZE - remux_buf_len;
+		if (readsize <= 0) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		readsize = read(fd, remux_buf + remux_buf_len, readsize);
+		if (readsize <= 0)
+			return readsize;
+		remux_buf_len += readsize;
+	}
+
+	used = transport_remux_feed(remux, remux_buf, remux_buf_len, buf, size, &outlen);
+	memmove(remux_buf, remux_buf + used, remux_buf_len - used);
+	remux_buf_len -= used;
+
+	if (outlen == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	return outlen;
+}
+
 static int gnutv_data_create_decoder_filter(int adapter, int demux, uint16_t pid, int pestype)
 {
 	int demux_fd = -1;
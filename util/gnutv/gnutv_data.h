@@ -23,17 +23,50 @@
 #ifndef gnutv_DATA_H
 #define gnutv_DATA_H 1
 
+#include <stdint.h>
+#include <time.h>
 #include <netdb.h>
+#include <sys/poll.h>
+#include <libucsi/transport_remux.h>
+
+/* gnutv_data_dvr_read() results, besides the number of bytes read */
+#define GNUTV_DVR_OVERFLOW	-1
+#define GNUTV_DVR_EOF		-2
+#define GNUTV_DVR_ERROR		-3
 
 extern void gnutv_data_start(int output_type,
 			   int ffaudiofd, int adapter_id, int demux_id, int buffer_size,
+			   int use_splice, int xfer_size,
 			   char *outfile,
-			   char* outif, struct addrinfo *outaddrs, int usertp);
+			   char* outif, struct addrinfo *outaddrs, int usertp, int pace_ms,
+			   struct transport_remux *remux, int ring_size);
 extern void gnutv_data_stop(void);
+extern int gnutv_data_finished(void);
 
 extern void gnutv_data_new_pat(int pmt_pid);
 extern int gnutv_data_new_pmt(struct mpeg_pmt_section *pmt);
 
+/**
+ * Wait for the DVR, then read it, through the remux given to
+ * gnutv_data_start() if there is one. Every output thread reads the DVR
+ * with this.
+ *
+ * @param pollfd The DVR. With a negative fd, this just waits for the timeout.
+ * @param timeout Longest time to wait for the DVR.
+ * @param buf Buffer for the data.
+ * @param size Size of buf.
+ * @param splicefd If not NULL and not -1, a pipe to splice() the DVR to
+ * instead of reading it into buf. Set to -1, with nothing read, if the DVR
+ * can't be spliced.
+ * @return The number of bytes read, 0 if there was nothing (the timeout, a
+ * signal, or everything read was dropped by the remux), GNUTV_DVR_OVERFLOW
+ * after a DVR overflow (the next read should succeed), GNUTV_DVR_EOF at the end
+ * of a recorded input file, or GNUTV_DVR_ERROR after a failure, which has been
+ * reported.
+ */
+extern int gnutv_data_dvr_read(struct pollfd *pollfd, const struct timespec *timeout,
+			       uint8_t *buf, int size, int *splicefd);
+
 
 
 #endif
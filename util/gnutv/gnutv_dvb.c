@@ -35,6 +35,7 @@
 #include "gnutv.h"
 #include "gnutv_dvb.h"
 #include "gnutv_data.h"
+#include "gnutv_multi.h"
 #include "gnutv_ca.h"
 
 #define FE_STATUS_PARAMS (DVBFE_INFO_LOCKSTATUS|DVBFE_INFO_SIGNAL_STRENGTH|DVBFE_INFO_BER|DVBFE_INFO_SNR|DVBFE_INFO_UNCORRECTED_BLOCKS)
@@ -45,13 +46,13 @@ static int tune_state = 0;
 
 static int pat_version = -1;
 static int ca_pmt_version = -1;
-static int data_pmt_version = -1;
+static int data_pmt_version[GNUTV_MULTI_MAX_SERVICES];
 
 static void *dvbthread_func(void* arg);
 
-static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd);
+static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fds, struct pollfd *pollfds);
 static void process_tdt(int tdt_fd);
-static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params);
+static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params, int service);
 static int create_section_filter(int adapter, int demux, uint16_t pid, uint8_t table_id);
 
 
@@ -75,9 +76,10 @@ int gnutv_dvb_locked(void)
 static void *dvbthread_func(void* arg)
 {
 	int pat_fd = -1;
-	int pmt_fd = -1;
+	int pmt_fds[GNUTV_MULTI_MAX_SERVICES];
 	int tdt_fd = -1;
-	struct pollfd pollfds[3];
+	struct pollfd pollfds[2 + GNUTV_MULTI_MAX_SERVICES];
+	int i;
 
 	struct gnutv_dvb_params *params = (struct gnutv_dvb_params *) arg;
 
@@ -100,14 +102,21 @@ static void *dvbthread_func(void* arg)
 	pollfds[1].fd = tdt_fd;
 	pollfds[1].events = POLLIN|POLLPRI|POLLERR;
 
-	// zero PMT filter
-	pollfds[2].fd = 0;
-	pollfds[2].events = 0;
+	// zero PMT filters, one per service
+	for(i=0; i < params->channel_count; i++) {
+		pmt_fds[i] = -1;
+		data_pmt_version[i] = -1;
+		pollfds[2 + i].fd = 0;
+		pollfds[2 + i].events = 0;
+	}
 
 	// the DVB loop
 	while(!dvbthread_shutdown) {
 		// tune frontend + monitor lock status
-		if (tune_state == 0) {
+		if ((tune_state == 0) && (params->fe == NULL)) {
+			// reading from a file: nothing to tune
+			tune_state = 2;
+		} else if (tune_state == 0) {
 			// get the type of frontend
 			struct dvbfe_info result;
 			char *types;
@@ -181,7 +190,7 @@ static void *dvbthread_func(void* arg)
 		}
 
 		// is there SI data?
-		int count = poll(pollfds, 3, 100);
+		int count = poll(pollfds, 2 + params->channel_count, 100);
 		if (count < 0) {
 			if (errno != EINTR)
 				fprintf(stderr, "Poll error: %m\n");
@@ -193,7 +202,7 @@ static void *dvbthread_func(void* arg)
 
 		// PAT
 		if (pollfds[0].revents & (POLLIN|POLLPRI)) {
-			process_pat(pat_fd, params, &pmt_fd, &pollfds[2]);
+			process_pat(pat_fd, params, pmt_fds, &pollfds[2]);
 		}
 
 		// TDT
@@ -201,25 +210,30 @@ static void *dvbthread_func(void* arg)
 			process_tdt(tdt_fd);
 		}
 
-		//  PMT
-		if (pollfds[2].revents & (POLLIN|POLLPRI)) {
-			process_pmt(pmt_fd, params);
+		//  PMTs
+		for(i=0; i < params->channel_count; i++) {
+			if (pollfds[2 + i].revents & (POLLIN|POLLPRI)) {
+				process_pmt(pmt_fds[i], params, i);
+			}
 		}
 	}
 
 	// close demuxers
 	if (pat_fd != -1)
 		close(pat_fd);
-	if (pmt_fd != -1)
-		close(pmt_fd);
+	for(i=0; i < params->channel_count; i++) {
+		if (pmt_fds[i] != -1)
+			close(pmt_fds[i]);
+	}
 	if (tdt_fd != -1)
 		close(tdt_fd);
 
 	return 0;
 }
 
-static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fd, struct pollfd *pollfd)
+static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fds, struct pollfd *pollfds)
 {
+	int i;
 	int size;
 	uint8_t sibuf[4096];
 
@@ -249,28 +263,34 @@ static void process_pat(int pat_fd, struct gnutv_dvb_params *params, int *pmt_fd
 		return;
 	}
 
-	// try and find the requested program
-	struct mpeg_pat_program *cur_program;
-	mpeg_pat_section_programs_for_each(pat, cur_program) {
-		if (cur_program->program_number == params->channel.service_id) {
-			// close old PMT fd
-			if (*pmt_fd != -1)
-				close(*pmt_fd);
-
-			// create PMT filter
-			if ((*pmt_fd = create_section_filter(params->adapter_id, params->demux_id,
-							     cur_program->pid, stag_mpeg_program_map)) < 0) {
-				return;
+	// try and find the requested programs
+	for(i=0; i < params->channel_count; i++) {
+		struct mpeg_pat_program *cur_program;
+		mpeg_pat_section_programs_for_each(pat, cur_program) {
+			if (cur_program->program_number == params->channels[i].service_id) {
+				// close old PMT fd
+				if (pmt_fds[i] != -1)
+					close(pmt_fds[i]);
+
+				// create PMT filter
+				if ((pmt_fds[i] = create_section_filter(params->adapter_id, params->demux_id,
+									cur_program->pid, stag_mpeg_program_map)) < 0) {
+					return;
+				}
+				pollfds[i].fd = pmt_fds[i];
+				pollfds[i].events = POLLIN|POLLPRI|POLLERR;
+
+				if (params->channel_count > 1)
+					gnutv_multi_new_pat(i, cur_program->pid);
+				else
+					gnutv_data_new_pat(cur_program->pid);
+
+				// we have a new PMT pid
+				data_pmt_version[i] = -1;
+				if (i == 0)
+					ca_pmt_version = -1;
+				break;
 			}
-			pollfd->fd = *pmt_fd;
-			pollfd->events = POLLIN|POLLPRI|POLLERR;
-
-			gnutv_data_new_pat(cur_program->pid);
-
-			// we have a new PMT pid
-			data_pmt_version = -1;
-			ca_pmt_version = -1;
-			break;
 		}
 	}
 
@@ -304,7 +324,7 @@ static void process_tdt(int tdt_fd)
 	gnutv_ca_new_dvbtime(dvbdate_to_unixtime(tdt->utc_time));
 }
 
-static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
+static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params, int service)
 {
 	int size;
 	uint8_t sibuf[4096];
@@ -325,9 +345,10 @@ static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
 	if (section_ext == NULL) {
 		return;
 	}
-	if ((section_ext->table_id_ext != params->channel.service_id) ||
-	    ((section_ext->version_number == data_pmt_version) &&
-	     (section_ext->version_number == ca_pmt_version))) {
+	// only the first service is descrambled
+	if ((section_ext->table_id_ext != params->channels[service].service_id) ||
+	    ((section_ext->version_number == data_pmt_version[service]) &&
+	     ((service != 0) || (section_ext->version_number == ca_pmt_version)))) {
 		return;
 	}
 
@@ -338,13 +359,18 @@ static void process_pmt(int pmt_fd, struct gnutv_dvb_params *params)
 	}
 
 	// do data handling
-	if (section_ext->version_number != data_pmt_version) {
-		if (gnutv_data_new_pmt(pmt) == 1)
-			data_pmt_version = pmt->head.version_number;
+	if (section_ext->version_number != data_pmt_version[service]) {
+		if (params->channel_count > 1) {
+			if (gnutv_multi_new_pmt(service, pmt) == 1)
+				data_pmt_version[service] = pmt->head.version_number;
+		} else {
+			if (gnutv_data_new_pmt(pmt) == 1)
+				data_pmt_version[service] = pmt->head.version_number;
+		}
 	}
 
 	// do ca handling
-	if (section_ext->version_number != ca_pmt_version) {
+	if ((service == 0) && (section_ext->version_number != ca_pmt_version)) {
 		if (gnutv_ca_new_pmt(pmt) == 1)
 			ca_pmt_version = pmt->head.version_number;
 	}
@@ -35,6 +35,8 @@ struct gnutv_dvb_params {
 	int valid_sec;
 	int output_type;
 	struct dvbfe_handle *fe;
+	struct dvbcfg_zapchannel *channels;	/* services to output, channels[0] is channel */
+	int channel_count;			/* more than one => gnutv_multi handles the data */
 };
 
 extern int gnutv_dvb_start(struct gnutv_dvb_params *params);
@@ -0,0 +1,486 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE_SOURCE 1
+#define _LARGEFILE64_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <libdvbapi/dvbdemux.h>
+#include <libucsi/transport_remux.h>
+#include <libucsi/mpeg/section.h>
+#include "gnutv.h"
+#include "gnutv_data.h"
+#include "gnutv_multi.h"
+#include "gnutv_udp.h"
+
+/* DVR read size: a whole batch of datagrams */
+#define MULTI_READ_SIZE (GNUTV_UDP_PAYLOAD_SIZE * GNUTV_UDP_BATCH)
+
+/* per-service output buffer: a whole read, plus inserted PSI and the
+ * remainder of a partial datagram */
+#define MULTI_OUTPUT_SIZE (MULTI_READ_SIZE * 2)
+
+#define PID_TYPE_NONE 0
+#define PID_TYPE_PAT 1
+#define PID_TYPE_SERVICE 2
+
+struct multi_pid {
+	int type;
+	int fd;				/* kernel filter feeding the DVR */
+	uint32_t services;		/* mask of services using the PID */
+};
+
+struct multi_service {
+	struct dvbcfg_zapchannel *channel;
+	struct transport_remux *remux;
+	int pmt_pid;
+
+	int fd;
+	struct gnutv_udp_stream *udp;
+	struct addrinfo addr;
+	struct sockaddr_storage sockaddr;
+	uint8_t *buf;
+	int len;
+
+	uint64_t dropped;
+};
+
+static void *multioutputthread_func(void* arg);
+static int multi_open_output(struct multi_service *service, int index, char *outfile,
+			     char *outif);
+static void multi_remux(struct multi_service *service, uint8_t *buf, int len);
+static int multi_flush(struct multi_service *service, int final);
+static int multi_add_pid(int pid, int type, int index);
+static void multi_remove_pid(int pid, int index);
+
+static pthread_t outputthread;
+static int outputthread_shutdown = 0;
+static volatile int outputthread_finished = 0;
+
+static int adapter_id = -1;
+static int demux_id = -1;
+static int output_type = 0;
+static int usertp = 0;
+static int dvrfd = -1;
+static struct addrinfo *outaddrs = NULL;
+
+/* protects the filters below, which the DVB thread updates */
+static pthread_mutex_t multi_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct multi_pid pids[TRANSPORT_MAX_PIDS];
+static struct multi_service *services = NULL;
+static int service_count = 0;
+
+void gnutv_multi_start(int _output_type, int _adapter_id, int _demux_id, int buffer_size,
+		       char *outfile, char *outif, struct addrinfo *_outaddrs, int _usertp,
+		       struct dvbcfg_zapchannel *channels, struct transport_remux **remuxes,
+		       int count)
+{
+	int i;
+
+	output_type = _output_type;
+	adapter_id = _adapter_id;
+	demux_id = _demux_id;
+	usertp = _usertp;
+	outaddrs = _outaddrs;
+
+	for(i=0; i < TRANSPORT_MAX_PIDS; i++)
+		pids[i].fd = -1;
+
+	services = (struct multi_service *) calloc(count, sizeof(struct multi_service));
+	if (services == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	service_count = count;
+
+	// open an output per service
+	for(i=0; i < count; i++) {
+		services[i].channel = &channels[i];
+		services[i].remux = remuxes[i];
+		services[i].pmt_pid = -1;
+		services[i].fd = -1;
+		services[i].buf = (uint8_t *) malloc(MULTI_OUTPUT_SIZE);
+		if (services[i].buf == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		if (multi_open_output(&services[i], i, outfile, outif))
+			exit(1);
+	}
+
+	// open dvr device
+	dvrfd = dvbdemux_open_dvr(adapter_id, 0, 1, 0);
+	if (dvrfd < 0) {
+		fprintf(stderr, "Failed to open DVR device\n");
+		exit(1);
+	}
+
+	// optionally set dvr buffer size
+	if (buffer_size > 0) {
+		if (dvbdemux_set_buffer(dvrfd, buffer_size) != 0) {
+			fprintf(stderr, "Failed to set DVR buffer size\n");
+			exit(1);
+		}
+	}
+
+	pthread_create(&outputthread, NULL, multioutputthread_func, NULL);
+}
+
+void gnutv_multi_stop(void)
+{
+	uint64_t packets = 0;
+	int filters = 0;
+	int i;
+
+	if (services == NULL)
+		return;
+
+	outputthread_shutdown = 1;
+	pthread_join(outputthread, NULL);
+
+	// the DVB thread may still be delivering tables
+	pthread_mutex_lock(&multi_lock);
+
+	for(i=0; i < TRANSPORT_MAX_PIDS; i++) {
+		if (pids[i].fd != -1) {
+			close(pids[i].fd);
+			filters++;
+		}
+	}
+
+	if (service_count)
+		packets = transport_remux_get_stats(services[0].remux)->packets;
+	fprintf(stderr, "Remultiplexed %llu packets from %i PID filters\n",
+		(unsigned long long) packets, filters);
+
+	for(i=0; i < service_count; i++) {
+		struct multi_service *service = &services[i];
+		struct transport_remux_stats *stats = transport_remux_get_stats(service->remux);
+
+		fprintf(stderr, "Service %i (%s): %llu packets (%llu PSI), %llu dropped, PMT version %i\n",
+			service->channel->service_id, service->channel->name,
+			(unsigned long long) stats->output, (unsigned long long) stats->psi,
+			(unsigned long long) service->dropped, stats->pmt_version);
+
+		if (service->udp) {
+			struct gnutv_udp_stats udpstats;
+
+			gnutv_udp_get_stats(service->udp, &udpstats);
+			fprintf(stderr, "  streamed %llu datagrams, %llu dropped\n",
+				(unsigned long long) udpstats.datagrams,
+				(unsigned long long) udpstats.dropped);
+			gnutv_udp_destroy(service->udp);
+		}
+		if (service->fd != -1)
+			close(service->fd);
+		transport_remux_destroy(service->remux);
+		free(service->buf);
+	}
+
+	close(dvrfd);
+	free(services);
+	services = NULL;
+	service_count = 0;
+	pthread_mutex_unlock(&multi_lock);
+	if (outaddrs)
+		freeaddrinfo(outaddrs);
+}
+
+int gnutv_multi_finished(void)
+{
+	return outputthread_finished;
+}
+
+static void *multioutputthread_func(void* arg)
+{
+	(void)arg;
+	uint8_t *buf;
+	struct pollfd pollfd;
+	struct timespec timeout = { 1, 0 };
+	int bufsize = 0;
+	int i;
+
+	buf = (uint8_t *) malloc(MULTI_READ_SIZE);
+	if (buf == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 0;
+	}
+
+	pollfd.fd = dvrfd;
+	pollfd.events = POLLIN|POLLPRI;
+
+	// every service has its own remux, so the DVR is read as it is
+	while(!outputthread_shutdown) {
+		int readsize;
+		int used;
+
+		readsize = gnutv_data_dvr_read(&pollfd, &timeout, buf + bufsize,
+					       MULTI_READ_SIZE - bufsize, NULL);
+		if (readsize == GNUTV_DVR_OVERFLOW) {
+			fprintf(stderr, "DVR overflow\n");
+			continue;
+		}
+		if (readsize < 0)
+			break;
+		if (readsize == 0)
+			continue;
+		bufsize += readsize;
+
+		// every service picks its own packets out of the whole buffer,
+		// then writes them out in one go
+		used = bufsize - (bufsize % TRANSPORT_PACKET_LENGTH);
+		for(i=0; i < service_count; i++) {
+			multi_remux(&services[i], buf, used);
+			if (multi_flush(&services[i], 0))
+				break;
+		}
+		if (i != service_count)
+			break;
+		memmove(buf, buf + used, bufsize - used);
+		bufsize -= used;
+	}
+
+	for(i=0; i < service_count; i++)
+		multi_flush(&services[i], 1);
+
+	// at the end of the input, and also after an error, so gnutv stops
+	outputthread_finished = 1;
+
+	free(buf);
+	return 0;
+}
+
+static int multi_open_output(struct multi_service *service, int index, char *outfile,
+			     char *outif)
+{
+	char filename[PATH_MAX];
+	char *subst;
+
+	switch(output_type) {
+	case OUTPUT_TYPE_FILE:
+		// substitute the channel name into the filename
+		subst = strstr(outfile, "%s");
+		if (subst == NULL) {
+			fprintf(stderr, "Output filename must contain %%s with several channels\n");
+			return -1;
+		}
+		snprintf(filename, sizeof(filename), "%.*s%s%s",
+			 (int) (subst - outfile), outfile, service->channel->name, subst + 2);
+
+		service->fd = open(filename, O_WRONLY|O_CREAT|O_LARGEFILE|O_TRUNC, 0644);
+		if (service->fd < 0) {
+			fprintf(stderr, "Failed to open output file %s\n", filename);
+			return -1;
+		}
+		break;
+
+	case OUTPUT_TYPE_UDP:
+		// each service goes to its own port
+		memcpy(&service->addr, outaddrs, sizeof(struct addrinfo));
+		memcpy(&service->sockaddr, outaddrs->ai_addr, outaddrs->ai_addrlen);
+		service->addr.ai_addr = (struct sockaddr *) &service->sockaddr;
+		service->addr.ai_next = NULL;
+		if (service->sockaddr.ss_family == AF_INET6) {
+			struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &service->sockaddr;
+			sin6->sin6_port = htons(ntohs(sin6->sin6_port) + index);
+		} else {
+			struct sockaddr_in *sin = (struct sockaddr_in *) &service->sockaddr;
+			sin->sin_port = htons(ntohs(sin->sin_port) + index);
+		}
+
+		service->fd = socket(outaddrs->ai_family, outaddrs->ai_socktype, outaddrs->ai_protocol);
+		if (service->fd < 0) {
+			fprintf(stderr, "Failed to open output socket\n");
+			return -1;
+		}
+		if (outif != NULL) {
+			if (setsockopt(service->fd, SOL_SOCKET, SO_BINDTODEVICE, outif, strlen(outif)) < 0) {
+				fprintf(stderr, "Failed to bind to interface %s\n", outif);
+				return -1;
+			}
+		}
+
+		service->udp = gnutv_udp_create(service->fd, &service->addr, usertp);
+		if (service->udp == NULL) {
+			fprintf(stderr, "Failed to create UDP stream\n");
+			return -1;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+static void multi_remux(struct multi_service *service, uint8_t *buf, int len)
+{
+	int used;
+	int outlen;
+
+	used = transport_remux_feed(service->remux, buf, len,
+				    service->buf + service->len, MULTI_OUTPUT_SIZE - service->len,
+				    &outlen);
+	service->len += outlen;
+
+	// only if the output has fallen a whole read behind
+	service->dropped += (len - used) / TRANSPORT_PACKET_LENGTH;
+}
+
+/*
+ * Write out the packets collected for a service. UDP output keeps back a
+ * partial datagram until more data arrives, unless final is set.
+ */
+static int multi_flush(struct multi_service *service, int final)
+{
+	int written = 0;
+
+	if (service->len == 0)
+		return 0;
+
+	if (service->udp) {
+		written = gnutv_udp_send(service->udp, service->buf, service->len, final);
+		if (written < 0)
+			return -1;
+	} else {
+		while(written < service->len) {
+			int tmp = write(service->fd, service->buf + written, service->len - written);
+			if (tmp == -1) {
+				if (errno != EINTR) {
+					fprintf(stderr, "Write error: %m\n");
+					return -1;
+				}
+			} else {
+				written += tmp;
+			}
+		}
+	}
+
+	memmove(service->buf, service->buf + written, service->len - written);
+	service->len -= written;
+	return 0;
+}
+
+void gnutv_multi_new_pat(int index, int pmt_pid)
+{
+	struct multi_service *service;
+
+	pthread_mutex_lock(&multi_lock);
+	if ((services == NULL) || (index >= service_count)) {
+		pthread_mutex_unlock(&multi_lock);
+		return;
+	}
+	service = &services[index];
+
+	// as for gnutv_data, the PAT itself is only added once it has been seen
+	if (multi_add_pid(TRANSPORT_PAT_PID, PID_TYPE_PAT, -1))
+		fprintf(stderr, "Unable to create dvr filter for PID %i\n", TRANSPORT_PAT_PID);
+
+	// the remux needs the PMT itself; the streams follow when it arrives
+	if (service->pmt_pid != pmt_pid) {
+		if (multi_add_pid(pmt_pid, PID_TYPE_SERVICE, index))
+			fprintf(stderr, "Unable to create dvr filter for PID %i\n", pmt_pid);
+		if (service->pmt_pid != -1)
+			multi_remove_pid(service->pmt_pid, index);
+		service->pmt_pid = pmt_pid;
+	}
+	pthread_mutex_unlock(&multi_lock);
+}
+
+int gnutv_multi_new_pmt(int index, struct mpeg_pmt_section *pmt)
+{
+	struct mpeg_pmt_stream *cur_stream;
+	uint8_t wanted[TRANSPORT_MAX_PIDS];
+	int pid;
+
+	pthread_mutex_lock(&multi_lock);
+	if ((services == NULL) || (index >= service_count) || (services[index].pmt_pid == -1)) {
+		pthread_mutex_unlock(&multi_lock);
+		return 0;
+	}
+
+	// add the new streams before dropping the old, so shared PIDs carry on
+	memset(wanted, 0, sizeof(wanted));
+	wanted[services[index].pmt_pid] = 1;
+	mpeg_pmt_section_streams_for_each(pmt, cur_stream) {
+		wanted[cur_stream->pid] = 1;
+	}
+	if (pmt->pcr_pid != TRANSPORT_NULL_PID)
+		wanted[pmt->pcr_pid] = 1;
+	for(pid=0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if (wanted[pid] && multi_add_pid(pid, PID_TYPE_SERVICE, index))
+			fprintf(stderr, "Unable to create dvr filter for PID %i\n", pid);
+	}
+	for(pid=0; pid < TRANSPORT_MAX_PIDS; pid++) {
+		if ((!wanted[pid]) && (pids[pid].type == PID_TYPE_SERVICE) &&
+		    (pids[pid].services & (1U << index)))
+			multi_remove_pid(pid, index);
+	}
+	pthread_mutex_unlock(&multi_lock);
+
+	return 1;
+}
+
+/*
+ * Add a service to a PID, creating the kernel filter if it is the first.
+ * index is -1 for the PAT, which belongs to no service.
+ */
+static int multi_add_pid(int pid, int type, int index)
+{
+	struct multi_pid *mpid = &pids[pid];
+
+	if (mpid->type == PID_TYPE_NONE) {
+		if ((mpid->fd = dvbdemux_open_demux(adapter_id, demux_id, 0)) < 0)
+			return -1;
+		if (dvbdemux_set_pid_filter(mpid->fd, pid, DVBDEMUX_INPUT_FRONTEND, DVBDEMUX_OUTPUT_DVR, 1)) {
+			close(mpid->fd);
+			mpid->fd = -1;
+			return -1;
+		}
+		mpid->type = type;
+	} else if (mpid->type != type) {
+		return -1;
+	}
+
+	if (index >= 0)
+		mpid->services |= 1U << index;
+	return 0;
+}
+
+static void multi_remove_pid(int pid, int index)
+{
+	struct multi_pid *mpid = &pids[pid];
+
+	mpid->services &= ~(1U << index);
+	if (mpid->services)
+		return;
+
+	close(mpid->fd);
+	mpid->fd = -1;
+	mpid->type = PID_TYPE_NONE;
+}
@@ -0,0 +1,82 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef gnutv_MULTI_H
+#define gnutv_MULTI_H 1
+
+#include <netdb.h>
+#include <libdvbcfg/dvbcfg_zapchannel.h>
+#include <libucsi/mpeg/section.h>
+#include <libucsi/transport_remux.h>
+
+/*
+ * Multi-service mode: several services from one multiplex are recorded or
+ * streamed at once. The DVR device is opened once, with one PID filter per
+ * distinct PID, and each service's output is remultiplexed from it in
+ * userspace as a single program stream. The kernel filters follow the tables
+ * from the DVB thread, as for gnutv_data.
+ */
+
+/* services are tracked in a 32 bit mask per PID */
+#define GNUTV_MULTI_MAX_SERVICES 32
+
+/**
+ * Start multi-service output.
+ *
+ * @param output_type OUTPUT_TYPE_FILE or OUTPUT_TYPE_UDP.
+ * @param adapter_id Adapter to use.
+ * @param demux_id Demux to use.
+ * @param buffer_size DVR buffer size, or 0 for the default.
+ * @param outfile Output filename for OUTPUT_TYPE_FILE. The first "%s" is
+ * replaced with each channel's name.
+ * @param outif Interface to bind UDP sockets to, or NULL.
+ * @param outaddrs Destination for OUTPUT_TYPE_UDP. Each service after the
+ * first is sent to the next port up.
+ * @param usertp Non-zero to send RTP rather than plain UDP.
+ * @param channels The services, all from the same multiplex.
+ * @param remuxes A transport_remux for each service, set up to extract it.
+ * They are destroyed by gnutv_multi_stop().
+ * @param count Number of services.
+ */
+extern void gnutv_multi_start(int output_type, int adapter_id, int demux_id, int buffer_size,
+			      char *outfile, char *outif, struct addrinfo *outaddrs, int usertp,
+			      struct dvbcfg_zapchannel *channels, struct transport_remux **remuxes,
+			      int count);
+extern void gnutv_multi_stop(void);
+extern int gnutv_multi_finished(void);
+
+/**
+ * A new PAT gave the PMT PID of a service.
+ *
+ * @param service Index of the service.
+ * @param pmt_pid The service's PMT PID.
+ */
+extern void gnutv_multi_new_pat(int service, int pmt_pid);
+
+/**
+ * A new version of a service's PMT was received: its streams are added to
+ * the DVR.
+ *
+ * @param service Index of the service.
+ * @param pmt The parsed PMT.
+ * @return 1 if the PMT was used.
+ */
+extern int gnutv_multi_new_pmt(int service, struct mpeg_pmt_section *pmt);
+
+#endif
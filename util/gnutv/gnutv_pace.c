@@ -0,0 +1,385 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libucsi/transport_packet.h>
+#include "gnutv_pace.h"
+#include "gnutv_udp.h"
+
+#define PCR_HZ 27000000.0
+#define PCR_MAX_GAP (PCR_HZ * 10)
+
+/* PCRs kept for interpolation: enough for several seconds of buffer */
+#define MAX_ANCHORS 256
+
+/* datagrams released per call */
+#define MAX_DUE 64
+
+/* buffer size: twice the latency at 100Mbit/s, plus some */
+#define BUFFER_BYTES_PER_MS 12500
+#define BUFFER_EXTRA_MS 200
+
+/* release error above which a datagram counts as late */
+#define LATE_THRESHOLD 0.001
+
+/* fraction of the buffer fill error corrected at each PCR, and its limit */
+#define SLEW_GAIN 0.001
+#define SLEW_MAX 0.00001
+
+struct gnutv_pace_anchor {
+	uint64_t position;		/* stream position of the PCR packet */
+	double t;			/* PCR, unwrapped, 27MHz */
+};
+
+struct gnutv_pace {
+	double latency;
+	int datagram_size;
+
+	uint8_t *buf;
+	int size;
+	int head;			/* data is buf[head..tail) */
+	int tail;
+	uint64_t head_position;		/* stream position of buf[head] */
+	int scanned;			/* offset in buf up to which PCRs have been found */
+
+	// stream time, from the PCRs
+	struct gnutv_pace_anchor anchors[MAX_ANCHORS];
+	int nanchors;
+	int pcr_pid;
+	uint64_t last_pcr;
+	double rate;			/* 27MHz ticks per byte, 0 if unknown */
+
+	// mapping of stream time to CLOCK_MONOTONIC
+	int scheduled;
+	double base_wall;
+	double base_t;
+	double target_fill;
+	double unscheduled_since;
+
+	// release times of the last due data, for the error statistics
+	double due_times[MAX_DUE];
+	int due_count;
+
+	struct gnutv_pace_stats stats;
+	double error_total;
+};
+
+static void gnutv_pace_scan(struct gnutv_pace *pace);
+static void gnutv_pace_add_pcr(struct gnutv_pace *pace, uint64_t position, uint64_t pcr, int discontinuity);
+static int gnutv_pace_time(struct gnutv_pace *pace, uint64_t position, double *t);
+static double gnutv_pace_now(void);
+
+
+struct gnutv_pace *gnutv_pace_create(int latency_ms, int datagram_size)
+{
+	struct gnutv_pace *pace;
+
+	pace = (struct gnutv_pace *) malloc(sizeof(struct gnutv_pace));
+	if (pace == NULL)
+		return NULL;
+	memset(pace, 0, sizeof(struct gnutv_pace));
+
+	pace->latency = latency_ms / 1000.0;
+	pace->datagram_size = datagram_size;
+	pace->pcr_pid = -1;
+	pace->size = ((2 * latency_ms) + BUFFER_EXTRA_MS) * BUFFER_BYTES_PER_MS;
+	pace->buf = (uint8_t *) malloc(pace->size);
+	if (pace->buf == NULL) {
+		free(pace);
+		return NULL;
+	}
+
+	return pace;
+}
+
+uint8_t *gnutv_pace_space(struct gnutv_pace *pace, int *len)
+{
+	// keep the data at the start of the buffer
+	if ((pace->head > 0) && (pace->head >= pace->size / 2)) {
+		memmove(pace->buf, pace->buf + pace->head, pace->tail - pace->head);
+		pace->tail -= pace->head;
+		pace->scanned -= pace->head;
+		pace->head = 0;
+	}
+
+	// a live source never gets this far ahead; a faster one is left waiting
+	*len = pace->size - pace->tail;
+	if ((pace->rate > 0) &&
+	    (((pace->tail - pace->head) * pace->rate) / PCR_HZ > (2 * pace->latency) + 0.1))
+		*len = 0;
+	return pace->buf + pace->tail;
+}
+
+void gnutv_pace_queued(struct gnutv_pace *pace, int len)
+{
+	pace->tail += len;
+	gnutv_pace_scan(pace);
+}
+
+int gnutv_pace_due(struct gnutv_pace *pace, int final, uint8_t **data,
+		   struct timespec *next, int *have_next)
+{
+	double now = gnutv_pace_now();
+	double next_when = 0;
+	int avail = pace->tail - pace->head;
+	int len = 0;
+
+	*have_next = 0;
+	*data = pace->buf + pace->head;
+	pace->due_count = 0;
+
+	if (final) {
+		pace->unscheduled_since = 0;
+		return avail;
+	}
+
+	while((pace->due_count < MAX_DUE) && (avail - len >= pace->datagram_size)) {
+		uint64_t position = pace->head_position + len;
+		double t;
+		double when;
+
+		if (!gnutv_pace_time(pace, position, &t)) {
+			// no timing yet: hold the data for the latency, then give up
+			if (pace->unscheduled_since == 0)
+				pace->unscheduled_since = now;
+			when = pace->unscheduled_since + pace->latency;
+			if ((when > now) && ((pace->tail - pace->head) < (pace->size / 8) * 7)) {
+				next_when = when;
+				*have_next = 1;
+				break;
+			}
+			pace->due_times[pace->due_count++] = 0;
+			len += pace->datagram_size;
+			continue;
+		}
+		pace->unscheduled_since = 0;
+
+		if (!pace->scheduled) {
+			pace->base_wall = now + pace->latency;
+			pace->base_t = t;
+			pace->scheduled = 1;
+		}
+		when = pace->base_wall + ((t - pace->base_t) / PCR_HZ);
+
+		// far behind (underrun) or ahead (a jump in the stream): start again
+		if ((when < now - pace->latency - 0.05) || (when > now + (2 * pace->latency) + 1.0)) {
+			pace->base_wall = now;
+			pace->base_t = t;
+			pace->target_fill = 0;
+			pace->stats.resyncs++;
+			when = now;
+		}
+
+		// release early rather than let the DVR overflow
+		if ((when > now) && ((pace->tail - pace->head) >= (pace->size / 8) * 7))
+			when = 0;
+
+		if (when > now) {
+			next_when = when;
+			*have_next = 1;
+			break;
+		}
+		pace->due_times[pace->due_count++] = when;
+		len += pace->datagram_size;
+	}
+
+	if (*have_next) {
+		next->tv_sec = (time_t) next_when;
+		next->tv_nsec = (long) ((next_when - next->tv_sec) * 1e9);
+	}
+
+	return len;
+}
+
+void gnutv_pace_release(struct gnutv_pace *pace, int len)
+{
+	double now = gnutv_pace_now();
+	int count = (len + pace->datagram_size - 1) / pace->datagram_size;
+	int i;
+
+	for(i = 0; i < count; i++) {
+		double error;
+
+		if ((i >= pace->due_count) || (pace->due_times[i] == 0)) {
+			pace->stats.unpaced++;
+			continue;
+		}
+		error = now - pace->due_times[i];
+		if (error < 0)
+			error = -error;
+		pace->stats.datagrams++;
+		pace->error_total += error;
+		if (error > pace->stats.error_max)
+			pace->stats.error_max = error;
+		if (error > LATE_THRESHOLD)
+			pace->stats.late++;
+	}
+	pace->due_count = 0;
+
+	pace->head += len;
+	pace->head_position += len;
+	if (pace->scanned < pace->head)
+		pace->scanned = pace->head;
+
+	// keep one PCR before the head for interpolation
+	while((pace->nanchors >= 2) && (pace->anchors[1].position <= pace->head_position)) {
+		memmove(pace->anchors, pace->anchors + 1,
+			(pace->nanchors - 1) * sizeof(struct gnutv_pace_anchor));
+		pace->nanchors--;
+	}
+}
+
+int gnutv_pace_buffered(struct gnutv_pace *pace)
+{
+	return pace->tail - pace->head;
+}
+
+void gnutv_pace_get_stats(struct gnutv_pace *pace, struct gnutv_pace_stats *stats)
+{
+	memcpy(stats, &pace->stats, sizeof(struct gnutv_pace_stats));
+	if (pace->stats.datagrams)
+		stats->error_mean = pace->error_total / pace->stats.datagrams;
+	if (pace->rate > 0) {
+		stats->bitrate = (PCR_HZ * 8) / pace->rate;
+		stats->fill = ((pace->tail - pace->head) * pace->rate) / PCR_HZ;
+	}
+}
+
+void gnutv_pace_destroy(struct gnutv_pace *pace)
+{
+	free(pace->buf);
+	free(pace);
+}
+
+static void gnutv_pace_scan(struct gnutv_pace *pace)
+{
+	while(pace->tail - pace->scanned >= TRANSPORT_PACKET_LENGTH) {
+		uint8_t *pkt = pace->buf + pace->scanned;
+		uint64_t position = pace->head_position + (pace->scanned - pace->head);
+		uint64_t pcr;
+		int discontinuity;
+		int pid;
+
+		if (pkt[0] != TRANSPORT_PACKET_SYNC) {
+			// lost sync: look for it again
+			pace->scanned++;
+			continue;
+		}
+		pace->scanned += TRANSPORT_PACKET_LENGTH;
+
+		pid = gnutv_udp_packet_pcr(pkt, pace->pcr_pid, &pcr, &discontinuity);
+		if (pid < 0)
+			continue;
+		pace->pcr_pid = pid;
+
+		gnutv_pace_add_pcr(pace, position, pcr, discontinuity);
+	}
+}
+
+static void gnutv_pace_add_pcr(struct gnutv_pace *pace, uint64_t position, uint64_t pcr, int discontinuity)
+{
+	struct gnutv_pace_anchor *last = pace->nanchors ? &pace->anchors[pace->nanchors - 1] : NULL;
+	double t = pcr;
+
+	if (last) {
+		uint64_t delta = gnutv_pcr_delta(pace->last_pcr, pcr);
+
+		if (position <= last->position)
+			return;
+
+		if (!discontinuity && (delta > 0) && (delta < PCR_MAX_GAP)) {
+			t = last->t + delta;
+			pace->rate = (double) delta / (position - last->position);
+		} else {
+			// a jump: carry the stream time on at the last rate
+			t = last->t + ((position - last->position) * pace->rate);
+		}
+	}
+	pace->last_pcr = pcr;
+
+	if (pace->nanchors == MAX_ANCHORS) {
+		memmove(pace->anchors, pace->anchors + 1,
+			(MAX_ANCHORS - 1) * sizeof(struct gnutv_pace_anchor));
+		pace->nanchors--;
+	}
+	pace->anchors[pace->nanchors].position = position;
+	pace->anchors[pace->nanchors].t = t;
+	pace->nanchors++;
+
+	// correct slowly for the difference between the sender's and the
+	// stream's clocks, by keeping the time the newest data is buffered for
+	// constant
+	if (pace->scheduled && (pace->rate > 0)) {
+		double fill = pace->base_wall + ((t - pace->base_t) / PCR_HZ) - gnutv_pace_now();
+		double slew;
+
+		if (pace->target_fill == 0) {
+			pace->target_fill = fill;
+		} else {
+			slew = (pace->target_fill - fill) * SLEW_GAIN;
+			if (slew > SLEW_MAX)
+				slew = SLEW_MAX;
+			if (slew < -SLEW_MAX)
+				slew = -SLEW_MAX;
+			pace->base_wall += slew;
+		}
+	}
+}
+
+/*
+ * Stream time of a position: interpolated between the PCRs either side of
+ * it, or extrapolated from the nearest at the current rate.
+ */
+static int gnutv_pace_time(struct gnutv_pace *pace, uint64_t position, double *t)
+{
+	struct gnutv_pace_anchor *a;
+	int i;
+
+	if (pace->nanchors == 0)
+		return 0;
+
+	for(i = pace->nanchors - 1; i > 0; i--) {
+		if (pace->anchors[i].position <= position)
+			break;
+	}
+	a = &pace->anchors[i];
+
+	if ((a->position <= position) && (i + 1 < pace->nanchors)) {
+		struct gnutv_pace_anchor *b = &pace->anchors[i + 1];
+
+		*t = a->t + ((b->t - a->t) * (position - a->position)) / (b->position - a->position);
+		return 1;
+	}
+
+	if (pace->rate <= 0)
+		return 0;
+	*t = a->t + (((double) position - (double) a->position) * pace->rate);
+	return 1;
+}
+
+static double gnutv_pace_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + (now.tv_nsec / 1e9);
+}
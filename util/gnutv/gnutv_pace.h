@@ -0,0 +1,105 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef gnutv_PACE_H
+#define gnutv_PACE_H 1
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The pacer buffers transport stream data between the DVR and the network,
+ * and releases it at the rate given by the PCRs in the stream, delayed by a
+ * fixed latency, instead of in the bursts the DVR delivers it in.
+ */
+
+struct gnutv_pace_stats {
+	uint64_t datagrams;		/* datagrams released on schedule */
+	uint64_t unpaced;		/* released without a schedule (no PCR yet, buffer full) */
+	uint64_t late;			/* released more than 1ms after their time */
+	uint64_t resyncs;		/* schedule restarted (PCR jumps, underruns) */
+	double error_mean;		/* mean absolute release error, seconds */
+	double error_max;		/* maximum absolute release error, seconds */
+	double bitrate;			/* mux bitrate from the PCRs, bits per second */
+	double fill;			/* current buffer fill, seconds of stream */
+};
+
+struct gnutv_pace;
+
+/**
+ * Create a pacer.
+ *
+ * @param latency_ms Delay between data arriving and being released.
+ * @param datagram_size Data is released in multiples of this many bytes.
+ * @return The pacer, or NULL on error.
+ */
+extern struct gnutv_pace *gnutv_pace_create(int latency_ms, int datagram_size);
+
+/**
+ * Get the free space at the end of the buffer, for reading new data into.
+ *
+ * @param pace The pacer.
+ * @param len Set to the number of bytes available. This is 0 when more than
+ * twice the latency is already buffered, so a source faster than real time
+ * is held back rather than filling the buffer.
+ * @return Where to put the data.
+ */
+extern uint8_t *gnutv_pace_space(struct gnutv_pace *pace, int *len);
+
+/**
+ * Add data placed in the space returned by gnutv_pace_space().
+ *
+ * @param pace The pacer.
+ * @param len Number of bytes added.
+ */
+extern void gnutv_pace_queued(struct gnutv_pace *pace, int len);
+
+/**
+ * Find data which is due to be sent.
+ *
+ * @param pace The pacer.
+ * @param final Non-zero to release everything, including a short datagram
+ * at the end.
+ * @param data Set to the due data.
+ * @param next Set to the absolute CLOCK_MONOTONIC time at which more data
+ * will be due, if any is buffered.
+ * @return Number of bytes due (a multiple of the datagram size unless final),
+ * or 0 if none. In that case next is valid if 1 is returned in *have_next.
+ */
+extern int gnutv_pace_due(struct gnutv_pace *pace, int final, uint8_t **data,
+			  struct timespec *next, int *have_next);
+
+/**
+ * Remove data which has been sent.
+ *
+ * @param pace The pacer.
+ * @param len Number of bytes sent (from the start of the due data).
+ */
+extern void gnutv_pace_release(struct gnutv_pace *pace, int len);
+
+/**
+ * @return Number of bytes buffered.
+ */
+extern int gnutv_pace_buffered(struct gnutv_pace *pace);
+
+extern void gnutv_pace_get_stats(struct gnutv_pace *pace, struct gnutv_pace_stats *stats);
+
+extern void gnutv_pace_destroy(struct gnutv_pace *pace);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "gnutv_ring.h"
+
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* keep the producer's and consumer's fields on separate cache lines */
+#define CACHE_LINE 64
+
+struct gnutv_ring {
+	uint8_t *buf;			/* size bytes, mapped twice */
+	size_t size;
+	int hugepages;
+
+	/* written by the producer only */
+	size_t tail __attribute__((aligned(CACHE_LINE)));
+	size_t high_water;
+	uint64_t full;
+	double full_since;		/* when the ring became full, or 0 */
+	double full_max;
+	uint64_t overflows;
+	int eof;
+
+	/* written by the consumer only */
+	size_t head __attribute__((aligned(CACHE_LINE)));
+	double data_time;
+	uint64_t stalls;
+	double stall_max;
+	double stall_total;
+
+	/* only used to sleep and wake */
+	int producer_waiting __attribute__((aligned(CACHE_LINE)));
+	int consumer_waiting;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static double gnutv_ring_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/*
+ * Map a memfd of the given size twice in a row. Huge pages need the mapping
+ * aligned to the huge page size.
+ */
+static uint8_t *gnutv_ring_map(size_t size, unsigned int flags, size_t align)
+{
+	uint8_t *reserve;
+	uint8_t *buf;
+	int fd;
+
+	if ((fd = memfd_create("gnutv_ring", flags)) < 0)
+		return NULL;
+	if (ftruncate(fd, size)) {
+		close(fd);
+		return NULL;
+	}
+
+	reserve = mmap(NULL, (2 * size) + align, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (reserve == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	buf = (uint8_t *) (((uintptr_t) reserve + align - 1) & ~(uintptr_t) (align - 1));
+
+	if ((mmap(buf, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) ||
+	    (mmap(buf + size, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED)) {
+		munmap(reserve, (2 * size) + align);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	// release the alignment slack either side
+	if (buf > reserve)
+		munmap(reserve, buf - reserve);
+	if (reserve + align > buf)
+		munmap(buf + (2 * size), (reserve + align) - buf);
+
+	// fault it all in now, rather than when the writer first falls behind
+	memset(buf, 0, size);
+	return buf;
+}
+
+struct gnutv_ring *gnutv_ring_create(size_t size)
+{
+	struct gnutv_ring *ring;
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t hsize = (size + HUGE_PAGE_SIZE - 1) & ~(size_t) (HUGE_PAGE_SIZE - 1);
+
+	if ((size == 0) || (size > INT_MAX / 2))
+		return NULL;
+	if (posix_memalign((void **) &ring, CACHE_LINE, sizeof(struct gnutv_ring)))
+		return NULL;
+	memset(ring, 0, sizeof(struct gnutv_ring));
+
+	// huge pages only exist if the administrator has reserved some
+	ring->buf = gnutv_ring_map(hsize, MFD_HUGETLB, HUGE_PAGE_SIZE);
+	if (ring->buf) {
+		ring->size = hsize;
+		ring->hugepages = 1;
+	} else {
+		ring->size = (size + page - 1) & ~(page - 1);
+		ring->buf = gnutv_ring_map(ring->size, 0, page);
+	}
+	if (ring->buf == NULL) {
+		free(ring);
+		return NULL;
+	}
+
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->cond, NULL);
+	return ring;
+}
+
+/*
+ * Wake the other thread if it is sleeping. The fence orders the caller's
+ * update of head or tail before the check of the flag, while the sleeper sets
+ * the flag before checking head and tail: one of them must see the other.
+ */
+static void gnutv_ring_wake(struct gnutv_ring *ring, int *waiting)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&ring->lock);
+		pthread_cond_broadcast(&ring->cond);
+		pthread_mutex_unlock(&ring->lock);
+	}
+}
+
+/*
+ * Sleep until ready() is true, or the timeout.
+ */
+static int gnutv_ring_sleep(struct gnutv_ring *ring, int *waiting,
+			    int (*ready)(struct gnutv_ring *ring, int min), int min, int timeout_ms)
+{
+	struct timespec ts;
+	int res = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&ring->lock);
+	__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+	while (!ready(ring, min) && (res != ETIMEDOUT))
+		res = pthread_cond_timedwait(&ring->cond, &ring->lock, &ts);
+	__atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&ring->lock);
+
+	return ready(ring, min) ? 0 : -1;
+}
+
+static int gnutv_ring_space_ready(struct gnutv_ring *ring, int min)
+{
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	return ring->size - (ring->tail - head) >= (size_t) min;
+}
+
+static int gnutv_ring_data_ready(struct gnutv_ring *ring, int min)
+{
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	return (tail - ring->head >= (size_t) min) || __atomic_load_n(&ring->eof, __ATOMIC_ACQUIRE);
+}
+
+uint8_t *gnutv_ring_space(struct gnutv_ring *ring, int *len)
+{
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	*len = ring->size - (ring->tail - head);
+	return ring->buf + (ring->tail % ring->size);
+}
+
+void gnutv_ring_produced(struct gnutv_ring *ring, int len)
+{
+	size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&ring->tail, ring->tail + len, __ATOMIC_RELEASE);
+	if (ring->tail - head > ring->high_water)
+		ring->high_water = ring->tail - head;
+	gnutv_ring_wake(ring, &ring->consumer_waiting);
+}
+
+int gnutv_ring_wait_space(struct gnutv_ring *ring, int min, int timeout_ms)
+{
+	if (!gnutv_ring_space_ready(ring, min)) {
+		// the writer has fallen a whole ring behind
+		if (ring->full_since == 0) {
+			ring->full_since = gnutv_ring_now();
+			ring->full++;
+		}
+		if (gnutv_ring_sleep(ring, &ring->producer_waiting, gnutv_ring_space_ready, min, timeout_ms))
+			return -1;
+	}
+
+	if (ring->full_since != 0) {
+		double wait = gnutv_ring_now() - ring->full_since;
+
+		if (wait > ring->full_max)
+			ring->full_max = wait;
+		ring->full_since = 0;
+	}
+	return 0;
+}
+
+void gnutv_ring_eof(struct gnutv_ring *ring)
+{
+	__atomic_store_n(&ring->eof, 1, __ATOMIC_RELEASE);
+	gnutv_ring_wake(ring, &ring->consumer_waiting);
+}
+
+void gnutv_ring_overflow(struct gnutv_ring *ring)
+{
+	ring->overflows++;
+}
+
+uint8_t *gnutv_ring_data(struct gnutv_ring *ring, int *len)
+{
+	size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	*len = tail - ring->head;
+	ring->data_time = gnutv_ring_now();
+	return ring->buf + (ring->head % ring->size);
+}
+
+void gnutv_ring_consumed(struct gnutv_ring *ring, int len)
+{
+	double write_time = gnutv_ring_now() - ring->data_time;
+
+	if (write_time * 1000 > GNUTV_RING_STALL_MS) {
+		ring->stalls++;
+		ring->stall_total += write_time;
+	}
+	if (write_time > ring->stall_max)
+		ring->stall_max = write_time;
+
+	__atomic_store_n(&ring->head, ring->head + len, __ATOMIC_RELEASE);
+	gnutv_ring_wake(ring, &ring->producer_waiting);
+}
+
+int gnutv_ring_wait_data(struct gnutv_ring *ring, int min, int timeout_ms)
+{
+	size_t tail;
+
+	if (!gnutv_ring_data_ready(ring, min) &&
+	    gnutv_ring_sleep(ring, &ring->consumer_waiting, gnutv_ring_data_ready, min, timeout_ms))
+		return -1;
+
+	// re-read tail after eof, as the last data was produced before it was set
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (tail - ring->head < (size_t) min)
+		return 1;
+	return 0;
+}
+
+void gnutv_ring_get_stats(struct gnutv_ring *ring, struct gnutv_ring_stats *stats)
+{
+	stats->size = ring->size;
+	stats->hugepages = ring->hugepages;
+	stats->bytes = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	stats->high_water = ring->high_water;
+	stats->full = ring->full;
+	stats->full_max = ring->full_max;
+	stats->stalls = ring->stalls;
+	stats->stall_max = ring->stall_max;
+	stats->stall_total = ring->stall_total;
+	stats->overflows = ring->overflows;
+}
+
+void gnutv_ring_destroy(struct gnutv_ring *ring)
+{
+	munmap(ring->buf, 2 * ring->size);
+	pthread_mutex_destroy(&ring->lock);
+	pthread_cond_destroy(&ring->cond);
+	free(ring);
+}
@@ -0,0 +1,139 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef gnutv_RING_H
+#define gnutv_RING_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * The ring passes data from the thread reading the DVR to the thread writing
+ * the output, so that a slow disk or network holds up the writer only, while
+ * the reader keeps the kernel's DVR buffer empty.
+ *
+ * There must be exactly one producer and one consumer thread. Neither takes
+ * a lock to pass data; a lock is only used by a thread going to sleep, to be
+ * woken by the other. The memory is mapped twice, back to back, so the data
+ * and free space are always contiguous.
+ */
+
+/* a write taking longer than this counts as a stall */
+#define GNUTV_RING_STALL_MS 10
+
+struct gnutv_ring_stats {
+	size_t size;			/* ring size in bytes */
+	int hugepages;			/* non-zero if backed by huge pages */
+	uint64_t bytes;			/* bytes passed through */
+	size_t high_water;		/* most bytes ever buffered */
+	uint64_t full;			/* times the producer waited for space */
+	double full_max;		/* longest wait for space, seconds */
+	uint64_t stalls;		/* consumer writes longer than GNUTV_RING_STALL_MS */
+	double stall_max;		/* longest consumer write, seconds */
+	double stall_total;		/* time spent in stalled writes, seconds */
+	uint64_t overflows;		/* DVR overflows reported by the producer */
+};
+
+struct gnutv_ring;
+
+/**
+ * Create a ring.
+ *
+ * @param size Size in bytes. This is rounded up to the page size, or the huge
+ * page size if huge pages are available.
+ * @return The ring, or NULL on error.
+ */
+extern struct gnutv_ring *gnutv_ring_create(size_t size);
+
+/**
+ * Get the free space, for the producer to read new data into.
+ *
+ * @param ring The ring.
+ * @param len Set to the number of bytes available.
+ * @return Where to put the data.
+ */
+extern uint8_t *gnutv_ring_space(struct gnutv_ring *ring, int *len);
+
+/**
+ * Make data placed in the space returned by gnutv_ring_space() available to
+ * the consumer.
+ *
+ * @param ring The ring.
+ * @param len Number of bytes added.
+ */
+extern void gnutv_ring_produced(struct gnutv_ring *ring, int len);
+
+/**
+ * Wait until there is free space, or a timeout.
+ *
+ * @param ring The ring.
+ * @param min Number of bytes of space wanted.
+ * @param timeout_ms Maximum time to wait.
+ * @return 0 if there is space, -1 on timeout.
+ */
+extern int gnutv_ring_wait_space(struct gnutv_ring *ring, int min, int timeout_ms);
+
+/**
+ * Mark the end of the data: the consumer is woken to finish it off.
+ *
+ * @param ring The ring.
+ */
+extern void gnutv_ring_eof(struct gnutv_ring *ring);
+
+/**
+ * Count a DVR overflow in the ring's statistics.
+ *
+ * @param ring The ring.
+ */
+extern void gnutv_ring_overflow(struct gnutv_ring *ring);
+
+/**
+ * Get the buffered data, for the consumer. The time until the matching
+ * gnutv_ring_consumed() call is measured as a write.
+ *
+ * @param ring The ring.
+ * @param len Set to the number of bytes available.
+ * @return Pointer to the data.
+ */
+extern uint8_t *gnutv_ring_data(struct gnutv_ring *ring, int *len);
+
+/**
+ * Free data which has been written.
+ *
+ * @param ring The ring.
+ * @param len Number of bytes written (from the start of the data).
+ */
+extern void gnutv_ring_consumed(struct gnutv_ring *ring, int len);
+
+/**
+ * Wait until there is data to write, or a timeout.
+ *
+ * @param ring The ring.
+ * @param min Number of bytes wanted.
+ * @param timeout_ms Maximum time to wait.
+ * @return 0 if there is data, -1 on timeout, or 1 if the end of the data
+ * was marked and fewer than min bytes remain.
+ */
+extern int gnutv_ring_wait_data(struct gnutv_ring *ring, int min, int timeout_ms);
+
+extern void gnutv_ring_get_stats(struct gnutv_ring *ring, struct gnutv_ring_stats *stats);
+
+extern void gnutv_ring_destroy(struct gnutv_ring *ring);
+
+#endif
@@ -0,0 +1,390 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#define _GNU_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <libucsi/transport_packet.h>
+#include "gnutv_udp.h"
+
+#define RTP_HEADER_SIZE 12
+
+/* a GSO send is limited to 64 segments, and to 64k in total */
+#define GSO_MAX_SEGMENTS 64
+#define GSO_MAX_BYTES 65000
+
+#define PCR_HZ 27000000ULL
+
+/*
+ * The rate assumed until two PCRs have given the real one. It is above that of
+ * any broadcast multiplex, so the timestamps step forwards, never backwards,
+ * when the real rate is found.
+ */
+#define NOMINAL_BITRATE 100000000
+
+struct gnutv_udp_stream {
+	int fd;
+	struct addrinfo *addr;
+	int usertp;
+	int gso;
+	int gso_segments;
+
+	// RTP state
+	uint16_t rtpseq;
+	uint32_t ssrc;
+	uint8_t headers[GNUTV_UDP_BATCH][RTP_HEADER_SIZE];
+
+	// PCR tracking for RTP timestamps
+	uint64_t position;		/* stream bytes consumed so far */
+	int pcr_pid;
+	int pcr_valid;			/* a PCR has been seen */
+	uint64_t pcr;			/* the last PCR... */
+	uint64_t pcr_position;		/* ...and its position in the stream */
+	double pcr_per_byte;		/* 27MHz ticks per stream byte */
+	uint32_t timestamp_offset;	/* keeps timestamps continuous over PCR jumps */
+
+	struct mmsghdr msgs[GNUTV_UDP_BATCH];
+	struct iovec iovs[GNUTV_UDP_BATCH * 2];
+
+	struct gnutv_udp_stats stats;
+};
+
+static void gnutv_udp_scan_pcr(struct gnutv_udp_stream *stream, uint8_t *buf, int len);
+static uint32_t gnutv_udp_timestamp(struct gnutv_udp_stream *stream);
+static int gnutv_udp_send_gso(struct gnutv_udp_stream *stream, int count, uint8_t *buf, int len);
+static int gnutv_udp_send_mmsg(struct gnutv_udp_stream *stream, int count, uint8_t *buf, int len);
+
+
+struct gnutv_udp_stream *gnutv_udp_create(int fd, struct addrinfo *addr, int usertp)
+{
+	struct gnutv_udp_stream *stream;
+	int segment_size;
+
+	stream = (struct gnutv_udp_stream *) malloc(sizeof(struct gnutv_udp_stream));
+	if (stream == NULL)
+		return NULL;
+	memset(stream, 0, sizeof(struct gnutv_udp_stream));
+	stream->fd = fd;
+	stream->addr = addr;
+	stream->usertp = usertp;
+	stream->pcr_pid = -1;
+
+	if (usertp) {
+		srandom(time(NULL));
+		stream->ssrc = random();
+		stream->rtpseq = random();
+		stream->timestamp_offset = random();
+	}
+	stream->pcr_per_byte = (double) (PCR_HZ * 8) / NOMINAL_BITRATE;
+
+	// use UDP GSO if the kernel has it: the whole batch in one sendmsg()
+	segment_size = GNUTV_UDP_PAYLOAD_SIZE + (usertp ? RTP_HEADER_SIZE : 0);
+	stream->gso_segments = GSO_MAX_BYTES / segment_size;
+	if (stream->gso_segments > GSO_MAX_SEGMENTS)
+		stream->gso_segments = GSO_MAX_SEGMENTS;
+	if (stream->gso_segments > GNUTV_UDP_BATCH)
+		stream->gso_segments = GNUTV_UDP_BATCH;
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0)
+		stream->gso = 1;
+	stream->stats.gso = stream->gso;
+
+	return stream;
+}
+
+int gnutv_udp_send(struct gnutv_udp_stream *stream, uint8_t *buf, int len, int final)
+{
+	int consumed = 0;
+
+	while(consumed < len) {
+		int count = (len - consumed) / GNUTV_UDP_PAYLOAD_SIZE;
+		int bytes;
+		int i;
+
+		// a short datagram is only sent at the end
+		if (count == 0) {
+			if (!final)
+				break;
+			count = 1;
+		}
+		if (count > GNUTV_UDP_BATCH)
+			count = GNUTV_UDP_BATCH;
+		if (stream->gso && (count > stream->gso_segments))
+			count = stream->gso_segments;
+		bytes = count * GNUTV_UDP_PAYLOAD_SIZE;
+		if (bytes > len - consumed)
+			bytes = len - consumed;
+
+		// RTP headers, one per datagram
+		if (stream->usertp) {
+			for(i = 0; i < count; i++) {
+				uint8_t *hdr = stream->headers[i];
+				uint8_t *payload = buf + consumed + (i * GNUTV_UDP_PAYLOAD_SIZE);
+				int payload_len = GNUTV_UDP_PAYLOAD_SIZE;
+				uint32_t timestamp;
+
+				if (payload_len > bytes - (i * GNUTV_UDP_PAYLOAD_SIZE))
+					payload_len = bytes - (i * GNUTV_UDP_PAYLOAD_SIZE);
+
+				// the timestamp is that of the first byte of the datagram
+				timestamp = gnutv_udp_timestamp(stream);
+				gnutv_udp_scan_pcr(stream, payload, payload_len);
+				stream->position += payload_len;
+
+				hdr[0x0] = 0x80;
+				hdr[0x1] = 0x21;
+				hdr[0x2] = stream->rtpseq >> 8;
+				hdr[0x3] = stream->rtpseq;
+				hdr[0x4] = timestamp >> 24;
+				hdr[0x5] = timestamp >> 16;
+				hdr[0x6] = timestamp >> 8;
+				hdr[0x7] = timestamp;
+				hdr[0x8] = stream->ssrc >> 24;
+				hdr[0x9] = stream->ssrc >> 16;
+				hdr[0xa] = stream->ssrc >> 8;
+				hdr[0xb] = stream->ssrc;
+				stream->rtpseq++;
+			}
+		}
+
+		if (stream->gso) {
+			if (gnutv_udp_send_gso(stream, count, buf + consumed, bytes) < 0)
+				return -1;
+		} else {
+			if (gnutv_udp_send_mmsg(stream, count, buf + consumed, bytes) < 0)
+				return -1;
+		}
+		consumed += bytes;
+	}
+
+	return consumed;
+}
+
+void gnutv_udp_overflow(struct gnutv_udp_stream *stream)
+{
+	stream->stats.overflows++;
+}
+
+void gnutv_udp_get_stats(struct gnutv_udp_stream *stream, struct gnutv_udp_stats *stats)
+{
+	memcpy(stats, &stream->stats, sizeof(struct gnutv_udp_stats));
+}
+
+void gnutv_udp_destroy(struct gnutv_udp_stream *stream)
+{
+	free(stream);
+}
+
+int gnutv_udp_packet_pcr(uint8_t *pkt, int pcr_pid, uint64_t *pcr, int *discontinuity)
+{
+	struct transport_packet *tspkt;
+	struct transport_values values;
+	int pid;
+
+	// cheap test for a PCR before parsing the adaptation field properly
+	if (!(pkt[3] & 0x20) || (pkt[4] == 0) || !(pkt[5] & transport_adaptation_flag_pcr))
+		return -1;
+	if ((tspkt = transport_packet_init(pkt)) == NULL)
+		return -1;
+	pid = transport_packet_pid(tspkt);
+	if ((pcr_pid != -1) && (pid != pcr_pid))
+		return -1;
+	if (transport_packet_values_extract_pcr(tspkt, &values) < 0)
+		return -1;
+	if (!(values.flags & transport_adaptation_flag_pcr))
+		return -1;
+
+	*pcr = values.pcr;
+	*discontinuity = (values.flags & transport_adaptation_flag_discontinuity) ? 1 : 0;
+	return pid;
+}
+
+static void gnutv_udp_scan_pcr(struct gnutv_udp_stream *stream, uint8_t *buf, int len)
+{
+	int pos;
+
+	for(pos = 0; pos + TRANSPORT_PACKET_LENGTH <= len; pos += TRANSPORT_PACKET_LENGTH) {
+		uint64_t position = stream->position + pos;
+		uint64_t pcr;
+		uint64_t delta;
+		int discontinuity;
+		int pid;
+
+		pid = gnutv_udp_packet_pcr(buf + pos, stream->pcr_pid, &pcr, &discontinuity);
+		if (pid < 0)
+			continue;
+		stream->pcr_pid = pid;
+
+		// estimate the rate from successive PCRs
+		delta = gnutv_pcr_delta(stream->pcr, pcr);
+		if (stream->pcr_valid && !discontinuity && (delta > 0) && (delta < PCR_HZ)) {
+			if (position > stream->pcr_position)
+				stream->pcr_per_byte = (double) delta / (position - stream->pcr_position);
+		} else {
+			// first PCR or a discontinuity: carry on from the current timestamp
+			uint32_t timestamp;
+
+			stream->position = position;
+			timestamp = gnutv_udp_timestamp(stream);
+			stream->position -= pos;
+			stream->timestamp_offset = timestamp - (uint32_t) (pcr / 300);
+		}
+		stream->pcr = pcr;
+		stream->pcr_position = position;
+		stream->pcr_valid = 1;
+	}
+}
+
+/*
+ * RTP timestamp (90kHz) of the next stream byte, interpolated from the last
+ * PCR. Until two PCRs have given the stream's rate, NOMINAL_BITRATE is
+ * assumed, so datagrams never share a timestamp.
+ * RTP only needs timestamps to advance at the right rate, so their origin is
+ * random, and chosen to avoid steps where the timing source changes.
+ */
+static uint32_t gnutv_udp_timestamp(struct gnutv_udp_stream *stream)
+{
+	uint64_t pcr;
+
+	pcr = stream->pcr +
+	      (uint64_t) ((stream->position - stream->pcr_position) * stream->pcr_per_byte);
+	return (uint32_t) (pcr / 300) + stream->timestamp_offset;
+}
+
+static int gnutv_udp_send_gso(struct gnutv_udp_stream *stream, int count, uint8_t *buf, int len)
+{
+	struct msghdr msg;
+	int iovcount = 0;
+	int i;
+
+	// headers and payloads are gathered, then cut into datagrams by the kernel
+	for(i = 0; i < count; i++) {
+		int offset = i * GNUTV_UDP_PAYLOAD_SIZE;
+		int payload_len = len - offset;
+
+		if (payload_len > GNUTV_UDP_PAYLOAD_SIZE)
+			payload_len = GNUTV_UDP_PAYLOAD_SIZE;
+		if (stream->usertp) {
+			stream->iovs[iovcount].iov_base = stream->headers[i];
+			stream->iovs[iovcount].iov_len = RTP_HEADER_SIZE;
+			iovcount++;
+		}
+		stream->iovs[iovcount].iov_base = buf + offset;
+		stream->iovs[iovcount].iov_len = payload_len;
+		iovcount++;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = stream->addr->ai_addr;
+	msg.msg_namelen = stream->addr->ai_addrlen;
+	msg.msg_iov = stream->iovs;
+	msg.msg_iovlen = iovcount;
+
+	while(1) {
+		stream->stats.calls++;
+		if (sendmsg(stream->fd, &msg, 0) >= 0)
+			break;
+		if (errno == EINTR)
+			continue;
+
+		// GSO rejected (e.g. by the route's device): do without it
+		if ((errno == EIO) || (errno == EINVAL) || (errno == EOPNOTSUPP)) {
+			int zero = 0;
+
+			setsockopt(stream->fd, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero));
+			stream->gso = 0;
+			stream->stats.gso = 0;
+			return gnutv_udp_send_mmsg(stream, count, buf, len);
+		}
+		if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+			stream->stats.dropped += count;
+			return 0;
+		}
+		fprintf(stderr, "Socket send failure: %m\n");
+		return -1;
+	}
+
+	stream->stats.datagrams += count;
+	stream->stats.bytes += len;
+	return 0;
+}
+
+static int gnutv_udp_send_mmsg(struct gnutv_udp_stream *stream, int count, uint8_t *buf, int len)
+{
+	int sent = 0;
+	int i;
+
+	for(i = 0; i < count; i++) {
+		struct msghdr *msg = &stream->msgs[i].msg_hdr;
+		struct iovec *iov = &stream->iovs[i * 2];
+		int offset = i * GNUTV_UDP_PAYLOAD_SIZE;
+		int payload_len = len - offset;
+
+		if (payload_len > GNUTV_UDP_PAYLOAD_SIZE)
+			payload_len = GNUTV_UDP_PAYLOAD_SIZE;
+
+		memset(msg, 0, sizeof(struct msghdr));
+		msg->msg_name = stream->addr->ai_addr;
+		msg->msg_namelen = stream->addr->ai_addrlen;
+		msg->msg_iov = iov;
+		if (stream->usertp) {
+			iov->iov_base = stream->headers[i];
+			iov->iov_len = RTP_HEADER_SIZE;
+			iov++;
+			msg->msg_iovlen = 1;
+		}
+		iov->iov_base = buf + offset;
+		iov->iov_len = payload_len;
+		msg->msg_iovlen++;
+	}
+
+	while(sent < count) {
+		int tmp;
+
+		stream->stats.calls++;
+		tmp = sendmmsg(stream->fd, stream->msgs + sent, count - sent, 0);
+		if (tmp < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == ENOBUFS) || (errno == EAGAIN)) {
+				// lose this datagram, carry on with the rest
+				stream->stats.dropped++;
+				sent++;
+				continue;
+			}
+			fprintf(stderr, "Socket send failure: %m\n");
+			return -1;
+		}
+
+		for(i = sent; i < sent + tmp; i++) {
+			stream->stats.bytes += stream->msgs[i].msg_hdr.msg_iov[stream->usertp ? 1 : 0].iov_len;
+		}
+		stream->stats.datagrams += tmp;
+		sent += tmp;
+	}
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+	gnutv utility
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef gnutv_UDP_H
+#define gnutv_UDP_H 1
+
+#include <stdint.h>
+#include <netdb.h>
+
+/* seven transport packets per datagram, as is usual for IPTV */
+#define GNUTV_UDP_PAYLOAD_SIZE (188*7)
+
+/* number of datagrams sent per system call */
+#define GNUTV_UDP_BATCH 64
+
+/* PCRs wrap at 2^33 90kHz ticks, in 27MHz units */
+#define GNUTV_PCR_WRAP (0x200000000ULL * 300)
+
+struct gnutv_udp_stats {
+	uint64_t datagrams;		/* datagrams sent */
+	uint64_t bytes;			/* transport stream bytes sent */
+	uint64_t dropped;		/* datagrams which could not be sent */
+	uint64_t calls;			/* send system calls */
+	uint64_t overflows;		/* DVR overflows reported by the caller */
+	int gso;			/* non-zero if UDP GSO is in use */
+};
+
+struct gnutv_udp_stream;
+
+/**
+ * Create a UDP/RTP stream sending to an already opened socket.
+ *
+ * @param fd The socket.
+ * @param addr Destination address.
+ * @param usertp Non-zero to send RTP, otherwise plain UDP.
+ * @return The stream, or NULL on error.
+ */
+extern struct gnutv_udp_stream *gnutv_udp_create(int fd, struct addrinfo *addr, int usertp);
+
+/**
+ * Send the complete datagrams in a block of transport packets. RTP
+ * timestamps are derived from the PCRs in the data.
+ *
+ * @param stream The stream.
+ * @param buf The packets.
+ * @param len Number of bytes in buf.
+ * @param final Non-zero to also send a last, short, datagram.
+ * @return The number of bytes consumed from buf (the caller should pass the
+ * remainder again with more data), or -1 on a fatal error.
+ */
+extern int gnutv_udp_send(struct gnutv_udp_stream *stream, uint8_t *buf, int len, int final);
+
+/**
+ * Find the PCR in a transport packet. Used for the RTP timestamps, and by the
+ * pacer.
+ *
+ * @param pkt The packet.
+ * @param pcr_pid Only accept a PCR on this PID, or -1 for any PID.
+ * @param pcr Set to the PCR, in 27MHz ticks.
+ * @param discontinuity Set to non-zero if the discontinuity_indicator is set.
+ * @return The PID of the PCR, or -1 if the packet does not carry one.
+ */
+extern int gnutv_udp_packet_pcr(uint8_t *pkt, int pcr_pid, uint64_t *pcr, int *discontinuity);
+
+/**
+ * Ticks between two PCRs, allowing for the wrap.
+ *
+ * @param from The earlier PCR.
+ * @param to The later PCR.
+ * @return The difference in 27MHz ticks.
+ */
+static inline uint64_t gnutv_pcr_delta(uint64_t from, uint64_t to)
+{
+	return (to + GNUTV_PCR_WRAP - from) % GNUTV_PCR_WRAP;
+}
+
+/**
+ * Count a DVR overflow in the stream's statistics.
+ */
+extern void gnutv_udp_overflow(struct gnutv_udp_stream *stream);
+
+/**
+ * Retrieve the stream's counters.
+ */
+extern void gnutv_udp_get_stats(struct gnutv_udp_stream *stream, struct gnutv_udp_stats *stats);
+
+extern void gnutv_udp_destroy(struct gnutv_udp_stream *stream);
+
+#endif
@@ -21,10 +21,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <time.h>
@@ -35,9 +37,11 @@
 #include <ctype.h>
 #include <iconv.h>
 #include <langinfo.h>
+#include <pthread.h>
 
 #include <linux/dvb/frontend.h>
 #include <linux/dvb/dmx.h>
+#include <libdvbapi/dvbdemux.h>
 
 #include "list.h"
 #include "diseqc.h"
@@ -48,15 +52,29 @@
 
 #include "atsc_psip_section.h"
 
-static char demux_devname[80];
+/* Each adapter scans in a thread of its own, so the state belonging to the
+ * tuner and its filters is per thread. The transponder and service lists are
+ * shared, and protected by scan_lock.
+ */
+static __thread char demux_devname[80];
+static __thread int demux_adapter;
+static __thread int demux_id;
 
-static struct dvb_frontend_info fe_info = {
+static __thread struct dvb_frontend_info fe_info = {
 	.type = -1
 };
 
+static pthread_mutex_t scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t scan_cond = PTHREAD_COND_INITIALIZER;
+static int scan_busy;	/* adapters scanning a transponder */
+
+#define MAX_ADAPTERS 16
+
 int verbosity = 2;
 
 static int long_timeout;
+static const char *state_file;
+static int max_filters;		/* 0: as many as the demux allows */
 static int current_tp_only;
 static int get_other_nits;
 static int vdr_dump_provider;
@@ -149,6 +167,13 @@ struct transponder {
 	unsigned int wrong_frequency	  : 1;	/* DVB-T with other_frequency_flag */
 	int n_other_f;
 	uint32_t *other_f;			/* DVB-T freqeuency-list descriptor */
+	int pat_version;			/* -1 if not seen */
+	int sdt_version;
+	int nit_version;
+	unsigned int from_state		  : 1;	/* loaded by -I */
+	unsigned int checked		  : 1;	/* versions probed, or scanned */
+	unsigned int changed		  : 1;
+	struct list_head old_services;		/* from the state, if changed */
 };
 
 
@@ -157,6 +182,8 @@ struct section_buf {
 	const char *dmx_devname;
 	unsigned int run_once  : 1;
 	unsigned int segmented : 1;	/* segmented by table_id_ext */
+	unsigned int probe     : 1;	/* only read the version number */
+	unsigned int learning  : 1;	/* kept open to time a repetition */
 	int fd;
 	int pid;
 	int table_id;
@@ -168,6 +195,18 @@ struct section_buf {
 	time_t timeout;
 	time_t start_time;
 	time_t running_time;
+	int64_t deadline;		/* ms, on filter_clock() */
+	int heap_index;			/* in timer_heap, or -1 */
+	int64_t start_ms;
+	int64_t limit;			/* deadline for the fixed timeout */
+	int adapt_ms;			/* learned timeout, or 0 */
+	int64_t first_ms;		/* arrival of the first section, or 0 */
+	int64_t new_ms;			/* arrival of the latest new section */
+	int64_t cycle_ms;		/* arrival of the section marking the cycle */
+	int cycle_ext;
+	int cycle_section;
+	int cycle_seen;			/* that section has come round again */
+	int repeat_ms;			/* longest repetition interval seen */
 	struct section_buf *next_seg;	/* this is used to handle
 					 * segmented tables (like NIT-other)
 					 */
@@ -175,7 +214,7 @@ struct section_buf {
 
 static LIST_HEAD(scanned_transponders);
 static LIST_HEAD(new_transponders);
-static struct transponder *current_tp;
+static __thread struct transponder *current_tp;
 
 
 static void dump_dvb_parameters (FILE *f, struct transponder *p);
@@ -184,6 +223,9 @@ static void setup_filter (struct section_buf* s, const char *dmx_devname,
 		          int pid, int tid, int tid_ext,
 			  int run_once, int segmented, int timeout);
 static void add_filter (struct section_buf *s);
+static int64_t filter_clock (void);
+static int profile_network (int network_id);
+static void adapt_running_filters (void);
 
 static const char * fe_type2str(fe_type_t t);
 
@@ -200,9 +242,18 @@ static struct transponder *alloc_transponder(uint32_t frequency)
 	struct transponder *tp = calloc(1, sizeof(*tp));
 
 	tp->param.frequency = frequency;
+	tp->pat_version = -1;
+	tp->sdt_version = -1;
+	tp->nit_version = -1;
 	INIT_LIST_HEAD(&tp->list);
 	INIT_LIST_HEAD(&tp->services);
+	INIT_LIST_HEAD(&tp->old_services);
 	list_add_tail(&tp->list, &new_transponders);
+
+	/* wake adapters waiting for work; scan_lock is held when it is found
+	 * in a NIT while other adapters are running
+	 */
+	pthread_cond_broadcast(&scan_cond);
 	return tp;
 }
 
@@ -1501,6 +1552,8 @@ static void set_bit (uint8_t *bitfield, int bit)
 static int parse_section (struct section_buf *s)
 {
 	const unsigned char *buf = s->buf;
+	struct section_buf *head = s;
+	int64_t now = filter_clock();
 	int table_id;
 	int section_length;
 	int table_id_ext;
@@ -1565,8 +1618,38 @@ static int parse_section (struct section_buf *s)
 		return 0;
 	}
 
+	switch (table_id) {
+	case 0x00:
+		current_tp->pat_version = section_version_number;
+		break;
+	case 0x40:
+		current_tp->nit_version = section_version_number;
+		break;
+	case 0x42:
+		current_tp->sdt_version = section_version_number;
+		break;
+	}
+	if (s->probe)
+		return 1;
+
+	/* time the repetition of the first section seen */
+	if (!head->cycle_ms) {
+		head->cycle_ms = now;
+		head->cycle_ext = table_id_ext;
+		head->cycle_section = section_number;
+	} else if (head->cycle_ext == table_id_ext &&
+		   head->cycle_section == section_number) {
+		if (now - head->cycle_ms > head->repeat_ms)
+			head->repeat_ms = now - head->cycle_ms;
+		head->cycle_ms = now;
+		head->cycle_seen = 1;
+	}
+
 	if (!get_bit(s->section_done, section_number)) {
 		set_bit (s->section_done, section_number);
+		if (!head->first_ms)
+			head->first_ms = now;
+		head->new_ms = now;
 
 		debug("pid 0x%02x tid 0x%02x table_id_ext 0x%04x, "
 		    "%i/%i (version %i)\n",
@@ -1588,6 +1671,8 @@ static int parse_section (struct section_buf *s)
 			verbose("////////////////////////////////////////////// NIT other\n");
 		case 0x40:
 			verbose("NIT (%s TS)\n", table_id == 0x40 ? "actual":"other");
+			if (table_id == 0x40 && profile_network (table_id_ext))
+				adapt_running_filters ();
 			parse_nit (buf, section_length, table_id_ext);
 			break;
 
@@ -1615,13 +1700,23 @@ static int parse_section (struct section_buf *s)
 	}
 
 	if (s->segmented) {
-		/* always wait for timeout; this is because we don't now how
-		 * many segments there are
+		/* we don't know how many segments there are: wait until the
+		 * first section has come round again, and nothing new has
+		 * turned up for a whole cycle
 		 */
-		return 0;
+		if (!head->cycle_seen || (now - head->new_ms < head->repeat_ms))
+			return 0;
+		for (s = head; s; s = s->next_seg)
+			if (!s->sectionfilter_done)
+				return 0;
+		return 1;
 	}
-	else if (s->sectionfilter_done)
+	else if (s->sectionfilter_done) {
+		/* while learning, wait for the table to come round again */
+		if (s->learning && !s->cycle_seen)
+			return 0;
 		return 1;
+	}
 
 	return 0;
 }
@@ -1631,7 +1726,7 @@ static int read_sections (struct section_buf *s)
 {
 	int section_length, count;
 
-	if (s->sectionfilter_done && !s->segmented)
+	if (s->sectionfilter_done && !s->segmented && !s->learning)
 		return 1;
 
 	/* the section filter API guarantess that we get one full section
@@ -1652,19 +1747,399 @@ static int read_sections (struct section_buf *s)
 	if (count != section_length + 3)
 		return -1;
 
-	if (parse_section(s) == 1)
+	pthread_mutex_lock(&scan_lock);
+	count = parse_section(s);
+	pthread_mutex_unlock(&scan_lock);
+	if (count == 1)
 		return 1;
 
 	return 0;
 }
 
 
-static LIST_HEAD(running_filters);
-static LIST_HEAD(waiting_filters);
-static int n_running;
-#define MAX_RUNNING 27
-static struct pollfd poll_fds[MAX_RUNNING];
-static struct section_buf* poll_section_bufs[MAX_RUNNING];
+/* initialised by init_filters() in each thread */
+static __thread struct list_head running_filters;
+static __thread struct list_head waiting_filters;
+static __thread int n_running;
+static __thread int max_running;	/* 0 until the demux runs out of filters */
+static __thread int epoll_fd;
+
+/* running filters, ordered by deadline */
+static __thread struct section_buf **timer_heap;
+static __thread int timer_heap_size;
+static __thread int timer_heap_alloc;
+
+#define MAX_EVENTS 64
+
+
+static void init_filters (int adapter, int demux)
+{
+	INIT_LIST_HEAD (&running_filters);
+	INIT_LIST_HEAD (&waiting_filters);
+	n_running = 0;
+	max_running = max_filters;
+	timer_heap = NULL;
+	timer_heap_size = 0;
+	timer_heap_alloc = 0;
+	if ((epoll_fd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+		fatal("epoll_create1 failed: %d %m\n", errno);
+
+	snprintf (demux_devname, sizeof(demux_devname),
+		  "/dev/dvb/adapter%i/demux%i", adapter, demux);
+	demux_adapter = adapter;
+	demux_id = demux;
+}
+
+static void release_filters (void)
+{
+	close (epoll_fd);
+	free (timer_heap);
+}
+
+
+static int64_t filter_clock (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000LL) + (ts.tv_nsec / 1000000);
+}
+
+static void timer_heap_set (int i, struct section_buf *s)
+{
+	timer_heap[i] = s;
+	s->heap_index = i;
+}
+
+static void timer_heap_up (int i)
+{
+	struct section_buf *s = timer_heap[i];
+
+	while (i > 0 && timer_heap[(i - 1) / 2]->deadline > s->deadline) {
+		timer_heap_set (i, timer_heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	timer_heap_set (i, s);
+}
+
+static void timer_heap_down (int i)
+{
+	struct section_buf *s = timer_heap[i];
+	int child;
+
+	while ((child = (2 * i) + 1) < timer_heap_size) {
+		if (child + 1 < timer_heap_size &&
+		    timer_heap[child + 1]->deadline < timer_heap[child]->deadline)
+			child++;
+		if (timer_heap[child]->deadline >= s->deadline)
+			break;
+		timer_heap_set (i, timer_heap[child]);
+		i = child;
+	}
+	timer_heap_set (i, s);
+}
+
+static void timer_heap_add (struct section_buf *s)
+{
+	if (timer_heap_size == timer_heap_alloc) {
+		timer_heap_alloc = timer_heap_alloc ? 2 * timer_heap_alloc : 32;
+		timer_heap = realloc (timer_heap, timer_heap_alloc * sizeof(*timer_heap));
+		if (timer_heap == NULL)
+			fatal("out of memory\n");
+	}
+	timer_heap_set (timer_heap_size++, s);
+	timer_heap_up (s->heap_index);
+}
+
+static void timer_heap_update (struct section_buf *s)
+{
+	timer_heap_up (s->heap_index);
+	timer_heap_down (s->heap_index);
+}
+
+static void timer_heap_remove (struct section_buf *s)
+{
+	int i = s->heap_index;
+
+	if (i < 0)
+		return;
+	s->heap_index = -1;
+	if (--timer_heap_size == i)
+		return;
+
+	timer_heap_set (i, timer_heap[timer_heap_size]);
+	timer_heap_up (i);
+	timer_heap_down (timer_heap[i]->heap_index);
+}
+
+static int profile_timeout (int pid, int table_id);
+static int profile_learning (int pid, int table_id);
+
+/* the network's profile has just been loaded: apply it to the filters
+ * already running on this adapter
+ */
+static void adapt_running_filters (void)
+{
+	struct list_head *pos;
+	struct section_buf *s;
+
+	list_for_each(pos, &running_filters) {
+		s = list_entry(pos, struct section_buf, list);
+		if (s->adapt_ms)
+			continue;
+		s->learning = profile_learning (s->pid, s->table_id);
+		s->adapt_ms = profile_timeout (s->pid, s->table_id);
+		if (s->adapt_ms && (s->start_ms + s->adapt_ms < s->deadline)) {
+			s->deadline = s->start_ms + s->adapt_ms;
+			timer_heap_update (s);
+		}
+	}
+}
+
+
+/* The section repetition profile records, for each (pid, table_id), how often
+ * the table is repeated, how long it took to arrive and how often it was
+ * missing. The first filter for a table stays open until the table comes
+ * round again, to time the repetition. From then on, its filters time out at
+ * a little over twice that interval, rather than the fixed timeout which
+ * allows for the slowest network. A table missing from several transponders,
+ * and never seen, is given as long as the slowest table on the network.
+ * Neither is ever shorter than the longest repetition interval the standards
+ * allow for the table. The profile is learned while scanning and, with -T,
+ * kept per network so that a rescan starts with it.
+ */
+struct table_profile {
+	struct list_head list;
+	int pid;
+	int table_id;
+	int seen;		/* times the table was found */
+	int absent;		/* times it timed out without a section */
+	int wait_ms;		/* longest wait for the complete table */
+	int repeat_ms;		/* longest repetition interval */
+};
+
+#define ADAPT_MARGIN_MS	200
+#define ADAPT_ABSENT	2	/* misses before a table is taken as absent */
+#define ADAPT_ABSENT_MS	2000	/* shortest timeout for a table never seen */
+
+static LIST_HEAD(table_profiles);
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *profile_dir;
+static int profile_network_id = -1;
+
+
+static struct table_profile *find_profile (int pid, int table_id, int create)
+{
+	struct list_head *pos;
+	struct table_profile *p;
+
+	list_for_each(pos, &table_profiles) {
+		p = list_entry(pos, struct table_profile, list);
+		if (p->pid == pid && p->table_id == table_id)
+			return p;
+	}
+	if (!create)
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		fatal("out of memory\n");
+	p->pid = pid;
+	p->table_id = table_id;
+	list_add_tail(&p->list, &table_profiles);
+	return p;
+}
+
+/* PMTs are on a pid of each service's choosing, so they are timed together,
+ * under the null packet pid, which never carries a table
+ */
+static int profile_pid (int pid, int table_id)
+{
+	return (table_id == 0x02) ? 0x1fff : pid;
+}
+
+/* the longest a compliant network may take to repeat a table, from
+ * ETSI TR 101 290 (and ATSC A/65 for the VCT)
+ */
+static int table_max_repeat_ms (int table_id)
+{
+	switch (table_id) {
+	case 0x00:	/* PAT */
+	case 0x02:	/* PMT */
+		return 500;
+	case 0x42:	/* SDT actual */
+		return 2000;
+	case 0xc8:	/* VCT */
+	case 0xc9:
+		return 400;
+	default:	/* NIT, SDT other */
+		return 10000;
+	}
+}
+
+static int profile_expected (struct table_profile *p)
+{
+	return (p->wait_ms > p->repeat_ms) ? p->wait_ms : p->repeat_ms;
+}
+
+/* the learned timeout in ms for a filter, or 0 if there is none */
+static int profile_timeout (int pid, int table_id)
+{
+	struct list_head *pos;
+	struct table_profile *p, *q;
+	int timeout = 0;
+	int slowest = 0;
+
+	pthread_mutex_lock(&profile_lock);
+	p = find_profile(profile_pid(pid, table_id), table_id, 0);
+	if (p && p->seen) {
+		/* the time to the first section depends on when the filter
+		 * started: only a repetition interval tells how long to wait
+		 */
+		if (p->repeat_ms)
+			timeout = (2 * profile_expected(p)) + ADAPT_MARGIN_MS;
+	} else if (p && p->absent >= ADAPT_ABSENT) {
+		list_for_each(pos, &table_profiles) {
+			q = list_entry(pos, struct table_profile, list);
+			if (profile_expected(q) > slowest)
+				slowest = profile_expected(q);
+		}
+		timeout = (2 * slowest) + ADAPT_MARGIN_MS;
+		if (timeout < ADAPT_ABSENT_MS)
+			timeout = ADAPT_ABSENT_MS;
+	}
+	pthread_mutex_unlock(&profile_lock);
+
+	if (timeout && (timeout < table_max_repeat_ms(table_id) + ADAPT_MARGIN_MS))
+		timeout = table_max_repeat_ms(table_id) + ADAPT_MARGIN_MS;
+	return timeout;
+}
+
+/* whether a filter should stay open to time the table's repetition */
+static int profile_learning (int pid, int table_id)
+{
+	struct table_profile *p;
+	int learning;
+
+	pthread_mutex_lock(&profile_lock);
+	p = find_profile(profile_pid(pid, table_id), table_id, 0);
+	learning = !p || !p->repeat_ms;
+	pthread_mutex_unlock(&profile_lock);
+
+	return learning;
+}
+
+/* learn from a filter which has finished, or timed out */
+static void profile_record (struct section_buf *s, int done)
+{
+	struct table_profile *p;
+	/* the table was complete on its last new section */
+	int wait_ms = s->new_ms - s->start_ms;
+
+	pthread_mutex_lock(&profile_lock);
+	p = find_profile(profile_pid(s->pid, s->table_id), s->table_id, 1);
+	if (s->first_ms) {
+		p->seen++;
+		if (done && wait_ms > p->wait_ms)
+			p->wait_ms = wait_ms;
+		if (s->repeat_ms > p->repeat_ms)
+			p->repeat_ms = s->repeat_ms;
+	} else if (s->deadline >= s->limit) {
+		/* not when cut short by a learned timeout */
+		p->absent++;
+	}
+	pthread_mutex_unlock(&profile_lock);
+}
+
+static void profile_path (char *path, int len)
+{
+	snprintf(path, len, "%s/network-%04x", profile_dir, profile_network_id);
+}
+
+/* merge the saved profile for the network into what has been learned so far */
+static int load_profile (void)
+{
+	char path[PATH_MAX];
+	char line[128];
+	struct table_profile *p;
+	int pid, table_id, seen, absent, wait_ms, repeat_ms;
+	FILE *f;
+
+	profile_path(path, sizeof(path));
+	if ((f = fopen(path, "r")) == NULL)
+		return 0;
+	info("using section profile '%s'\n", path);
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%i %i %i %i %i %i", &pid, &table_id,
+			   &seen, &absent, &wait_ms, &repeat_ms) != 6)
+			continue;
+		p = find_profile(pid, table_id, 1);
+		p->seen += seen;
+		p->absent += absent;
+		if (wait_ms > p->wait_ms)
+			p->wait_ms = wait_ms;
+		if (repeat_ms > p->repeat_ms)
+			p->repeat_ms = repeat_ms;
+	}
+	fclose(f);
+
+	return 1;
+}
+
+static void save_profile (void)
+{
+	char path[PATH_MAX];
+	char tmp[PATH_MAX + 4];
+	struct list_head *pos;
+	struct table_profile *p;
+	FILE *f;
+
+	if (!profile_dir || profile_network_id == -1)
+		return;
+
+	mkdir(profile_dir, 0755);
+	profile_path(path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+	if ((f = fopen(tmp, "w")) == NULL) {
+		error("failed to write '%s': %d %m\n", tmp, errno);
+		return;
+	}
+
+	fprintf(f, "# section repetition profile for network 0x%04x\n", profile_network_id);
+	fprintf(f, "# pid table_id seen absent wait_ms repeat_ms\n");
+	list_for_each(pos, &table_profiles) {
+		p = list_entry(pos, struct table_profile, list);
+		fprintf(f, "0x%04x 0x%02x %d %d %d %d\n", p->pid, p->table_id,
+			p->seen, p->absent, p->wait_ms, p->repeat_ms);
+	}
+	if (fclose(f) || rename(tmp, path)) {
+		error("failed to write '%s': %d %m\n", path, errno);
+		unlink(tmp);
+		return;
+	}
+	info("saved section profile '%s'\n", path);
+}
+
+/* Called for each NIT actual: the profile is kept for the first network.
+ * Returns 1 if a saved profile was loaded.
+ */
+static int profile_network (int network_id)
+{
+	int loaded = 0;
+
+	pthread_mutex_lock(&profile_lock);
+	if (profile_network_id == -1) {
+		profile_network_id = network_id;
+		if (profile_dir)
+			loaded = load_profile();
+	}
+	pthread_mutex_unlock(&profile_lock);
+
+	return loaded;
+}
 
 
 static void setup_filter (struct section_buf* s, const char *dmx_devname,
@@ -1688,85 +2163,91 @@ static void setup_filter (struct section_buf* s, const char *dmx_devname,
 
 	s->table_id_ext = tid_ext;
 	s->section_version_number = -1;
+	s->heap_index = -1;
 
 	INIT_LIST_HEAD (&s->list);
 }
 
-static void update_poll_fds(void)
+/* Called when the demux refuses another filter: the filters already running
+ * are as many as it can take, so later ones wait for one of those to stop.
+ */
+static void filter_capacity_reached (void)
 {
-	struct list_head *p;
-	struct section_buf* s;
-	int i;
-
-	memset(poll_section_bufs, 0, sizeof(poll_section_bufs));
-	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
-	i = 0;
-	list_for_each (p, &running_filters) {
-		if (i >= MAX_RUNNING)
-			fatal("too many poll_fds\n");
-		s = list_entry (p, struct section_buf, list);
-		if (s->fd == -1)
-			fatal("s->fd == -1 on running_filters\n");
-		verbosedebug("poll fd %d\n", s->fd);
-		poll_fds[i].fd = s->fd;
-		poll_fds[i].events = POLLIN;
-		poll_fds[i].revents = 0;
-		poll_section_bufs[i] = s;
-		i++;
-	}
-	if (i != n_running)
-		fatal("n_running is hosed\n");
+	if ((errno != EMFILE) && (errno != ENFILE) &&
+	    (errno != ENOSPC) && (errno != EBUSY))
+		return;
+	if (n_running && (!max_running || (n_running < max_running))) {
+		info("%s: running at most %d section filters\n",
+		     demux_devname, n_running);
+		max_running = n_running;
+	}
 }
 
 static int start_filter (struct section_buf* s)
 {
-	struct dmx_sct_filter_params f;
+	struct epoll_event ev;
+	uint8_t filter[18];
+	uint8_t mask[18];
 
-	if (n_running >= MAX_RUNNING)
+	if (max_running && (n_running >= max_running))
 		goto err0;
-	if ((s->fd = open (s->dmx_devname, O_RDWR | O_NONBLOCK)) < 0)
+	if ((s->fd = dvbdemux_open_demux (demux_adapter, demux_id, 1)) < 0) {
+		filter_capacity_reached ();
 		goto err0;
+	}
 
 	verbosedebug("start filter pid 0x%04x table_id 0x%02x\n", s->pid, s->table_id);
 
-	memset(&f, 0, sizeof(f));
-
-	f.pid = (uint16_t) s->pid;
+	memset(filter, 0, sizeof(filter));
+	memset(mask, 0, sizeof(mask));
 
 	if (s->table_id < 0x100 && s->table_id > 0) {
-		f.filter.filter[0] = (uint8_t) s->table_id;
-		f.filter.mask[0]   = 0xff;
+		filter[0] = (uint8_t) s->table_id;
+		mask[0]   = 0xff;
 	}
 	if (s->table_id_ext < 0x10000 && s->table_id_ext > 0) {
-		f.filter.filter[1] = (uint8_t) ((s->table_id_ext >> 8) & 0xff);
-		f.filter.filter[2] = (uint8_t) (s->table_id_ext & 0xff);
-		f.filter.mask[1] = 0xff;
-		f.filter.mask[2] = 0xff;
+		filter[3] = (uint8_t) ((s->table_id_ext >> 8) & 0xff);
+		filter[4] = (uint8_t) (s->table_id_ext & 0xff);
+		mask[3] = 0xff;
+		mask[4] = 0xff;
 	}
 
-	f.timeout = 0;
-	f.flags = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
+	if (dvbdemux_set_section_filter(s->fd, s->pid, filter, mask, 1, 1)) {
+		filter_capacity_reached ();
+		if (max_running != n_running)
+			errorn ("ioctl DMX_SET_FILTER failed");
+		goto err1;
+	}
 
-	if (ioctl(s->fd, DMX_SET_FILTER, &f) == -1) {
-		errorn ("ioctl DMX_SET_FILTER failed");
+	ev.events = EPOLLIN;
+	ev.data.ptr = s;
+	if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, s->fd, &ev)) {
+		errorn ("epoll_ctl failed");
 		goto err1;
 	}
 
 	s->sectionfilter_done = 0;
 	time(&s->start_time);
+	s->start_ms = filter_clock();
+	s->limit = s->start_ms + (s->timeout * 1000);
+	s->learning = profile_learning (s->pid, s->table_id);
+	s->adapt_ms = profile_timeout (s->pid, s->table_id);
+	s->deadline = s->limit;
+	if (s->adapt_ms && (s->start_ms + s->adapt_ms < s->limit))
+		s->deadline = s->start_ms + s->adapt_ms;
+	timer_heap_add (s);
 
 	list_del_init (&s->list);  /* might be in waiting filter list */
 	list_add (&s->list, &running_filters);
 
 	n_running++;
-	update_poll_fds();
 
 	return 0;
 
 err1:
-	ioctl (s->fd, DMX_STOP);
+	dvbdemux_stop (s->fd);
 	close (s->fd);
+	s->fd = -1;
 err0:
 	return -1;
 }
@@ -1775,22 +2256,30 @@ err0:
 static void stop_filter (struct section_buf *s)
 {
 	verbosedebug("stop filter pid 0x%04x\n", s->pid);
-	ioctl (s->fd, DMX_STOP);
+	epoll_ctl (epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+	dvbdemux_stop (s->fd);
 	close (s->fd);
 	s->fd = -1;
 	list_del (&s->list);
+	timer_heap_remove (s);
 	s->running_time += time(NULL) - s->start_time;
 
 	n_running--;
-	update_poll_fds();
 }
 
 
 static void add_filter (struct section_buf *s)
 {
 	verbosedebug("add filter pid 0x%04x\n", s->pid);
-	if (start_filter (s))
-		list_add_tail (&s->list, &waiting_filters);
+	if (start_filter (s) == 0)
+		return;
+
+	/* with nothing running, it would wait forever */
+	if (n_running == 0) {
+		error("failed to start filter pid 0x%04x\n", s->pid);
+		return;
+	}
+	list_add_tail (&s->list, &waiting_filters);
 }
 
 
@@ -1810,29 +2299,55 @@ static void remove_filter (struct section_buf *s)
 
 static void read_filters (void)
 {
+	struct epoll_event events[MAX_EVENTS];
 	struct section_buf *s;
-	int i, n, done;
+	int64_t now;
+	int i, n;
+	int timeout = 1000;
+
+	if (timer_heap_size) {
+		now = filter_clock();
+		if (timer_heap[0]->deadline - now < timeout)
+			timeout = timer_heap[0]->deadline - now;
+		if (timeout < 0)
+			timeout = 0;
+	}
 
-	n = poll(poll_fds, n_running, 1000);
-	if (n == -1)
-		errorn("poll");
+	n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+	if (n == -1) {
+		if (errno != EINTR)
+			errorn("epoll_wait");
+		n = 0;
+	}
 
-	for (i = 0; i < n_running; i++) {
-		s = poll_section_bufs[i];
-		if (!s)
-			fatal("poll_section_bufs[%d] is NULL\n", i);
-		if (poll_fds[i].revents)
-			done = read_sections (s) == 1;
-		else
-			done = 0; /* timeout */
-		if (done || time(NULL) > s->start_time + s->timeout) {
-			if (s->run_once) {
-				if (done)
-					verbosedebug("filter done pid 0x%04x\n", s->pid);
-				else
-					warning("filter timeout pid 0x%04x\n", s->pid);
-				remove_filter (s);
-			}
+	for (i = 0; i < n; i++) {
+		s = events[i].data.ptr;
+		if ((read_sections (s) == 1) && s->run_once) {
+			verbosedebug("filter done pid 0x%04x\n", s->pid);
+			profile_record (s, 1);
+			remove_filter (s);
+		} else if (s->adapt_ms && (s->new_ms + s->adapt_ms > s->deadline)) {
+			/* still receiving new sections: give it longer */
+			s->deadline = s->new_ms + s->adapt_ms;
+			if (s->deadline > s->limit)
+				s->deadline = s->limit;
+			timer_heap_update (s);
+		}
+	}
+
+	now = filter_clock();
+	while (timer_heap_size && (timer_heap[0]->deadline <= now)) {
+		s = timer_heap[0];
+		if (s->run_once) {
+			if ((s->deadline < s->limit) || s->sectionfilter_done)
+				verbose("filter pid 0x%04x table_id 0x%02x ended after %d ms\n",
+					s->pid, s->table_id, (int) (now - s->start_ms));
+			else
+				warning("filter timeout pid 0x%04x\n", s->pid);
+			profile_record (s, s->sectionfilter_done);
+			remove_filter (s);
+		} else {
+			timer_heap_remove (s);
 		}
 	}
 }
@@ -1966,15 +2481,10 @@ static int set_delivery_system(int fd, unsigned type)
 	return errno;
 }
 
-static int tune_to_transponder (int frontend_fd, struct transponder *t)
+static int tune_scanned_transponder (int frontend_fd, struct transponder *t)
 {
 	int rc;
 
-	/* move TP from "new" to "scanned" list */
-	list_del_init(&t->list);
-	list_add_tail(&t->list, &scanned_transponders);
-	t->scan_done = 1;
-
 	if (t->type != fe_info.type) {
 		rc = set_delivery_system(frontend_fd, t->type);
 		if (!rc)
@@ -1995,38 +2505,62 @@ static int tune_to_transponder (int frontend_fd, struct transponder *t)
 	return __tune_to_transponder (frontend_fd, t);
 }
 
+static int tune_to_transponder (int frontend_fd, struct transponder *t)
+{
+	/* move TP from "new" to "scanned" list */
+	list_del_init(&t->list);
+	list_add_tail(&t->list, &scanned_transponders);
+	t->scan_done = 1;
+
+	return tune_scanned_transponder (frontend_fd, t);
+}
+
+
+/* After tuning to a DVB-T transponder failed, switch it to the next
+ * alternative frequency from its frequency list descriptor.
+ * Returns 1 if there was one, 0 if not.
+ */
+static int next_other_frequency (struct transponder *t)
+{
+	struct transponder *to;
+	uint32_t freq;
+
+	while (t->other_frequency_flag && t->other_f && t->n_other_f) {
+		/* check if the alternate freqeuncy is really new to us */
+		freq = t->other_f[t->n_other_f - 1];
+		t->n_other_f--;
+		if (find_transponder(freq))
+			continue;
+
+		/* remember tuning to the old frequency failed */
+		to = calloc(1, sizeof(*to));
+		to->param.frequency = t->param.frequency;
+		to->wrong_frequency = 1;
+		INIT_LIST_HEAD(&to->list);
+		INIT_LIST_HEAD(&to->services);
+		list_add_tail(&to->list, &scanned_transponders);
+		copy_transponder(to, t);
+
+		t->param.frequency = freq;
+		info("retrying with f=%d\n", t->param.frequency);
+		return 1;
+	}
+	return 0;
+}
+
 
 static int tune_to_next_transponder (int frontend_fd)
 {
 	struct list_head *pos, *tmp;
-	struct transponder *t, *to;
-	uint32_t freq;
+	struct transponder *t;
 
 	list_for_each_safe(pos, tmp, &new_transponders) {
 		t = list_entry (pos, struct transponder, list);
-retry:
 		if (tune_to_transponder (frontend_fd, t) == 0)
 			return 0;
-next:
-		if (t->other_frequency_flag && t->other_f && t->n_other_f) {
-			/* check if the alternate freqeuncy is really new to us */
-			freq = t->other_f[t->n_other_f - 1];
-			t->n_other_f--;
-			if (find_transponder(freq))
-				goto next;
-
-			/* remember tuning to the old frequency failed */
-			to = calloc(1, sizeof(*to));
-			to->param.frequency = t->param.frequency;
-			to->wrong_frequency = 1;
-			INIT_LIST_HEAD(&to->list);
-			INIT_LIST_HEAD(&to->services);
-			list_add_tail(&to->list, &scanned_transponders);
-			copy_transponder(to, t);
-
-			t->param.frequency = freq;
-			info("retrying with f=%d\n", t->param.frequency);
-			goto retry;
+		while (next_other_frequency (t)) {
+			if (tune_scanned_transponder (frontend_fd, t) == 0)
+				return 0;
 		}
 	}
 	return -1;
@@ -2155,7 +2689,7 @@ static const char * fe_type2str(fe_type_t t)
 	return enum2str(t, typetab, "UNK");
 }
 
-static int tune_initial (int frontend_fd, const char *initial)
+static int read_initial (const char *initial)
 {
 	FILE *inif;
 	unsigned int f, sr;
@@ -2241,6 +2775,14 @@ static int tune_initial (int frontend_fd, const char *initial)
 
 	fclose(inif);
 
+	return 0;
+}
+
+static int tune_initial (int frontend_fd, const char *initial)
+{
+	if (initial && read_initial (initial) < 0)
+		return -1;
+
 	return tune_to_next_transponder(frontend_fd);
 }
 
@@ -2306,8 +2848,62 @@ static void scan_tp_dvb (void)
 		   list_empty(&waiting_filters)));
 }
 
+/* For -I: read the PAT, SDT and NIT version numbers of a transponder from the
+ * saved state. If they are unchanged, its saved services stand; otherwise
+ * they are put aside for the diff, and it is scanned in full.
+ * Returns 1 if it has changed.
+ */
+static int probe_tp (void)
+{
+	struct transponder *t = current_tp;
+	struct section_buf s0, s1, s2;
+	int pat_version = t->pat_version;
+	int sdt_version = t->sdt_version;
+	int nit_version = t->nit_version;
+	int changed = 1;
+
+	if (fe_info.type != FE_ATSC) {
+		t->pat_version = t->sdt_version = t->nit_version = -1;
+
+		setup_filter (&s0, demux_devname, 0x00, 0x00, -1, 1, 0, 5); /* PAT */
+		setup_filter (&s1, demux_devname, 0x11, 0x42, -1, 1, 0, 5); /* SDT */
+		setup_filter (&s2, demux_devname, 0x10, 0x40, -1, 1, 0, 15); /* NIT */
+		s0.probe = s1.probe = s2.probe = 1;
+		add_filter (&s0);
+		add_filter (&s1);
+		add_filter (&s2);
+
+		do {
+			read_filters ();
+		} while (!(list_empty(&running_filters) &&
+			   list_empty(&waiting_filters)));
+
+		changed = (t->pat_version == -1) ||
+			  (t->pat_version != pat_version) ||
+			  (t->sdt_version != sdt_version) ||
+			  (t->nit_version != nit_version);
+	}
+
+	pthread_mutex_lock(&scan_lock);
+	t->checked = 1;
+	t->changed = changed;
+	if (changed)
+		list_splice_init(&t->services, &t->old_services);
+	pthread_mutex_unlock(&scan_lock);
+
+	if (changed)
+		info("versions changed, rescanning\n");
+	else
+		info("versions unchanged (PAT %d, SDT %d, NIT %d)\n",
+		     pat_version, sdt_version, nit_version);
+	return changed;
+}
+
 static void scan_tp(void)
 {
+	if (current_tp->from_state && !probe_tp ())
+		return;
+
 	switch(fe_info.type) {
 		case FE_QPSK:
 		case FE_QAM:
@@ -2335,6 +2931,121 @@ static void scan_network (int frontend_fd, const char *initial)
 }
 
 
+struct scan_worker {
+	pthread_t thread;
+	int adapter;
+	int frontend;
+	int demux;
+	int tuned;
+	int failed;
+};
+
+/* Take the next transponder off the new list. While it is empty, wait for
+ * other adapters which are still scanning, and may find more in the NIT.
+ * Returns NULL when every transponder has been scanned.
+ */
+static struct transponder *take_next_transponder (void)
+{
+	struct transponder *t = NULL;
+
+	pthread_mutex_lock(&scan_lock);
+	while (list_empty(&new_transponders) && scan_busy)
+		pthread_cond_wait(&scan_cond, &scan_lock);
+	if (!list_empty(&new_transponders)) {
+		t = list_entry (new_transponders.next, struct transponder, list);
+		list_del_init(&t->list);
+		list_add_tail(&t->list, &scanned_transponders);
+		t->scan_done = 1;
+		scan_busy++;
+	}
+	pthread_mutex_unlock(&scan_lock);
+
+	return t;
+}
+
+static void finish_transponder (void)
+{
+	pthread_mutex_lock(&scan_lock);
+	scan_busy--;
+	pthread_cond_broadcast(&scan_cond);
+	pthread_mutex_unlock(&scan_lock);
+}
+
+static void *scan_worker_func (void *arg)
+{
+	struct scan_worker *w = arg;
+	char frontend_devname [80];
+	struct transponder *t;
+	int frontend_fd;
+	int retry;
+
+	init_filters (w->adapter, w->demux);
+
+	snprintf (frontend_devname, sizeof(frontend_devname),
+		  "/dev/dvb/adapter%i/frontend%i", w->adapter, w->frontend);
+	info("using '%s' and '%s'\n", frontend_devname, demux_devname);
+	if ((frontend_fd = open (frontend_devname, O_RDWR)) < 0)
+		fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
+	if (ioctl(frontend_fd, FE_GET_INFO, &fe_info) == -1)
+		fatal("FE_GET_INFO failed: %d %m\n", errno);
+
+	while ((t = take_next_transponder ())) {
+		retry = 1;
+		while (tune_scanned_transponder (frontend_fd, t)) {
+			pthread_mutex_lock(&scan_lock);
+			retry = next_other_frequency (t);
+			pthread_mutex_unlock(&scan_lock);
+			if (!retry)
+				break;
+		}
+		if (retry) {
+			scan_tp();
+			w->tuned++;
+		} else {
+			w->failed++;
+		}
+		finish_transponder ();
+	}
+
+	close (frontend_fd);
+	release_filters ();
+	return NULL;
+}
+
+/* Scan the network with several identical tuners at once: each adapter takes
+ * the next transponder to be scanned, and new ones found in the NIT go on the
+ * shared list as usual, so find_transponder() still removes duplicates.
+ */
+static void scan_network_parallel (int *adapters, int n_adapters,
+				   int frontend, int demux, const char *initial)
+{
+	struct scan_worker workers[MAX_ADAPTERS];
+	time_t start = time(NULL);
+	int i;
+
+	if (initial && read_initial (initial) < 0) {
+		error("initial tuning failed\n");
+		return;
+	}
+
+	for (i = 0; i < n_adapters; i++) {
+		memset(&workers[i], 0, sizeof(struct scan_worker));
+		workers[i].adapter = adapters[i];
+		workers[i].frontend = frontend;
+		workers[i].demux = demux;
+		if (pthread_create(&workers[i].thread, NULL, scan_worker_func, &workers[i]))
+			fatal("failed to start thread for adapter %d\n", adapters[i]);
+	}
+
+	for (i = 0; i < n_adapters; i++) {
+		pthread_join(workers[i].thread, NULL);
+		info("adapter %d: %d transponders scanned, %d failed to tune\n",
+		     workers[i].adapter, workers[i].tuned, workers[i].failed);
+	}
+	info("scan on %d adapters took %ld s\n", n_adapters, (long) (time(NULL) - start));
+}
+
+
 static void pids_dump_service_parameter_set(FILE *f, struct service *s)
 {
         int i;
@@ -2382,14 +3093,119 @@ static int sat_number (struct transponder *t)
 	return switch_pos;
 }
 
+static void name_service (struct service *s, int *anon_services)
+{
+	char sn[20];
+	int i;
+
+	if (!s->service_name) {
+		/* not in SDT */
+		if (unique_anon_services)
+			snprintf(sn, sizeof(sn), "[%03x-%04x]",
+				 *anon_services, s->service_id);
+		else
+			snprintf(sn, sizeof(sn), "[%04x]",
+				 s->service_id);
+		s->service_name = strdup(sn);
+		(*anon_services)++;
+	}
+	/* ':' is field separator in szap and vdr service lists */
+	for (i = 0; s->service_name[i]; i++) {
+		if (s->service_name[i] == ':')
+			s->service_name[i] = ' ';
+	}
+	for (i = 0; s->provider_name && s->provider_name[i]; i++) {
+		if (s->provider_name[i] == ':')
+			s->provider_name[i] = ' ';
+	}
+}
+
+static int service_selected (struct service *s)
+{
+	if (s->video_pid && !(serv_select & 1))
+		return 0; /* no TV services */
+	if (!s->video_pid && s->audio_num && !(serv_select & 2))
+		return 0; /* no radio services */
+	if (!s->video_pid && !s->audio_num && !(serv_select & 4))
+		return 0; /* no data/other services */
+	if (s->scrambled && !ca_select)
+		return 0; /* FTA only */
+	return 1;
+}
+
+static void dump_service (FILE *f, struct transponder *t, struct service *s)
+{
+	switch (output_format)
+	{
+	  case OUTPUT_PIDS:
+		pids_dump_service_parameter_set (f, s);
+		break;
+	  case OUTPUT_VDR:
+		vdr_dump_service_parameter_set (f,
+				    s->service_name,
+				    s->provider_name,
+				    t->type,
+				    &t->param,
+				    sat_polarisation(t),
+				    s->video_pid,
+				    s->pcr_pid,
+				    s->audio_pid,
+				    s->audio_lang,
+				    s->audio_num,
+				    s->teletext_pid,
+				    s->scrambled,
+				    //FIXME: s->subtitling_pid
+				    s->ac3_pid,
+				    s->service_id,
+				    t->original_network_id,
+				    s->transport_stream_id,
+				    t->orbital_pos,
+				    t->we_flag,
+				    vdr_dump_provider,
+				    ca_select,
+				    vdr_version,
+				    vdr_dump_channum,
+				    s->channel_num);
+		break;
+	  case OUTPUT_ZAP:
+		zap_dump_service_parameter_set (f,
+				    s->service_name,
+				    t->type,
+				    &t->param,
+				    sat_polarisation(t),
+				    sat_number(t),
+				    s->video_pid,
+				    s->audio_pid,
+				    s->service_id);
+	  default:
+		break;
+	  }
+}
+
+static void name_services (void)
+{
+	struct list_head *p1, *p2;
+	struct transponder *t;
+	struct service *s;
+	int anon_services = 0;
+
+	list_for_each(p1, &scanned_transponders) {
+		t = list_entry(p1, struct transponder, list);
+		if (t->wrong_frequency)
+			continue;
+		list_for_each(p2, &t->services) {
+			s = list_entry(p2, struct service, list);
+			name_service(s, &anon_services);
+		}
+	}
+}
+
 static void dump_lists (void)
 {
 	struct list_head *p1, *p2;
 	struct transponder *t;
 	struct service *s;
-	int n = 0, i;
-	char sn[20];
-        int anon_services = 0;
+	int n = 0;
 
 	list_for_each(p1, &scanned_transponders) {
 		t = list_entry(p1, struct transponder, list);
@@ -2401,89 +3217,326 @@ static void dump_lists (void)
 	}
 	info("dumping lists (%d services)\n", n);
 
+	name_services();
 	list_for_each(p1, &scanned_transponders) {
 		t = list_entry(p1, struct transponder, list);
 		if (t->wrong_frequency)
 			continue;
 		list_for_each(p2, &t->services) {
 			s = list_entry(p2, struct service, list);
+			if (service_selected(s))
+				dump_service(stdout, t, s);
+		}
+	}
+	info("Done.\n");
+}
 
-			if (!s->service_name) {
-				/* not in SDT */
-				if (unique_anon_services)
-					snprintf(sn, sizeof(sn), "[%03x-%04x]",
-						 anon_services, s->service_id);
-				else
-					snprintf(sn, sizeof(sn), "[%04x]",
-						 s->service_id);
-				s->service_name = strdup(sn);
-				anon_services++;
+
+/* The -I state file keeps each transponder, with the version numbers of its
+ * PAT, SDT and NIT, and its services, one line each:
+ *
+ * T type frequency inversion param... polarisation orbital_pos we_flag
+ *   network_id original_network_id transport_stream_id pat sdt nit
+ * S transport_stream_id service_id pmt_pid pcr_pid video_pid teletext_pid
+ *   subtitling_pid ac3_pid type scrambled running channel_num
+ *   audio_num [pid lang]... ca_num [ca_id]... <tab> provider <tab> name
+ *
+ * param is the frontend parameter union as raw words.
+ */
+#define STATE_PARAM_WORDS (sizeof(((struct dvb_frontend_parameters *) 0)->u) / sizeof(uint32_t))
+#define STATE_LINE_MAX 2048
+
+static void state_string (char *buf, int len, const char *s)
+{
+	int i;
+
+	for (i = 0; s && s[i] && i < len - 1; i++)
+		buf[i] = ((s[i] == '\t') || (s[i] == '\n')) ? ' ' : s[i];
+	buf[i] = 0;
+}
+
+static void state_service (char *buf, int len, struct service *s)
+{
+	char provider[256], name[256];
+	char lang[4];
+	int n, i, j;
+
+	n = snprintf(buf, len, "S %d %d %d %d %d %d %d %d %d %d %d %d %d",
+		     s->transport_stream_id, s->service_id, s->pmt_pid,
+		     s->pcr_pid, s->video_pid, s->teletext_pid,
+		     s->subtitling_pid, s->ac3_pid, s->type, s->scrambled,
+		     s->running, s->channel_num, s->audio_num);
+	for (i = 0; i < s->audio_num; i++) {
+		for (j = 0; j < 3 && isgraph((unsigned char) s->audio_lang[i][j]); j++)
+			lang[j] = s->audio_lang[i][j];
+		lang[j] = 0;
+		n += snprintf(buf + n, len - n, " %d %s", s->audio_pid[i], j ? lang : "-");
+	}
+	n += snprintf(buf + n, len - n, " %d", s->ca_num);
+	for (i = 0; i < s->ca_num; i++)
+		n += snprintf(buf + n, len - n, " %d", s->ca_id[i]);
+
+	state_string(provider, sizeof(provider), s->provider_name);
+	state_string(name, sizeof(name), s->service_name);
+	snprintf(buf + n, len - n, "\t%s\t%s\n", provider, name);
+}
+
+static long state_number (char **p)
+{
+	return strtol(*p, p, 0);
+}
+
+static struct transponder *load_state_transponder (char *line)
+{
+	struct transponder *t;
+	uint32_t param[STATE_PARAM_WORDS];
+	char *p = line + 1;
+	unsigned int i;
+
+	t = alloc_transponder(0);
+	t->type = state_number(&p);
+	t->param.frequency = state_number(&p);
+	t->param.inversion = state_number(&p);
+	for (i = 0; i < STATE_PARAM_WORDS; i++)
+		param[i] = state_number(&p);
+	memcpy(&t->param.u, param, sizeof(t->param.u));
+	t->polarisation = state_number(&p);
+	t->orbital_pos = state_number(&p);
+	t->we_flag = state_number(&p);
+	t->network_id = state_number(&p);
+	t->original_network_id = state_number(&p);
+	t->transport_stream_id = state_number(&p);
+	t->pat_version = state_number(&p);
+	t->sdt_version = state_number(&p);
+	t->nit_version = state_number(&p);
+	t->from_state = 1;
+
+	return t;
+}
+
+static int load_state_service (struct transponder *t, char *line)
+{
+	struct service *s;
+	char *p = line + 1;
+	char *provider, *name, *lang;
+	int i;
+
+	if ((provider = strchr(line, '\t')) == NULL)
+		return -1;
+	*provider++ = 0;
+	if ((name = strchr(provider, '\t')) == NULL)
+		return -1;
+	*name++ = 0;
+	name[strcspn(name, "\n")] = 0;
+
+	s = alloc_service(t, 0);
+	s->transport_stream_id = state_number(&p);
+	s->service_id = state_number(&p);
+	s->pmt_pid = state_number(&p);
+	s->pcr_pid = state_number(&p);
+	s->video_pid = state_number(&p);
+	s->teletext_pid = state_number(&p);
+	s->subtitling_pid = state_number(&p);
+	s->ac3_pid = state_number(&p);
+	s->type = state_number(&p);
+	s->scrambled = state_number(&p);
+	s->running = state_number(&p);
+	s->channel_num = state_number(&p);
+	s->audio_num = state_number(&p);
+	if (s->audio_num < 0 || s->audio_num > AUDIO_CHAN_MAX)
+		return -1;
+	for (i = 0; i < s->audio_num; i++) {
+		s->audio_pid[i] = state_number(&p);
+		lang = strtok(p, " ");
+		if (lang == NULL)
+			return -1;
+		p = lang + strlen(lang) + 1;
+		if (strcmp(lang, "-"))
+			strncpy(s->audio_lang[i], lang, 3);
+	}
+	s->ca_num = state_number(&p);
+	if (s->ca_num < 0 || s->ca_num > CA_SYSTEM_ID_MAX)
+		return -1;
+	for (i = 0; i < s->ca_num; i++)
+		s->ca_id[i] = state_number(&p);
+	if (*provider)
+		s->provider_name = strdup(provider);
+	s->service_name = strdup(name);
+
+	return 0;
+}
+
+/* returns the number of transponders loaded, 0 if there is no state file yet,
+ * or -1 on error
+ */
+static int load_state (const char *path)
+{
+	char line[STATE_LINE_MAX];
+	struct transponder *t = NULL;
+	int n = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		if (errno == ENOENT)
+			return 0;
+		error("failed to open '%s': %d %m\n", path, errno);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == 'T') {
+			t = load_state_transponder(line);
+			n++;
+		} else if (line[0] == 'S' && t) {
+			if (load_state_service(t, line))
+				warning("bad service in '%s': %s", path, line);
+		}
+	}
+	fclose(f);
+
+	return n;
+}
+
+static void save_state (const char *path)
+{
+	char line[STATE_LINE_MAX];
+	char tmp[PATH_MAX + 4];
+	struct list_head *p1, *p2;
+	struct transponder *t;
+	struct service *s;
+	uint32_t param[STATE_PARAM_WORDS];
+	unsigned int i;
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.new", path);
+	if ((f = fopen(tmp, "w")) == NULL) {
+		error("failed to write '%s': %d %m\n", tmp, errno);
+		return;
+	}
+
+	fprintf(f, "# scan state, for rescanning with -I\n");
+	list_for_each(p1, &scanned_transponders) {
+		t = list_entry(p1, struct transponder, list);
+		if (t->wrong_frequency)
+			continue;
+
+		memcpy(param, &t->param.u, sizeof(t->param.u));
+		fprintf(f, "T %d %u %d", t->type, t->param.frequency, t->param.inversion);
+		for (i = 0; i < STATE_PARAM_WORDS; i++)
+			fprintf(f, " %u", param[i]);
+		fprintf(f, " %d %d %d %d %d %d %d %d %d\n",
+			t->polarisation, t->orbital_pos, t->we_flag,
+			t->network_id, t->original_network_id,
+			t->transport_stream_id,
+			t->pat_version, t->sdt_version, t->nit_version);
+
+		list_for_each(p2, &t->services) {
+			s = list_entry(p2, struct service, list);
+			state_service(line, sizeof(line), s);
+			fputs(line, f);
+		}
+	}
+	if (fclose(f) || rename(tmp, path)) {
+		error("failed to write '%s': %d %m\n", path, errno);
+		unlink(tmp);
+	}
+}
+
+static struct service *find_old_service (struct transponder *t, int service_id)
+{
+	struct list_head *pos;
+	struct service *s;
+
+	list_for_each(pos, &t->old_services) {
+		s = list_entry(pos, struct service, list);
+		if (s->service_id == service_id)
+			return s;
+	}
+	return NULL;
+}
+
+static void dump_diff_service (struct transponder *t, struct service *s, const char *change)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f;
+
+	if (!service_selected(s))
+		return;
+
+	/* the vdr format skips some services: only mark lines printed */
+	if ((f = open_memstream(&buf, &len)) == NULL)
+		return;
+	dump_service(f, t, s);
+	fclose(f);
+	if (len)
+		printf("%s%s", change, buf);
+	free(buf);
+}
+
+/* for -I: print the services which have been added, removed or changed since
+ * the state was saved, as "+ " and "- " lines in the output format
+ */
+static void dump_diff (void)
+{
+	char old_line[STATE_LINE_MAX], new_line[STATE_LINE_MAX];
+	struct list_head *p1, *p2;
+	struct transponder *t;
+	struct service *s, *old;
+	int unchanged = 0, changed = 0, added = 0, unchecked = 0;
+	int n_add = 0, n_del = 0, n_mod = 0;
+	int anon_services = 0;
+
+	name_services();
+	list_for_each(p1, &scanned_transponders) {
+		t = list_entry(p1, struct transponder, list);
+		if (t->wrong_frequency)
+			continue;
+
+		if (t->from_state && !t->checked) {
+			warning("transponder %d was not checked, keeping its services\n",
+				t->param.frequency);
+			unchecked++;
+			continue;
+		}
+		if (t->from_state && !t->changed) {
+			unchanged++;
+			continue;
+		}
+		if (t->from_state)
+			changed++;
+		else
+			added++;
+
+		list_for_each(p2, &t->old_services) {
+			old = list_entry(p2, struct service, list);
+			name_service(old, &anon_services);
+			s = find_service(t, old->service_id);
+			if (s == NULL) {
+				dump_diff_service(t, old, "- ");
+				n_del++;
+				continue;
 			}
-			/* ':' is field separator in szap and vdr service lists */
-			for (i = 0; s->service_name[i]; i++) {
-				if (s->service_name[i] == ':')
-					s->service_name[i] = ' ';
+			state_service(old_line, sizeof(old_line), old);
+			state_service(new_line, sizeof(new_line), s);
+			if (strcmp(old_line, new_line)) {
+				dump_diff_service(t, old, "- ");
+				dump_diff_service(t, s, "+ ");
+				n_mod++;
 			}
-			for (i = 0; s->provider_name && s->provider_name[i]; i++) {
-				if (s->provider_name[i] == ':')
-					s->provider_name[i] = ' ';
+		}
+		list_for_each(p2, &t->services) {
+			s = list_entry(p2, struct service, list);
+			if (!find_old_service(t, s->service_id)) {
+				dump_diff_service(t, s, "+ ");
+				n_add++;
 			}
-			if (s->video_pid && !(serv_select & 1))
-				continue; /* no TV services */
-			if (!s->video_pid && s->audio_num && !(serv_select & 2))
-				continue; /* no radio services */
-			if (!s->video_pid && !s->audio_num && !(serv_select & 4))
-				continue; /* no data/other services */
-			if (s->scrambled && !ca_select)
-				continue; /* FTA only */
-			switch (output_format)
-			{
-			  case OUTPUT_PIDS:
-				pids_dump_service_parameter_set (stdout, s);
-				break;
-			  case OUTPUT_VDR:
-				vdr_dump_service_parameter_set (stdout,
-						    s->service_name,
-						    s->provider_name,
-						    t->type,
-						    &t->param,
-						    sat_polarisation(t),
-						    s->video_pid,
-						    s->pcr_pid,
-						    s->audio_pid,
-						    s->audio_lang,
-						    s->audio_num,
-						    s->teletext_pid,
-						    s->scrambled,
-						    //FIXME: s->subtitling_pid
-						    s->ac3_pid,
-						    s->service_id,
-						    t->original_network_id,
-						    s->transport_stream_id,
-						    t->orbital_pos,
-						    t->we_flag,
-						    vdr_dump_provider,
-						    ca_select,
-						    vdr_version,
-						    vdr_dump_channum,
-						    s->channel_num);
-				break;
-			  case OUTPUT_ZAP:
-				zap_dump_service_parameter_set (stdout,
-						    s->service_name,
-						    t->type,
-						    &t->param,
-						    sat_polarisation(t),
-						    sat_number(t),
-						    s->video_pid,
-						    s->audio_pid,
-						    s->service_id);
-			  default:
-				break;
-			  }
 		}
 	}
-	info("Done.\n");
+
+	info("transponders: %d unchanged, %d changed, %d new, %d not checked\n",
+	     unchanged, changed, added, unchecked);
+	info("services: %d added, %d removed, %d changed\n", n_add, n_del, n_mod);
 }
 
 static void show_existing_tuning_data_files(void)
@@ -2522,9 +3575,12 @@ static const char *usage = "\n"
 	"	atsc/dvbscan doesn't do frequency scans, hence it needs initial\n"
 	"	tuning data for at least one transponder/channel.\n"
 	"	-c	scan on currently tuned transponder only\n"
+	"	-R file	scan a recorded transport stream file instead of a frontend\n"
+	"		(implies -c; the file is read repeatedly, ATSC if -A is given)\n"
 	"	-v 	verbose (repeat for more)\n"
 	"	-q 	quiet (repeat for less)\n"
 	"	-a N	use DVB /dev/dvb/adapterN/\n"
+	"	-a N,N...	scan with several identical adapters in parallel\n"
 	"	-f N	use DVB /dev/dvb/adapter?/frontendN\n"
 	"	-d N	use DVB /dev/dvb/adapter?/demuxN\n"
 	"	-s N	use DiSEqC switch position N (DVB-S only)\n"
@@ -2532,6 +3588,14 @@ static const char *usage = "\n"
 	"	-n	evaluate NIT-other for full network scan (slow!)\n"
 	"	-5	multiply all filter timeouts by factor 5\n"
 	"		for non-DVB-compliant section repitition rates\n"
+	"	-F N	run at most N section filters at once\n"
+	"		(default: as many as the demux allows)\n"
+	"	-T dir	keep the section timings learned for each network in dir,\n"
+	"		to time filters out sooner when it is rescanned\n"
+	"	-I file	incremental rescan: check the transponders saved in file,\n"
+	"		rescan those whose PAT, SDT or NIT version changed, and\n"
+	"		print the changes as +/- lines; the initial tuning file\n"
+	"		is only needed the first time\n"
 	"	-o fmt	output format: 'zap' (default), 'vdr' or 'pids' (default with -c)\n"
 	"	-x N	Conditional Access, (default -1)\n"
 	"		N=0 gets only FTA channels\n"
@@ -2588,10 +3652,15 @@ int main (int argc, char **argv)
 {
 	char frontend_devname [80];
 	int adapter = 0, frontend = 0, demux = 0;
-	int opt, i;
-	int frontend_fd;
+	int adapters[MAX_ADAPTERS];
+	int n_adapters = 1;
+	char *endp;
+	int opt;
+	int frontend_fd = -1;
 	int fe_open_mode;
 	const char *initial = NULL;
+	const char *infile = NULL;
+	int atsc_set = 0;
 	char *charset;
 
 	if (argc <= 1) {
@@ -2621,16 +3690,40 @@ int main (int argc, char **argv)
 
 	/* start with default lnb type */
 	lnb_type = *lnb_enum(0);
-	while ((opt = getopt(argc, argv, "5cnpa:f:d:s:o:x:e:t:i:l:vquPA:UC:D:")) != -1) {
+	while ((opt = getopt(argc, argv, "5cnpa:f:d:s:o:x:e:t:i:l:vquPA:UC:D:R:F:T:I:")) != -1) {
 		switch (opt) {
 		case 'a':
-			adapter = strtoul(optarg, NULL, 0);
+			n_adapters = 0;
+			endp = optarg;
+			do {
+				if (n_adapters == MAX_ADAPTERS) {
+					bad_usage(argv[0], 0);
+					return -1;
+				}
+				adapters[n_adapters++] = strtoul(endp, &endp, 0);
+			} while (*endp++ == ',');
+			adapter = adapters[0];
 			break;
 		case 'c':
 			current_tp_only = 1;
 			if (!output_format_set)
 				output_format = OUTPUT_PIDS;
 			break;
+		case 'R':
+			infile = optarg;
+			current_tp_only = 1;
+			if (!output_format_set)
+				output_format = OUTPUT_PIDS;
+			break;
+		case 'F':
+			max_filters = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			profile_dir = optarg;
+			break;
+		case 'I':
+			state_file = optarg;
+			break;
 		case 'n':
 			get_other_nits = 1;
 			break;
@@ -2692,6 +3785,7 @@ int main (int argc, char **argv)
 			break;
 		case 'A':
 			ATSC_type = strtoul(optarg,NULL,0);
+			atsc_set = 1;
 			if (ATSC_type == 0 || ATSC_type > 3) {
 				bad_usage(argv[0], 1);
 				return -1;
@@ -2715,8 +3809,11 @@ int main (int argc, char **argv)
 
 	if (optind < argc)
 		initial = argv[optind];
-	if ((!initial && !current_tp_only) || (initial && current_tp_only) ||
-			(spectral_inversion > 2)) {
+	if ((!initial && !current_tp_only && !state_file) ||
+			(initial && current_tp_only) ||
+			(spectral_inversion > 2) ||
+			((n_adapters > 1) && current_tp_only) ||
+			(state_file && current_tp_only)) {
 		bad_usage(argv[0], 0);
 		return -1;
 	}
@@ -2733,26 +3830,53 @@ int main (int argc, char **argv)
 	snprintf (frontend_devname, sizeof(frontend_devname),
 		  "/dev/dvb/adapter%i/frontend%i", adapter, frontend);
 
-	snprintf (demux_devname, sizeof(demux_devname),
-		  "/dev/dvb/adapter%i/demux%i", adapter, demux);
-	info("using '%s' and '%s'\n", frontend_devname, demux_devname);
+	init_filters (adapter, demux);
 
-	for (i = 0; i < MAX_RUNNING; i++)
-		poll_fds[i].fd = -1;
-
-	fe_open_mode = current_tp_only ? O_RDONLY : O_RDWR;
-	if ((frontend_fd = open (frontend_devname, fe_open_mode)) < 0)
-		fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
-	/* determine FE type and caps */
-	if (ioctl(frontend_fd, FE_GET_INFO, &fe_info) == -1)
-		fatal("FE_GET_INFO failed: %d %m\n", errno);
+	if (infile) {
+		/* sections repeat in the file, so read it in a loop */
+		info("using '%s'\n", infile);
+		if (dvbdemux_set_file_input(infile, DVBDEMUX_FILE_LOOP))
+			fatal("failed to open '%s': %d %m\n", infile, errno);
+		fe_info.type = atsc_set ? FE_ATSC : FE_OFDM;
+	} else {
+		info("using '%s' and '%s'\n", frontend_devname, demux_devname);
+		fe_open_mode = current_tp_only ? O_RDONLY : O_RDWR;
+		if ((frontend_fd = open (frontend_devname, fe_open_mode)) < 0)
+			fatal("failed to open '%s': %d %m\n", frontend_devname, errno);
+		/* determine FE type and caps */
+		if (ioctl(frontend_fd, FE_GET_INFO, &fe_info) == -1)
+			fatal("FE_GET_INFO failed: %d %m\n", errno);
+	}
 
-	if ((spectral_inversion == INVERSION_AUTO ) &&
+	if (!infile && (spectral_inversion == INVERSION_AUTO ) &&
 	    !(fe_info.caps & FE_CAN_INVERSION_AUTO)) {
 		info("Frontend can not do INVERSION_AUTO, trying INVERSION_OFF instead\n");
 		spectral_inversion = INVERSION_OFF;
 	}
 
+	/* the adapters are identical: each worker opens its own frontend */
+	if (n_adapters > 1) {
+		close (frontend_fd);
+		frontend_fd = -1;
+	}
+
+	if (state_file) {
+		switch (load_state (state_file)) {
+		case -1:
+			return -1;
+		case 0:
+			if (!initial) {
+				error("no state in '%s' yet: an initial tuning file is needed\n",
+				      state_file);
+				return -1;
+			}
+			break;
+		default:
+			info("rescanning the transponders in '%s'\n", state_file);
+			initial = NULL;
+		}
+	}
+
 	signal(SIGINT, handle_sigint);
 
 	if (current_tp_only) {
@@ -2763,12 +3887,21 @@ int main (int argc, char **argv)
 		current_tp->scan_done = 1;
 		scan_tp ();
 	}
+	else if (n_adapters > 1)
+		scan_network_parallel (adapters, n_adapters, frontend, demux, initial);
 	else
 		scan_network (frontend_fd, initial);
 
-	close (frontend_fd);
+	if (frontend_fd >= 0)
+		close (frontend_fd);
 
-	dump_lists ();
+	if (state_file) {
+		dump_diff ();
+		save_state (state_file);
+	} else {
+		dump_lists ();
+	}
+	save_profile ();
 
 	return 0;
 }
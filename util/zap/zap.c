@@ -30,6 +30,7 @@
 #include <libdvbapi/dvbdemux.h>
 #include <libdvbapi/dvbaudio.h>
 #include <libdvbsec/dvbsec_cfg.h>
+#include <libdvbcfg/dvbcfg_zapdb.h>
 #include <libucsi/mpeg/section.h>
 #include "zap_dvb.h"
 #include "zap_ca.h"
@@ -51,10 +52,14 @@ void usage(void)
 		" -frontend <id>	frontend to use (default 0)\n"
 		" -demux <id>		demux to use (default 0)\n"
 		" -caslotnum <id>	ca slot number to use (default 0)\n"
-		" -channels <filename>	channels.conf file.\n"
+		" -channels <filename>	channels.conf file, or a database compiled from one by zapdb.\n"
 		" -secfile <filename>	Optional sec.conf file.\n"
 		" -secid <secid>	ID of the SEC configuration to use, one of:\n"
 		" -nomoveca		Do not attempt to move CA descriptors from stream to programme level\n"
+		" -infile <filename>	Read a recorded transport stream instead of using the frontend\n"
+		"				(the channel may then be given as a service id)\n"
+		" -fast			Read the -infile as fast as possible instead of in real time\n"
+		" -loop			Restart the -infile at its end\n"
 		" <channel name>\n";
 	fprintf(stderr, "%s\n", _usage);
 
@@ -73,6 +78,43 @@ int find_channel(struct dvbcfg_zapchannel *channel, void *private_data)
 	return 0;
 }
 
+/*
+ * A compiled channel database (see zapdb) is searched through its index
+ * rather than parsed. Returns 1 if the channel was found, 0 if not, or -1 if
+ * chanfile is not a database.
+ */
+static int find_db_channel(char *chanfile, struct dvbcfg_zapchannel *channel)
+{
+	struct dvbcfg_zapdb *db;
+	const struct dvbcfg_zapchannel *found;
+
+	if ((db = dvbcfg_zapdb_open(chanfile)) == NULL)
+		return -1;
+
+	found = dvbcfg_zapdb_find_name(db, channel->name);
+	if (found)
+		memcpy(channel, found, sizeof(struct dvbcfg_zapchannel));
+	dvbcfg_zapdb_close(db);
+
+	return found ? 1 : 0;
+}
+
+/*
+ * With a recorded file, a channel may be given as a service id: no tuning
+ * parameters are needed.
+ */
+static int find_file_service(char *infile, struct dvbcfg_zapchannel *channel)
+{
+	int service_id;
+	char tmp;
+
+	if ((infile == NULL) || (sscanf(channel->name, "%i%c", &service_id, &tmp) != 1))
+		return 0;
+
+	channel->service_id = service_id;
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {
 	int adapter_id = 0;
@@ -84,6 +126,8 @@ int main(int argc, char *argv[])
 	char *secid = NULL;
 	char *channel_name = NULL;
 	int moveca = 1;
+	char *infile = NULL;
+	int infile_flags = DVBDEMUX_FILE_REALTIME;
 	int argpos = 1;
 	struct zap_dvb_params zap_dvb_params;
 	struct zap_ca_params zap_ca_params;
@@ -130,6 +174,17 @@ int main(int argc, char *argv[])
 				usage();
 			secid = argv[argpos+1];
 			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-infile")) {
+			if ((argc - argpos) < 2)
+				usage();
+			infile = argv[argpos+1];
+			argpos+=2;
+		} else if (!strcmp(argv[argpos], "-fast")) {
+			infile_flags &= ~DVBDEMUX_FILE_REALTIME;
+			argpos++;
+		} else if (!strcmp(argv[argpos], "-loop")) {
+			infile_flags |= DVBDEMUX_FILE_LOOP;
+			argpos++;
 		} else if (!strcmp(argv[argpos], "-nomoveca")) {
 			moveca = 0;
 			argpos++;
@@ -149,6 +204,14 @@ int main(int argc, char *argv[])
 	signal(SIGINT, signal_handler);
 	signal(SIGPIPE, SIG_IGN);
 
+	// replace the demux hardware with a recorded file if requested
+	if (infile != NULL) {
+		if (dvbdemux_set_file_input(infile, infile_flags)) {
+			fprintf(stderr, "Failed to open input file %s: %m\n", infile);
+			exit(1);
+		}
+	}
+
 	// start the CA stuff
 	zap_ca_params.adapter_id = adapter_id;
 	zap_ca_params.caslot_num = caslot_num;
@@ -160,17 +223,25 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "Channel name is too long %s\n", channel_name);
 		exit(1);
 	}
-	FILE *channel_file = fopen(chanfile, "r");
-	if (channel_file == NULL) {
-		fprintf(stderr, "Could open channel file %s\n", chanfile);
-		exit(1);
-	}
+	memset(&zap_dvb_params.channel, 0, sizeof(zap_dvb_params.channel));
 	memcpy(zap_dvb_params.channel.name, channel_name, strlen(channel_name) + 1);
-	if (dvbcfg_zapchannel_parse(channel_file, find_channel, &zap_dvb_params.channel) != 1) {
-		fprintf(stderr, "Unable to find requested channel %s\n", channel_name);
-		exit(1);
+	if (!find_file_service(infile, &zap_dvb_params.channel)) {
+		int found = find_db_channel(chanfile, &zap_dvb_params.channel);
+
+		if (found < 0) {
+			FILE *channel_file = fopen(chanfile, "r");
+			if (channel_file == NULL) {
+				fprintf(stderr, "Could open channel file %s\n", chanfile);
+				exit(1);
+			}
+			found = dvbcfg_zapchannel_parse(channel_file, find_channel, &zap_dvb_params.channel) == 1;
+			fclose(channel_file);
+		}
+		if (!found) {
+			fprintf(stderr, "Unable to find requested channel %s\n", channel_name);
+			exit(1);
+		}
 	}
-	fclose(channel_file);
 
 	// default SEC with a DVBS card
 	if ((secid == NULL) && (zap_dvb_params.channel.fe_type == DVBFE_TYPE_DVBS))
@@ -187,11 +258,14 @@ int main(int argc, char *argv[])
 		zap_dvb_params.valid_sec = 1;
 	}
 
-	// open the frontend
-	zap_dvb_params.fe = dvbfe_open(adapter_id, frontend_id, 0);
-	if (zap_dvb_params.fe == NULL) {
-		fprintf(stderr, "Failed to open frontend\n");
-		exit(1);
+	// open the frontend, unless reading from a file
+	zap_dvb_params.fe = NULL;
+	if (infile == NULL) {
+		zap_dvb_params.fe = dvbfe_open(adapter_id, frontend_id, 0);
+		if (zap_dvb_params.fe == NULL) {
+			fprintf(stderr, "Failed to open frontend\n");
+			exit(1);
+		}
 	}
 
 	// start the DVB stuff
@@ -95,6 +95,7 @@ void zap_ca_stop(void)
 
 	// shutdown the cam thread
 	camthread_shutdown = 1;
+	en50221_tl_wakeup(tl);
 	pthread_join(camthread, NULL);
 
 	// destroy session layer
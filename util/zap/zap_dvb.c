@@ -95,7 +95,10 @@ static void *dvbthread_func(void* arg)
 	// the DVB loop
 	while(!dvbthread_shutdown) {
 		// tune frontend + monitor lock status
-		if (tune_state == 0) {
+		if ((tune_state == 0) && (params->fe == NULL)) {
+			// reading from a file: nothing to tune
+			tune_state = 2;
+		} else if (tune_state == 0) {
 			// get the type of frontend
 			struct dvbfe_info result;
 			char *types;
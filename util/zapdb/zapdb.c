@@ -0,0 +1,62 @@
+/*
+	zapdb - compile a channels.conf file into an indexed channel database
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libdvbcfg/dvbcfg_zapdb.h>
+
+static void usage(void)
+{
+	static const char *_usage = "\n"
+		" zapdb: compile a channels.conf file into a channel database\n"
+		" which zap and gnutv can search without parsing the whole file.\n\n"
+		" usage: zapdb <channels.conf> <database>\n"
+		" The channels.conf may be - for standard input.\n"
+		" The database should be recompiled whenever the channels.conf changes.\n";
+	fprintf(stderr, "%s\n", _usage);
+
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	FILE *channel_file;
+	int count;
+
+	if (argc != 3)
+		usage();
+
+	if (strcmp(argv[1], "-") == 0) {
+		channel_file = stdin;
+	} else if ((channel_file = fopen(argv[1], "r")) == NULL) {
+		fprintf(stderr, "Could not open channel file %s\n", argv[1]);
+		exit(1);
+	}
+
+	count = dvbcfg_zapdb_compile(channel_file, argv[2]);
+	if (channel_file != stdin)
+		fclose(channel_file);
+	if (count < 0) {
+		fprintf(stderr, "Unable to write database %s: %s\n", argv[2], strerror(-count));
+		exit(1);
+	}
+
+	printf("%i channels\n", count);
+	exit(0);
+}